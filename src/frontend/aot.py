@@ -0,0 +1,1035 @@
+"""
+Ahead-of-time compilation of Beacon programs to C (beacon compile).
+
+A program becomes one C file that includes the runtime (main.c) and its
+compiled-code support (aot.h), embeds the program's AST and adds a C
+function for each top-level spec. The executable runs the program as the
+interpreter would, except that calls to those specs run the C functions:
+variables live in C locals, arithmetic and comparisons on numbers are
+inline, ranges are counted in C loops and compiled specs call each other
+directly. Top-level statements, and anything inside a spec the compiler
+does not translate, still run in the interpreter, which the C code hands
+the node (found by the "aot" mark added to its JSON) and the right scope.
+
+Beacon scoping is dynamic, so a variable a spec assigns may belong to a
+spec that called it. The compiler works out, per spec, which assignments
+and reads refer to the spec's own variables (its "bindings") and keeps only
+those in C locals; everything else is looked up in the scopes at run time.
+Bindings are written to their scopes ("spilled") before any code that
+could see them runs and read back afterwards (see aot.h). A spec whose
+bindings cannot be resolved statically, or that contains constructs only
+the interpreter knows (nested specs, blueprints, halt and proceed, ...),
+stays interpreted as a whole; compile_program reports which and why.
+"""
+
+import copy
+import json
+import os
+import re
+import subprocess
+import sys
+
+# Builtins and toolkits that neither run specs nor look at variables
+PURE_BUILTINS = ('length', 'time_now')
+PURE_TOOLKITS = ('math', 'text')
+NATIVE_TOOLKITS = ('collection', 'math', 'text', 'file', 'io', 'serial', 'json', 'csv', 'net', 'web', 'snapshot')
+
+# Node types the runtime's JSON loader knows; anything else loads as nothing
+RUNTIME_NODES = {
+    'ProgramNode', 'NumberNode', 'UnaryOpNode', 'BinaryOpNode', 'VarAccessNode', 'VarAssignNode',
+    'ConstantDeclNode', 'ExpressionStatementNode', 'ShowStatementNode', 'NickDeclNode',
+    'FunctionDeclNode', 'ReturnStatementNode', 'FunctionCallNode', 'SpawnNode', 'CheckStatementNode',
+    'ConstructorNode', 'AttemptTrapConcludeNode', 'AttributeAccessNode', 'DenNode', 'ConvertNode',
+    'ToolkitNode', 'PlugNode', 'BridgeNode', 'InletNode', 'LinkNode', 'TraverseNode', 'UntilNode',
+    'InterpolatedStringNode', 'StringNode', 'DocstringNode', 'EmbedNode', 'ParalNode', 'HoldNode',
+    'SignalNode', 'ListenNode', 'AskNode', 'BlueprintNode', 'KindNode', 'TypeNode', 'BooleanNode',
+    'NilNode', 'NickNode', 'EachNode', 'MethodCallNode', 'ModuleNode', 'BringNode', 'ContractNode',
+    'TriggerNode', 'PackNode',
+}
+
+# Node types that keep a spec in the interpreter: they declare things,
+# change control flow across statements or run code out of order
+INTERPRETED_NODES = {
+    'FunctionDeclNode', 'BlueprintNode', 'ToolkitNode', 'BridgeNode', 'ModuleNode', 'BringNode',
+    'PlugNode', 'ContractNode', 'InletNode', 'LinkNode', 'NickNode', 'NickDeclNode', 'TraverseNode',
+    'SignalNode', 'HoldNode', 'HaltNode', 'ProceedNode',
+}
+
+# Nodes that bring in names from elsewhere, so no name is known to be unshadowed
+OPEN_NODES = {'BringNode', 'PlugNode', 'ModuleNode', 'InletNode', 'LinkNode', 'BridgeNode'}
+
+OPERATORS = {
+    '+': 'aot_add', '-': 'aot_sub', '*': 'aot_mul', '/': 'aot_div',
+    '<': 'aot_less', '>': 'aot_greater', '<=': 'aot_less_equal', '>=': 'aot_greater_equal',
+    '==': 'aot_equal', "'=": 'aot_not_equal',
+}
+
+INT_EXACT_LIMIT = 2 ** 53
+
+# Obs() of a spec that may run arbitrary code
+ALL = None
+
+
+class Reject(Exception):
+    """The spec stays interpreted"""
+
+
+def walk(node):
+    """Every AST node in node's subtree, node included"""
+    if isinstance(node, dict):
+        if 'type' in node:
+            yield node
+        for key, value in node.items():
+            if key != 'op':
+                yield from walk(value)
+    elif isinstance(node, list):
+        for item in node:
+            yield from walk(item)
+
+
+def c_string(text):
+    """text as a C string literal"""
+    out = ['"']
+    for byte in text.encode('utf-8'):
+        ch = chr(byte)
+        if ch in '"\\?':
+            out.append('\\' + ch)
+        elif 32 <= byte < 127:
+            out.append(ch)
+        else:
+            out.append('\\%03o' % byte)
+    out.append('"')
+    return ''.join(out)
+
+
+def bound_names(node):
+    """Names node's subtree declares or assigns"""
+    names = set()
+    for n in walk(node):
+        kind = n['type']
+        if kind == 'VarAssignNode' and n['target'] and n['target']['type'] == 'VarAccessNode':
+            names.add(n['target']['var_name'])
+        elif kind in ('EachNode', 'TraverseNode'):
+            names.add(n['var_name'])
+        elif kind == 'ConstantDeclNode':
+            names.add(n['const_name'])
+        elif kind == 'NickNode':
+            names.add(n.get('alias'))
+        elif kind == 'AttemptTrapConcludeNode' and n.get('peek'):
+            names.add('peek')
+        if isinstance(n.get('params'), list):
+            names.update(p for p in n['params'] if isinstance(p, str))
+        if kind in ('FunctionDeclNode', 'BlueprintNode', 'ToolkitNode', 'BridgeNode', 'ModuleNode', 'ContractNode'):
+            names.add(n['name'])
+    return names
+
+
+def referenced_names(node):
+    """Names node's subtree reads, calls or assigns"""
+    names = bound_names(node)
+    for n in walk(node):
+        if n['type'] == 'VarAccessNode':
+            names.add(n['var_name'])
+        elif n['type'] == 'FunctionCallNode':
+            names.add(n['function_name'])
+    return names
+
+
+class Program:
+    """What holds for the whole program: which names can only ever mean one thing"""
+
+    def __init__(self, ast):
+        self.specs = [s for s in ast['statements'] if s['type'] == 'FunctionDeclNode']
+        self.next_mark = 0
+        if any(n['type'] in OPEN_NODES for n in walk(ast)):
+            self.static_specs = {}
+            self.clean = set()
+            return
+        declared = {}
+        for spec in self.specs:
+            declared[spec['name']] = declared.get(spec['name'], 0) + 1
+        # Names bound anywhere other than by their own top-level declaration
+        bound = set()
+        for statement in ast['statements']:
+            if statement['type'] == 'FunctionDeclNode':
+                bound |= bound_names(statement['body'])
+                bound.update(statement['params'])
+            else:
+                bound |= bound_names(statement)
+        self.static_specs = {name: None for name, count in declared.items() if count == 1 and name not in bound}
+        self.clean = (set(PURE_BUILTINS) | set(PURE_TOOLKITS)) - bound - set(declared)
+
+    def mark(self, node):
+        if 'aot' not in node:
+            node['aot'] = self.next_mark
+            self.next_mark += 1
+        return node['aot']
+
+
+class Block:
+    """A spec body (level 0) or a traverse body, one scope level deeper"""
+
+    def __init__(self, parent):
+        self.parent = parent
+        self.level = parent.level + 1 if parent else 0
+        self.bindings = []
+
+    def chain(self):
+        block = self
+        while block:
+            yield block
+            block = block.parent
+
+
+class Binding:
+    """A variable the compiled spec keeps in a C local (v<k>, dirty flag d<k>).
+    One it assigns may live in a calling scope, found on entry (h<k>)."""
+
+    def __init__(self, k, name, block, const=False, param=False):
+        self.k = k
+        self.name = name
+        self.block = block
+        self.const = const
+        self.param = param
+
+    @property
+    def homed(self):
+        return not self.param and not self.const
+
+    def scope(self):
+        """Where the variable lives once spilled"""
+        if self.homed:
+            return 'h%d ? h%d : aot_scope(sc, %d, caller)' % (self.k, self.k, self.block.level)
+        return 'aot_scope(sc, %d, caller)' % self.block.level
+
+    def existing_scope(self):
+        if self.homed:
+            return 'h%d ? h%d : sc[%d]' % (self.k, self.k, self.block.level)
+        return 'sc[%d]' % self.block.level
+
+
+class Deferred:
+    """Spill code for a direct call, known once every callee's Obs() is"""
+
+    def __init__(self, render):
+        self.render = render
+
+
+def prune_flags(lines, bindings):
+    """Drops the dirty flags nothing reads, those of bindings never spilled
+    or written back, and the bindings nothing uses, so the generated C
+    compiles without warnings"""
+    text = '\n'.join(lines)
+    for b in bindings:
+        if len(re.findall(r'\bv%d\b' % b.k, text)) == 1:
+            text = re.sub(r'\n *Value v%d = [^\n]*' % b.k, '', text)
+            continue
+        if re.search(r'\bif \(d%d\b' % b.k, text):
+            continue
+        text = re.sub(r' bool d%d = (true|false);' % b.k, '', text)
+        text = re.sub(r' d%d = (true|false);' % b.k, '', text)
+    return text.split('\n')
+
+
+def join(a, b):
+    """Where two paths meet, a binding is defined only if both defined it"""
+    out = {}
+    for k in set(a) | set(b):
+        out[k] = 'def' if a.get(k) == 'def' and b.get(k) == 'def' else 'maybe'
+    return out
+
+
+class SpecCompiler:
+    def __init__(self, program, decl, index, compiled):
+        self.program = program
+        self.decl = decl
+        self.index = index
+        self.compiled = compiled   # static spec name -> index, for specs compiled so far
+        self.bindings = {}
+        self.temps = 0
+        self.lines = []
+        self.depth = 1
+        self.max_level = 0
+        self.uses_done = False
+        self.opaque = False        # runs code that may see any variable
+        self.callees = set()
+        self.refs = referenced_names(decl['body']) - set(decl['params'])
+        self.compiled_names = set(decl['params'])
+        self.firms = []
+
+    # --- output ------------------------------------------------------------------
+
+    def out(self, text):
+        self.lines.append('    ' * self.depth + text)
+
+    def temp(self, prefix='t'):
+        self.temps += 1
+        return '%s%d' % (prefix, self.temps)
+
+    def cur(self, block):
+        return 'aot_cur(sc, %d, caller)' % block.level
+
+    # --- bindings ------------------------------------------------------------------
+
+    def binding(self, name, block, const=False, param=False):
+        key = (name, id(block))
+        if key not in self.bindings:
+            b = Binding(len(self.bindings), name, block, const, param)
+            self.bindings[key] = b
+            block.bindings.append(b)
+        return self.bindings[key]
+
+    def candidates(self, name, block, env):
+        return [b for blk in block.chain() for b in blk.bindings if b.name == name and b.k in env]
+
+    def visible(self, block, env):
+        return [b for blk in block.chain() for b in blk.bindings if b.k in env]
+
+    def resolve_read(self, name, block, env):
+        found = self.candidates(name, block, env)
+        if not found:
+            return None, None
+        if env[found[0].k] == 'def':
+            return found[0], 'def'
+        if len(found) > 1:
+            raise Reject("'%s' may be one of several variables" % name)
+        return found[0], 'maybe'
+
+    def resolve_assign(self, name, block, env):
+        found = self.candidates(name, block, env)
+        if found:
+            b = found[0]
+            if b.const:
+                raise Reject("assigns the firm '%s'" % name)
+            if env[b.k] == 'def':
+                return b
+            if b.block is not block or len(found) > 1:
+                raise Reject("'%s' may be assigned in one of several scopes" % name)
+            return b
+        return self.binding(name, block)
+
+    def spill(self, bindings):
+        for b in bindings:
+            self.out('if (d%d) { aot_spill(%s, %s, &v%d, %s); d%d = false; }'
+                     % (b.k, b.scope(), c_string(b.name), b.k, 'true' if b.const else 'false', b.k))
+
+    def reload(self, bindings):
+        for b in bindings:
+            self.out('aot_reload(%s, %s, &v%d);' % (b.existing_scope(), c_string(b.name), b.k))
+
+    def write_back(self, bindings, lines=None):
+        """Assignments to variables of a calling scope, made before they go"""
+        for b in bindings:
+            if b.homed:
+                line = 'if (d%d && h%d) aot_spill(h%d, %s, &v%d, false);' % (b.k, b.k, b.k, c_string(b.name), b.k)
+                if lines is None:
+                    self.out(line)
+                else:
+                    lines.append('    ' + line)
+
+    # --- the spec ------------------------------------------------------------------
+
+    def compile(self):
+        for n in walk(self.decl['body']):
+            if n['type'] in INTERPRETED_NODES or n['type'] not in RUNTIME_NODES:
+                raise Reject('contains %s' % n['type'])
+        self.prescan(self.decl['body'], True)
+        self.check_firms()
+        root = Block(None)
+        env = {}
+        for name in self.decl['params']:
+            env[self.binding(name, root, param=True).k] = 'def'
+        self.statements(self.decl['body'], root, env, top=True)
+        self.render_root = self.render(root)
+
+    def prescan(self, statements, top):
+        """Names compiled code binds (fallback code must not introduce them).
+        Only a firm that is a direct statement of its block is compiled; one
+        inside a when or until runs in the interpreter."""
+        for s in statements:
+            kind = s['type']
+            if kind == 'VarAssignNode' and s['target'] and s['target']['type'] == 'VarAccessNode':
+                self.compiled_names.add(s['target']['var_name'])
+            elif kind == 'ConstantDeclNode' and top:
+                self.compiled_names.add(s['const_name'])
+                self.firms.append(s['const_name'])
+            elif kind == 'EachNode':
+                self.compiled_names.add(s['var_name'])
+                self.prescan(s['body'], True)
+            elif kind == 'UntilNode':
+                self.prescan(s['body'], False)
+            elif kind == 'CheckStatementNode':
+                self.prescan(s['body'], False)
+                for clause in s['alter_clauses']:
+                    self.prescan(clause['body'], False)
+                self.prescan(s['altern_clause'] or [], False)
+
+    def check_firms(self):
+        """A compiled firm must be the only way its name is bound in the spec"""
+        others = set(self.decl['params'])
+        firms = 0
+        for n in walk(self.decl['body']):
+            if n['type'] == 'VarAssignNode' and n['target'] and n['target']['type'] == 'VarAccessNode':
+                others.add(n['target']['var_name'])
+            elif n['type'] == 'EachNode':
+                others.add(n['var_name'])
+            elif n['type'] == 'ConstantDeclNode' and n['const_name'] in self.firms:
+                firms += 1
+        if firms > len(self.firms):
+            raise Reject("a firm is declared twice")
+        for name in self.firms:
+            if self.firms.count(name) > 1 or name in others:
+                raise Reject("firm '%s' is also assigned" % name)
+
+    def render(self, root):
+        bindings = sorted(self.bindings.values(), key=lambda b: b.k)
+        name = self.decl['name']
+        head = ['static bool aot_spec_%d(Value* args, Scope* caller, Value* out) {' % self.index,
+                '    // spec %s' % name]
+        for b in bindings:
+            if b.homed:
+                head.append('    Scope* h%d;' % b.k)
+                head.append('    if (!aot_home(caller, %s, &h%d)) return false;' % (c_string(b.name), b.k))
+        head.append('    Scope* sc[%d] = {NULL};' % (self.max_level + 1))
+        for b in bindings:
+            init = 'args[%d]' % self.decl['params'].index(b.name) if b.param else 'aot_unset()'
+            head.append('    Value v%d = %s; bool d%d = %s;  // %s'
+                        % (b.k, init, b.k, 'true' if b.param else 'false', b.name))
+        head.append('    *out = aot_nil();')
+        tail = []
+        if self.uses_done:
+            tail.append('done:')
+        self.write_back(root.bindings, tail)
+        for b in root.bindings:
+            tail.append('    aot_drop(&v%d);' % b.k)
+        tail.append('    aot_leave(sc, 0);')
+        tail.append('    return true;')
+        tail.append('}')
+        return head, self.lines, tail
+
+    # --- statements ------------------------------------------------------------------
+
+    def statements(self, statements, block, env, top=False):
+        for s in statements:
+            env = self.statement(s, block, env, top)
+            if env is None:
+                return None
+        return env
+
+    def statement(self, node, block, env, top):
+        kind = node['type']
+        if kind == 'VarAssignNode' and node['target'] and node['target']['type'] == 'VarAccessNode' and node['value']:
+            self.out('{')
+            self.depth += 1
+            value = self.owned(self.expr(node['value'], block, env, True))
+            b = self.resolve_assign(node['target']['var_name'], block, env)
+            self.out('aot_assign(&v%d, %s); d%d = true;' % (b.k, value, b.k))
+            self.depth -= 1
+            self.out('}')
+            env = dict(env)
+            env[b.k] = 'def'
+            return env
+        if kind == 'ConstantDeclNode' and top:
+            self.out('{')
+            self.depth += 1
+            value = self.owned(self.expr(node['value'], block, env, True))
+            b = self.binding(node['const_name'], block, const=True)
+            self.out('aot_assign(&v%d, %s); d%d = true;' % (b.k, value, b.k))
+            self.depth -= 1
+            self.out('}')
+            env = dict(env)
+            env[b.k] = 'def'
+            return env
+        if kind == 'ExpressionStatementNode':
+            self.out('{')
+            self.depth += 1
+            self.drop(self.expr(node['expression'], block, env, True))
+            self.depth -= 1
+            self.out('}')
+            return env
+        if kind == 'ReturnStatementNode':
+            self.out('{')
+            self.depth += 1
+            if node['expression'] is None:
+                value = 'aot_nil()'
+            else:
+                value = self.owned(self.expr(node['expression'], block, env, True))
+            if top and block.level == 0:
+                self.out('*out = %s;' % value)
+                self.out('goto done;')
+                self.uses_done = True
+                self.depth -= 1
+                self.out('}')
+                return None
+            # Forwarding from inside a block only evaluates the value
+            discarded = self.temp('f')
+            self.out('Value %s = %s;' % (discarded, value))
+            self.out('aot_drop(&%s);' % discarded)
+            self.depth -= 1
+            self.out('}')
+            return env
+        if kind == 'ShowStatementNode':
+            self.out('{')
+            self.depth += 1
+            self.out('StrBuf line;')
+            self.out('strbuf_init(&line, 128);')
+            for e in node['expressions']:
+                value = self.expr(e, block, env, True)
+                self.out('aot_show_part(&line, &%s);' % value[0])
+                self.drop(value)
+            self.out('aot_show_end(&line);')
+            self.depth -= 1
+            self.out('}')
+            return env
+        if kind == 'CheckStatementNode':
+            return self.check(node, block, env)
+        if kind == 'UntilNode':
+            return self.until(node, block, env)
+        if kind == 'EachNode':
+            return self.each(node, block, env)
+        return self.fallback_statement(node, block, env)
+
+    def condition(self, node, block, env):
+        """Evaluates node into a new bool and returns its name"""
+        value = self.expr(node, block, env, True)
+        flag = self.temp('c')
+        self.out('bool %s = aot_truthy(&%s);' % (flag, value[0]))
+        self.drop(value)
+        return flag
+
+    def nested(self, statements, block, env):
+        self.depth += 1
+        env = self.statements(statements, block, env)
+        self.depth -= 1
+        return env
+
+    def check(self, node, block, env):
+        self.out('{')
+        self.depth += 1
+        flag = self.condition(node['condition'], block, env)
+        self.out('if (%s) {' % flag)
+        outs = [self.nested(node['body'], block, env)]
+        closes = 1
+        for clause in node['alter_clauses']:
+            self.out('} else {')
+            self.depth += 1
+            flag = self.condition(clause['condition'], block, env)
+            self.out('if (%s) {' % flag)
+            outs.append(self.nested(clause['body'], block, env))
+            closes += 1
+        if node['altern_clause']:
+            self.out('} else {')
+            outs.append(self.nested(node['altern_clause'], block, env))
+        else:
+            outs.append(env)
+        for i in range(closes):
+            self.out('}')
+            if i < closes - 1:
+                self.depth -= 1
+        self.depth -= 1
+        self.out('}')
+        result = outs[0]
+        for other in outs[1:]:
+            result = join(result, other)
+        return result
+
+    def fixpoint(self, env, body):
+        """The state at the head of a loop: entry joined with every way round"""
+        head = env
+        while True:
+            saved, self.lines = self.lines, []
+            temps = self.temps
+            after = body(head)
+            self.lines = saved
+            self.temps = temps
+            new = join(env, after)
+            if new == head:
+                return head
+            head = new
+
+    def until(self, node, block, env):
+        head = self.fixpoint(env, lambda state: self.statements(node['body'], block, state))
+        self.out('for (;;) {')
+        self.depth += 1
+        flag = self.condition(node['condition'], block, head)
+        self.out('if (%s) break;' % flag)
+        self.statements(node['body'], block, head)
+        self.depth -= 1
+        self.out('}')
+        return head
+
+    def each(self, node, block, env):
+        inner = Block(block)
+        self.max_level = max(self.max_level, inner.level)
+
+        def body(state):
+            state = dict(state)
+            b = self.resolve_assign(node['var_name'], inner, state)
+            state[b.k] = 'def'
+            self.out('aot_assign(&v%d, item); d%d = true;' % (b.k, b.k))
+            after = self.statements(node['body'], inner, state, top=True)
+            self.write_back(inner.bindings)
+            for local in inner.bindings:
+                self.out('aot_drop(&v%d); v%d = aot_unset(); d%d = false;' % (local.k, local.k, local.k))
+                after.pop(local.k, None)
+            self.out('aot_leave(sc, %d);' % inner.level)
+            return after
+
+        iterable = node['iterable']
+        ranged = iterable['type'] == 'BinaryOpNode' and iterable['op']['value'] == '..'
+        if not ranged:
+            self.opaque = True
+        self.out('{')
+        self.depth += 1
+        if ranged:
+            start = self.expr(iterable['left'], block, env, not self.may_reload(iterable['right']))
+            end = self.expr(iterable['right'], block, env, True)
+            self.out('AotRange range;')
+            self.out('aot_range_init(&range, &%s, &%s);' % (start[0], end[0]))
+            self.drop(start)
+            self.drop(end)
+        else:
+            source = self.owned(self.expr(iterable, block, env, True))
+            self.out('Value source = %s;' % source)
+        head = self.fixpoint(env, body)
+        if ranged:
+            self.out('Value item;')
+            self.out('while (aot_range_next(&range, &item)) {')
+            self.depth += 1
+            body(head)
+            self.depth -= 1
+            self.out('}')
+        else:
+            visible = self.visible(block, head)
+            self.out('IterObj* it = iter_from_value(&source);')
+            self.out('if (it) {')
+            self.depth += 1
+            self.out('bool runs_specs = aot_iter_runs_specs(it);')
+            self.out('for (;;) {')
+            self.depth += 1
+            self.out('if (runs_specs) {')
+            self.depth += 1
+            self.spill(visible)
+            self.depth -= 1
+            self.out('}')
+            self.out('Value* next;')
+            self.out('bool more = iter_next(it, %s, &next);' % self.cur(block))
+            self.out('if (runs_specs) {')
+            self.depth += 1
+            self.reload(visible)
+            self.depth -= 1
+            self.out('}')
+            self.out('if (!more) break;')
+            self.out('Value item = aot_take(next);')
+            body(head)
+            self.depth -= 1
+            self.out('}')
+            self.out('iter_release(it);')
+            self.depth -= 1
+            self.out('} else {')
+            self.out("    runtime_errorf(\"Type mismatch: 'traverse ... in' requires a range, list, dict, set, text, file or iterator.\\n\");")
+            self.out('}')
+            self.out('aot_drop(&source);')
+        self.depth -= 1
+        self.out('}')
+        return head
+
+    def fallback_statement(self, node, block, env):
+        for n in walk(node):
+            if n['type'] == 'ConstantDeclNode' and n['const_name'] in self.compiled_names:
+                raise Reject("'%s' is declared by code left to the interpreter" % n['const_name'])
+        for name in bound_names(node) & self.compiled_names:
+            found = self.candidates(name, block, env)
+            if not found or env[found[0].k] != 'def':
+                raise Reject("'%s' is assigned by code left to the interpreter" % name)
+        self.opaque = True
+        mark = self.program.mark(node)
+        visible = self.visible(block, env)
+        self.out('{  // %s' % node['type'])
+        self.depth += 1
+        self.spill(visible)
+        self.out('aot_exec(%d, aot_scope(sc, %d, caller));' % (mark, block.level))
+        self.reload(visible)
+        self.depth -= 1
+        self.out('}')
+        return env
+
+    # --- expressions -----------------------------------------------------------------
+    #
+    # expr() emits code that evaluates node and returns (name, owned): name
+    # is a Value variable holding the result, owned says the caller has to
+    # drop it. A binding is lent out as is (not owned) only when borrow is
+    # set, meaning nothing the caller evaluates before using it can reload it.
+
+    def owned(self, value):
+        return value[0] if value[1] else 'aot_dup(&%s)' % value[0]
+
+    def drop(self, value):
+        if value[1]:
+            self.out('aot_drop(&%s);' % value[0])
+
+    def define(self, init):
+        name = self.temp()
+        self.out('Value %s = %s;' % (name, init))
+        return name, True
+
+    def may_reload(self, node):
+        """Whether evaluating node can run code that changes bindings"""
+        for n in walk(node):
+            if n['type'] not in ('NumberNode', 'StringNode', 'BooleanNode', 'NilNode', 'VarAccessNode',
+                                 'BinaryOpNode', 'InterpolatedStringNode', 'PackNode'):
+                return True
+        return False
+
+    def expr(self, node, block, env, borrow):
+        kind = node['type']
+        if kind == 'NumberNode':
+            n = node['value']
+            if float(n).is_integer() and abs(n) <= INT_EXACT_LIMIT:
+                return self.define('aot_int(%dLL)' % int(n))
+            return self.define('aot_num(%r)' % float(n))
+        if kind == 'StringNode':
+            return self.define('aot_text(%s)' % c_string(node['value']))
+        if kind == 'BooleanNode':
+            return self.define('aot_bool(%s)' % ('true' if node['value'] else 'false'))
+        if kind == 'NilNode':
+            return self.define('aot_nil()')
+        if kind == 'VarAccessNode':
+            name = node['var_name']
+            b, state = self.resolve_read(name, block, env)
+            if b is None:
+                return self.define('aot_lookup(%s, %s)' % (self.cur(block), c_string(name)))
+            if state == 'maybe':
+                return self.define('aot_read(&v%d, %s, %s)' % (b.k, self.cur(block), c_string(name)))
+            if borrow:
+                return 'v%d' % b.k, False
+            return self.define('aot_dup(&v%d)' % b.k)
+        if kind == 'BinaryOpNode':
+            op = node['op']['value']
+            left = self.expr(node['left'], block, env, not self.may_reload(node['right']))
+            right = self.expr(node['right'], block, env, True)
+            if op in OPERATORS:
+                result = self.define('%s(&%s, &%s)' % (OPERATORS[op], left[0], right[0]))
+            else:
+                result = self.define('aot_binary(%s, &%s, &%s)' % (c_string(op), left[0], right[0]))
+            self.drop(left)
+            self.drop(right)
+            return result
+        if kind == 'InterpolatedStringNode':
+            text = self.temp('s')
+            self.out('StrBuf %s;' % text)
+            self.out('strbuf_init(&%s, 64);' % text)
+            for part in node['parts']:
+                if part['type'] == 'StringNode':
+                    literal = part['value']
+                    self.out('strbuf_append_n(&%s, %s, %d);' % (text, c_string(literal), len(literal.encode('utf-8'))))
+                else:
+                    value = self.expr(part, block, env, True)
+                    self.out('aot_template_part(&%s, &%s);' % (text, value[0]))
+                    self.drop(value)
+            return self.define('aot_text_of(&%s)' % text)
+        if kind == 'PackNode':
+            items = node['items']
+            list_name = self.temp('l')
+            self.out('ListObj* %s = list_new(%d, true);' % (list_name, len(items)))
+            for item in items:
+                value = self.owned(self.expr(item, block, env, True))
+                self.out('list_append(%s, aot_give(%s));' % (list_name, value))
+            return self.define('aot_list_of(%s)' % list_name)
+        if kind == 'FunctionCallNode':
+            return self.call(node, block, env)
+        if kind == 'MethodCallNode':
+            return self.method_call(node, block, env)
+        return self.fallback(node, block, env)
+
+    def arguments(self, nodes, block, env):
+        """Evaluates call arguments into a new Value array and returns its name"""
+        if not nodes:
+            return 'NULL'
+        array = self.temp('a')
+        self.out('Value %s[%d];' % (array, len(nodes)))
+        for i, arg in enumerate(nodes):
+            self.out('%s[%d] = %s;' % (array, i, self.owned(self.expr(arg, block, env, True))))
+        return array
+
+    def fallback(self, node, block, env):
+        """Hands the whole node to the interpreter"""
+        self.opaque = True
+        result = self.temp()
+        self.out('Value %s;' % result)
+        self.out('{')
+        self.depth += 1
+        self.fallback_body(self.program.mark(node), result, block, self.visible(block, env))
+        self.depth -= 1
+        self.out('}')
+        return result, True
+
+    def fallback_body(self, mark, result, block, visible):
+        self.spill(visible)
+        self.out('%s = aot_eval(%d, %s);' % (result, mark, self.cur(block)))
+        self.reload(visible)
+
+    def call(self, node, block, env):
+        name = node['function_name']
+        args = node['arguments']
+        index = self.compiled.get(name)
+        if index is not None and len(args) != len(self.program.specs_by_index[index]['params']):
+            index = None
+        if index is None and not (name in PURE_BUILTINS and name in self.program.clean):
+            return self.fallback(node, block, env)
+        result = self.temp()
+        visible = self.visible(block, env)
+        mark = self.program.mark(node)
+        self.out('Value %s;' % result)
+        self.out('{')
+        self.depth += 1
+        self.out('FunctionSymbol* spec = NULL;')
+        self.out('int found = aot_callee(%s, %s, &spec);' % (self.cur(block), c_string(name)))
+        if index is not None:
+            self.callees.add(index)
+            self.out('if (found == 1 && spec == aot_sym_%d) {' % index)
+            self.depth += 1
+            array = self.arguments(args, block, env)
+            obs = self.program.obs
+            self.lines.append(Deferred(lambda depth=self.depth: self.rendered(
+                depth, lambda: self.spill([b for b in visible if obs[index] is ALL or b.name in obs[index]]))))
+            self.out('if (!aot_spec_%d(%s, %s, &%s)) {' % (index, array, self.cur(block), result))
+            self.depth += 1
+            self.spill(visible)
+            self.out('%s = aot_call_spec(spec, %s, %d, %s);' % (result, array, len(args), self.cur(block)))
+            self.reload(visible)
+            self.depth -= 1
+            self.out('}')
+            mods = self.program.mods
+            self.lines.append(Deferred(lambda depth=self.depth: self.rendered(
+                depth, lambda: self.reload([b for b in visible if mods[index] is ALL or b.name in mods[index]]))))
+        else:
+            self.out('if (found == 0) {')
+            self.depth += 1
+            array = self.arguments(args, block, env)
+            self.out('%s = aot_call_native(aot_builtin(%s), NULL, %s, %d, %s);'
+                     % (result, c_string(name), array, len(args), self.cur(block)))
+        self.depth -= 1
+        self.out('} else {')
+        self.depth += 1
+        self.fallback_body(mark, result, block, visible)
+        self.depth -= 1
+        self.out('}')
+        self.depth -= 1
+        self.out('}')
+        return result, True
+
+    def rendered(self, depth, emit):
+        saved, saved_depth = self.lines, self.depth
+        self.lines, self.depth = [], depth
+        emit()
+        lines = self.lines
+        self.lines, self.depth = saved, saved_depth
+        return lines
+
+    def method_call(self, node, block, env):
+        target = node['object']
+        method = node['method_name']
+        if target['type'] != 'VarAccessNode':
+            return self.fallback(node, block, env)
+        name = target['var_name']
+        b, state = self.resolve_read(name, block, env)
+        visible = self.visible(block, env)
+        if b is None and name in NATIVE_TOOLKITS and name not in self.compiled_names:
+            pure = name in PURE_TOOLKITS and name in self.program.clean
+            if not pure:
+                self.opaque = True
+            result = self.temp()
+            mark = self.program.mark(node)
+            self.out('Value %s;' % result)
+            self.out('{')
+            self.depth += 1
+            self.out('NativeFn fn = aot_toolkit_member(%s, %s, %s);'
+                     % (self.cur(block), c_string(name), c_string(method)))
+            self.out('if (fn) {')
+            self.depth += 1
+            array = self.arguments(node['arguments'], block, env)
+            if not pure:
+                self.spill(visible)
+            self.out('%s = aot_call_native(fn, NULL, %s, %d, %s);'
+                     % (result, array, len(node['arguments']), self.cur(block)))
+            if not pure:
+                self.reload(visible)
+        elif b is not None and state == 'def':
+            self.opaque = True
+            result = self.temp()
+            mark = self.program.mark(node)
+            self.out('Value %s;' % result)
+            self.out('{')
+            self.depth += 1
+            self.out('bool pure = false;')
+            self.out('NativeFn fn = aot_method(&v%d, %s, &pure);' % (b.k, c_string(method)))
+            self.out('if (fn) {')
+            self.depth += 1
+            self.out('Value receiver = aot_dup(&v%d);' % b.k)
+            array = self.arguments(node['arguments'], block, env)
+            self.out('if (!pure) {')
+            self.depth += 1
+            self.spill(visible)
+            self.depth -= 1
+            self.out('}')
+            self.out('%s = aot_call_native(fn, &receiver, %s, %d, %s);'
+                     % (result, array, len(node['arguments']), self.cur(block)))
+            self.out('if (!pure) {')
+            self.depth += 1
+            self.reload(visible)
+            self.depth -= 1
+            self.out('}')
+        else:
+            return self.fallback(node, block, env)
+        self.depth -= 1
+        self.out('} else {')
+        self.depth += 1
+        self.fallback_body(mark, result, block, visible)
+        self.depth -= 1
+        self.out('}')
+        self.depth -= 1
+        self.out('}')
+        return result, True
+
+
+# --- programs ----------------------------------------------------------------------
+
+
+def observed(compilers):
+    """Obs(spec): the names a compiled spec can see in the scopes of its caller.
+    A caller calling it directly spills only those bindings. Everything the
+    spec or the compiled specs it calls refers to (parameters aside), or ALL
+    when it hands code to the interpreter or to natives that may run specs."""
+    obs = {i: ALL if c.opaque else set(c.refs) for i, c in compilers.items()}
+    changed = True
+    while changed:
+        changed = False
+        for i, c in compilers.items():
+            if obs[i] is ALL:
+                continue
+            for callee in c.callees:
+                if obs.get(callee, ALL) is ALL:
+                    obs[i] = ALL
+                    changed = True
+                    break
+                if not obs[callee] <= obs[i]:
+                    obs[i] |= obs[callee]
+                    changed = True
+    return obs
+
+
+def modified(compilers):
+    """Mod(spec): the names a compiled spec can assign in the scopes of its
+    caller, a subset of Obs(spec). A caller calling it directly reloads those
+    bindings afterwards."""
+    mods = {i: ALL if c.opaque else {b.name for b in c.bindings.values() if b.homed}
+            for i, c in compilers.items()}
+    changed = True
+    while changed:
+        changed = False
+        for i, c in compilers.items():
+            if mods[i] is ALL:
+                continue
+            for callee in c.callees:
+                if mods.get(callee, ALL) is ALL:
+                    mods[i] = ALL
+                    changed = True
+                    break
+                if not mods[callee] <= mods[i]:
+                    mods[i] |= mods[callee]
+                    changed = True
+    return mods
+
+
+def compile_specs(ast, only=None):
+    """Compiles the specs of ast (marking it); returns the Program, the
+    compilers of the specs that compiled and the reasons for the others"""
+    program = Program(ast)
+    program.specs_by_index = program.specs
+    program.obs = {}
+    program.mods = {}
+    compilers, skipped = {}, {}
+    static = {spec['name']: i for i, spec in enumerate(program.specs)
+              if spec['name'] in program.static_specs and (only is None or i in only)}
+    for i, spec in enumerate(program.specs):
+        compiler = SpecCompiler(program, spec, i, static)
+        try:
+            compiler.compile()
+            compilers[i] = compiler
+        except Reject as reason:
+            skipped[i] = str(reason)
+    return program, compilers, skipped
+
+
+def compile_program(ast, name):
+    """C source for the program (an AST as Parser().parse().to_dict() gives
+    it) and a list of (spec, reason) for the specs left to the interpreter"""
+    # Direct calls are only for specs that compile, which the first pass finds
+    _, first, _ = compile_specs(copy.deepcopy(ast))
+    ast = copy.deepcopy(ast)
+    program, compilers, skipped = compile_specs(ast, set(first))
+    program.obs.update(observed(compilers))
+    program.mods.update(modified(compilers))
+
+    out = ['// Generated by beacon compile from %s; do not edit.' % name,
+           '// Build from the repository root:',
+           '//   cc -O2 -I src/runtime -I third_party/cJSON <this file> third_party/cJSON/cJSON.c -lm -lpthread',
+           '',
+           '#define BEACON_LIBRARY',
+           '#define BEACON_AOT',
+           '#include "main.c"',
+           '#include "aot.h"',
+           '']
+    bodies = []
+    for i, compiler in sorted(compilers.items()):
+        head, lines, tail = compiler.render_root
+        body = list(head)
+        for line in lines:
+            body.extend(line.render() if isinstance(line, Deferred) else [line])
+        body.extend(tail)
+        bodies.append(prune_flags(body, compiler.bindings.values()))
+        program.mark(compiler.decl)
+    for i in sorted(compilers):
+        out.append('static FunctionSymbol* aot_sym_%d;' % i)
+    for i in sorted(compilers):
+        out.append('static bool aot_spec_%d(Value* args, Scope* caller, Value* out);' % i)
+    out.append('')
+    for body in bodies:
+        out.extend(body)
+        out.append('')
+    for i in sorted(compilers):
+        out.append('static Value* aot_entry_%d(Value** args, int argc, Scope* scope) {' % i)
+        out.append('    return aot_enter(aot_spec_%d, args, argc, scope);' % i)
+        out.append('}')
+        out.append('')
+    text = json.dumps(ast, separators=(',', ':'))
+    out.append('static const char aot_program[] =')
+    chunks = [text[i:i + 96] for i in range(0, len(text), 96)] or ['']
+    for chunk in chunks[:-1]:
+        out.append('    %s' % c_string(chunk))
+    out.append('    %s;' % c_string(chunks[-1]))
+    out.append('')
+    out.append('static const AotSpec aot_specs[] = {')
+    for i, compiler in sorted(compilers.items()):
+        out.append('    {%d, aot_entry_%d, &aot_sym_%d},  // %s' % (compiler.decl['aot'], i, i, compiler.decl['name']))
+    if not compilers:
+        out.append('    {-1, NULL, NULL}')
+    out.append('};')
+    out.append('')
+    out.append('int main(void) {')
+    out.append('    return aot_main(aot_program, %s, aot_specs, %d);' % (c_string(name), len(compilers)))
+    out.append('}')
+    report = [(program.specs[i]['name'], reason) for i, reason in sorted(skipped.items())]
+    return '\n'.join(out) + '\n', report
+
+
+def build(c_path, exe_path, cc=None):
+    """Builds a generated C file with the system C compiler; returns the
+    compiler's exit status"""
+    here = os.path.dirname(os.path.abspath(__file__))
+    runtime = os.path.normpath(os.path.join(here, '..', 'runtime'))
+    cjson = os.path.normpath(os.path.join(here, '..', '..', 'third_party', 'cJSON'))
+    command = [cc or os.environ.get('CC', 'cc'), '-O2', '-I', runtime, '-I', cjson, c_path,
+               os.path.join(cjson, 'cJSON.c'), '-lm', '-lpthread', '-o', exe_path]
+    return subprocess.run(command).returncode
@@ -38,7 +38,20 @@ def generate_ast_json(source_code: str):
     
     backend_exe = os.path.abspath(backend_exe)
 
-    if os.path.exists(backend_exe):
+    server_socket = os.environ.get('BEACON_SERVER')
+    if server_socket:
+        # A runtime already running with --serve <socket> takes the job
+        from runtime_server import RuntimeServer
+        print("\n--- Execution Output ---")
+        try:
+            with RuntimeServer(socket_path=server_socket) as server:
+                result = server.run_file(ast_path)
+            print(result.stdout)
+            if result.stderr:
+                print("Errors:", result.stderr)
+        except OSError as e:
+            print(f"Failed to reach runtime server at {server_socket}: {e}")
+    elif os.path.exists(backend_exe):
         print("\n--- Execution Output ---")
         try:
             result = subprocess.run([backend_exe, ast_path], capture_output=True, text=True)
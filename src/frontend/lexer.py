@@ -63,6 +63,8 @@ class Lexer:
         'ask': 'ASK',
         'ask': 'ASK',
         'with': 'WITH',
+        'paral': 'PARAL',
+        'hold': 'HOLD',
         'signal': 'SIGNAL',
         'listen': 'LISTEN',
         'pack': 'PACK',
@@ -180,11 +182,12 @@ class Lexer:
             elif self.current_char == ',':
                 tokens.append(Token('COMMA', ','))
                 self.advance()
-                if self.peek() == '>':
-                    tokens.append(Token('ACCESS', '~>'))
+            elif self.current_char == '.':
+                if self.peek() == '.':
+                    tokens.append(Token('RANGE', '..'))
                     self.advance()
                     self.advance()
-                else: 
+                else:
                      # Deprecated dot access and range
                      # Show context
                      start = max(0, self.position - 10)
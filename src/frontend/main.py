@@ -9,6 +9,7 @@ from lexer import Lexer
 from parser import Parser
 from interpreter import Interpreter
 from frontend import generate_ast_json
+import aot
 
 
 def print_usage():
@@ -17,14 +18,14 @@ def print_usage():
 
 Usage:
     beacon run <file.bpl>       Run Beacon file with interpreter
-    beacon compile <file.bpl>   Compile Beacon file to C
-    beacon <file.bpl>           Run Beacon file (default mode)
+    beacon compile <file.bpl>   Compile Beacon file to C and build an executable
+    beacon <file.bpl>           Run Beacon file on the C runtime (default mode)
     beacon --help               Show this help message
 
 Examples:
     beacon run hello.bpl        # Interpret and run
-    beacon compile hello.bpl    # Compile to C
-    beacon hello.bpl            # Same as 'beacon run hello.bpl'
+    beacon compile hello.bpl    # Writes hello.c and builds hello
+    beacon hello.bpl            # Run on the C runtime
 """)
 
 
@@ -58,17 +59,45 @@ def run_file(file_path: str):
         sys.exit(1)
 
 
-def compile_file(file_path: str):
-    """Compile a Beacon file to C"""
+def read_source(file_path: str) -> str:
+    """Read a Beacon file, exiting if it is missing"""
     try:
         with open(file_path, 'r') as f:
-            source_code = f.read()
+            return f.read()
     except FileNotFoundError:
         print(f"Error: File not found: {file_path}", file=sys.stderr)
         sys.exit(1)
-    
+
+
+def execute_file(file_path: str):
+    """Run a Beacon file on the C runtime"""
     # Use existing compilation pipeline
-    generate_ast_json(source_code)
+    generate_ast_json(read_source(file_path))
+
+
+def compile_file(file_path: str):
+    """Compile a Beacon file ahead of time to C and build it"""
+    source_code = read_source(file_path)
+    try:
+        ast = Parser(Lexer(source_code).tokenize()).parse()
+    except Exception as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(1)
+
+    stem = os.path.splitext(file_path)[0]
+    c_path = stem + '.c'
+    exe_path = stem + ('.exe' if os.name == 'nt' else '')
+    source, report = aot.compile_program(ast.to_dict(), os.path.basename(file_path))
+    with open(c_path, 'w') as f:
+        f.write(source)
+    print(f"C source saved to {os.path.abspath(c_path)}")
+    for spec, reason in report:
+        print(f"  spec '{spec}' stays interpreted: {reason}")
+
+    if aot.build(c_path, exe_path) != 0:
+        print("Error: C compiler failed", file=sys.stderr)
+        sys.exit(1)
+    print(f"Executable saved to {os.path.abspath(exe_path)}")
 
 
 def main():
@@ -102,8 +131,8 @@ def main():
         file_path = sys.argv[2]
     
     else:
-        # Default to compile mode (uses C backend)
-        mode = 'compile'
+        # Default to running on the C backend
+        mode = 'execute'
         file_path = first_arg
     
     # Validate file extension
@@ -115,6 +144,8 @@ def main():
         run_file(file_path)
     elif mode == 'compile':
         compile_file(file_path)
+    elif mode == 'execute':
+        execute_file(file_path)
 
 
 if __name__ == "__main__":
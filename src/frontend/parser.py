@@ -1,7 +1,7 @@
 # parser.py
 
 from .symbol_table import SymbolTable
-from .lexer import Token
+from .lexer import Lexer, Token
 from .beacon_ast import (
     ProgramNode, NumberNode, BinaryOpNode, UnaryOpNode, VarAccessNode, VarAssignNode, ConstantDeclNode, 
     ShowStatementNode, NickDeclNode, FunctionDeclNode, ReturnStatementNode, FunctionCallNode, MethodCallNode, 
@@ -267,6 +267,16 @@ class Parser:
         self.eat('TRAVERSE')
         var_name = self.current_token.value
         self.eat('WORD')
+        if self.current_token.type == 'WORD' and self.current_token.value == 'in':
+            # traverse item in iterable: over a list, dict, set, text, file or iterator
+            self.eat('WORD')
+            iterable = self.expression()
+            self.eat('COLON')
+            body = []
+            while self.current_token.type not in ('DONE', 'EOF'):
+                body.append(self.statement())
+            self.eat('DONE')
+            return EachNode(var_name, iterable, body)
         self.eat('FROM')
         start_val = self.expression()
         self.eat('TO')
@@ -430,7 +440,6 @@ class Parser:
                         if interp_expr.strip() == 'peek':
                             parts.append(VarAccessNode('peek'))
                         else:
-                            from .lexer import Lexer
                             temp_lexer = Lexer(interp_expr)
                             temp_parser = self.__class__(temp_lexer.tokenize())
                             parts.append(temp_parser.expression())
@@ -499,7 +508,11 @@ class Parser:
         while self.current_token and self.current_token.type == 'ACCESS':
             self.eat('ACCESS') # Consume ~>
             attribute = self.current_token.value
-            self.eat('WORD')
+            # Members may share a name with a keyword, as in serial~>pack
+            if self.current_token.type != 'WORD' and Lexer.KEYWORDS.get(attribute) == self.current_token.type:
+                self.eat(self.current_token.type)
+            else:
+                self.eat('WORD')
             
             # Check for method call
             if self.current_token.type == 'LPAREN':
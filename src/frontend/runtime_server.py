@@ -0,0 +1,90 @@
+"""Client for the runtime's server mode.
+
+A runtime started with `BPL --serve` (jobs on its stdin) or
+`BPL --serve <socket path>` (jobs from Unix socket clients) stays up and
+runs one AST after another, so each run skips process startup, and files
+run by path are only parsed the first time. See src/runtime/jobserver.h
+for the protocol.
+"""
+import socket
+import subprocess
+
+
+class JobResult:
+    def __init__(self, stdout, stderr, status):
+        self.stdout = stdout
+        self.stderr = stderr
+        self.status = status
+
+
+def _send_job(writer, path, ast_json=None, input_text=""):
+    ast_bytes = ast_json.encode() if ast_json is not None else b""
+    input_bytes = input_text.encode()
+    header = f"RUN {len(ast_bytes)} {len(input_bytes)} {path}\n".encode()
+    writer.write(header + ast_bytes + input_bytes)
+    writer.flush()
+
+
+def _read_result(reader):
+    out, err = [], []
+    while True:
+        line = reader.readline()
+        if not line:
+            raise ConnectionError("runtime server closed the connection")
+        kind, value = line.decode().split()
+        if kind == "END":
+            return JobResult(b"".join(out).decode(errors="replace"),
+                             b"".join(err).decode(errors="replace"),
+                             int(value))
+        data = reader.read(int(value))
+        (out if kind == "OUT" else err).append(data)
+
+
+class RuntimeServer:
+    """Runs jobs on a runtime server, either one it starts itself or one
+    already listening on a Unix socket."""
+
+    def __init__(self, runtime=None, socket_path=None):
+        self.process = None
+        self.sock = None
+        if socket_path:
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self.sock.connect(socket_path)
+            self.reader = self.sock.makefile("rb")
+            self.writer = self.sock.makefile("wb")
+        else:
+            self.process = subprocess.Popen([runtime, "--serve"],
+                                            stdin=subprocess.PIPE,
+                                            stdout=subprocess.PIPE)
+            self.reader = self.process.stdout
+            self.writer = self.process.stdin
+
+    def run_file(self, ast_path, input_text=""):
+        """Runs an AST JSON file, which the server caches until it changes."""
+        _send_job(self.writer, ast_path, None, input_text)
+        return _read_result(self.reader)
+
+    def run_json(self, ast_json, input_text="", label="<inline>"):
+        """Runs an AST given as JSON text."""
+        _send_job(self.writer, label, ast_json, input_text)
+        return _read_result(self.reader)
+
+    def close(self):
+        """Stops a server this client started; a shared one keeps running."""
+        if self.process:
+            try:
+                self.writer.write(b"QUIT\n")
+                self.writer.flush()
+            except (BrokenPipeError, OSError):
+                pass
+            self.process.wait()
+        if self.sock:
+            self.reader.close()
+            self.writer.close()
+            self.sock.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
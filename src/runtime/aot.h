@@ -0,0 +1,486 @@
+#ifndef BEACON_AOT_H
+#define BEACON_AOT_H
+
+// Runtime support for programs compiled ahead of time with
+// `beacon compile` (src/frontend/aot.py).
+//
+// A compiled program is one C file: it defines BEACON_LIBRARY and
+// BEACON_AOT, includes main.c and then this header, embeds the program's
+// AST JSON and adds a C function per top-level spec it could translate.
+// Unlike the other headers here, this one is included after main.c and
+// works with its internals directly. The executable parses the embedded
+// AST, hangs each compiled function on its spec's FunctionSymbol and runs
+// the program as the interpreter would; call_spec then runs compiled
+// bodies instead of walking their statements.
+//
+// Compiled bodies keep the spec's variables in C locals (inline Values)
+// rather than in a Scope, do number arithmetic and comparisons inline,
+// count ranges in C loops and call other compiled specs directly. Beacon
+// scoping is dynamic, though: a spec sees every variable of the specs
+// that called it. So a compiled spec still has the scopes the interpreter
+// would give it, made only when something needs them. Before code that
+// can look at variables (an interpreted spec, most natives, or any
+// statement the compiler left to the interpreter, which runs on the real
+// scope) the variables it might see are spilled into their scopes, and
+// afterwards read back; a call to another compiled spec spills only the
+// names that spec (and what it calls) uses. Each variable has a dirty flag
+// so an unchanged one is not spilled again.
+//
+// A variable a spec assigns may already exist in a calling scope, in which
+// case the interpreter assigns that one. A compiled body looks such
+// variables up once on entry and then spills to, reloads from and finally
+// writes back to the scope it found (its "home") instead of its own; a
+// caller reloads what a directly called spec may have assigned. A compiled
+// body returns false without touching its arguments when it cannot run
+// faithfully (the variable it would assign is a firm, which is an error
+// the interpreter reports), and the interpreter runs the spec instead.
+//
+// The helpers are static inline so that a program which does not need one
+// compiles without unused-function warnings.
+
+// A kept variable that has not been assigned yet
+#define AOT_UNSET ((ValueType)0x7f)
+
+// --- inline values -------------------------------------------------------------
+
+static inline Value aot_int(int64_t n) {
+    Value v;
+    v.type = VAL_INT;
+    v.as.integer = n;
+    return v;
+}
+
+static inline Value aot_num(double n) {
+    Value v;
+    v.type = VAL_NUMBER;
+    v.as.number = n;
+    return v;
+}
+
+static inline Value aot_bool(bool b) {
+    Value v;
+    v.type = VAL_BOOL;
+    v.as.boolean = b;
+    return v;
+}
+
+static inline Value aot_nil(void) {
+    Value v;
+    v.type = VAL_NIL;
+    return v;
+}
+
+static inline Value aot_unset(void) {
+    Value v;
+    v.type = AOT_UNSET;
+    return v;
+}
+
+static inline Value aot_text(const char* s) {
+    Value v;
+    v.type = VAL_STRING;
+    v.as.string = strdup(s);
+    return v;
+}
+
+// Values without anything to copy or release
+static inline bool aot_plain(const Value* v) {
+    return v->type == VAL_INT || v->type == VAL_NUMBER || v->type == VAL_BOOL ||
+           v->type == VAL_NIL || v->type == AOT_UNSET;
+}
+
+// Moves a value out of the slab into an inline one
+static inline Value aot_take(Value* v) {
+    Value out = *v;
+    slab_free(&value_slab, v);
+    return out;
+}
+
+// Moves an inline value into the slab, for code that wants a Value*
+static inline Value* aot_give(Value v) {
+    Value* out = alloc_value();
+    *out = v;
+    return out;
+}
+
+// A copy, with copy_value's sharing rules
+static inline Value aot_dup(const Value* v) {
+    return aot_plain(v) ? *v : aot_take(copy_value(v));
+}
+
+static inline void aot_drop(Value* v) {
+    if (!aot_plain(v)) clear_value(v);
+}
+
+static inline void aot_assign(Value* slot, Value v) {
+    aot_drop(slot);
+    *slot = v;
+}
+
+// --- operators -----------------------------------------------------------------
+
+// Anything but the number fast paths goes through the interpreter's own code
+static inline Value aot_binary(const char* op, const Value* a, const Value* b) {
+    return aot_take(binary_op(op, (Value*)a, (Value*)b));
+}
+
+static inline Value aot_add(const Value* a, const Value* b) {
+    int64_t n;
+    if (a->type == VAL_INT && b->type == VAL_INT && int_add(a->as.integer, b->as.integer, &n)) return aot_int(n);
+    if (is_number(a) && is_number(b)) return aot_num(number_of(a) + number_of(b));
+    return aot_binary("+", a, b);
+}
+
+static inline Value aot_sub(const Value* a, const Value* b) {
+    int64_t n;
+    if (a->type == VAL_INT && b->type == VAL_INT && int_sub(a->as.integer, b->as.integer, &n)) return aot_int(n);
+    if (is_number(a) && is_number(b)) return aot_num(number_of(a) - number_of(b));
+    return aot_binary("-", a, b);
+}
+
+static inline Value aot_mul(const Value* a, const Value* b) {
+    int64_t n;
+    if (a->type == VAL_INT && b->type == VAL_INT && int_mul(a->as.integer, b->as.integer, &n)) return aot_int(n);
+    if (is_number(a) && is_number(b)) return aot_num(number_of(a) * number_of(b));
+    return aot_binary("*", a, b);
+}
+
+static inline Value aot_div(const Value* a, const Value* b) {
+    if (is_number(a) && is_number(b)) return aot_num(number_of(a) / number_of(b));
+    return aot_binary("/", a, b);
+}
+
+#define AOT_COMPARE(fn, op, text)                                                  \
+    static inline Value fn(const Value* a, const Value* b) {                      \
+        if (a->type == VAL_INT && b->type == VAL_INT) return aot_bool(a->as.integer op b->as.integer); \
+        if (is_number(a) && is_number(b)) return aot_bool(number_of(a) op number_of(b)); \
+        return aot_binary(text, a, b);                                             \
+    }
+
+AOT_COMPARE(aot_less, <, "<")
+AOT_COMPARE(aot_greater, >, ">")
+AOT_COMPARE(aot_less_equal, <=, "<=")
+AOT_COMPARE(aot_greater_equal, >=, ">=")
+
+static inline Value aot_equal(const Value* a, const Value* b) {
+    if (is_number(a) && is_number(b)) return aot_bool(numbers_equal(a, b));
+    return aot_binary("==", a, b);
+}
+
+static inline Value aot_not_equal(const Value* a, const Value* b) {
+    if (is_number(a) && is_number(b)) return aot_bool(!numbers_equal(a, b));
+    return aot_binary("'=", a, b);
+}
+
+static inline bool aot_truthy(Value* v) {
+    return value_to_bool(v);
+}
+
+// --- scopes --------------------------------------------------------------------
+
+// A compiled spec has one scope per block level (its body is level 0, each
+// traverse body one deeper), NULL until needed. Levels are made outermost
+// first, so the innermost one made so far is where code at a level runs.
+static inline Scope* aot_cur(Scope** scopes, int level, Scope* caller) {
+    for (int i = level; i >= 0; i--) {
+        if (scopes[i]) return scopes[i];
+    }
+    return caller;
+}
+
+static inline Scope* aot_scope(Scope** scopes, int level, Scope* caller) {
+    if (!scopes[level]) {
+        Scope* parent = level > 0 ? aot_scope(scopes, level - 1, caller) : caller;
+        scopes[level] = create_scope(parent);
+    }
+    return scopes[level];
+}
+
+static inline void aot_leave(Scope** scopes, int level) {
+    if (scopes[level]) {
+        destroy_scope(scopes[level]);
+        scopes[level] = NULL;
+    }
+}
+
+// Puts a kept variable where interpreted code will look for it
+static inline void aot_spill(Scope* home, const char* name, const Value* v, bool is_const) {
+    define_variable(home, name, copy_value(v), is_const);
+}
+
+// Takes back whatever interpreted code left in a kept variable
+static inline void aot_reload(Scope* home, const char* name, Value* v) {
+    if (!home) return;
+    for (int i = 0; i < home->symbol_count; i++) {
+        if (strcmp(home->symbols[i].name, name) == 0) {
+            aot_assign(v, aot_dup(home->symbols[i].value));
+            return;
+        }
+    }
+}
+
+static inline bool aot_defined(Scope* scope, const char* name) {
+    for (Scope* s = scope; s; s = s->parent) {
+        for (int i = 0; i < s->symbol_count; i++) {
+            if (strcmp(s->symbols[i].name, name) == 0) return true;
+        }
+    }
+    return false;
+}
+
+// The entry check for a variable a compiled body assigns: sets *home to the
+// calling scope that already has it (NULL if none), and returns false if
+// that one is a firm
+static inline bool aot_home(Scope* scope, const char* name, Scope** home) {
+    for (Scope* s = scope; s; s = s->parent) {
+        for (int i = 0; i < s->symbol_count; i++) {
+            if (strcmp(s->symbols[i].name, name) == 0) {
+                *home = s;
+                return !s->symbols[i].is_constant;
+            }
+        }
+    }
+    *home = NULL;
+    return true;
+}
+
+// A variable the compiled code does not keep, looked up as the interpreter does
+static inline Value aot_lookup(Scope* scope, const char* name) {
+    Value* v = get_variable(scope, name);
+    if (!v) {
+        runtime_errorf("Variable '%s' not found.\n", name);
+        return aot_nil();
+    }
+    return aot_take(v);
+}
+
+// A kept variable read where it may not have been assigned yet
+static inline Value aot_read(const Value* v, Scope* scope, const char* name) {
+    return v->type == AOT_UNSET ? aot_lookup(scope, name) : aot_dup(v);
+}
+
+// --- calls ---------------------------------------------------------------------
+
+// What calling name finds: 1 and the spec, 0 for no variable, -1 for a
+// variable that is not a spec
+static inline int aot_callee(Scope* scope, const char* name, FunctionSymbol** spec) {
+    for (Scope* s = scope; s; s = s->parent) {
+        for (int i = 0; i < s->symbol_count; i++) {
+            if (strcmp(s->symbols[i].name, name) == 0) {
+                Value* v = s->symbols[i].value;
+                if (v->type != VAL_FUNCTION) return -1;
+                *spec = v->as.function;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static inline int aot_params(FunctionSymbol* spec) {
+    return spec->node->data.function_decl.num_params;
+}
+
+// Runs any spec through call_spec, which takes the arguments
+static inline Value aot_call_spec(FunctionSymbol* spec, Value* args, int argc, Scope* scope) {
+    Value* small[8];
+    Value** heap = argc <= 8 ? small : (Value**)malloc(argc * sizeof(Value*));
+    for (int i = 0; i < argc; i++) heap[i] = aot_give(args[i]);
+    Value* result = call_spec(spec, heap, argc, scope);
+    if (heap != small) free(heap);
+    return aot_take(result);
+}
+
+// Runs a native as call_native would; takes the receiver and arguments
+static inline Value aot_call_native(NativeFn fn, Value* receiver, Value* args, int argc, Scope* scope) {
+    int offset = receiver ? 1 : 0;
+    Value* small[8];
+    Value** heap = argc + offset <= 8 ? small : (Value**)malloc((argc + offset) * sizeof(Value*));
+    if (receiver) heap[0] = aot_give(*receiver);
+    for (int i = 0; i < argc; i++) heap[i + offset] = aot_give(args[i]);
+    Value* result = fn(heap, argc + offset, scope);
+    for (int i = 0; i < argc + offset; i++) free_value(heap[i]);
+    if (heap != small) free(heap);
+    return aot_take(result);
+}
+
+// A builtin function, or NULL
+static inline NativeFn aot_builtin(const char* name) {
+    return find_native(native_builtins, name);
+}
+
+// toolkit~>member as the interpreter resolves it, or NULL when a variable
+// shadows the toolkit or it has no such member (the interpreter then takes
+// the call, to do the same)
+static inline NativeFn aot_toolkit_member(Scope* scope, const char* toolkit, const char* member) {
+    const NativeToolkit* found = find_native_toolkit(toolkit);
+    if (!found || aot_defined(scope, toolkit)) return NULL;
+    return find_native(found->members, member);
+}
+
+// A built-in method of a value, or NULL. Pure methods neither look at
+// variables nor run specs, so nothing has to be spilled around them.
+static inline NativeFn aot_method(const Value* object, const char* method, bool* pure) {
+    const NativeEntry* table = native_methods_for(object);
+    if (!table) return NULL;
+    *pure = table == list_methods || table == dict_methods || table == set_methods || table == text_members;
+    return find_native(table, method);
+}
+
+// --- statements and expressions --------------------------------------------------
+
+// Nodes the compiler left to the interpreter, by the mark it gave them
+static ASTNode** aot_nodes;
+static int aot_node_capacity;
+
+static void aot_mark(int mark, ASTNode* node) {
+    if (mark < 0) return;
+    if (mark >= aot_node_capacity) {
+        int capacity = aot_node_capacity ? aot_node_capacity : 64;
+        while (capacity <= mark) capacity *= 2;
+        aot_nodes = (ASTNode**)realloc(aot_nodes, capacity * sizeof(ASTNode*));
+        memset(aot_nodes + aot_node_capacity, 0, (capacity - aot_node_capacity) * sizeof(ASTNode*));
+        aot_node_capacity = capacity;
+    }
+    aot_nodes[mark] = node;
+}
+
+static inline void aot_exec(int mark, Scope* scope) {
+    free_value(interpret_ast(aot_nodes[mark], scope));
+}
+
+static inline Value aot_eval(int mark, Scope* scope) {
+    return aot_take(interpret_ast(aot_nodes[mark], scope));
+}
+
+static inline void aot_show_part(StrBuf* line, Value* v) {
+    strbuf_append_value(line, v);
+    strbuf_append_n(line, " ", 1);
+}
+
+static inline void aot_show_end(StrBuf* line) {
+    strbuf_append_n(line, "\n", 1);
+    runtime_write(line->data, line->len);
+    free(line->data);
+}
+
+// One interpolated slot, formatted as a template slot formats it
+static inline void aot_template_part(StrBuf* text, Value* v) {
+    TemplateSlot slot;
+    Value* shared = aot_give(*v);
+    size_t length = template_slot_fill(&slot, shared);
+    strbuf_append_n(text, slot.text, length);
+    free(slot.owned);
+    slab_free(&value_slab, shared);
+}
+
+static inline Value aot_text_of(StrBuf* text) {
+    Value v;
+    v.type = VAL_STRING;
+    v.as.string = text->data;
+    return v;
+}
+
+static inline Value aot_list_of(ListObj* list) {
+    Value v;
+    v.type = VAL_LIST;
+    v.as.list = list;
+    return v;
+}
+
+// --- traverse --------------------------------------------------------------------
+
+// A counted range, stepping exactly as iter_next steps its range iterators
+typedef struct {
+    bool integral;
+    int64_t next, end, step;
+    double fnext, fend, fstep;
+} AotRange;
+
+static inline void aot_range_init(AotRange* r, const Value* start, const Value* end) {
+    double s = is_number(start) ? number_of(start) : 0;
+    double e = is_number(end) ? number_of(end) : 0;
+    *r = (AotRange){0};
+    r->integral = fabs(s) <= INT_EXACT_LIMIT && fabs(e) <= INT_EXACT_LIMIT &&
+                  s == (double)(int64_t)s && e == (double)(int64_t)e;
+    if (r->integral) {
+        r->next = (int64_t)s;
+        r->end = (int64_t)e;
+        r->step = r->next > r->end ? -1 : 1;
+    } else {
+        r->fnext = s;
+        r->fend = e;
+        r->fstep = s > e ? -1.0 : 1.0;
+    }
+}
+
+static inline bool aot_range_next(AotRange* r, Value* out) {
+    if (r->integral) {
+        int64_t i = r->next;
+        if (r->step > 0 ? i > r->end : i < r->end) return false;
+        r->next = i + r->step;
+        *out = aot_int(i);
+        return true;
+    }
+    double x = r->fnext;
+    if (r->fstep > 0 ? x > r->fend : x < r->fend) return false;
+    r->fnext = x + r->fstep;
+    *out = aot_num(x);
+    return true;
+}
+
+// Iterators that run specs as they are pulled, so variables must be spilled
+// around each step
+static inline bool aot_iter_runs_specs(const IterObj* it) {
+    switch (it->kind) {
+        case ITER_TRANSFORM:
+        case ITER_FILTER: return true;
+        case ITER_JSON: return aot_iter_runs_specs(it->as.json.source);
+        default: return false;
+    }
+}
+
+// --- programs --------------------------------------------------------------------
+
+typedef bool (*AotBody)(Value* args, Scope* scope, Value* out);
+
+// The FunctionSymbol hook: runs a compiled body on call_spec's arguments,
+// taking them only if it ran
+static inline Value* aot_enter(AotBody body, Value** args, int argc, Scope* scope) {
+    Value small[8];
+    Value* in = argc <= 8 ? small : (Value*)malloc(argc * sizeof(Value));
+    for (int i = 0; i < argc; i++) in[i] = *args[i];
+    Value out;
+    bool ran = body(in, scope, &out);
+    if (in != small) free(in);
+    if (!ran) return NULL;
+    for (int i = 0; i < argc; i++) slab_free(&value_slab, args[i]);
+    return aot_give(out);
+}
+
+typedef struct {
+    int mark;                                        // of the spec's declaration
+    Value* (*entry)(Value** args, int argc, Scope* scope);
+    FunctionSymbol** symbol;                         // set to the spec's symbol
+} AotSpec;
+
+// main() of a compiled program
+static int aot_main(const char* ast_json, const char* name, const AotSpec* specs, int count) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+    setvbuf(stderr, NULL, _IONBF, 0);
+    ASTNode* ast = parse_ast_from_text(ast_json, name);
+    if (!ast) return 1;
+    for (int i = 0; i < count; i++) {
+        ASTNode* decl = specs[i].mark < aot_node_capacity ? aot_nodes[specs[i].mark] : NULL;
+        if (!decl || decl->type != NODE_FUNCTION_DECL) continue;
+        decl->data.function_decl.symbol->compiled = specs[i].entry;
+        *specs[i].symbol = decl->data.function_decl.symbol;
+    }
+    run_program(&default_runtime, ast);
+    runtime_reset(&default_runtime);
+    free_ast(ast);
+    free(aot_nodes);
+    return 0;
+}
+
+#endif
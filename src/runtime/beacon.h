@@ -0,0 +1,126 @@
+#ifndef BEACON_H
+#define BEACON_H
+
+#include <stddef.h>
+
+// libbeacon: the Beacon runtime as a library, for hosts that run Beacon
+// programs inside their own process.
+//
+// A BeaconProgram is an AST loaded once (from the JSON the frontend writes)
+// and run as often as needed. A BeaconRuntime is everything a running
+// program owns: its global scope, its signal listeners and paral queue,
+// where its output goes and the native functions the host has added. Each
+// beacon_run() starts the program from fresh globals and keeps them, so the
+// host can then call the program's specs with beacon_call() as many times
+// as it likes without spawning a process or parsing anything again.
+// A program with a snapshot~>point resumes from its snapshot here just as
+// it does on the command line (see snapshot.h).
+//
+//   BeaconProgram* program = beacon_program_load("pricing.bpl.json");
+//   BeaconRuntime* rt = beacon_runtime_new();
+//   beacon_run(rt, program);
+//   BeaconValue* args[1] = {beacon_number(42)};
+//   BeaconValue* price = beacon_call(rt, "quote", args, 1);
+//   ...
+//   beacon_value_free(args[0]);
+//   beacon_value_free(price);
+//   beacon_runtime_free(rt);
+//   beacon_program_free(program);
+//
+// Values passed in stay owned by the caller; values returned are owned by
+// the caller and released with beacon_value_free(). Programs are read-only
+// once loaded, and a program must outlive the runtimes that ran it.
+//
+// Runtimes are isolates. Each has its own globals, signals, queues and
+// output, so N runtimes can run on N threads at the same time, all running
+// the same loaded programs (and modules brought in, which are loaded once
+// per process). They share the worker pool behind paral_* and the I/O
+// queue behind io~>, and nothing else. A runtime is used by one thread at
+// a time, and its open connections belong to the thread that opened them.
+//
+// Build the library from src/runtime with -DBEACON_LIBRARY, which leaves
+// out the command-line main():
+//   gcc -O2 -c -DBEACON_LIBRARY main.c cJSON.c && ar rcs libbeacon.a main.o cJSON.o
+// and link hosts with -lbeacon -lm -lpthread.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct BeaconRuntime BeaconRuntime;
+typedef struct BeaconProgram BeaconProgram;
+typedef struct Value BeaconValue;
+
+typedef enum {
+    BEACON_NIL,
+    BEACON_BOOL,
+    BEACON_NUMBER,
+    BEACON_TEXT,
+    BEACON_LIST,
+    BEACON_DICT,
+    BEACON_OTHER
+} BeaconType;
+
+// Receives output: what show writes, or error messages
+typedef void (*BeaconWriteFn)(void* user, const char* data, size_t length);
+
+// A host function callable from Beacon by name. Arguments are borrowed;
+// the result is handed over to the runtime (NULL means Nil).
+typedef BeaconValue* (*BeaconNativeFn)(BeaconValue** args, int argc, void* user);
+
+// A caller-owned buffer that beacon_buffer_write fills; output beyond its
+// size is dropped and counted in overflow
+typedef struct {
+    char* data;
+    size_t size;
+    size_t length;
+    size_t overflow;
+} BeaconBuffer;
+
+// --- programs ---
+BeaconProgram* beacon_program_load(const char* ast_path);
+BeaconProgram* beacon_program_parse(const char* ast_json, const char* name);
+void beacon_program_free(BeaconProgram* program);
+
+// --- runtimes ---
+BeaconRuntime* beacon_runtime_new(void);
+void beacon_runtime_free(BeaconRuntime* rt);
+// NULL restores the default (stdout for output, stderr for errors)
+void beacon_set_output(BeaconRuntime* rt, BeaconWriteFn write, void* user);
+void beacon_set_errors(BeaconRuntime* rt, BeaconWriteFn write, void* user);
+void beacon_buffer_write(void* buffer, const char* data, size_t length);
+// Makes fn callable as name(...) from programs this runtime runs; 0 on
+// success, -1 if the name is already a builtin
+int beacon_register(BeaconRuntime* rt, const char* name, BeaconNativeFn fn, void* user);
+
+// Runs the program from fresh globals, which stay for beacon_call; 0 on
+// success
+int beacon_run(BeaconRuntime* rt, BeaconProgram* program);
+// Calls a spec defined by the last beacon_run; NULL if there is no such spec
+BeaconValue* beacon_call(BeaconRuntime* rt, const char* spec, BeaconValue** args, int argc);
+
+// --- values ---
+BeaconValue* beacon_nil(void);
+BeaconValue* beacon_bool(int value);
+BeaconValue* beacon_number(double value);
+BeaconValue* beacon_text(const char* text, size_t length);
+BeaconValue* beacon_list(BeaconValue** items, int count);
+void beacon_value_free(BeaconValue* value);
+
+BeaconType beacon_type(const BeaconValue* value);
+int beacon_as_bool(const BeaconValue* value);
+double beacon_as_number(const BeaconValue* value);
+// The characters of a Text, valid while the value lives; NULL otherwise
+const char* beacon_as_text(BeaconValue* value, size_t* length);
+int beacon_list_length(const BeaconValue* value);
+// A new reference to a list's item
+BeaconValue* beacon_list_get(const BeaconValue* value, int index);
+// Writes the value as show would into buffer (always terminated) and
+// returns the full length, like snprintf
+size_t beacon_render(BeaconValue* value, char* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
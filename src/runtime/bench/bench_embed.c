@@ -0,0 +1,81 @@
+// Microbenchmark: a host running Beacon through libbeacon (beacon.h).
+// Loads bench_embed.bpl.json once, runs it, then calls its quote spec many
+// times with a host-supplied rate() native, and compares that with running
+// the whole program per call (what starting the runtime per request would
+// do at best, without the process start). Output is captured into a buffer.
+//
+// Build and run from src/runtime:
+//   gcc -O2 -DBEACON_LIBRARY -o bench_embed bench/bench_embed.c main.c cJSON.c -lm -lpthread
+//   ./bench_embed
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../beacon.h"
+
+#define CALLS 200000
+#define RUNS 20000
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// rate(item): the host's price for an item
+static BeaconValue* host_rate(BeaconValue** args, int argc, void* user) {
+    double* widget_rate = (double*)user;
+    size_t length;
+    const char* item = argc == 1 ? beacon_as_text(args[0], &length) : NULL;
+    if (!item || strcmp(item, "widget") != 0) return beacon_nil();
+    return beacon_number(*widget_rate);
+}
+
+int main(void) {
+    BeaconProgram* program = beacon_program_load("bench/bench_embed.bpl.json");
+    if (!program) return 1;
+    BeaconRuntime* rt = beacon_runtime_new();
+    char captured[256];
+    BeaconBuffer output = {captured, sizeof(captured), 0, 0};
+    beacon_set_output(rt, beacon_buffer_write, &output);
+    double widget_rate = 4.0;
+    beacon_register(rt, "rate", host_rate, &widget_rate);
+
+    if (beacon_run(rt, program) != 0) return 1;
+    BeaconValue* args[1] = {beacon_number(3)};
+    BeaconValue* label = beacon_call(rt, "label", args, 1);
+    BeaconValue* price = beacon_call(rt, "quote", args, 1);
+    char rendered[64];
+    beacon_render(label, rendered, sizeof(rendered));
+    printf("captured:   %s", captured);
+    printf("label:      %s\n", rendered);
+    printf("quote(3):   %g\n", beacon_as_number(price));
+    beacon_value_free(label);
+    beacon_value_free(price);
+
+    double sum = 0;
+    double start = now_ms();
+    for (int i = 0; i < CALLS; i++) {
+        BeaconValue* result = beacon_call(rt, "quote", args, 1);
+        sum += beacon_as_number(result);
+        beacon_value_free(result);
+    }
+    double ms = now_ms() - start;
+    printf("call spec:  %8.2f us  (%.0f calls/s)\n", ms * 1000.0 / CALLS, CALLS / (ms / 1000.0));
+
+    start = now_ms();
+    for (int i = 0; i < RUNS; i++) {
+        output.length = 0;
+        beacon_run(rt, program);
+        BeaconValue* result = beacon_call(rt, "quote", args, 1);
+        sum += beacon_as_number(result);
+        beacon_value_free(result);
+    }
+    ms = now_ms() - start;
+    printf("run + call: %8.2f us\n", ms * 1000.0 / RUNS);
+
+    beacon_value_free(args[0]);
+    beacon_runtime_free(rt);
+    beacon_program_free(program);
+    return sum > 0 ? 0 : 1;
+}
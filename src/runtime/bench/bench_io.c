@@ -0,0 +1,107 @@
+// Microbenchmark: reading and writing many files through ioqueue.h, against
+// one blocking open/read/close after another.
+//
+// Build and run from src/runtime:
+//   gcc -O2 -o bench_io bench/bench_io.c -lpthread && ./bench_io
+//
+// The files live in the system temp directory and are mostly in the page
+// cache after the first round, so this measures how well the queue overlaps
+// system calls; on cold storage the gap is larger. Set BEACON_NO_URING=1 to
+// time the I/O thread pool instead of io_uring.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../ioqueue.h"
+
+#define FILES 512
+#define FILE_SIZE (64 * 1024)
+#define ROUNDS 5
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Keeps the compiler from discarding the results
+static volatile size_t sink;
+
+static char paths[FILES][64];
+
+// What file~>read does: size the file, then read it into its own buffer
+static void read_blocking(void) {
+    char* buffers[FILES];
+    for (int i = 0; i < FILES; i++) {
+        int fd = open(paths[i], O_RDONLY);
+        struct stat st;
+        fstat(fd, &st);
+        buffers[i] = (char*)malloc((size_t)st.st_size + 1);
+        sink += (size_t)read(fd, buffers[i], (size_t)st.st_size);
+        close(fd);
+    }
+    for (int i = 0; i < FILES; i++) free(buffers[i]);
+}
+
+static void read_queued(void) {
+    IoqOp* ops[FILES];
+    for (int i = 0; i < FILES; i++) ops[i] = ioq_read(paths[i]);
+    for (int i = 0; i < FILES; i++) {
+        ioq_wait(ops[i]);
+        sink += ops[i]->length;
+    }
+    for (int i = 0; i < FILES; i++) ioq_free(ops[i]);
+}
+
+// Both write loops start from a fresh copy of each file's contents, as
+// io~>write does when it takes the text form of a value
+static char* contents_copy(const char* data) {
+    char* copy = (char*)malloc(FILE_SIZE);
+    memcpy(copy, data, FILE_SIZE);
+    return copy;
+}
+
+static void write_blocking(const char* data) {
+    char* copies[FILES];
+    for (int i = 0; i < FILES; i++) {
+        copies[i] = contents_copy(data);
+        int fd = open(paths[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        sink += (size_t)write(fd, copies[i], FILE_SIZE);
+        close(fd);
+    }
+    for (int i = 0; i < FILES; i++) free(copies[i]);
+}
+
+static void write_queued(const char* data) {
+    IoqOp* ops[FILES];
+    for (int i = 0; i < FILES; i++) ops[i] = ioq_write(paths[i], contents_copy(data), FILE_SIZE);
+    ioq_wait_all();
+    for (int i = 0; i < FILES; i++) ioq_free(ops[i]);
+}
+
+int main(void) {
+    const char* dir = getenv("TMPDIR");
+    if (!dir) dir = "/tmp";
+    char* data = (char*)malloc(FILE_SIZE);
+    for (int i = 0; i < FILE_SIZE; i++) data[i] = (char)('a' + i % 26);
+    for (int i = 0; i < FILES; i++) snprintf(paths[i], sizeof(paths[i]), "%s/bench_io_%d.txt", dir, i);
+    write_blocking(data);
+
+    printf("backend: %s, %d files of %d KB\n", ioq_backend(), FILES, FILE_SIZE / 1024);
+    double start = now_ms();
+    for (int r = 0; r < ROUNDS; r++) read_blocking();
+    printf("read, blocking:         %8.1f ms\n", (now_ms() - start) / ROUNDS);
+    start = now_ms();
+    for (int r = 0; r < ROUNDS; r++) read_queued();
+    printf("read, queued:           %8.1f ms\n", (now_ms() - start) / ROUNDS);
+    start = now_ms();
+    for (int r = 0; r < ROUNDS; r++) write_blocking(data);
+    printf("write, blocking:        %8.1f ms\n", (now_ms() - start) / ROUNDS);
+    start = now_ms();
+    for (int r = 0; r < ROUNDS; r++) write_queued(data);
+    printf("write, queued:          %8.1f ms\n", (now_ms() - start) / ROUNDS);
+
+    for (int i = 0; i < FILES; i++) unlink(paths[i]);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Microbenchmark: isolates (beacon.h) running one program on many threads.
+// Loads bench_isolates.bpl.json once; each thread has its own runtime and
+// runs the program RUNS times, capturing its output. Reports the time for
+// one thread and for THREADS threads doing the same work each, and checks
+// every run printed the same thing (isolates that shared globals, signals
+// or output would not).
+//
+// Build and run from src/runtime:
+//   gcc -O2 -DBEACON_LIBRARY -o bench_isolates bench/bench_isolates.c main.c cJSON.c -lm -lpthread
+//   ./bench_isolates
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../beacon.h"
+
+#define THREADS 4
+#ifndef RUNS
+#define RUNS 8
+#endif
+
+static const char expected[] = "Counted 239 primes \n";
+
+typedef struct {
+    BeaconProgram* program;
+    int mismatches;
+} Tenant;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void* tenant_main(void* arg) {
+    Tenant* tenant = (Tenant*)arg;
+    BeaconRuntime* rt = beacon_runtime_new();
+    char captured[256];
+    BeaconBuffer output = {captured, sizeof(captured), 0, 0};
+    beacon_set_output(rt, beacon_buffer_write, &output);
+    for (int i = 0; i < RUNS; i++) {
+        output.length = 0;
+        beacon_run(rt, tenant->program);
+        if (output.length == 0 || strcmp(captured, expected) != 0) tenant->mismatches++;
+    }
+    beacon_runtime_free(rt);
+    return NULL;
+}
+
+static double run_tenants(BeaconProgram* program, int count, int* mismatches) {
+    pthread_t threads[THREADS];
+    Tenant tenants[THREADS];
+    double start = now_ms();
+    for (int i = 0; i < count; i++) {
+        tenants[i].program = program;
+        tenants[i].mismatches = 0;
+        pthread_create(&threads[i], NULL, tenant_main, &tenants[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+        *mismatches += tenants[i].mismatches;
+    }
+    return now_ms() - start;
+}
+
+int main(void) {
+    BeaconProgram* program = beacon_program_load("bench/bench_isolates.bpl.json");
+    if (!program) return 1;
+    int mismatches = 0;
+    double one = run_tenants(program, 1, &mismatches);
+    double many = run_tenants(program, THREADS, &mismatches);
+    printf("1 isolate,  %d runs:     %8.1f ms\n", RUNS, one);
+    printf("%d isolates, %d runs each: %8.1f ms  (%.2fx the work in %.2fx the time)\n",
+           THREADS, RUNS, many, (double)THREADS, many / one);
+    printf("runs with wrong output:  %d\n", mismatches);
+    beacon_program_free(program);
+    return mismatches == 0 ? 0 : 1;
+}
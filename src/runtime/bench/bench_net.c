@@ -0,0 +1,123 @@
+// Microbenchmark: loopback TCP through netloop.h. Measures request/response
+// latency and bulk throughput with both ends on one event loop, and a
+// three-piece reply sent with one gathered send against one write per piece.
+//
+// Build and run from src/runtime:
+//   gcc -O2 -o bench_net bench/bench_net.c && ./bench_net
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../netloop.h"
+
+#define ROUND_TRIPS 20000
+#define MESSAGE 64
+#define STREAM_BYTES (512u << 20)
+#define STREAM_CHUNK (64u << 10)
+#define REPLIES 50000
+
+// Keeps the compiler from discarding the results
+static volatile size_t sink;
+
+// A connected client and the server side of the same connection
+static void open_pair(NetConn** client, NetConn** server) {
+    int error = 0;
+    NetConn* listener = net_listen("127.0.0.1", 0, &error);
+    if (!listener) {
+        fprintf(stderr, "listen: %s\n", strerror(error));
+        exit(1);
+    }
+    *client = net_connect("127.0.0.1", net_port(listener), &error);
+    net_wait(*client, NET_WAIT_CONNECT, 0, -1);
+    net_wait(listener, NET_WAIT_ACCEPT, 0, -1);
+    *server = net_take_accepted(listener);
+    net_close(listener);
+}
+
+static void send_bytes(NetConn* c, const char* p, size_t n) {
+    struct iovec iov = {(void*)p, n};
+    net_send(c, &iov, 1);
+}
+
+static void latency(NetConn* client, NetConn* server) {
+    char message[MESSAGE];
+    memset(message, 'x', sizeof(message));
+    double start = net_now_ms();
+    for (int i = 0; i < ROUND_TRIPS; i++) {
+        send_bytes(client, message, MESSAGE);
+        net_wait(server, NET_WAIT_INPUT, MESSAGE, -1);
+        netbuf_consume(&server->in, MESSAGE);
+        send_bytes(server, message, MESSAGE);
+        net_wait(client, NET_WAIT_INPUT, MESSAGE, -1);
+        netbuf_consume(&client->in, MESSAGE);
+    }
+    double ms = net_now_ms() - start;
+    printf("round trip, %d bytes:    %8.1f us\n", MESSAGE, ms * 1000.0 / ROUND_TRIPS);
+}
+
+static void throughput(NetConn* client, NetConn* server) {
+    char* chunk = (char*)malloc(STREAM_CHUNK);
+    memset(chunk, 'y', STREAM_CHUNK);
+    size_t received = 0;
+    double start = net_now_ms();
+    for (size_t sent = 0; sent < STREAM_BYTES; sent += STREAM_CHUNK) {
+        send_bytes(client, chunk, STREAM_CHUNK);
+        // Drain as we go so the output queue stays short
+        while (netbuf_size(&client->out) > STREAM_CHUNK) net_poll(-1);
+        received += netbuf_size(&server->in);
+        netbuf_consume(&server->in, netbuf_size(&server->in));
+    }
+    while (received < STREAM_BYTES) {
+        net_wait(server, NET_WAIT_INPUT, 1, -1);
+        received += netbuf_size(&server->in);
+        netbuf_consume(&server->in, netbuf_size(&server->in));
+    }
+    double ms = net_now_ms() - start;
+    printf("stream, %u MB:          %8.1f MB/s\n", STREAM_BYTES >> 20, (STREAM_BYTES >> 20) / (ms / 1000.0));
+    free(chunk);
+}
+
+// A reply in three pieces, as the web toolkit writes status, headers and body
+static const char status[] = "HTTP/1.1 200 OK\r\n";
+static const char headers[] = "Content-Type: text/plain\r\nContent-Length: 12\r\n\r\n";
+static const char body[] = "hello, world";
+
+static void drain(NetConn* server, size_t want) {
+    net_wait(server, NET_WAIT_INPUT, want, -1);
+    sink += netbuf_size(&server->in);
+    netbuf_consume(&server->in, netbuf_size(&server->in));
+}
+
+static void replies(NetConn* client, NetConn* server) {
+    size_t size = sizeof(status) + sizeof(headers) + sizeof(body) - 3;
+    double start = net_now_ms();
+    for (int i = 0; i < REPLIES; i++) {
+        if (write(client->fd, status, sizeof(status) - 1) < 0 ||
+            write(client->fd, headers, sizeof(headers) - 1) < 0 ||
+            write(client->fd, body, sizeof(body) - 1) < 0) break;
+        drain(server, size);
+    }
+    printf("reply, write per piece: %8.1f us\n", (net_now_ms() - start) * 1000.0 / REPLIES);
+    start = net_now_ms();
+    for (int i = 0; i < REPLIES; i++) {
+        struct iovec iov[3] = {
+            {(void*)status, sizeof(status) - 1},
+            {(void*)headers, sizeof(headers) - 1},
+            {(void*)body, sizeof(body) - 1},
+        };
+        net_send(client, iov, 3);
+        drain(server, size);
+    }
+    printf("reply, gathered send:   %8.1f us\n", (net_now_ms() - start) * 1000.0 / REPLIES);
+}
+
+int main(void) {
+    NetConn* client;
+    NetConn* server;
+    open_pair(&client, &server);
+    latency(client, server);
+    throughput(client, server);
+    replies(client, server);
+    net_close(client);
+    net_close(server);
+    return 0;
+}
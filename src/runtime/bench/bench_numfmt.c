@@ -0,0 +1,66 @@
+// Microbenchmark: numfmt.h against the printf family. "printf %.17g" is
+// the cheapest printf call that always round-trips; "printf shortest"
+// tries increasing precisions until strtod reads the value back, which is
+// what printing the shortest form costs without a dedicated algorithm.
+//
+// Build and run from src/runtime:
+//   gcc -O2 -o bench_numfmt bench/bench_numfmt.c && ./bench_numfmt
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../numfmt.h"
+
+#define COUNT 1000000
+
+static double elapsed_ms(clock_t start) {
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+// Keeps the compiler from discarding the results
+static volatile size_t sink;
+
+static int printf_shortest(char* out, double d) {
+    int n = 0;
+    for (int precision = 1; precision <= 17; precision++) {
+        n = snprintf(out, 32, "%.*g", precision, d);
+        if (strtod(out, NULL) == d) break;
+    }
+    return n;
+}
+
+int main(void) {
+    double* doubles = (double*)malloc(COUNT * sizeof(double));
+    int64_t* ints = (int64_t*)malloc(COUNT * sizeof(int64_t));
+    srand(42);
+    for (int i = 0; i < COUNT; i++) {
+        doubles[i] = (double)rand() / RAND_MAX * 1000.0;
+        ints[i] = ((int64_t)rand() << 16) ^ rand();
+    }
+    char buf[64];
+    printf("%d values\n", COUNT);
+
+    clock_t start = clock();
+    for (int i = 0; i < COUNT; i++) sink += snprintf(buf, sizeof(buf), "%.17g", doubles[i]);
+    printf("double printf %%.17g    %8.1f ms\n", elapsed_ms(start));
+
+    start = clock();
+    for (int i = 0; i < COUNT; i++) sink += printf_shortest(buf, doubles[i]);
+    printf("double printf shortest %8.1f ms\n", elapsed_ms(start));
+
+    start = clock();
+    for (int i = 0; i < COUNT; i++) sink += numfmt_double(buf, doubles[i]);
+    printf("double numfmt          %8.1f ms\n", elapsed_ms(start));
+
+    start = clock();
+    for (int i = 0; i < COUNT; i++) sink += snprintf(buf, sizeof(buf), "%lld", (long long)ints[i]);
+    printf("int    printf %%lld     %8.1f ms\n", elapsed_ms(start));
+
+    start = clock();
+    for (int i = 0; i < COUNT; i++) sink += numfmt_int(buf, ints[i]);
+    printf("int    numfmt          %8.1f ms\n", elapsed_ms(start));
+
+    free(doubles);
+    free(ints);
+    return sink == 42 ? 1 : 0;
+}
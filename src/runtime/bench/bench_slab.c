@@ -0,0 +1,103 @@
+// Microbenchmark: malloc/free versus the slab pools in slab.h for the two
+// allocation patterns that dominate the interpreter:
+//   - Value structs: a short burst of temporaries released in LIFO order
+//   - Scopes: a Scope plus its initial symbol array, created and destroyed
+//     once per loop iteration by NODE_EACH
+//
+// Build and run from src/runtime:
+//   gcc -O2 -o bench_slab bench/bench_slab.c && ./bench_slab
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../slab.h"
+
+// Mirror the sizes of the structs in main.c
+typedef struct { int type; union { double number; void* ptrs[3]; } as; } BenchValue;
+typedef struct { void* parent; void* symbols; int count; int capacity; } BenchScope;
+typedef struct { char* name; void* value; int is_constant; } BenchSymbol;
+
+#define ROUNDS 2000000
+#define BURST 16
+#define SCOPE_SYMBOLS 10
+
+static SlabCache value_slab;
+static SlabCache scope_slab;
+static SlabCache symbol_slab;
+
+static double elapsed_ms(clock_t start) {
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+// Keeps the compiler from discarding the allocations
+static volatile unsigned long sink;
+
+static double bench_values_malloc(void) {
+    BenchValue* live[BURST];
+    clock_t start = clock();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < BURST; i++) {
+            live[i] = (BenchValue*)malloc(sizeof(BenchValue));
+            live[i]->type = i;
+        }
+        for (int i = BURST - 1; i >= 0; i--) {
+            sink += (unsigned long)live[i]->type;
+            free(live[i]);
+        }
+    }
+    return elapsed_ms(start);
+}
+
+static double bench_values_slab(void) {
+    BenchValue* live[BURST];
+    clock_t start = clock();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < BURST; i++) {
+            live[i] = (BenchValue*)slab_alloc(&value_slab, sizeof(BenchValue));
+            live[i]->type = i;
+        }
+        for (int i = BURST - 1; i >= 0; i--) {
+            sink += (unsigned long)live[i]->type;
+            slab_free(&value_slab, live[i]);
+        }
+    }
+    return elapsed_ms(start);
+}
+
+static double bench_scopes_malloc(void) {
+    clock_t start = clock();
+    for (int r = 0; r < ROUNDS * 4; r++) {
+        BenchScope* scope = (BenchScope*)malloc(sizeof(BenchScope));
+        scope->symbols = malloc(SCOPE_SYMBOLS * sizeof(BenchSymbol));
+        scope->count = r;
+        sink += (unsigned long)scope->count;
+        free(scope->symbols);
+        free(scope);
+    }
+    return elapsed_ms(start);
+}
+
+static double bench_scopes_slab(void) {
+    clock_t start = clock();
+    for (int r = 0; r < ROUNDS * 4; r++) {
+        BenchScope* scope = (BenchScope*)slab_alloc(&scope_slab, sizeof(BenchScope));
+        scope->symbols = slab_alloc(&symbol_slab, SCOPE_SYMBOLS * sizeof(BenchSymbol));
+        scope->count = r;
+        sink += (unsigned long)scope->count;
+        slab_free(&symbol_slab, scope->symbols);
+        slab_free(&scope_slab, scope);
+    }
+    return elapsed_ms(start);
+}
+
+static void report(const char* name, double base_ms, double slab_ms) {
+    printf("%-8s malloc %8.1f ms   slab %8.1f ms   speedup %.2fx\n",
+           name, base_ms, slab_ms, slab_ms > 0 ? base_ms / slab_ms : 0.0);
+}
+
+int main(void) {
+    report("values", bench_values_malloc(), bench_values_slab());
+    report("scopes", bench_scopes_malloc(), bench_scopes_slab());
+    return sink == 42 ? 1 : 0;
+}
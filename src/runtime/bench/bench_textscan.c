@@ -0,0 +1,75 @@
+// Microbenchmark: substring search in textscan.h over log-like text,
+// against the C library's strstr and a byte-at-a-time loop.
+//
+// Build and run from src/runtime:
+//   gcc -O2 -o bench_textscan bench/bench_textscan.c && ./bench_textscan
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../textscan.h"
+
+#define SIZE (64 << 20)
+#define ROUNDS 10
+
+static double elapsed_ms(clock_t start) {
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+// Keeps the compiler from discarding the results
+static volatile size_t sink;
+
+static size_t find_bytewise(const char* h, size_t n, const char* s, size_t m) {
+    for (size_t i = 0; i + m <= n; i++) {
+        size_t j = 0;
+        while (j < m && h[i + j] == s[j]) j++;
+        if (j == m) return i;
+    }
+    return SCAN_NONE;
+}
+
+typedef size_t (*FindFn)(const char*, size_t, const char*, size_t);
+
+static size_t find_strstr(const char* h, size_t n, const char* s, size_t m) {
+    const char* p = strstr(h, s);
+    return p ? (size_t)(p - h) : SCAN_NONE;
+}
+
+static void bench_find(const char* name, FindFn fn, const char* h, const char* s) {
+    clock_t start = clock();
+    for (int r = 0; r < ROUNDS; r++) sink += fn(h, SIZE, s, strlen(s));
+    printf("%-9s %-14s %8.1f ms\n", name, s, elapsed_ms(start));
+}
+
+int main(void) {
+    static const char* words[] = {"GET", "POST", "/index", "/api/v1/items", "200", "404", "user=", "ms"};
+    char* h = (char*)malloc(SIZE + 1);
+    size_t pos = 0;
+    srand(1);
+    while (pos < SIZE) {
+        const char* w = words[rand() % 8];
+        size_t n = strlen(w);
+        if (pos + n + 1 > SIZE) break;
+        memcpy(h + pos, w, n);
+        pos += n;
+        h[pos++] = rand() % 10 ? ' ' : '\n';
+    }
+    while (pos < SIZE) h[pos++] = ' ';
+    h[SIZE] = '\0';
+    // Needles that never occur, so each call scans the whole text
+    const char* needles[] = {"timeout", "status=500"};
+    printf("%d MB x %d rounds\n", SIZE >> 20, ROUNDS);
+    for (int i = 0; i < 2; i++) {
+        bench_find("bytewise", find_bytewise, h, needles[i]);
+        bench_find("strstr", find_strstr, h, needles[i]);
+        bench_find("scalar", scan_find_scalar, h, needles[i]);
+#ifdef KERNELS_SSE2
+        bench_find("sse2", scan_find_sse2, h, needles[i]);
+#endif
+#ifdef KERNELS_AVX2
+        if (kernels_use_avx2()) bench_find("avx2", scan_find_avx2, h, needles[i]);
+#endif
+    }
+    free(h);
+    return sink == 42 ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+// Load generator for the web toolkit: keep-alive HTTP/1.1 clients on
+// 127.0.0.1, each with a number of requests pipelined at a time. Reports
+// requests per second and the mean time from sending a batch to receiving
+// its last response.
+//
+// Build from src/runtime and run against bench/bench_web.bpl:
+//   gcc -O2 -o bench_web bench/bench_web.c
+//   ./bpl bench/bench_web.bpl.json &  ./bench_web [port] [connections] [requests] [pipeline]
+//
+// For comparison, starting the runtime once per request (what a
+// process-per-request wrapper does) costs at least the time of
+//   ./bpl some_script.bpl.json
+// per request.
+
+#define _GNU_SOURCE  // memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include "../netloop.h"
+
+static const char request[] = "GET /?n=1 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+typedef struct {
+    NetConn* conn;
+    int sent;
+    int pending;       // requests in the current pipelined batch still unanswered
+    double batch_start;
+} Client;
+
+// Consumes complete responses from the front of the input; returns how many
+static int take_responses(NetConn* c) {
+    int count = 0;
+    for (;;) {
+        const char* data = c->in.data + c->in.start;
+        size_t size = netbuf_size(&c->in);
+        const char* end = size ? memmem(data, size, "\r\n\r\n", 4) : NULL;
+        if (!end) return count;
+        size_t head = (size_t)(end - data) + 4;
+        const char* length = memmem(data, head, "Content-Length: ", 16);
+        size_t body = length ? strtoul(length + 16, NULL, 10) : 0;
+        if (size < head + body) return count;
+        netbuf_consume(&c->in, head + body);
+        count++;
+    }
+}
+
+static void send_batch(Client* client, int pipeline, int requests) {
+    int n = requests - client->sent < pipeline ? requests - client->sent : pipeline;
+    struct iovec iov[64];
+    for (int i = 0; i < n; i++) {
+        iov[i].iov_base = (void*)request;
+        iov[i].iov_len = sizeof(request) - 1;
+    }
+    net_send(client->conn, iov, n);
+    client->sent += n;
+    client->pending = n;
+    client->batch_start = net_now_ms();
+}
+
+int main(int argc, char** argv) {
+    int port = argc > 1 ? atoi(argv[1]) : 8088;
+    int connections = argc > 2 ? atoi(argv[2]) : 16;
+    int requests = argc > 3 ? atoi(argv[3]) : 10000;   // per connection
+    int pipeline = argc > 4 ? atoi(argv[4]) : 1;
+    if (pipeline < 1) pipeline = 1;
+    if (pipeline > 64) pipeline = 64;
+
+    Client* clients = (Client*)calloc(connections, sizeof(Client));
+    for (int i = 0; i < connections; i++) {
+        int error = 0;
+        clients[i].conn = net_connect("127.0.0.1", port, &error);
+        if (!clients[i].conn || !net_wait(clients[i].conn, NET_WAIT_CONNECT, 0, 5000) || clients[i].conn->error) {
+            fprintf(stderr, "cannot connect to port %d\n", port);
+            return 1;
+        }
+    }
+
+    double start = net_now_ms();
+    double latency_total = 0;
+    long batches = 0;
+    long done = 0;
+    long total = (long)connections * requests;
+    for (int i = 0; i < connections; i++) send_batch(&clients[i], pipeline, requests);
+    while (done < total) {
+        net_poll(-1);
+        for (int i = 0; i < connections; i++) {
+            Client* client = &clients[i];
+            if (client->pending == 0) continue;
+            int got = take_responses(client->conn);
+            if (client->conn->eof || client->conn->error) {
+                fprintf(stderr, "server closed the connection\n");
+                return 1;
+            }
+            client->pending -= got;
+            done += got;
+            if (client->pending == 0) {
+                latency_total += net_now_ms() - client->batch_start;
+                batches++;
+                if (client->sent < requests) send_batch(client, pipeline, requests);
+            }
+        }
+    }
+    double seconds = (net_now_ms() - start) / 1000.0;
+    printf("%d connections x %d requests, pipeline %d\n", connections, requests, pipeline);
+    printf("requests/s:   %10.0f\n", total / seconds);
+    printf("batch time:   %10.1f us\n", latency_total * 1000.0 / batches);
+    for (int i = 0; i < connections; i++) net_close(clients[i].conn);
+    free(clients);
+    return 0;
+}
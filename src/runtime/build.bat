@@ -1 +1,4 @@
-gcc -o main.exe main.c ../../third_party/cJSON/cJSON.c -I../../third_party/cJSON -lm
\ No newline at end of file
+gcc -o main.exe main.c ../../third_party/cJSON/cJSON.c -I../../third_party/cJSON -lm
+gcc -c -DBEACON_LIBRARY -o beacon.o main.c -I../../third_party/cJSON
+gcc -c -o beacon_cjson.o ../../third_party/cJSON/cJSON.c -I../../third_party/cJSON
+ar rcs libbeacon.a beacon.o beacon_cjson.o
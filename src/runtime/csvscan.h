@@ -0,0 +1,126 @@
+#ifndef BEACON_CSVSCAN_H
+#define BEACON_CSVSCAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kernels.h"
+
+// Field scanning behind the csv toolkit.
+//
+// Outside quotes, the only bytes that matter to a CSV parser are the
+// delimiter, the quote and line breaks; everything else is field content.
+// csv_scan() finds the next of those four, comparing 16 (SSE2) or 32 (AVX2)
+// bytes at a time and turning the matches into a bit mask, so ordinary
+// field text is skipped at close to memory speed. Inside quotes only the
+// closing quote matters, which memchr finds. AVX2 is chosen at run time as
+// in kernels.h.
+//
+// Also here: csv_number(), which recognises a field that is a plain decimal
+// number and converts it without a copy for the common case of integers.
+
+// --- scalar -----------------------------------------------------------------
+
+static inline bool csv_is_special(char c, char delim) {
+    return c == delim || c == '"' || c == '\n' || c == '\r';
+}
+
+static inline size_t csv_scan_scalar(const char* p, size_t n, char delim) {
+    for (size_t i = 0; i < n; i++) {
+        if (csv_is_special(p[i], delim)) return i;
+    }
+    return n;
+}
+
+// --- SSE2 -------------------------------------------------------------------
+
+#ifdef KERNELS_SSE2
+static inline size_t csv_scan_sse2(const char* p, size_t n, char delim) {
+    const __m128i d = _mm_set1_epi8(delim);
+    const __m128i q = _mm_set1_epi8('"');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, d), _mm_cmpeq_epi8(x, q)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, cr)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask) return i + (unsigned)__builtin_ctz(mask);
+    }
+    return i + csv_scan_scalar(p + i, n - i, delim);
+}
+#endif
+
+// --- AVX2 -------------------------------------------------------------------
+
+#ifdef KERNELS_AVX2
+KERNELS_TARGET_AVX2
+static size_t csv_scan_avx2(const char* p, size_t n, char delim) {
+    const __m256i d = _mm256_set1_epi8(delim);
+    const __m256i q = _mm256_set1_epi8('"');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, d), _mm256_cmpeq_epi8(x, q)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(x, lf), _mm256_cmpeq_epi8(x, cr)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask) return i + (unsigned)__builtin_ctz(mask);
+    }
+    return i + csv_scan_scalar(p + i, n - i, delim);
+}
+#endif
+
+// --- dispatch ---------------------------------------------------------------
+
+// Offset of the first delimiter, quote or line break in p[0..n), or n
+static inline size_t csv_scan(const char* p, size_t n, char delim) {
+#ifdef KERNELS_AVX2
+    if (kernels_use_avx2()) return csv_scan_avx2(p, n, delim);
+#endif
+#ifdef KERNELS_SSE2
+    return csv_scan_sse2(p, n, delim);
+#else
+    return csv_scan_scalar(p, n, delim);
+#endif
+}
+
+// --- numbers ----------------------------------------------------------------
+
+#define CSV_NUMBER_MAX 64  // longer fields are never numbers
+
+// Whether p[0..n) is a decimal number (optional sign, digits, fraction,
+// exponent), and its value. Integers of up to 18 digits are converted
+// directly; everything else goes through strtod on a terminated copy.
+static inline bool csv_number(const char* p, size_t n, double* out) {
+    if (n == 0 || n >= CSV_NUMBER_MAX) return false;
+    size_t i = (p[0] == '-' || p[0] == '+') ? 1 : 0;
+    if (i == n) return false;
+    if (n - i <= 18) {
+        int64_t v = 0;
+        size_t j = i;
+        while (j < n && p[j] >= '0' && p[j] <= '9') v = v * 10 + (p[j++] - '0');
+        if (j == n) {
+            *out = (double)(p[0] == '-' ? -v : v);
+            return true;
+        }
+    }
+    bool digits = false;
+    for (size_t j = i; j < n; j++) {
+        char c = p[j];
+        if (c >= '0' && c <= '9') digits = true;
+        else if (c != '.' && c != 'e' && c != 'E' && c != '-' && c != '+') return false;
+    }
+    if (!digits) return false;
+    char buf[CSV_NUMBER_MAX];
+    memcpy(buf, p, n);
+    buf[n] = '\0';
+    char* end;
+    *out = strtod(buf, &end);
+    return end == buf + n;
+}
+
+#endif
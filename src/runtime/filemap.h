@@ -0,0 +1,105 @@
+#ifndef BEACON_FILEMAP_H
+#define BEACON_FILEMAP_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Whole-file reads for the file toolkit and lines().
+//
+// Regular files of FILEMAP_MIN_SIZE bytes or more are mapped read-only
+// with mmap, so nothing is read until a page is touched and a multi-GB log
+// costs address space rather than memory. The mapping is advised as
+// sequential, which lets the kernel read ahead of a line-by-line scan.
+// Smaller files (where a mapping costs more than one read) and platforms
+// without mmap get a single read into a malloc'd buffer. Pipes, terminals
+// and other non-regular files are left to the caller to stream.
+//
+// The contents are not terminated: callers keep the size alongside.
+
+#ifndef _WIN32
+#define FILEMAP_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#define FILEMAP_MIN_SIZE (64 * 1024)
+
+typedef enum {
+    FILEMAP_OK,
+    FILEMAP_MISSING,     // could not be opened
+    FILEMAP_NOT_REGULAR  // a pipe, device or directory
+} FileMapStatus;
+
+typedef struct {
+    char* data;
+    size_t size;
+    bool mapped;         // release with filemap_release, not free
+} FileMap;
+
+static FileMapStatus filemap_open(const char* path, FileMap* map) {
+    map->data = NULL;
+    map->size = 0;
+    map->mapped = false;
+#ifdef FILEMAP_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return FILEMAP_MISSING;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return FILEMAP_NOT_REGULAR;
+    }
+    map->size = (size_t)st.st_size;
+    if (map->size >= FILEMAP_MIN_SIZE) {
+        void* data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, map->size, MADV_SEQUENTIAL);
+            close(fd);
+            map->data = (char*)data;
+            map->mapped = true;
+            return FILEMAP_OK;
+        }
+    }
+    map->data = (char*)malloc(map->size + 1);
+    size_t done = 0;
+    while (done < map->size) {
+        ssize_t n = read(fd, map->data + done, map->size - done);
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    close(fd);
+    map->size = done;
+    return FILEMAP_OK;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return FILEMAP_MISSING;
+    if (!(st.st_mode & S_IFREG)) return FILEMAP_NOT_REGULAR;
+    FILE* file = fopen(path, "rb");
+    if (!file) return FILEMAP_MISSING;
+    map->data = (char*)malloc((size_t)st.st_size + 1);
+    map->size = fread(map->data, 1, (size_t)st.st_size, file);
+    fclose(file);
+    return FILEMAP_OK;
+#endif
+}
+
+static void filemap_release(char* data, size_t size, bool mapped) {
+#ifdef FILEMAP_MMAP
+    if (mapped) {
+        munmap(data, size);
+        return;
+    }
+#endif
+    free(data);
+}
+
+static bool filemap_exists(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+#endif
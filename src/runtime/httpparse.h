@@ -0,0 +1,181 @@
+#ifndef BEACON_HTTPPARSE_H
+#define BEACON_HTTPPARSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// HTTP/1.1 request parsing behind the web toolkit.
+//
+// http_parse_request() reads a request head straight out of a connection's
+// input buffer. The method, target and every header are slices (pointer
+// and length) into that buffer, kept in a fixed array inside HttpRequest,
+// so parsing allocates nothing however many headers arrive; the caller
+// copies out what it keeps before the buffer moves on. Incomplete input is
+// not an error: the parser says so and is simply run again once more bytes
+// have arrived, which is also how pipelined requests are taken one after
+// another from the same buffer.
+//
+// Request bodies are sized by Content-Length. Chunked request bodies are
+// refused (501), as are heads over HTTP_MAX_HEAD bytes or with more than
+// HTTP_MAX_HEADERS headers (431).
+
+#define HTTP_MAX_HEADERS 64
+#define HTTP_MAX_HEAD (64 * 1024)
+#define HTTP_MAX_BODY (64u << 20)
+
+typedef struct {
+    const char* name;
+    size_t name_len;
+    const char* value;
+    size_t value_len;
+} HttpHeader;
+
+typedef struct {
+    const char* method;
+    size_t method_len;
+    const char* target;
+    size_t target_len;
+    int minor_version;       // HTTP/1.x
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    int num_headers;
+    size_t head_length;      // bytes up to and including the blank line
+    size_t content_length;
+    bool keep_alive;
+} HttpRequest;
+
+typedef enum {
+    HTTP_INCOMPLETE = 0,
+    HTTP_OK = 1,
+    HTTP_BAD = 400,
+    HTTP_TOO_LARGE = 413,
+    HTTP_HEADERS_TOO_LARGE = 431,
+    HTTP_NOT_IMPLEMENTED = 501
+} HttpStatus;
+
+static inline bool http_token_equals(const char* p, size_t n, const char* lower) {
+    size_t m = strlen(lower);
+    if (n != m) return false;
+    for (size_t i = 0; i < n; i++) {
+        char c = p[i];
+        if (c >= 'A' && c <= 'Z') c = (char)(c + 32);
+        if (c != lower[i]) return false;
+    }
+    return true;
+}
+
+// Whether a comma-separated header value lists the token, e.g. "close" in
+// "Connection: keep-alive, close"
+static inline bool http_value_has(const char* p, size_t n, const char* lower) {
+    size_t i = 0;
+    while (i < n) {
+        while (i < n && (p[i] == ' ' || p[i] == '\t' || p[i] == ',')) i++;
+        size_t start = i;
+        while (i < n && p[i] != ',') i++;
+        size_t end = i;
+        while (end > start && (p[end - 1] == ' ' || p[end - 1] == '\t')) end--;
+        if (http_token_equals(p + start, end - start, lower)) return true;
+    }
+    return false;
+}
+
+// One line ending in \n (the \r before it is optional); NULL if the line
+// is not complete yet
+static inline const char* http_line(const char* p, const char* end, size_t* len) {
+    const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+    if (!nl) return NULL;
+    *len = (size_t)(nl - p);
+    if (*len > 0 && p[*len - 1] == '\r') (*len)--;
+    return nl + 1;
+}
+
+// Parses the request head at the start of p[0..n). HTTP_OK fills req;
+// HTTP_INCOMPLETE means more bytes are needed; anything else is the status
+// to refuse the request with.
+static HttpStatus http_parse_request(const char* p, size_t n, HttpRequest* req) {
+    const char* end = p + (n < HTTP_MAX_HEAD ? n : HTTP_MAX_HEAD);
+    const char* cursor = p;
+    size_t len;
+    // Blank lines before a request are allowed (RFC 9112, 2.2)
+    const char* next;
+    while ((next = http_line(cursor, end, &len)) && len == 0) cursor = next;
+    if (!next) return n >= HTTP_MAX_HEAD ? HTTP_HEADERS_TOO_LARGE : HTTP_INCOMPLETE;
+
+    // Request line: method SP target SP HTTP/1.x
+    const char* line = cursor;
+    const char* sp1 = (const char*)memchr(line, ' ', len);
+    const char* sp2 = sp1 ? (const char*)memchr(sp1 + 1, ' ', len - (size_t)(sp1 + 1 - line)) : NULL;
+    if (!sp1 || !sp2 || sp1 == line || sp2 == sp1 + 1) return HTTP_BAD;
+    size_t version_len = len - (size_t)(sp2 + 1 - line);
+    if (version_len != 8 || memcmp(sp2 + 1, "HTTP/1.", 7) != 0 || sp2[8] < '0' || sp2[8] > '9') return HTTP_BAD;
+    req->method = line;
+    req->method_len = (size_t)(sp1 - line);
+    req->target = sp1 + 1;
+    req->target_len = (size_t)(sp2 - sp1 - 1);
+    req->minor_version = sp2[8] - '0';
+    req->keep_alive = req->minor_version >= 1;
+    req->content_length = 0;
+    req->num_headers = 0;
+    cursor = next;
+
+    for (;;) {
+        next = http_line(cursor, end, &len);
+        if (!next) return n >= HTTP_MAX_HEAD ? HTTP_HEADERS_TOO_LARGE : HTTP_INCOMPLETE;
+        if (len == 0) break;
+        const char* colon = (const char*)memchr(cursor, ':', len);
+        if (!colon || colon == cursor) return HTTP_BAD;
+        if (req->num_headers == HTTP_MAX_HEADERS) return HTTP_HEADERS_TOO_LARGE;
+        HttpHeader* h = &req->headers[req->num_headers++];
+        h->name = cursor;
+        h->name_len = (size_t)(colon - cursor);
+        const char* value = colon + 1;
+        const char* value_end = cursor + len;
+        while (value < value_end && (*value == ' ' || *value == '\t')) value++;
+        while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+        h->value = value;
+        h->value_len = (size_t)(value_end - value);
+
+        if (http_token_equals(h->name, h->name_len, "content-length")) {
+            size_t length = 0;
+            if (h->value_len == 0) return HTTP_BAD;
+            for (size_t i = 0; i < h->value_len; i++) {
+                if (h->value[i] < '0' || h->value[i] > '9') return HTTP_BAD;
+                length = length * 10 + (size_t)(h->value[i] - '0');
+                if (length > HTTP_MAX_BODY) return HTTP_TOO_LARGE;
+            }
+            req->content_length = length;
+        } else if (http_token_equals(h->name, h->name_len, "transfer-encoding")) {
+            return HTTP_NOT_IMPLEMENTED;
+        } else if (http_token_equals(h->name, h->name_len, "connection")) {
+            if (http_value_has(h->value, h->value_len, "close")) req->keep_alive = false;
+            else if (http_value_has(h->value, h->value_len, "keep-alive")) req->keep_alive = true;
+        }
+        cursor = next;
+    }
+    req->head_length = (size_t)(next - p);
+    return HTTP_OK;
+}
+
+static const char* http_reason(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Content Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return status < 300 ? "OK" : status < 400 ? "Redirect" : status < 500 ? "Client Error" : "Server Error";
+    }
+}
+
+#endif
@@ -0,0 +1,475 @@
+#ifndef BEACON_IOQUEUE_H
+#define BEACON_IOQUEUE_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "workers.h"
+
+// Asynchronous whole-file reads and writes behind the io toolkit.
+//
+// ioq_read() and ioq_write() start an operation and return at once; the
+// interpreter carries on and collects the result later with ioq_wait() (one
+// operation) or ioq_wait_all() (everything in flight, which is what hold
+// does). A script that reads thousands of files can therefore keep many
+// transfers going at the same time instead of waiting for each in turn.
+//
+// On Linux the transfers go through io_uring, driven with raw system calls
+// so no liburing is needed: each operation is a read or write entry in the
+// submission ring, completions are reaped from the completion ring, and
+// short transfers are resubmitted for the remainder. Where io_uring is
+// missing or blocked (older kernels, seccomp'd containers, or
+// BEACON_NO_URING set), a pool of IOQ_THREADS I/O threads performs the
+// transfers with blocking calls instead. Opening the file and sizing a read
+// happen on the caller's thread; pipes and devices, whose size is unknown,
+// are read right there. Other systems run every operation synchronously.
+
+#ifndef _WIN32
+#define IOQ_ASYNC 1
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(IOQ_ASYNC) && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define IOQ_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define IOQ_THREADS 4
+#define IOQ_RING_ENTRIES 256
+#define IOQ_MAX_CHUNK (1u << 30)  // largest single transfer
+
+typedef enum { IOQ_READ, IOQ_WRITE } IoqKind;
+
+typedef struct IoqOp {
+    IoqKind kind;
+    int fd;
+    char* data;          // a read's buffer (terminated when done), or the bytes to write
+    size_t length;       // bytes to transfer; a read's is its final size once done
+    size_t transferred;
+    int error;           // errno of a failure, 0 on success
+    int finished;
+    struct IoqOp* next;  // I/O thread queue
+} IoqOp;
+
+#ifdef IOQ_URING
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned inflight;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+} IoqRing;
+#endif
+
+typedef struct {
+    WorkerLock lock;
+    WorkerCond wake;     // the I/O threads have work
+    WorkerCond done;     // an operation finished
+    bool started;
+    bool use_ring;
+#ifdef IOQ_URING
+    IoqRing ring;
+#endif
+    IoqOp* queue_head;
+    IoqOp* queue_tail;
+    int unfinished;      // submitted to the I/O threads and not finished
+} IoQueue;
+
+static IoQueue io_queue;
+
+#ifdef IOQ_ASYNC
+static pthread_once_t ioq_once = PTHREAD_ONCE_INIT;
+#endif
+
+static inline bool ioq_finished(IoqOp* op) {
+#if defined(__GNUC__)
+    return __atomic_load_n(&op->finished, __ATOMIC_ACQUIRE);
+#else
+    return op->finished;
+#endif
+}
+
+// Closes the file and publishes the result
+static void ioq_finish(IoqOp* op) {
+#ifdef IOQ_ASYNC
+    if (op->fd >= 0) close(op->fd);
+#endif
+    op->fd = -1;
+    if (op->kind == IOQ_READ) {
+        op->length = op->transferred;
+        op->data[op->length] = '\0';
+    }
+#if defined(__GNUC__)
+    __atomic_store_n(&op->finished, 1, __ATOMIC_RELEASE);
+#else
+    op->finished = 1;
+#endif
+}
+
+// --- blocking transfers -------------------------------------------------------
+
+#ifdef IOQ_ASYNC
+static void ioq_transfer(IoqOp* op) {
+    while (op->transferred < op->length) {
+        size_t left = op->length - op->transferred;
+        if (left > IOQ_MAX_CHUNK) left = IOQ_MAX_CHUNK;
+        ssize_t n = op->kind == IOQ_READ
+            ? pread(op->fd, op->data + op->transferred, left, (off_t)op->transferred)
+            : pwrite(op->fd, op->data + op->transferred, left, (off_t)op->transferred);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            op->error = errno;
+            break;
+        }
+        if (n == 0) break;  // the file shrank
+        op->transferred += (size_t)n;
+    }
+}
+
+static void* ioq_thread_main(void* arg) {
+    IoQueue* q = (IoQueue*)arg;
+    worker_lock(&q->lock);
+    for (;;) {
+        while (!q->queue_head) worker_wait(&q->wake, &q->lock);
+        IoqOp* op = q->queue_head;
+        q->queue_head = op->next;
+        if (!q->queue_head) q->queue_tail = NULL;
+        worker_unlock(&q->lock);
+        ioq_transfer(op);
+        worker_lock(&q->lock);
+        ioq_finish(op);
+        q->unfinished--;
+        worker_broadcast(&q->done);
+    }
+    return NULL;
+}
+#endif
+
+// --- io_uring -----------------------------------------------------------------
+
+#ifdef IOQ_URING
+static int ioq_ring_enter(IoqRing* r, unsigned submit, unsigned wait) {
+    return (int)syscall(__NR_io_uring_enter, r->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Needs IORING_OP_READ and IORING_OP_WRITE (Linux 5.6)
+static bool ioq_ring_supported(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+    bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+              probe->last_op >= IORING_OP_WRITE &&
+              (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+              (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+static bool ioq_ring_setup(IoqRing* r) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, IOQ_RING_ENTRIES, &p);
+    if (fd < 0) return false;
+    if (!ioq_ring_supported(fd)) {
+        close(fd);
+        return false;
+    }
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && cq_size > sq_size) sq_size = cq_size;
+    char* sq = (char*)mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    char* cq = single ? sq : (char*)mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    r->fd = fd;
+    r->entries = p.sq_entries;
+    r->inflight = 0;
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->sqes = (struct io_uring_sqe*)sqes;
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return true;
+}
+
+// Queues the next transfer of op; io_uring_enter submits it
+static void ioq_ring_push(IoqRing* r, IoqOp* op) {
+    unsigned tail = *r->sq_tail;
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[index];
+    size_t left = op->length - op->transferred;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op->kind == IOQ_READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = op->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(op->data + op->transferred);
+    sqe->len = left > IOQ_MAX_CHUNK ? IOQ_MAX_CHUNK : (unsigned)left;
+    sqe->off = op->transferred;
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    r->sq_array[index] = index;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->inflight++;
+}
+
+// Handles every completion posted so far
+static void ioq_ring_reap(IoqRing* r) {
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned resubmit = 0;
+    for (; head != tail; head++) {
+        struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+        IoqOp* op = (IoqOp*)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        r->inflight--;
+        if (res == -EINTR || res == -EAGAIN) {
+            ioq_ring_push(r, op);
+            resubmit++;
+            continue;
+        }
+        if (res < 0) {
+            op->error = -res;
+        } else {
+            op->transferred += (size_t)res;
+            if (res > 0 && op->transferred < op->length) {
+                // Short transfer: go again for the rest
+                ioq_ring_push(r, op);
+                resubmit++;
+                continue;
+            }
+        }
+        ioq_finish(op);
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    if (resubmit) ioq_ring_enter(r, resubmit, 0);
+}
+#endif
+
+// --- setup ----------------------------------------------------------------------
+
+#ifdef IOQ_ASYNC
+static void ioq_start(void) {
+    IoQueue* q = &io_queue;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->wake, NULL);
+    pthread_cond_init(&q->done, NULL);
+    q->started = true;
+#ifdef IOQ_URING
+    if (!getenv("BEACON_NO_URING") && ioq_ring_setup(&q->ring)) {
+        q->use_ring = true;
+        return;
+    }
+#endif
+    for (int i = 0; i < IOQ_THREADS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, ioq_thread_main, q) != 0) break;
+        pthread_detach(thread);
+    }
+}
+#endif
+
+// "io_uring", "threads" or "sync"
+static const char* ioq_backend(void) {
+#ifdef IOQ_ASYNC
+    pthread_once(&ioq_once, ioq_start);
+    return io_queue.use_ring ? "io_uring" : "threads";
+#else
+    return "sync";
+#endif
+}
+
+// --- operations -----------------------------------------------------------------
+
+// Hands an opened operation to the backend
+static void ioq_submit(IoqOp* op) {
+#ifdef IOQ_ASYNC
+    if (ioq_finished(op)) return;
+    IoQueue* q = &io_queue;
+    worker_lock(&q->lock);
+#ifdef IOQ_URING
+    if (q->use_ring) {
+        // Keep at most one ring's worth in flight so completions never overflow
+        while (q->ring.inflight >= q->ring.entries) {
+            ioq_ring_enter(&q->ring, 0, 1);
+            ioq_ring_reap(&q->ring);
+        }
+        ioq_ring_push(&q->ring, op);
+        ioq_ring_enter(&q->ring, 1, 0);
+        worker_unlock(&q->lock);
+        return;
+    }
+#endif
+    if (q->queue_tail) q->queue_tail->next = op;
+    else q->queue_head = op;
+    q->queue_tail = op;
+    q->unfinished++;
+    worker_broadcast(&q->wake);
+    worker_unlock(&q->lock);
+#endif
+}
+
+static IoqOp* ioq_op_new(IoqKind kind) {
+    IoqOp* op = (IoqOp*)calloc(1, sizeof(IoqOp));
+    op->kind = kind;
+    op->fd = -1;
+    return op;
+}
+
+// Starts reading the whole of path; op->data is the contents once finished.
+// Failures show up as op->error when the operation finishes.
+static IoqOp* ioq_read(const char* path) {
+    IoqOp* op = ioq_op_new(IOQ_READ);
+#ifdef IOQ_ASYNC
+    ioq_backend();
+    op->fd = open(path, O_RDONLY);
+    struct stat st;
+    if (op->fd < 0 || fstat(op->fd, &st) != 0) {
+        op->error = errno;
+        op->data = (char*)malloc(1);
+        ioq_finish(op);
+        return op;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        // Unknown size: read it here until the end
+        size_t cap = 4096;
+        op->data = (char*)malloc(cap + 1);
+        ssize_t n;
+        while ((n = read(op->fd, op->data + op->transferred, cap - op->transferred)) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                op->error = errno;
+                break;
+            }
+            op->transferred += (size_t)n;
+            if (op->transferred == cap) {
+                cap *= 2;
+                op->data = (char*)realloc(op->data, cap + 1);
+            }
+        }
+        ioq_finish(op);
+        return op;
+    }
+    op->length = (size_t)st.st_size;
+    op->data = (char*)malloc(op->length + 1);
+    ioq_submit(op);
+#else
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        op->error = errno;
+        op->data = (char*)malloc(1);
+        ioq_finish(op);
+        return op;
+    }
+    fseek(file, 0, SEEK_END);
+    op->length = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    op->data = (char*)malloc(op->length + 1);
+    op->transferred = fread(op->data, 1, op->length, file);
+    fclose(file);
+    ioq_finish(op);
+#endif
+    return op;
+}
+
+// Starts replacing path's contents with the length bytes at data, which the
+// operation takes over
+static IoqOp* ioq_write(const char* path, char* data, size_t length) {
+    IoqOp* op = ioq_op_new(IOQ_WRITE);
+    op->data = data;
+    op->length = length;
+#ifdef IOQ_ASYNC
+    ioq_backend();
+    op->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (op->fd < 0) {
+        op->error = errno;
+        ioq_finish(op);
+    } else {
+        ioq_submit(op);
+    }
+#else
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        op->error = errno;
+    } else {
+        op->transferred = fwrite(data, 1, length, file);
+        fclose(file);
+    }
+    ioq_finish(op);
+#endif
+    return op;
+}
+
+// Polls for completions without blocking
+static bool ioq_ready(IoqOp* op) {
+#ifdef IOQ_URING
+    if (!ioq_finished(op) && io_queue.use_ring) {
+        worker_lock(&io_queue.lock);
+        ioq_ring_reap(&io_queue.ring);
+        worker_unlock(&io_queue.lock);
+    }
+#endif
+    return ioq_finished(op);
+}
+
+static void ioq_wait(IoqOp* op) {
+#ifdef IOQ_ASYNC
+    if (ioq_finished(op)) return;
+    IoQueue* q = &io_queue;
+    worker_lock(&q->lock);
+    while (!ioq_finished(op)) {
+#ifdef IOQ_URING
+        if (q->use_ring) {
+            ioq_ring_reap(&q->ring);
+            if (!ioq_finished(op)) ioq_ring_enter(&q->ring, 0, 1);
+            continue;
+        }
+#endif
+        worker_wait(&q->done, &q->lock);
+    }
+    worker_unlock(&q->lock);
+#endif
+}
+
+// Waits until nothing is in flight
+static void ioq_wait_all(void) {
+#ifdef IOQ_ASYNC
+    IoQueue* q = &io_queue;
+    if (!q->started) return;
+    worker_lock(&q->lock);
+#ifdef IOQ_URING
+    if (q->use_ring) {
+        ioq_ring_reap(&q->ring);
+        while (q->ring.inflight > 0) {
+            ioq_ring_enter(&q->ring, 0, 1);
+            ioq_ring_reap(&q->ring);
+        }
+    }
+#endif
+    while (q->unfinished > 0) worker_wait(&q->done, &q->lock);
+    worker_unlock(&q->lock);
+#endif
+}
+
+// Frees an operation, waiting for it first if it is still in flight
+static void ioq_free(IoqOp* op) {
+    ioq_wait(op);
+    free(op->data);
+    free(op);
+}
+
+#endif // BEACON_IOQUEUE_H
@@ -0,0 +1,310 @@
+#ifndef BEACON_JOBSERVER_H
+#define BEACON_JOBSERVER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Framing and output capture for the runtime's server mode (--serve).
+//
+// A long-lived runtime reads jobs from its standard input, or from clients
+// of a Unix socket, and runs each one without starting a new process. A
+// job is a header line followed by two payloads:
+//
+//   RUN <ast bytes> <input bytes> <path>\n<ast><input>
+//
+// With an AST length of 0 the job runs the AST JSON file at <path>; files
+// are parsed once and kept (see ast_cache in main.c). Otherwise the AST
+// JSON is the inline payload and <path> is only a label. The input payload
+// is what the job's ask reads. "QUIT\n" stops the server.
+//
+// While a job runs, its standard input is the input payload and its
+// standard output and error are pipes; a relay thread forwards what they
+// produce as it is written, in frames of
+//
+//   OUT <n>\n<n bytes>      ERR <n>\n<n bytes>
+//
+// followed by "END <status>\n" once the job has finished (status 0, or 1
+// if its AST could not be loaded). A malformed header, a payload over
+// JOB_PAYLOAD_MAX or one cut short gets an ERR frame and "END 1" instead. Between jobs, standard input and output
+// point at /dev/null so nothing stray lands in the protocol stream.
+//
+// The functions below exist only where the command-line runtime can serve
+// (JOB_SERVER); the library build (BEACON_LIBRARY) has no server mode.
+
+#ifndef _WIN32
+#ifndef BEACON_LIBRARY
+#define JOB_SERVER 1
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define JOB_HEADER_MAX 4096
+#define JOB_RELAY_CHUNK 16384
+#define JOB_PAYLOAD_MAX ((size_t)1 << 30)   // per payload
+
+typedef struct {
+    int in_fd;
+    int out_fd;
+    char buf[JOB_HEADER_MAX];
+    size_t start;
+    size_t end;
+    bool quit;          // QUIT was read
+} JobChannel;
+
+typedef struct {
+    char* path;
+    char* ast;          // inline AST JSON, or NULL to load path
+    size_t ast_len;
+    char* input;
+    size_t input_len;
+} JobRequest;
+
+static inline void job_request_free(JobRequest* req) {
+    free(req->path);
+    free(req->ast);
+    free(req->input);
+    memset(req, 0, sizeof(*req));
+}
+
+#ifdef JOB_SERVER
+
+static bool job_write_all(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+static bool job_write_frame(int fd, const char* kind, const char* p, size_t n) {
+    char head[48];
+    int len = snprintf(head, sizeof(head), "%s %zu\n", kind, n);
+    return job_write_all(fd, head, (size_t)len) && job_write_all(fd, p, n);
+}
+
+// Reads exactly n bytes, first from what is buffered
+static bool job_read_exact(JobChannel* ch, char* out, size_t n) {
+    size_t buffered = ch->end - ch->start;
+    size_t take = buffered < n ? buffered : n;
+    memcpy(out, ch->buf + ch->start, take);
+    ch->start += take;
+    while (take < n) {
+        ssize_t r = read(ch->in_fd, out + take, n - take);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        take += (size_t)r;
+    }
+    return true;
+}
+
+// The next header line, terminated in place; NULL at the end of input
+static char* job_read_line(JobChannel* ch) {
+    for (;;) {
+        char* nl = (char*)memchr(ch->buf + ch->start, '\n', ch->end - ch->start);
+        if (nl) {
+            char* line = ch->buf + ch->start;
+            *nl = '\0';
+            ch->start = (size_t)(nl - ch->buf) + 1;
+            return line;
+        }
+        if (ch->start > 0) {
+            memmove(ch->buf, ch->buf + ch->start, ch->end - ch->start);
+            ch->end -= ch->start;
+            ch->start = 0;
+        }
+        if (ch->end == sizeof(ch->buf)) return NULL;  // no line fits
+        ssize_t r = read(ch->in_fd, ch->buf + ch->end, sizeof(ch->buf) - ch->end);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return NULL;
+        ch->end += (size_t)r;
+    }
+}
+
+// Answers a job that cannot run and drops what was read of it
+static bool job_reject(JobChannel* ch, JobRequest* req, const char* message) {
+    job_write_frame(ch->out_fd, "ERR", message, strlen(message));
+    job_write_all(ch->out_fd, "END 1\n", 6);
+    job_request_free(req);
+    return false;
+}
+
+// Reads a payload of n bytes into a fresh, terminated buffer
+static const char* job_read_payload(JobChannel* ch, char** out, size_t n) {
+    *out = (char*)malloc(n + 1);
+    if (!*out) return "Server Error: out of memory for the job\n";
+    if (!job_read_exact(ch, *out, n)) return "Server Error: the job ended before its payload\n";
+    (*out)[n] = '\0';
+    return NULL;
+}
+
+// Reads the next job. False at the end of input, on QUIT or on a job that
+// cannot be read, which is reported on the channel.
+static bool job_read_request(JobChannel* ch, JobRequest* req) {
+    memset(req, 0, sizeof(*req));
+    char* line = job_read_line(ch);
+    if (!line) return false;
+    if (strcmp(line, "QUIT") == 0) {
+        ch->quit = true;
+        return false;
+    }
+    size_t ast_len, input_len;
+    int path_at = 0;
+    if (sscanf(line, "RUN %zu %zu %n", &ast_len, &input_len, &path_at) != 2 || path_at == 0) {
+        return job_reject(ch, req, "Server Error: expected RUN <ast bytes> <input bytes> <path>\n");
+    }
+    if (ast_len > JOB_PAYLOAD_MAX || input_len > JOB_PAYLOAD_MAX) {
+        return job_reject(ch, req, "Server Error: job payload too large\n");
+    }
+    req->path = strdup(line + path_at);
+    req->ast_len = ast_len;
+    req->input_len = input_len;
+    if (!req->path) return job_reject(ch, req, "Server Error: out of memory for the job\n");
+    const char* error = NULL;
+    if (ast_len > 0) error = job_read_payload(ch, &req->ast, ast_len);
+    if (!error) error = job_read_payload(ch, &req->input, input_len);
+    if (error) return job_reject(ch, req, error);
+    return true;
+}
+
+// --- output capture -------------------------------------------------------------
+
+typedef struct {
+    int out_fd;         // the channel's output
+    int pipes[2];       // read ends of the job's stdout and stderr
+    int saved[3];       // the server's own 0, 1 and 2
+    pthread_t relay;
+} JobCapture;
+
+// Forwards the job's output as frames until both pipes are closed
+static void* job_relay(void* arg) {
+    JobCapture* cap = (JobCapture*)arg;
+    static const char* kinds[2] = {"OUT", "ERR"};
+    char chunk[JOB_RELAY_CHUNK];
+    struct pollfd fds[2] = {{cap->pipes[0], POLLIN, 0}, {cap->pipes[1], POLLIN, 0}};
+    int open_pipes = 2;
+    while (open_pipes > 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t n = read(fds[i].fd, chunk, sizeof(chunk));
+            if (n > 0) {
+                job_write_frame(cap->out_fd, kinds[i], chunk, (size_t)n);
+            } else if (n == 0 || errno != EINTR) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_pipes--;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Points the process's standard streams at the job: input from the
+// payload, output and error into pipes relayed to out_fd
+static bool job_capture_start(JobCapture* cap, int out_fd, const char* input, size_t input_len) {
+    FILE* in = tmpfile();
+    if (!in) return false;
+    if (input_len > 0) fwrite(input, 1, input_len, in);
+    fflush(in);
+    int out_pipe[2], err_pipe[2];
+    if (pipe(out_pipe) != 0) {
+        fclose(in);
+        return false;
+    }
+    if (pipe(err_pipe) != 0) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        fclose(in);
+        return false;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    cap->out_fd = out_fd;
+    for (int i = 0; i < 3; i++) cap->saved[i] = dup(i);
+    lseek(fileno(in), 0, SEEK_SET);
+    dup2(fileno(in), 0);
+    fclose(in);
+    clearerr(stdin);
+    fseek(stdin, 0, SEEK_SET);  // drops anything stdio buffered from before
+    dup2(out_pipe[1], 1);
+    dup2(err_pipe[1], 2);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    cap->pipes[0] = out_pipe[0];
+    cap->pipes[1] = err_pipe[0];
+    pthread_create(&cap->relay, NULL, job_relay, cap);
+    return true;
+}
+
+// Restores the standard streams, waits for the relay to forward the last
+// of the output and ends the job's response
+static void job_capture_finish(JobCapture* cap, int status) {
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++) {
+        dup2(cap->saved[i], i);
+        close(cap->saved[i]);
+    }
+    clearerr(stdin);
+    pthread_join(cap->relay, NULL);
+    char end[32];
+    int len = snprintf(end, sizeof(end), "END %d\n", status);
+    job_write_all(cap->out_fd, end, (size_t)len);
+}
+
+// --- transports -----------------------------------------------------------------
+
+// Moves the protocol off standard input and output, which then read from
+// and write to /dev/null between jobs
+static void job_channel_stdio(JobChannel* ch) {
+    memset(ch, 0, sizeof(*ch));
+    ch->in_fd = dup(0);
+    ch->out_fd = dup(1);
+    int null_fd = open("/dev/null", O_RDWR);
+    dup2(null_fd, 0);
+    dup2(null_fd, 1);
+    close(null_fd);
+}
+
+// A listening Unix socket at path, replacing a stale one; -1 on failure
+static int job_listen_unix(const char* path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef BEACON_KERNELS_H
+#define BEACON_KERNELS_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+// Vectorized loops over arrays of doubles, used for dense (all-number)
+// lists by the math toolkit and by condense.
+//
+// Each kernel has a scalar version and, on x86, an SSE2 and an AVX2
+// version. SSE2 is part of the x86-64 baseline; AVX2 variants are compiled
+// with a target attribute and only picked when the CPU reports support at
+// run time, so the binary still runs on older machines. The check runs once
+// at start-up, before any worker thread exists. Set BEACON_NO_AVX2 to force
+// the SSE2 path.
+//
+// Sums and dot products keep several partial sums, so their results can
+// differ from a strict left-to-right fold in the last bits.
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define KERNELS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(KERNELS_SSE2) && defined(__GNUC__)
+#define KERNELS_AVX2 1
+#include <immintrin.h>
+#define KERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+typedef enum { KERN_LESS, KERN_GREATER, KERN_EQUAL } KernCompare;
+
+#ifdef KERNELS_AVX2
+static bool kernels_avx2;
+
+__attribute__((constructor)) static void kernels_detect(void) {
+    __builtin_cpu_init();
+    kernels_avx2 = __builtin_cpu_supports("avx2") && !getenv("BEACON_NO_AVX2");
+}
+#endif
+
+static inline bool kernels_use_avx2(void) {
+#ifdef KERNELS_AVX2
+    return kernels_avx2;
+#else
+    return false;
+#endif
+}
+
+// --- scalar -----------------------------------------------------------------
+
+static inline double kern_sum_scalar(const double* x, size_t n) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += x[i];
+        s1 += x[i + 1];
+        s2 += x[i + 2];
+        s3 += x[i + 3];
+    }
+    for (; i < n; i++) s0 += x[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+static inline double kern_dot_scalar(const double* a, const double* b, size_t n) {
+    double s0 = 0, s1 = 0;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+    }
+    for (; i < n; i++) s0 += a[i] * b[i];
+    return s0 + s1;
+}
+
+// --- SSE2 -------------------------------------------------------------------
+
+#ifdef KERNELS_SSE2
+static inline double kern_sum_sse2(const double* x, size_t n) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(x + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(x + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+    double s = lanes[0] + lanes[1];
+    for (; i < n; i++) s += x[i];
+    return s;
+}
+
+static inline double kern_dot_sse2(const double* a, const double* b, size_t n) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+    double s = lanes[0] + lanes[1];
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+#endif
+
+// --- AVX2 -------------------------------------------------------------------
+
+#ifdef KERNELS_AVX2
+KERNELS_TARGET_AVX2 static inline double kern_sum_avx2(const double* x, size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(x + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(x + i + 4));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+    double s = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++) s += x[i];
+    return s;
+}
+
+KERNELS_TARGET_AVX2 static inline double kern_dot_avx2(const double* a, const double* b, size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+    double s = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+// op: 0 = min, 1 = max
+KERNELS_TARGET_AVX2 static inline double kern_minmax_avx2(const double* x, size_t n, int op) {
+    __m256d acc = _mm256_set1_pd(x[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(x + i);
+        acc = op ? _mm256_max_pd(acc, v) : _mm256_min_pd(acc, v);
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double r = lanes[0];
+    for (int k = 1; k < 4; k++) r = op ? (lanes[k] > r ? lanes[k] : r) : (lanes[k] < r ? lanes[k] : r);
+    for (; i < n; i++) r = op ? (x[i] > r ? x[i] : r) : (x[i] < r ? x[i] : r);
+    return r;
+}
+
+// op: 0 = add, 1 = mul
+KERNELS_TARGET_AVX2 static inline void kern_binary_avx2(double* out, const double* a, const double* b, size_t n, int op) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i), y = _mm256_loadu_pd(b + i);
+        _mm256_storeu_pd(out + i, op ? _mm256_mul_pd(x, y) : _mm256_add_pd(x, y));
+    }
+    for (; i < n; i++) out[i] = op ? a[i] * b[i] : a[i] + b[i];
+}
+
+KERNELS_TARGET_AVX2 static inline void kern_scale_avx2(double* out, const double* x, double k, size_t n) {
+    __m256d kv = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(x + i), kv));
+    for (; i < n; i++) out[i] = x[i] * k;
+}
+
+KERNELS_TARGET_AVX2 static inline void kern_compare_avx2(unsigned char* mask, const double* x, double k, size_t n, KernCompare op) {
+    __m256d kv = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(x + i);
+        __m256d c = op == KERN_LESS ? _mm256_cmp_pd(v, kv, _CMP_LT_OQ)
+                  : op == KERN_GREATER ? _mm256_cmp_pd(v, kv, _CMP_GT_OQ)
+                  : _mm256_cmp_pd(v, kv, _CMP_EQ_OQ);
+        int bits = _mm256_movemask_pd(c);
+        for (int b = 0; b < 4; b++) mask[i + b] = (bits >> b) & 1;
+    }
+    for (; i < n; i++) mask[i] = op == KERN_LESS ? x[i] < k : op == KERN_GREATER ? x[i] > k : x[i] == k;
+}
+#endif
+
+// --- dispatch ---------------------------------------------------------------
+
+static inline double kern_sum(const double* x, size_t n) {
+#ifdef KERNELS_AVX2
+    if (kernels_use_avx2()) return kern_sum_avx2(x, n);
+#endif
+#ifdef KERNELS_SSE2
+    return kern_sum_sse2(x, n);
+#else
+    return kern_sum_scalar(x, n);
+#endif
+}
+
+static inline double kern_dot(const double* a, const double* b, size_t n) {
+#ifdef KERNELS_AVX2
+    if (kernels_use_avx2()) return kern_dot_avx2(a, b, n);
+#endif
+#ifdef KERNELS_SSE2
+    return kern_dot_sse2(a, b, n);
+#else
+    return kern_dot_scalar(a, b, n);
+#endif
+}
+
+// Smallest (op 0) or largest (op 1) of n > 0 values
+static inline double kern_minmax(const double* x, size_t n, int op) {
+#ifdef KERNELS_AVX2
+    if (kernels_use_avx2()) return kern_minmax_avx2(x, n, op);
+#endif
+    size_t i = 0;
+    double r = x[0];
+#ifdef KERNELS_SSE2
+    __m128d acc = _mm_set1_pd(x[0]);
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(x + i);
+        acc = op ? _mm_max_pd(acc, v) : _mm_min_pd(acc, v);
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    r = op ? (lanes[1] > lanes[0] ? lanes[1] : lanes[0]) : (lanes[1] < lanes[0] ? lanes[1] : lanes[0]);
+#endif
+    for (; i < n; i++) r = op ? (x[i] > r ? x[i] : r) : (x[i] < r ? x[i] : r);
+    return r;
+}
+
+// out[i] = a[i] + b[i] (op 0) or a[i] * b[i] (op 1); out may alias a or b
+static inline void kern_binary(double* out, const double* a, const double* b, size_t n, int op) {
+#ifdef KERNELS_AVX2
+    if (kernels_use_avx2()) {
+        kern_binary_avx2(out, a, b, n, op);
+        return;
+    }
+#endif
+    size_t i = 0;
+#ifdef KERNELS_SSE2
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i), y = _mm_loadu_pd(b + i);
+        _mm_storeu_pd(out + i, op ? _mm_mul_pd(x, y) : _mm_add_pd(x, y));
+    }
+#endif
+    for (; i < n; i++) out[i] = op ? a[i] * b[i] : a[i] + b[i];
+}
+
+static inline void kern_scale(double* out, const double* x, double k, size_t n) {
+#ifdef KERNELS_AVX2
+    if (kernels_use_avx2()) {
+        kern_scale_avx2(out, x, k, n);
+        return;
+    }
+#endif
+    size_t i = 0;
+#ifdef KERNELS_SSE2
+    __m128d kv = _mm_set1_pd(k);
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(x + i), kv));
+#endif
+    for (; i < n; i++) out[i] = x[i] * k;
+}
+
+// Running totals: out[i] = x[0] + ... + x[i]. Each pair is scanned
+// in-register and then offset by the running carry.
+static inline void kern_prefix_sum(double* out, const double* x, size_t n) {
+    size_t i = 0;
+    double carry = 0;
+#ifdef KERNELS_SSE2
+    __m128d c = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(x + i);                             // (a, b)
+        v = _mm_add_pd(v, _mm_unpacklo_pd(_mm_setzero_pd(), v));     // (a, a + b)
+        v = _mm_add_pd(v, c);                                         // (c + a, c + a + b)
+        _mm_storeu_pd(out + i, v);
+        c = _mm_unpackhi_pd(v, v);
+    }
+    _mm_store_sd(&carry, c);
+#endif
+    for (; i < n; i++) {
+        carry += x[i];
+        out[i] = carry;
+    }
+}
+
+static inline void kern_compare(unsigned char* mask, const double* x, double k, size_t n, KernCompare op) {
+#ifdef KERNELS_AVX2
+    if (kernels_use_avx2()) {
+        kern_compare_avx2(mask, x, k, n, op);
+        return;
+    }
+#endif
+    size_t i = 0;
+#ifdef KERNELS_SSE2
+    __m128d kv = _mm_set1_pd(k);
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(x + i);
+        __m128d cmp = op == KERN_LESS ? _mm_cmplt_pd(v, kv) : op == KERN_GREATER ? _mm_cmpgt_pd(v, kv) : _mm_cmpeq_pd(v, kv);
+        int bits = _mm_movemask_pd(cmp);
+        mask[i] = bits & 1;
+        mask[i + 1] = (bits >> 1) & 1;
+    }
+#endif
+    for (; i < n; i++) mask[i] = op == KERN_LESS ? x[i] < k : op == KERN_GREATER ? x[i] > k : x[i] == k;
+}
+
+#endif // BEACON_KERNELS_H
@@ -2,20 +2,50 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <stdarg.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "cJSON.h"
+#include "slab.h"
+#include "workers.h"
+#include "kernels.h"
+#include "numfmt.h"
+#include "textscan.h"
+#include "filemap.h"
+#include "ioqueue.h"
+#include "serial.h"
+#include "csvscan.h"
+#include "netloop.h"
+#include "httpparse.h"
+#include "jobserver.h"
+#include "snapshot.h"
+#include "beacon.h"
 
 // Enum for value types
 typedef enum {
     VAL_NIL,
     VAL_BOOL,
     VAL_NUMBER,
+    VAL_INT,
     VAL_STRING,
+    VAL_ROPE,
     VAL_FUNCTION,
     VAL_BLUEPRINT,
     VAL_BLUEPRINT_INSTANCE,
     VAL_TOOLKIT,
     VAL_BRIDGE,
-    VAL_RANGE
+    VAL_RANGE,
+    VAL_LIST,
+    VAL_DICT,
+    VAL_SET,
+    VAL_ITER,
+    VAL_FILE,
+    VAL_PENDING,
+    VAL_SOCKET
 } ValueType;
 
 // Forward declaration of Value
@@ -41,6 +71,7 @@ typedef struct {
 typedef struct {
     Scope* blueprint_scope;
     Scope* instance_scope;
+    const char* blueprint_name;  // shared with the Blueprint
 } BlueprintInstanceValue;
 
 typedef struct {
@@ -52,11 +83,28 @@ typedef struct {
     Scope* bridge_scope;
 } BridgeValue;
 
+// Growable list backing `pack`. Lists have reference semantics: copies of a
+// VAL_LIST share one ListObj and the last release frees it. Like the other
+// shared objects below, the count is atomic (see workers.h). While every item
+// is a number the list stays dense and keeps raw doubles in `numbers`; the
+// first non-number demotes it to an array of inline Values.
+typedef struct ListObj {
+    int refcount;
+    int count;
+    int capacity;
+    bool dense;
+    union {
+        double* numbers;
+        Value* items;
+    } data;
+} ListObj;
+
 // Struct for values
 typedef struct Value {
     ValueType type;
     union {
         double number;
+        int64_t integer;
         char *string;
         bool boolean;
         struct FunctionSymbol* function; // For function values
@@ -64,6 +112,14 @@ typedef struct Value {
         BlueprintInstanceValue blueprint_instance;
         ToolkitValue toolkit;
         BridgeValue bridge;
+        ListObj* list;
+        struct DictObj* dict;
+        struct SetObj* set;
+        struct IterObj* iter;
+        struct RopeObj* rope;
+        struct FileObj* file;
+        struct PendingObj* pending;
+        struct SocketObj* socket;
         struct {
             double start;
             double end;
@@ -71,6 +127,145 @@ typedef struct Value {
     } as;
 } Value;
 
+// Text built with + becomes a rope (VAL_ROPE) once it outgrows a short
+// string: each concatenation is an immutable node pointing at its two
+// halves, so extending a text in a loop costs O(1) per step instead of
+// copying everything built so far. The characters are gathered into one
+// buffer the first time something reads them, and that buffer is cached in
+// the node. A slice (what text~>split and text~>trim return) is a third
+// kind of rope: it keeps the text it was cut from alive through left and
+// points into it, so cutting a text into pieces copies nothing; a file's
+// mapped contents (filemap.h) are held by a leaf in the same way. Ropes are
+// Text to Beacon code; consumers read any text through is_text and
+// text_view (characters and length) or text_of (a terminated string).
+typedef struct RopeObj {
+    int refcount;
+    size_t length;
+    struct RopeObj* left;   // both NULL for a leaf; a slice has only left
+    struct RopeObj* right;
+    char* flat;             // a leaf's text, or a node's text once gathered
+    const char* view;       // a slice's characters, inside left's text
+    bool mapped;            // a leaf over a file mapping, which is view
+} RopeObj;
+
+// An open file from file~>open. A handle reading a regular file holds its
+// whole contents as a rope (mapped or read, see filemap.h) that read and
+// lines cut slices from, so closing the handle leaves those slices valid.
+// Pipes and devices are streamed instead. Writing handles are a stdio
+// stream with a buffer of the requested size.
+typedef struct FileObj {
+    int refcount;
+    char* path;
+    bool writing;
+    RopeObj* contents;
+    FILE* stream;
+    char* buffer;
+} FileObj;
+
+// An io~>read or io~>write in flight (see ioqueue.h). Waiting on it gives
+// the text read, or On once written; the text is kept, so waiting again
+// returns it without another copy.
+typedef struct PendingObj {
+    int refcount;
+    char* path;
+    IoqOp* op;
+    RopeObj* text;
+} PendingObj;
+
+// A connection or listener from the net toolkit (see netloop.h). A listener
+// keeps the spec that net~>serve and hold hand its connections to; a
+// web~>listen listener also keeps its open HTTP connections.
+typedef struct SocketObj {
+    int refcount;
+    NetConn* conn;      // NULL once closed
+    char* address;
+    struct FunctionSymbol* handler;
+    struct WebServer* web;
+    struct BeaconRuntime* runtime;  // whose net_listeners has it
+} SocketObj;
+
+// Numbers are VAL_INT while they stay integral (literals, + - * of integers,
+// counters, lengths) and VAL_NUMBER otherwise; the two are one type to Beacon
+// code. Arithmetic that overflows int64, and all division, produces doubles.
+// Anything that reads a number accepts both through is_number/number_of.
+
+// 2^53: every integer up to here is exact as a double
+#define INT_EXACT_LIMIT 9007199254740992.0
+
+static inline bool is_number(const Value* v) {
+    return v->type == VAL_NUMBER || v->type == VAL_INT;
+}
+
+static inline double number_of(const Value* v) {
+    return v->type == VAL_INT ? (double)v->as.integer : v->as.number;
+}
+
+// Stores n as VAL_INT when it is integral and exact, else as VAL_NUMBER
+static inline void set_numeric(Value* v, double n) {
+    if (n >= -INT_EXACT_LIMIT && n <= INT_EXACT_LIMIT && n == (double)(int64_t)n) {
+        v->type = VAL_INT;
+        v->as.integer = (int64_t)n;
+    } else {
+        v->type = VAL_NUMBER;
+        v->as.number = n;
+    }
+}
+
+// Numbers a dense list can hold as doubles without losing precision
+static inline bool fits_dense(const Value* v) {
+    return v->type == VAL_NUMBER ||
+           (v->type == VAL_INT && v->as.integer >= -(int64_t)INT_EXACT_LIMIT && v->as.integer <= (int64_t)INT_EXACT_LIMIT);
+}
+
+static inline bool numbers_equal(const Value* a, const Value* b) {
+    if (a->type == VAL_INT && b->type == VAL_INT) return a->as.integer == b->as.integer;
+    return number_of(a) == number_of(b);
+}
+
+// Hash map behind collection~>dict(). Entries live in insertion order in
+// `entries`; `index` is an open-addressing table of entry positions probed
+// Robin Hood style, so probe sequences stay short even at high load. Each
+// entry caches its key's hash, so growing the index never rehashes keys.
+// Removed entries are marked dead and squeezed out on the next rebuild.
+typedef struct {
+    uint32_t hash;
+    bool live;
+    Value key;
+    Value value;
+} DictEntry;
+
+typedef struct {
+    uint32_t hash;
+    int32_t entry; // -1 when the slot is empty
+} DictSlot;
+
+typedef struct DictObj {
+    int refcount;
+    int count;          // live entries
+    int entry_count;    // used entries, including dead ones
+    int entry_capacity;
+    DictEntry* entries;
+    int slot_capacity;  // power of two
+    DictSlot* index;
+    int walks;          // iterators walking the entries; dead entries stay
+                        // (and positions hold) until the last one is done
+} DictObj;
+
+// Set behind collection~>set(). While every member is a small non-negative
+// integer the set is a bitset, so membership is a bit test and union,
+// intersection and difference run a word (or SSE2 register) at a time. The
+// first member that does not fit converts it to a hash set, which reuses
+// DictObj with Nil values.
+typedef struct SetObj {
+    int refcount;
+    bool bitset;
+    int count;
+    uint64_t* words;   // bitset form
+    int word_count;
+    DictObj* hash;     // hash form
+    int walks;         // iterators walking the members (see DictObj)
+} SetObj;
+
 // Definition of Symbol
 typedef struct Symbol {
     char *name;
@@ -93,12 +288,55 @@ Value* get_variable(Scope* scope, const char* name);
 void set_variable(Scope* scope, const char* name, Value* value);
 void define_variable(Scope* scope, const char* name, Value* value, bool is_const);
 
+// Values, scopes and the initial symbol array of each scope come from
+// per-thread slabs (see slab.h). A scope that outgrows its initial array
+// moves to a malloc'd one in define_variable.
+#define SCOPE_INITIAL_SYMBOLS 10
+
+static SlabPool value_pool = SLAB_POOL_INIT;
+static SlabPool scope_pool = SLAB_POOL_INIT;
+static SlabPool symbol_pool = SLAB_POOL_INIT;
+static SLAB_THREAD_LOCAL SlabCache value_slab = SLAB_CACHE_INIT(value_pool);
+static SLAB_THREAD_LOCAL SlabCache scope_slab = SLAB_CACHE_INIT(scope_pool);
+static SLAB_THREAD_LOCAL SlabCache symbol_slab = SLAB_CACHE_INIT(symbol_pool);
+
+static inline Value* alloc_value(void) {
+    return (Value*)slab_alloc(&value_slab, sizeof(Value));
+}
+
+void list_release(ListObj* list);
+void dict_release(DictObj* dict);
+void set_release(SetObj* set);
+void iter_retain(struct IterObj* iter);
+void iter_release(struct IterObj* iter);
+void rope_release(RopeObj* rope);
+void file_release(struct FileObj* file);
+void pending_release(PendingObj* pending);
+void socket_release(SocketObj* socket);
+
 Value* copy_value(const Value* val) {
     if (!val) return NULL;
-    Value* new_val = (Value*)malloc(sizeof(Value));
+    Value* new_val = alloc_value();
     memcpy(new_val, val, sizeof(Value));
     if (val->type == VAL_STRING) {
         new_val->as.string = strdup(val->as.string);
+    } else if (val->type == VAL_LIST) {
+        // Reference semantics: share the list
+        ref_retain(&val->as.list->refcount);
+    } else if (val->type == VAL_DICT) {
+        ref_retain(&val->as.dict->refcount);
+    } else if (val->type == VAL_SET) {
+        ref_retain(&val->as.set->refcount);
+    } else if (val->type == VAL_ITER) {
+        iter_retain(val->as.iter);
+    } else if (val->type == VAL_ROPE) {
+        ref_retain(&val->as.rope->refcount);
+    } else if (val->type == VAL_FILE) {
+        ref_retain(&val->as.file->refcount);
+    } else if (val->type == VAL_PENDING) {
+        ref_retain(&val->as.pending->refcount);
+    } else if (val->type == VAL_SOCKET) {
+        ref_retain(&val->as.socket->refcount);
     } else if (val->type == VAL_BLUEPRINT_INSTANCE) {
         // Reference semantics: Just copy pointers
         new_val->as.blueprint_instance.blueprint_scope = val->as.blueprint_instance.blueprint_scope;
@@ -110,10 +348,27 @@ Value* copy_value(const Value* val) {
     return new_val;
 }
 
-void free_value(Value* value) {
-    if (!value) return;
+// Releases whatever a value owns without freeing the Value itself. Used for
+// values stored inline, such as list items.
+void clear_value(Value* value) {
     if (value->type == VAL_STRING && value->as.string) {
         free(value->as.string);
+    } else if (value->type == VAL_LIST) {
+        list_release(value->as.list);
+    } else if (value->type == VAL_DICT) {
+        dict_release(value->as.dict);
+    } else if (value->type == VAL_SET) {
+        set_release(value->as.set);
+    } else if (value->type == VAL_ITER) {
+        iter_release(value->as.iter);
+    } else if (value->type == VAL_ROPE) {
+        rope_release(value->as.rope);
+    } else if (value->type == VAL_FILE) {
+        file_release(value->as.file);
+    } else if (value->type == VAL_PENDING) {
+        pending_release(value->as.pending);
+    } else if (value->type == VAL_SOCKET) {
+        socket_release(value->as.socket);
     } else if (value->type == VAL_BLUEPRINT) {
         // Reference semantics: Do not free name or scope as they are shared/shallow copied
         // free(value->as.blueprint.name);
@@ -127,12 +382,20 @@ void free_value(Value* value) {
     } else if (value->type == VAL_BRIDGE) {
         destroy_scope(value->as.bridge.bridge_scope);
     }
-    free(value);
+}
+
+void free_value(Value* value) {
+    if (!value) return;
+    clear_value(value);
+    slab_free(&value_slab, value);
 }
 
 typedef struct FunctionSymbol {
     char name[50];
     ASTNode *node;
+    // The spec's body compiled ahead of time (aot.h), tried before the
+    // interpreter; it returns NULL when the interpreter has to run it after all
+    Value* (*compiled)(Value** args, int argc, Scope* scope);
 } FunctionSymbol;
 
 char* value_to_string(Value* val);
@@ -140,6 +403,11 @@ Value* interpret_ast(ASTNode *node, Scope* scope);
 void free_ast(ASTNode *node);
 ASTNode* parse_ast_from_json(cJSON *json_node);
 ASTNode* parse_ast_from_file(const char* filename); // Forward decl
+ASTNode* ast_cache_get(const char* filename);
+static ASTNode* ast_cache_owner(const ASTNode* node, char** path);
+#ifdef BEACON_AOT
+static void aot_mark(int mark, ASTNode* node);
+#endif
 
 // Simple event registry and parallel task queue
 typedef struct {
@@ -149,66 +417,155 @@ typedef struct {
     int capacity;
 } EventEntry;
 
-static EventEntry *event_registry = NULL;
-static int event_registry_count = 0;
-static int event_registry_capacity = 0;
+// A host function added with beacon_register
+typedef struct {
+    char* name;
+    BeaconNativeFn fn;
+    void* user;
+} HostNative;
+
+// Everything a running program owns (see beacon.h). The command-line
+// runtime uses default_runtime; an embedding host creates its own. Runtimes
+// are isolates: each thread works on its own current one, so several can
+// run on different threads at once, sharing only the loaded ASTs (which
+// nothing writes to while running), the worker pool and the I/O queue.
+struct BeaconRuntime {
+    Scope* globals;             // from the last run, kept for beacon_call
+    EventEntry* event_registry;
+    int event_registry_count;
+    int event_registry_capacity;
+    ASTNode** paral_queue;
+    int paral_queue_count;
+    int paral_queue_capacity;
+    SocketObj** net_listeners;  // listeners with a handler, which hold serves
+    int net_listener_count;
+    int net_listener_capacity;
+    BeaconWriteFn write_out;    // NULL for stdout
+    void* out_user;
+    BeaconWriteFn write_err;    // NULL for stderr
+    void* err_user;
+    HostNative* natives;
+    int native_count;
+    int native_capacity;
+    bool resumed;               // the last run started from a snapshot
+};
+
+static BeaconRuntime default_runtime;
+
+// This thread's runtime. It lives in worker_context (workers.h), so pool
+// threads running a paral task take on the runtime of whoever started it.
+static inline BeaconRuntime* current_runtime(void) {
+    BeaconRuntime* rt = (BeaconRuntime*)worker_context;
+    return rt ? rt : &default_runtime;
+}
+
+// Makes rt this thread's runtime; returns the one to restore afterwards
+static inline BeaconRuntime* runtime_enter(BeaconRuntime* rt) {
+    BeaconRuntime* previous = (BeaconRuntime*)worker_context;
+    worker_context = rt;
+    return previous;
+}
+
+static inline void runtime_leave(BeaconRuntime* previous) {
+    worker_context = previous;
+}
+
+// Program output, where the current runtime sends it
+static void runtime_write(const char* data, size_t length) {
+    BeaconRuntime* rt = current_runtime();
+    if (rt->write_out) {
+        rt->write_out(rt->out_user, data, length);
+    } else {
+        fwrite(data, 1, length, stdout);
+    }
+}
 
-static ASTNode **paral_queue = NULL;
-static int paral_queue_count = 0;
-static int paral_queue_capacity = 0;
+// Error messages, where the current runtime sends them
+static void runtime_errorf(const char* format, ...) {
+    BeaconRuntime* rt = current_runtime();
+    va_list args;
+    va_start(args, format);
+    if (!rt->write_err) {
+        vfprintf(stderr, format, args);
+        va_end(args);
+        return;
+    }
+    char small[512];
+    va_list again;
+    va_copy(again, args);
+    int length = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (length < 0) {
+        va_end(again);
+        return;
+    }
+    if ((size_t)length < sizeof(small)) {
+        rt->write_err(rt->err_user, small, (size_t)length);
+    } else {
+        char* message = (char*)malloc((size_t)length + 1);
+        vsnprintf(message, (size_t)length + 1, format, again);
+        rt->write_err(rt->err_user, message, (size_t)length);
+        free(message);
+    }
+    va_end(again);
+}
 
 static void register_listener(const char *event_name, ASTNode **handler_body, int num_body) {
-    for (int i = 0; i < event_registry_count; i++) {
-        if (strcmp(event_registry[i].event_name, event_name) == 0) {
-            if (event_registry[i].num_handlers + num_body > event_registry[i].capacity) {
-                event_registry[i].capacity = event_registry[i].capacity + num_body + 4;
-                event_registry[i].handlers = (ASTNode**)realloc(event_registry[i].handlers, event_registry[i].capacity * sizeof(ASTNode*));
+    BeaconRuntime* rt = current_runtime();
+    for (int i = 0; i < rt->event_registry_count; i++) {
+        if (strcmp(rt->event_registry[i].event_name, event_name) == 0) {
+            if (rt->event_registry[i].num_handlers + num_body > rt->event_registry[i].capacity) {
+                rt->event_registry[i].capacity = rt->event_registry[i].capacity + num_body + 4;
+                rt->event_registry[i].handlers = (ASTNode**)realloc(rt->event_registry[i].handlers, rt->event_registry[i].capacity * sizeof(ASTNode*));
             }
             for (int j = 0; j < num_body; j++) {
-                event_registry[i].handlers[event_registry[i].num_handlers++] = handler_body[j];
+                rt->event_registry[i].handlers[rt->event_registry[i].num_handlers++] = handler_body[j];
             }
             return;
         }
     }
-    if (event_registry_count >= event_registry_capacity) {
-        event_registry_capacity = event_registry_capacity == 0 ? 4 : event_registry_capacity * 2;
-        event_registry = (EventEntry*)realloc(event_registry, event_registry_capacity * sizeof(EventEntry));
+    if (rt->event_registry_count >= rt->event_registry_capacity) {
+        rt->event_registry_capacity = rt->event_registry_capacity == 0 ? 4 : rt->event_registry_capacity * 2;
+        rt->event_registry = (EventEntry*)realloc(rt->event_registry, rt->event_registry_capacity * sizeof(EventEntry));
     }
-    event_registry[event_registry_count].event_name = strdup(event_name);
-    event_registry[event_registry_count].capacity = num_body + 4;
-    event_registry[event_registry_count].handlers = (ASTNode**)malloc(event_registry[event_registry_count].capacity * sizeof(ASTNode*));
-    event_registry[event_registry_count].num_handlers = 0;
+    rt->event_registry[rt->event_registry_count].event_name = strdup(event_name);
+    rt->event_registry[rt->event_registry_count].capacity = num_body + 4;
+    rt->event_registry[rt->event_registry_count].handlers = (ASTNode**)malloc(rt->event_registry[rt->event_registry_count].capacity * sizeof(ASTNode*));
+    rt->event_registry[rt->event_registry_count].num_handlers = 0;
     for (int j = 0; j < num_body; j++) {
-        event_registry[event_registry_count].handlers[event_registry[event_registry_count].num_handlers++] = handler_body[j];
+        rt->event_registry[rt->event_registry_count].handlers[rt->event_registry[rt->event_registry_count].num_handlers++] = handler_body[j];
     }
-    event_registry_count++;
+    rt->event_registry_count++;
 }
 
 static void emit_signal(const char *event_name, Scope* scope) {
-    for (int i = 0; i < event_registry_count; i++) {
-        if (strcmp(event_registry[i].event_name, event_name) == 0) {
-            for (int j = 0; j < event_registry[i].num_handlers; j++) {
-                free_value(interpret_ast(event_registry[i].handlers[j], scope));
+    BeaconRuntime* rt = current_runtime();
+    for (int i = 0; i < rt->event_registry_count; i++) {
+        if (strcmp(rt->event_registry[i].event_name, event_name) == 0) {
+            for (int j = 0; j < rt->event_registry[i].num_handlers; j++) {
+                free_value(interpret_ast(rt->event_registry[i].handlers[j], scope));
             }
         }
     }
 }
 
 static void enqueue_paral(ASTNode **body, int num_body) {
-    if (paral_queue_count + num_body > paral_queue_capacity) {
-        paral_queue_capacity = paral_queue_capacity == 0 ? (num_body + 4) : (paral_queue_capacity + num_body + 4);
-        paral_queue = (ASTNode**)realloc(paral_queue, paral_queue_capacity * sizeof(ASTNode*));
+    BeaconRuntime* rt = current_runtime();
+    if (rt->paral_queue_count + num_body > rt->paral_queue_capacity) {
+        rt->paral_queue_capacity = rt->paral_queue_capacity == 0 ? (num_body + 4) : (rt->paral_queue_capacity + num_body + 4);
+        rt->paral_queue = (ASTNode**)realloc(rt->paral_queue, rt->paral_queue_capacity * sizeof(ASTNode*));
     }
     for (int i = 0; i < num_body; i++) {
-        paral_queue[paral_queue_count++] = body[i];
+        rt->paral_queue[rt->paral_queue_count++] = body[i];
     }
 }
 
 static void drain_hold(Scope* scope) {
-    for (int i = 0; i < paral_queue_count; i++) {
-        free_value(interpret_ast(paral_queue[i], scope));
+    BeaconRuntime* rt = current_runtime();
+    for (int i = 0; i < rt->paral_queue_count; i++) {
+        free_value(interpret_ast(rt->paral_queue[i], scope));
     }
-    paral_queue_count = 0;
+    rt->paral_queue_count = 0;
 }
 
 bool value_to_bool(Value* val) {
@@ -220,502 +577,6024 @@ bool value_to_bool(Value* val) {
             return val->as.boolean;
         case VAL_NUMBER:
             return val->as.number != 0;
+        case VAL_INT:
+            return val->as.integer != 0;
         case VAL_STRING:
             if (!val->as.string) return false;
             return val->as.string[0] != '\0';
+        case VAL_ROPE:
+            return val->as.rope->length > 0;
         default:
             return true;
     }
 }
 
 Value* create_string_value_helper(const char* s) {
-    Value* val = (Value*)malloc(sizeof(Value));
+    Value* val = alloc_value();
     val->type = VAL_STRING;
     val->as.string = strdup(s ? s : "");
     return val;
 }
 
-typedef enum {
-    NODE_PROGRAM,
-    NODE_NUMBER,
-    NODE_BOOL,
-    NODE_NIL,
-    NODE_STRING,
-    NODE_BINARY_OP,
-    NODE_VAR_ACCESS,
-    NODE_VAR_ASSIGN,
-    NODE_CONSTANT_DECL,
-    NODE_SHOW_STATEMENT,
-    NODE_EXPRESSION_STATEMENT,
-    NODE_NICK_DECL,
-    NODE_FUNCTION_DECL,
-    NODE_RETURN_STATEMENT,
-    NODE_FUNCTION_CALL,
-    NODE_CHECK_STATEMENT,
-    NODE_ALTER_CLAUSE,
-    NODE_BLUEPRINT,
-    NODE_ATTRIBUTE_ACCESS,
-    NODE_SPAWN,
-    NODE_ADOPT,
-    NODE_DEN,
-    NODE_CONVERT,
-    NODE_TOOLKIT,
-    NODE_PLUG,
-    NODE_BRIDGE,
-    NODE_INLET,
-    NODE_LINK,
-    NODE_EXPOSE,
-    NODE_HALT,
-    NODE_PROCEED,
-    NODE_WAIT,
-    NODE_TRIGGER,
-    NODE_BLAME,
-    NODE_TYPE,
-    NODE_KIND,
-    NODE_NICK,
-    NODE_HIDDEN,
-    NODE_SHIELDED,
-    NODE_INTERNAL,
-    NODE_EMBED,
-    NODE_PARAL,
-    NODE_HOLD,
-    NODE_SIGNAL,
-    NODE_LISTEN,
-    NODE_ASK,
-    NODE_AUTHEN,
-    NODE_TRANSFORM,
-    NODE_CONDENSE,
-    NODE_PACK,
-    NODE_UNPACK,
-    NODE_INTERPOLATED_STRING,
-    NODE_TRAVERSE,
-    NODE_EACH, // Replaces TRAVERSE
-    NODE_UNTIL,
-    NODE_DOCSTRING,
-    NODE_CONSTRUCTOR_DECL,
-    NODE_ATTEMPT_TRAP_CONCLUDE,
-    NODE_METHOD_CALL,
-    NODE_MODULE,
-    NODE_BRING,
-    NODE_CONTRACT,
-    NODE_UNARY_OP
-} NodeType;
-
+Value* create_nil_value_helper(void) {
+    Value* val = alloc_value();
+    val->type = VAL_NIL;
+    return val;
+}
 
-typedef struct ASTNode ASTNode;
+Value* create_number_value_helper(double n) {
+    Value* val = alloc_value();
+    val->type = VAL_NUMBER;
+    val->as.number = n;
+    return val;
+}
 
-typedef struct {
-    ASTNode **statements;
-    int num_statements;
-} ProgramNode;
+Value* create_int_value_helper(int64_t n) {
+    Value* val = alloc_value();
+    val->type = VAL_INT;
+    val->as.integer = n;
+    return val;
+}
 
-typedef struct {
-    ASTNode *left;
-    char *op;
-    ASTNode *right;
-} BinaryOpNode;
+// For doubles that may well be integral (list items, kernel results)
+Value* create_numeric_value_helper(double n) {
+    Value* val = alloc_value();
+    set_numeric(val, n);
+    return val;
+}
 
-typedef struct {
-    char *var_name;
-} VarAccessNode;
+Value* create_bool_value_helper(bool b) {
+    Value* val = alloc_value();
+    val->type = VAL_BOOL;
+    val->as.boolean = b;
+    return val;
+}
 
-typedef struct {
-    ASTNode *target;
-    ASTNode *value;
-} VarAssignNode;
+// ---------------------------------------------------------------------------
+// Text
+// ---------------------------------------------------------------------------
 
-typedef struct {
-    char *const_name;
-    ASTNode *value;
-} ConstantDeclNode;
+// Concatenations up to this length produce a plain string
+#define ROPE_FLAT_LIMIT 256
 
-typedef struct {
-    ASTNode *expression;
-} ExpressionStatementNode;
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
 
-typedef struct {
-    ASTNode **expressions;
-    int num_expressions;
-} ShowStatementNode;
+static RopeObj* rope_leaf(const char* s, size_t n) {
+    RopeObj* rope = (RopeObj*)malloc(sizeof(RopeObj));
+    rope->refcount = 1;
+    rope->length = n;
+    rope->left = NULL;
+    rope->right = NULL;
+    rope->flat = (char*)malloc(n + 1);
+    memcpy(rope->flat, s, n);
+    rope->flat[n] = '\0';
+    rope->view = NULL;
+    rope->mapped = false;
+    return rope;
+}
 
-typedef struct {
-    char *original_type;
-    char *alias;
-} NickDeclNode;
+// A leaf that takes over s, a malloc'd string of n characters
+static RopeObj* rope_adopt(char* s, size_t n) {
+    RopeObj* rope = (RopeObj*)malloc(sizeof(RopeObj));
+    rope->refcount = 1;
+    rope->length = n;
+    rope->left = NULL;
+    rope->right = NULL;
+    rope->flat = s;
+    rope->view = NULL;
+    rope->mapped = false;
+    return rope;
+}
 
-typedef struct {
-    char *name;
-    char **params;
-    int num_params;
-    ASTNode **body;
-    int num_body_statements;
-    char *docstring;
-    bool exposed;
-    bool shared;
-    char *func_type;
-} FunctionDeclNode;
+// Takes ownership of both references
+static RopeObj* rope_concat(RopeObj* left, RopeObj* right) {
+    RopeObj* rope = (RopeObj*)malloc(sizeof(RopeObj));
+    rope->refcount = 1;
+    rope->length = left->length + right->length;
+    rope->left = left;
+    rope->right = right;
+    rope->flat = NULL;
+    rope->view = NULL;
+    rope->mapped = false;
+    return rope;
+}
 
+// n characters at start, which lie inside source's text. Takes ownership
+// of the reference to source.
+static RopeObj* rope_slice(RopeObj* source, const char* start, size_t n) {
+    if (source->left && source->view) {
+        // Cut from the original text, not from another slice
+        RopeObj* whole = source->left;
+        ref_retain(&whole->refcount);
+        rope_release(source);
+        source = whole;
+    }
+    RopeObj* rope = (RopeObj*)malloc(sizeof(RopeObj));
+    rope->refcount = 1;
+    rope->length = n;
+    rope->left = source;
+    rope->right = NULL;
+    rope->flat = NULL;
+    rope->view = start;
+    rope->mapped = false;
+    return rope;
+}
 
+// A leaf over file contents from filemap_open
+static RopeObj* rope_from_map(FileMap* map) {
+    if (!map->mapped) {
+        map->data[map->size] = '\0';
+        return rope_adopt(map->data, map->size);
+    }
+    RopeObj* rope = (RopeObj*)malloc(sizeof(RopeObj));
+    rope->refcount = 1;
+    rope->length = map->size;
+    rope->left = NULL;
+    rope->right = NULL;
+    rope->flat = NULL;
+    rope->view = map->data;
+    rope->mapped = true;
+    return rope;
+}
 
+// Ropes built in a loop are as deep as the loop is long, so walks over
+// them use an explicit stack rather than recursion
 typedef struct {
-    ASTNode *expression;
-} ReturnStatementNode;
+    RopeObj* small[64];
+    RopeObj** items;
+    size_t count;
+    size_t capacity;
+} RopeStack;
+
+static void rope_stack_init(RopeStack* stack) {
+    stack->items = stack->small;
+    stack->count = 0;
+    stack->capacity = 64;
+}
 
-typedef struct {
-    char *function_name;
-    ASTNode **arguments;
-    int num_arguments;
-} FunctionCallNode;
+static void rope_stack_push(RopeStack* stack, RopeObj* rope) {
+    if (stack->count == stack->capacity) {
+        RopeObj** items = (RopeObj**)malloc(stack->capacity * 2 * sizeof(RopeObj*));
+        memcpy(items, stack->items, stack->count * sizeof(RopeObj*));
+        if (stack->items != stack->small) free(stack->items);
+        stack->items = items;
+        stack->capacity *= 2;
+    }
+    stack->items[stack->count++] = rope;
+}
 
-typedef struct {
-    ASTNode *blueprint_expr;
-    ASTNode **arguments;
-    int num_arguments;
-} SpawnNode;
+static void rope_stack_free(RopeStack* stack) {
+    if (stack->items != stack->small) free(stack->items);
+}
 
-typedef struct {
-    char *child_blueprint_name;
-    char *parent_blueprint_name;
-} AdoptNode;
+void rope_release(RopeObj* rope) {
+    RopeStack stack;
+    rope_stack_init(&stack);
+    rope_stack_push(&stack, rope);
+    while (stack.count > 0) {
+        RopeObj* r = stack.items[--stack.count];
+        if (!r || ref_release(&r->refcount) > 0) continue;
+        rope_stack_push(&stack, r->left);
+        rope_stack_push(&stack, r->right);
+        if (r->mapped) filemap_release((char*)r->view, r->length, true);
+        free(r->flat);
+        free(r);
+    }
+    rope_stack_free(&stack);
+}
 
-typedef struct {
-    ASTNode *condition;
-    ASTNode **body;
-    int num_body_statements;
-    struct AlterClause *alter_clauses;
-    int num_alter_clauses;
-    ASTNode **altern_clause;
-    int num_altern_statements;
-} CheckStatementNode;
+// The rope's characters, gathered on first use. Ropes may be shared across
+// paral_* workers: concurrent callers each gather, and the first buffer
+// published wins.
+static const char* rope_flatten(RopeObj* rope) {
+    char* flat = (char*)ptr_load((void**)&rope->flat);
+    if (flat) return flat;
+    flat = (char*)malloc(rope->length + 1);
+    size_t pos = 0;
+    RopeStack stack;
+    rope_stack_init(&stack);
+    rope_stack_push(&stack, rope);
+    while (stack.count > 0) {
+        RopeObj* r = stack.items[--stack.count];
+        const char* part = (const char*)ptr_load((void**)&r->flat);
+        if (!part) part = r->view;
+        if (part) {
+            memcpy(flat + pos, part, r->length);
+            pos += r->length;
+        } else {
+            rope_stack_push(&stack, r->right);
+            rope_stack_push(&stack, r->left);
+        }
+    }
+    rope_stack_free(&stack);
+    flat[pos] = '\0';
+    if (!ptr_publish((void**)&rope->flat, flat)) {
+        free(flat);
+        flat = (char*)ptr_load((void**)&rope->flat);
+    }
+    return flat;
+}
 
-typedef struct AlterClause {
-    ASTNode *condition;
-    ASTNode **body;
-    int num_body_statements;
-} AlterClause;
+Value* create_rope_value_helper(RopeObj* rope) {
+    Value* val = alloc_value();
+    val->type = VAL_ROPE;
+    val->as.rope = rope;
+    return val;
+}
 
-typedef struct {
-    char *name;
-    char *parent;
-    ASTNode *constructor;
-    ASTNode **attributes;
-    int num_attributes;
-    ASTNode **methods;
-    int num_methods;
-    char *docstring;
-} BlueprintNode;
+static inline bool is_text(const Value* v) {
+    return v->type == VAL_STRING || v->type == VAL_ROPE;
+}
 
-typedef struct {
-    ASTNode **attempt_body;
-    int num_attempt_statements;
-    char *error_var;
-    ASTNode **trap_body;
-    int num_trap_statements;
-    ASTNode **conclude_body;
-    int num_conclude_statements;
-    bool peek;
-} AttemptTrapConcludeNode;
+// A terminated string; reading a slice this way gives it its own copy
+static const char* text_of(const Value* v) {
+    return v->type == VAL_ROPE ? rope_flatten(v->as.rope) : v->as.string;
+}
 
+static size_t text_length(const Value* v) {
+    return v->type == VAL_ROPE ? v->as.rope->length : strlen(v->as.string);
+}
 
+// The characters of a text without copying; they are not terminated
+static const char* text_view(const Value* v, size_t* len) {
+    if (v->type == VAL_STRING) {
+        *len = strlen(v->as.string);
+        return v->as.string;
+    }
+    *len = v->as.rope->length;
+    return v->as.rope->view ? v->as.rope->view : rope_flatten(v->as.rope);
+}
 
-typedef struct {
-    int dummy;
-} HaltNode;
+// Byte order, as strcmp
+static int text_compare(const Value* a, const Value* b) {
+    size_t a_len, b_len;
+    const char* a_chars = text_view(a, &a_len);
+    const char* b_chars = text_view(b, &b_len);
+    int order = memcmp(a_chars, b_chars, a_len < b_len ? a_len : b_len);
+    if (order != 0) return order;
+    return a_len < b_len ? -1 : a_len > b_len;
+}
 
-typedef struct {
-    int dummy;
-} ProceedNode;
+static bool texts_equal(const Value* a, const Value* b) {
+    return text_length(a) == text_length(b) && text_compare(a, b) == 0;
+}
 
-typedef struct {
-    ASTNode *duration;
-} WaitNode;
+// a + b where either side is text; the other side is converted with
+// value_to_string
+static Value* text_concat(Value* a, Value* b) {
+    char* a_str = is_text(a) ? NULL : value_to_string(a);
+    char* b_str = is_text(b) ? NULL : value_to_string(b);
+    size_t a_len = 0, b_len = 0;
+    const char* a_chars = a_str ? a_str : text_view(a, &a_len);
+    const char* b_chars = b_str ? b_str : text_view(b, &b_len);
+    if (a_str) a_len = strlen(a_str);
+    if (b_str) b_len = strlen(b_str);
+    Value* result;
+    if (a_len + b_len <= ROPE_FLAT_LIMIT) {
+        char* joined = (char*)malloc(a_len + b_len + 1);
+        memcpy(joined, a_chars, a_len);
+        memcpy(joined + a_len, b_chars, b_len);
+        joined[a_len + b_len] = '\0';
+        result = alloc_value();
+        result->type = VAL_STRING;
+        result->as.string = joined;
+    } else {
+        RopeObj* left;
+        RopeObj* right;
+        if (a->type == VAL_ROPE) {
+            left = a->as.rope;
+            ref_retain(&left->refcount);
+        } else {
+            left = rope_leaf(a_str ? a_str : a->as.string, a_len);
+        }
+        if (b->type == VAL_ROPE) {
+            right = b->as.rope;
+            ref_retain(&right->refcount);
+        } else {
+            right = rope_leaf(b_str ? b_str : b->as.string, b_len);
+        }
+        result = create_rope_value_helper(rope_concat(left, right));
+    }
+    free(a_str);
+    free(b_str);
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Lists
+// ---------------------------------------------------------------------------
+
+ListObj* list_new(int capacity, bool dense) {
+    ListObj* list = (ListObj*)malloc(sizeof(ListObj));
+    list->refcount = 1;
+    list->count = 0;
+    list->capacity = capacity > 0 ? capacity : 4;
+    list->dense = dense;
+    if (dense) {
+        list->data.numbers = (double*)malloc(list->capacity * sizeof(double));
+    } else {
+        list->data.items = (Value*)malloc(list->capacity * sizeof(Value));
+    }
+    return list;
+}
+
+void list_release(ListObj* list) {
+    if (!list || ref_release(&list->refcount) > 0) return;
+    if (list->dense) {
+        free(list->data.numbers);
+    } else {
+        for (int i = 0; i < list->count; i++) {
+            clear_value(&list->data.items[i]);
+        }
+        free(list->data.items);
+    }
+    free(list);
+}
+
+Value* create_list_value_helper(ListObj* list) {
+    Value* val = alloc_value();
+    val->type = VAL_LIST;
+    val->as.list = list;
+    return val;
+}
+
+// Turns a dense list into an array of inline number Values
+static void list_make_generic(ListObj* list) {
+    if (!list->dense) return;
+    Value* items = (Value*)malloc(list->capacity * sizeof(Value));
+    for (int i = 0; i < list->count; i++) {
+        set_numeric(&items[i], list->data.numbers[i]);
+    }
+    free(list->data.numbers);
+    list->data.items = items;
+    list->dense = false;
+}
+
+static void list_reserve(ListObj* list, int needed) {
+    if (needed <= list->capacity) return;
+    int capacity = list->capacity;
+    while (capacity < needed) capacity *= 2;
+    if (list->dense) {
+        list->data.numbers = (double*)realloc(list->data.numbers, capacity * sizeof(double));
+    } else {
+        list->data.items = (Value*)realloc(list->data.items, capacity * sizeof(Value));
+    }
+    list->capacity = capacity;
+}
+
+// Appends a value, taking ownership of it
+void list_append(ListObj* list, Value* value) {
+    list_reserve(list, list->count + 1);
+    if (list->dense && fits_dense(value)) {
+        list->data.numbers[list->count++] = number_of(value);
+        free_value(value);
+        return;
+    }
+    list_make_generic(list);
+    list->data.items[list->count++] = *value;
+    slab_free(&value_slab, value); // The payload now lives in the list
+}
+
+// Returns a new copy of the item at index; the caller checks bounds
+Value* list_get(ListObj* list, int index) {
+    if (list->dense) {
+        return create_numeric_value_helper(list->data.numbers[index]);
+    }
+    return copy_value(&list->data.items[index]);
+}
+
+// Replaces the item at index, taking ownership of value; the caller checks bounds
+void list_set(ListObj* list, int index, Value* value) {
+    if (list->dense && fits_dense(value)) {
+        list->data.numbers[index] = number_of(value);
+        free_value(value);
+        return;
+    }
+    list_make_generic(list);
+    clear_value(&list->data.items[index]);
+    list->data.items[index] = *value;
+    slab_free(&value_slab, value);
+}
+
+// Growable, always terminated text buffer behind value_to_string, show,
+// interpolation and collection rendering. Appends double the capacity
+// when needed, so building a text of n characters copies O(n) bytes.
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} StrBuf;
+
+static void strbuf_init(StrBuf* sb, size_t cap) {
+    sb->cap = cap > 16 ? cap : 16;
+    sb->data = (char*)malloc(sb->cap);
+    sb->data[0] = '\0';
+    sb->len = 0;
+}
+
+// Makes room for n more characters plus the terminator
+static void strbuf_reserve(StrBuf* sb, size_t n) {
+    if (sb->len + n + 1 > sb->cap) {
+        while (sb->len + n + 1 > sb->cap) sb->cap *= 2;
+        sb->data = (char*)realloc(sb->data, sb->cap);
+    }
+}
+
+static void strbuf_append_n(StrBuf* sb, const char* s, size_t n) {
+    strbuf_reserve(sb, n);
+    memcpy(sb->data + sb->len, s, n);
+    sb->len += n;
+    sb->data[sb->len] = '\0';
+}
+
+static void strbuf_append(StrBuf* sb, const char* s) {
+    strbuf_append_n(sb, s, strlen(s));
+}
+
+// Numbers are formatted straight into the buffer (see numfmt.h)
+static void strbuf_append_number(StrBuf* sb, const Value* v) {
+    strbuf_reserve(sb, NUMFMT_MAX);
+    sb->len += v->type == VAL_INT ? numfmt_int(sb->data + sb->len, v->as.integer) : numfmt_double(sb->data + sb->len, v->as.number);
+    sb->data[sb->len] = '\0';
+}
+
+static void render_value(Value* item, StrBuf* sb);
+static void set_render(SetObj* set, StrBuf* sb);
+
+// The lists and dicts being rendered on this thread, innermost first. Both
+// can hold themselves (l~>push(l)); a container met again inside itself
+// renders as [...] or {...}.
+typedef struct RenderFrame {
+    const void* container;
+    struct RenderFrame* outer;
+} RenderFrame;
+
+static WORKERS_THREAD_LOCAL RenderFrame* render_frames;
+
+static bool render_enter(RenderFrame* frame, const void* container) {
+    for (RenderFrame* f = render_frames; f; f = f->outer) {
+        if (f->container == container) return false;
+    }
+    frame->container = container;
+    frame->outer = render_frames;
+    render_frames = frame;
+    return true;
+}
+
+static void render_leave(RenderFrame* frame) {
+    render_frames = frame->outer;
+}
+
+static void list_render(ListObj* list, StrBuf* sb) {
+    RenderFrame frame;
+    if (!render_enter(&frame, list)) {
+        strbuf_append(sb, "[...]");
+        return;
+    }
+    strbuf_append(sb, "[");
+    for (int i = 0; i < list->count; i++) {
+        if (i > 0) strbuf_append(sb, ", ");
+        if (list->dense) {
+            Value item = {VAL_NUMBER};
+            item.as.number = list->data.numbers[i];
+            strbuf_append_number(sb, &item);
+        } else {
+            render_value(&list->data.items[i], sb);
+        }
+    }
+    strbuf_append(sb, "]");
+    render_leave(&frame);
+}
+
+// Resolves a list index argument, reporting out-of-range access
+static bool list_index_arg(ListObj* list, Value* index_val, int* index) {
+    if (!index_val || !is_number(index_val)) {
+        runtime_errorf("Runtime Error: List index must be a number.\n");
+        return false;
+    }
+    int i = (int)number_of(index_val);
+    if (i < 0 || i >= list->count) {
+        runtime_errorf("Runtime Error: List index %d out of range (length %d).\n", i, list->count);
+        return false;
+    }
+    *index = i;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Dicts
+// ---------------------------------------------------------------------------
+
+static uint32_t hash_bytes(const char* s, size_t n) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t hash_number(double d) {
+    if (d == 0) d = 0; // -0.0 and 0.0 are the same key
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    bits ^= bits >> 33; // murmur3 finalizer
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    bits *= 0xc4ceb9fe1a85ec53ULL;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+// Hashes a dict key; returns false for values that cannot be keys
+static bool hash_key(const Value* key, uint32_t* hash) {
+    switch (key->type) {
+        case VAL_STRING:
+        case VAL_ROPE: {
+            size_t len;
+            const char* chars = text_view(key, &len);
+            *hash = hash_bytes(chars, len);
+            return true;
+        }
+        case VAL_NUMBER:
+        case VAL_INT: *hash = hash_number(number_of(key)); return true;
+        case VAL_BOOL: *hash = key->as.boolean ? 0x9e3779b9u : 0x7f4a7c15u; return true;
+        case VAL_NIL: *hash = 0x165667b1u; return true;
+        default: return false;
+    }
+}
+
+static bool keys_equal(const Value* a, const Value* b) {
+    if (is_number(a) && is_number(b)) return numbers_equal(a, b);
+    if (is_text(a) && is_text(b)) return texts_equal(a, b);
+    if (a->type != b->type) return false;
+    switch (a->type) {
+        case VAL_BOOL: return a->as.boolean == b->as.boolean;
+        case VAL_NIL: return true;
+        default: return false;
+    }
+}
+
+static void dict_build_index(DictObj* dict, int slot_capacity);
+
+DictObj* dict_new(void) {
+    DictObj* dict = (DictObj*)malloc(sizeof(DictObj));
+    dict->refcount = 1;
+    dict->count = 0;
+    dict->entry_count = 0;
+    dict->entry_capacity = 8;
+    dict->entries = (DictEntry*)malloc(dict->entry_capacity * sizeof(DictEntry));
+    dict->index = NULL;
+    dict->walks = 0;
+    dict_build_index(dict, 16);
+    return dict;
+}
+
+void dict_release(DictObj* dict) {
+    if (!dict || ref_release(&dict->refcount) > 0) return;
+    for (int i = 0; i < dict->entry_count; i++) {
+        if (dict->entries[i].live) {
+            clear_value(&dict->entries[i].key);
+            clear_value(&dict->entries[i].value);
+        }
+    }
+    free(dict->entries);
+    free(dict->index);
+    free(dict);
+}
+
+Value* create_dict_value_helper(DictObj* dict) {
+    Value* val = alloc_value();
+    val->type = VAL_DICT;
+    val->as.dict = dict;
+    return val;
+}
+
+// Robin Hood insert of an entry position into the index. The caller
+// guarantees the key is absent and the index has a free slot.
+static void dict_index_insert(DictObj* dict, uint32_t hash, int32_t entry) {
+    uint32_t mask = (uint32_t)dict->slot_capacity - 1;
+    uint32_t pos = hash & mask;
+    uint32_t dist = 0;
+    DictSlot incoming = {hash, entry};
+    for (;;) {
+        DictSlot* slot = &dict->index[pos];
+        if (slot->entry < 0) {
+            *slot = incoming;
+            return;
+        }
+        uint32_t slot_dist = (pos - (slot->hash & mask)) & mask;
+        if (slot_dist < dist) {
+            // The resident is closer to home than we are: take its slot
+            DictSlot displaced = *slot;
+            *slot = incoming;
+            incoming = displaced;
+            dist = slot_dist;
+        }
+        pos = (pos + 1) & mask;
+        dist++;
+    }
+}
+
+// Rebuilds the index at the given size, dropping dead entries on the way
+// unless an iterator is walking them
+static void dict_build_index(DictObj* dict, int slot_capacity) {
+    if (!dict->walks) {
+        int live = 0;
+        for (int i = 0; i < dict->entry_count; i++) {
+            if (dict->entries[i].live) dict->entries[live++] = dict->entries[i];
+        }
+        dict->entry_count = live;
+    }
+    free(dict->index);
+    dict->slot_capacity = slot_capacity;
+    dict->index = (DictSlot*)malloc(slot_capacity * sizeof(DictSlot));
+    for (int i = 0; i < slot_capacity; i++) dict->index[i].entry = -1;
+    for (int i = 0; i < dict->entry_count; i++) {
+        if (dict->entries[i].live) dict_index_insert(dict, dict->entries[i].hash, i);
+    }
+}
+
+// Returns the index slot holding key, or -1
+static int dict_find_slot(DictObj* dict, const Value* key, uint32_t hash) {
+    uint32_t mask = (uint32_t)dict->slot_capacity - 1;
+    uint32_t pos = hash & mask;
+    for (uint32_t dist = 0;; dist++) {
+        DictSlot* slot = &dict->index[pos];
+        if (slot->entry < 0) return -1;
+        // Had the key been here it would have displaced a resident that sits
+        // closer to home than our probe length, so we can stop early.
+        if (((pos - (slot->hash & mask)) & mask) < dist) return -1;
+        if (slot->hash == hash && keys_equal(&dict->entries[slot->entry].key, key)) return (int)pos;
+        pos = (pos + 1) & mask;
+    }
+}
+
+static bool dict_key_arg(const Value* key, uint32_t* hash) {
+    if (!hash_key(key, hash)) {
+        runtime_errorf("Runtime Error: Dict keys must be Text, Num, On/Off or Nil.\n");
+        return false;
+    }
+    return true;
+}
+
+// Returns the stored value for key (borrowed), or NULL
+Value* dict_lookup(DictObj* dict, const Value* key) {
+    uint32_t hash;
+    if (!dict_key_arg(key, &hash)) return NULL;
+    int slot = dict_find_slot(dict, key, hash);
+    return slot < 0 ? NULL : &dict->entries[dict->index[slot].entry].value;
+}
+
+// Inserts or replaces key, copying the key and taking ownership of value
+void dict_set(DictObj* dict, const Value* key, Value* value) {
+    uint32_t hash;
+    if (!dict_key_arg(key, &hash)) {
+        free_value(value);
+        return;
+    }
+    int slot = dict_find_slot(dict, key, hash);
+    if (slot >= 0) {
+        DictEntry* entry = &dict->entries[dict->index[slot].entry];
+        clear_value(&entry->value);
+        entry->value = *value;
+        slab_free(&value_slab, value);
+        return;
+    }
+    if (dict->entry_count >= dict->entry_capacity) {
+        if (dict->count < dict->entry_count / 2 && !dict->walks) {
+            // Mostly dead entries: compacting frees enough room
+            dict_build_index(dict, dict->slot_capacity);
+        } else {
+            dict->entry_capacity *= 2;
+            dict->entries = (DictEntry*)realloc(dict->entries, dict->entry_capacity * sizeof(DictEntry));
+        }
+    }
+    // Keep the index at most 7/8 full
+    if ((dict->entry_count + 1) * 8 > dict->slot_capacity * 7) {
+        dict_build_index(dict, dict->slot_capacity * 2);
+    }
+    DictEntry* entry = &dict->entries[dict->entry_count];
+    entry->hash = hash;
+    entry->live = true;
+    Value* key_copy = copy_value(key);
+    entry->key = *key_copy;
+    slab_free(&value_slab, key_copy);
+    entry->value = *value;
+    slab_free(&value_slab, value);
+    dict_index_insert(dict, hash, dict->entry_count);
+    dict->entry_count++;
+    dict->count++;
+}
+
+bool dict_remove(DictObj* dict, const Value* key) {
+    uint32_t hash;
+    if (!dict_key_arg(key, &hash)) return false;
+    int slot = dict_find_slot(dict, key, hash);
+    if (slot < 0) return false;
+    DictEntry* entry = &dict->entries[dict->index[slot].entry];
+    clear_value(&entry->key);
+    clear_value(&entry->value);
+    entry->live = false;
+    dict->count--;
+    // Backward-shift deletion keeps probe sequences free of tombstones
+    uint32_t mask = (uint32_t)dict->slot_capacity - 1;
+    uint32_t pos = (uint32_t)slot;
+    for (;;) {
+        uint32_t next = (pos + 1) & mask;
+        DictSlot* next_slot = &dict->index[next];
+        if (next_slot->entry < 0 || ((next - (next_slot->hash & mask)) & mask) == 0) break;
+        dict->index[pos] = *next_slot;
+        pos = next;
+    }
+    dict->index[pos].entry = -1;
+    return true;
+}
+
+// Collects the live keys (or values) into a new list in insertion order
+ListObj* dict_collect(DictObj* dict, bool values) {
+    ListObj* list = list_new(dict->count, true);
+    for (int i = 0; i < dict->entry_count; i++) {
+        DictEntry* entry = &dict->entries[i];
+        if (entry->live) list_append(list, copy_value(values ? &entry->value : &entry->key));
+    }
+    return list;
+}
+
+static void dict_render(DictObj* dict, StrBuf* sb) {
+    RenderFrame frame;
+    if (!render_enter(&frame, dict)) {
+        strbuf_append(sb, "{...}");
+        return;
+    }
+    bool first = true;
+    strbuf_append(sb, "{");
+    for (int i = 0; i < dict->entry_count; i++) {
+        DictEntry* entry = &dict->entries[i];
+        if (!entry->live) continue;
+        if (!first) strbuf_append(sb, ", ");
+        first = false;
+        render_value(&entry->key, sb);
+        strbuf_append(sb, ": ");
+        render_value(&entry->value, sb);
+    }
+    strbuf_append(sb, "}");
+    render_leave(&frame);
+}
+
+// Renders a value the way it appears inside a collection: text is quoted
+static void render_value(Value* item, StrBuf* sb) {
+    if (is_number(item)) {
+        strbuf_append_number(sb, item);
+    } else if (is_text(item)) {
+        size_t len;
+        const char* chars = text_view(item, &len);
+        strbuf_append(sb, "\"");
+        strbuf_append_n(sb, chars, len);
+        strbuf_append(sb, "\"");
+    } else if (item->type == VAL_BOOL) {
+        strbuf_append(sb, item->as.boolean ? "true" : "false");
+    } else if (item->type == VAL_LIST) {
+        list_render(item->as.list, sb);
+    } else if (item->type == VAL_DICT) {
+        dict_render(item->as.dict, sb);
+    } else if (item->type == VAL_SET) {
+        set_render(item->as.set, sb);
+    } else {
+        strbuf_append(sb, "nil");
+    }
+}
+
+// Appends the text form of a value: what show and interpolation print
+static void strbuf_append_value(StrBuf* sb, Value* val) {
+    switch (val->type) {
+        case VAL_INT:
+        case VAL_NUMBER:
+            strbuf_append_number(sb, val);
+            break;
+        case VAL_STRING:
+            strbuf_append(sb, val->as.string ? val->as.string : "(null string)");
+            break;
+        case VAL_ROPE: {
+            size_t len;
+            const char* chars = text_view(val, &len);
+            strbuf_append_n(sb, chars, len);
+            break;
+        }
+        case VAL_BOOL:
+            strbuf_append(sb, val->as.boolean ? "true" : "false");
+            break;
+        case VAL_RANGE: {
+            Value bound = {VAL_NUMBER};
+            bound.as.number = val->as.range.start;
+            strbuf_append_number(sb, &bound);
+            strbuf_append(sb, "..");
+            bound.as.number = val->as.range.end;
+            strbuf_append_number(sb, &bound);
+            break;
+        }
+        case VAL_LIST:
+        case VAL_DICT:
+        case VAL_SET:
+            render_value(val, sb);
+            break;
+        case VAL_ITER:
+            strbuf_append(sb, "<iterator>");
+            break;
+        case VAL_FILE:
+            strbuf_append(sb, "<file ");
+            strbuf_append(sb, val->as.file->path);
+            strbuf_append(sb, ">");
+            break;
+        case VAL_PENDING:
+            strbuf_append(sb, val->as.pending->op->kind == IOQ_READ ? "<pending read " : "<pending write ");
+            strbuf_append(sb, val->as.pending->path);
+            strbuf_append(sb, ">");
+            break;
+        case VAL_SOCKET:
+            strbuf_append(sb, val->as.socket->conn && val->as.socket->conn->listener ? "<listener " : "<socket ");
+            strbuf_append(sb, val->as.socket->address);
+            strbuf_append(sb, ">");
+            break;
+        case VAL_NIL:
+            strbuf_append(sb, "nil");
+            break;
+        default:
+            strbuf_append(sb, "Unknown value type");
+            break;
+    }
+}
+
+// One evaluated expression of an interpolation template. Numbers are
+// formatted into the slot itself and text is read in place; only other
+// values need a converted copy.
+#define TEMPLATE_SMALL_SLOTS 8
+
+typedef struct {
+    Value* value;
+    const char* text;
+    size_t length;
+    char* owned;
+    char number[NUMFMT_MAX];
+} TemplateSlot;
+
+// Takes ownership of value; returns the slot's length
+static size_t template_slot_fill(TemplateSlot* ts, Value* value) {
+    ts->value = value;
+    ts->owned = NULL;
+    if (value->type == VAL_INT) {
+        ts->length = numfmt_int(ts->number, value->as.integer);
+        ts->text = ts->number;
+    } else if (value->type == VAL_NUMBER) {
+        ts->length = numfmt_double(ts->number, value->as.number);
+        ts->text = ts->number;
+    } else if (value->type == VAL_STRING && value->as.string) {
+        ts->text = value->as.string;
+        ts->length = strlen(ts->text);
+    } else if (value->type == VAL_ROPE) {
+        ts->text = text_view(value, &ts->length);
+    } else {
+        ts->owned = value_to_string(value);
+        ts->text = ts->owned;
+        ts->length = strlen(ts->text);
+    }
+    return ts->length;
+}
+
+static void template_slot_done(TemplateSlot* ts) {
+    free(ts->owned);
+    free_value(ts->value);
+}
+
+// ---------------------------------------------------------------------------
+// Sets
+// ---------------------------------------------------------------------------
+
+// Members at or above this stay out of the bitset form
+#define SET_BITSET_LIMIT (1 << 24)
+
+typedef enum { SET_UNION, SET_INTERSECT, SET_DIFFERENCE } SetOp;
+
+static int popcount64(uint64_t w) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(w);
+#else
+    int n = 0;
+    for (; w; w &= w - 1) n++;
+    return n;
+#endif
+}
+
+static int ctz64(uint64_t w) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(w);
+#else
+    int n = 0;
+    for (; !(w & 1); w >>= 1) n++;
+    return n;
+#endif
+}
+
+// Returns the bit position for a value that fits a bitset, or -1
+static long set_bit_of(const Value* val) {
+    if (val->type == VAL_INT) {
+        return val->as.integer >= 0 && val->as.integer < SET_BITSET_LIMIT ? (long)val->as.integer : -1;
+    }
+    if (val->type != VAL_NUMBER) return -1;
+    double d = val->as.number;
+    if (d < 0 || d >= SET_BITSET_LIMIT || d != (double)(long)d) return -1;
+    return (long)d;
+}
+
+SetObj* set_new(void) {
+    SetObj* set = (SetObj*)malloc(sizeof(SetObj));
+    set->refcount = 1;
+    set->bitset = true;
+    set->count = 0;
+    set->words = NULL;
+    set->word_count = 0;
+    set->hash = NULL;
+    set->walks = 0;
+    return set;
+}
+
+void set_release(SetObj* set) {
+    if (!set || ref_release(&set->refcount) > 0) return;
+    free(set->words);
+    dict_release(set->hash);
+    free(set);
+}
+
+Value* create_set_value_helper(SetObj* set) {
+    Value* val = alloc_value();
+    val->type = VAL_SET;
+    val->as.set = set;
+    return val;
+}
+
+static void set_to_hash(SetObj* set) {
+    set->hash = dict_new();
+    set->hash->walks = set->walks;
+    for (int w = 0; w < set->word_count; w++) {
+        for (uint64_t bits = set->words[w]; bits; bits &= bits - 1) {
+            Value key = {VAL_INT};
+            key.as.integer = w * 64 + ctz64(bits);
+            dict_set(set->hash, &key, create_nil_value_helper());
+        }
+    }
+    free(set->words);
+    set->words = NULL;
+    set->word_count = 0;
+    set->bitset = false;
+}
+
+bool set_contains(SetObj* set, const Value* val) {
+    if (set->bitset) {
+        long bit = set_bit_of(val);
+        if (bit < 0 || bit / 64 >= set->word_count) return false;
+        return (set->words[bit / 64] >> (bit % 64)) & 1;
+    }
+    uint32_t hash;
+    if (!hash_key(val, &hash)) return false;
+    return dict_find_slot(set->hash, val, hash) >= 0;
+}
+
+void set_add(SetObj* set, const Value* val) {
+    if (set->bitset) {
+        long bit = set_bit_of(val);
+        // Stay a bitset only while it is no sparser than one member per word
+        if (bit >= 0 && (bit / 64 < set->word_count || bit / 64 < 64 || bit / 64 <= set->count)) {
+            int word = (int)(bit / 64);
+            if (word >= set->word_count) {
+                int new_count = set->word_count ? set->word_count : 1;
+                while (new_count <= word) new_count *= 2;
+                set->words = (uint64_t*)realloc(set->words, new_count * sizeof(uint64_t));
+                memset(set->words + set->word_count, 0, (new_count - set->word_count) * sizeof(uint64_t));
+                set->word_count = new_count;
+            }
+            uint64_t mask = (uint64_t)1 << (bit % 64);
+            if (!(set->words[word] & mask)) {
+                set->words[word] |= mask;
+                set->count++;
+            }
+            return;
+        }
+        uint32_t hash;
+        if (!dict_key_arg(val, &hash)) return;
+        set_to_hash(set);
+    }
+    dict_set(set->hash, val, create_nil_value_helper());
+    set->count = set->hash->count;
+}
+
+bool set_remove(SetObj* set, const Value* val) {
+    if (!set_contains(set, val)) return false;
+    if (set->bitset) {
+        long bit = set_bit_of(val);
+        set->words[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+        set->count--;
+        return true;
+    }
+    dict_remove(set->hash, val);
+    set->count = set->hash->count;
+    return true;
+}
+
+// Members as a new list: ascending for bitsets, insertion order otherwise
+ListObj* set_items(SetObj* set) {
+    if (!set->bitset) return dict_collect(set->hash, false);
+    ListObj* list = list_new(set->count, true);
+    for (int w = 0; w < set->word_count; w++) {
+        for (uint64_t bits = set->words[w]; bits; bits &= bits - 1) {
+            list_append(list, create_int_value_helper(w * 64 + ctz64(bits)));
+        }
+    }
+    return list;
+}
+
+// dst[i] = a[i] op b[i] for n words; dst may alias a
+static void bitset_combine(uint64_t* dst, const uint64_t* a, const uint64_t* b, int n, SetOp op) {
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i r = op == SET_UNION ? _mm_or_si128(x, y)
+                  : op == SET_INTERSECT ? _mm_and_si128(x, y)
+                  : _mm_andnot_si128(y, x);
+        _mm_storeu_si128((__m128i*)(dst + i), r);
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = op == SET_UNION ? a[i] | b[i]
+               : op == SET_INTERSECT ? a[i] & b[i]
+               : a[i] & ~b[i];
+    }
+}
+
+SetObj* set_combine(SetObj* a, SetObj* b, SetOp op) {
+    SetObj* result = set_new();
+    if (a->bitset && b->bitset) {
+        int n = op == SET_INTERSECT ? (a->word_count < b->word_count ? a->word_count : b->word_count)
+              : op == SET_UNION ? (a->word_count > b->word_count ? a->word_count : b->word_count)
+              : a->word_count;
+        int overlap = a->word_count < b->word_count ? a->word_count : b->word_count;
+        if (n > 0) {
+            result->words = (uint64_t*)calloc(n, sizeof(uint64_t));
+            result->word_count = n;
+            if (op == SET_INTERSECT) {
+                bitset_combine(result->words, a->words, b->words, n, op);
+            } else {
+                // Start from a, padded with zero words, and fold b into it
+                memcpy(result->words, a->words, a->word_count * sizeof(uint64_t));
+                bitset_combine(result->words, result->words, b->words, op == SET_UNION ? b->word_count : overlap, op);
+            }
+            for (int i = 0; i < n; i++) result->count += popcount64(result->words[i]);
+        }
+        return result;
+    }
+    // Mixed or hash sets: walk the members one at a time
+    ListObj* items = set_items(a);
+    for (int i = 0; i < items->count; i++) {
+        Value* item = list_get(items, i);
+        bool in_b = set_contains(b, item);
+        if (op == SET_UNION || (op == SET_INTERSECT) == in_b) set_add(result, item);
+        free_value(item);
+    }
+    list_release(items);
+    if (op == SET_UNION) {
+        items = set_items(b);
+        for (int i = 0; i < items->count; i++) {
+            Value* item = list_get(items, i);
+            set_add(result, item);
+            free_value(item);
+        }
+        list_release(items);
+    }
+    return result;
+}
+
+static void set_render(SetObj* set, StrBuf* sb) {
+    ListObj* items = set_items(set);
+    strbuf_append(sb, "{");
+    for (int i = 0; i < items->count; i++) {
+        if (i > 0) strbuf_append(sb, ", ");
+        Value* item = list_get(items, i);
+        render_value(item, sb);
+        free_value(item);
+    }
+    strbuf_append(sb, "}");
+    list_release(items);
+}
+
+typedef enum {
+    NODE_PROGRAM,
+    NODE_NUMBER,
+    NODE_BOOL,
+    NODE_NIL,
+    NODE_STRING,
+    NODE_BINARY_OP,
+    NODE_VAR_ACCESS,
+    NODE_VAR_ASSIGN,
+    NODE_CONSTANT_DECL,
+    NODE_SHOW_STATEMENT,
+    NODE_EXPRESSION_STATEMENT,
+    NODE_NICK_DECL,
+    NODE_FUNCTION_DECL,
+    NODE_RETURN_STATEMENT,
+    NODE_FUNCTION_CALL,
+    NODE_CHECK_STATEMENT,
+    NODE_ALTER_CLAUSE,
+    NODE_BLUEPRINT,
+    NODE_ATTRIBUTE_ACCESS,
+    NODE_SPAWN,
+    NODE_ADOPT,
+    NODE_DEN,
+    NODE_CONVERT,
+    NODE_TOOLKIT,
+    NODE_PLUG,
+    NODE_BRIDGE,
+    NODE_INLET,
+    NODE_LINK,
+    NODE_EXPOSE,
+    NODE_HALT,
+    NODE_PROCEED,
+    NODE_WAIT,
+    NODE_TRIGGER,
+    NODE_BLAME,
+    NODE_TYPE,
+    NODE_KIND,
+    NODE_NICK,
+    NODE_HIDDEN,
+    NODE_SHIELDED,
+    NODE_INTERNAL,
+    NODE_EMBED,
+    NODE_PARAL,
+    NODE_HOLD,
+    NODE_SIGNAL,
+    NODE_LISTEN,
+    NODE_ASK,
+    NODE_AUTHEN,
+    NODE_TRANSFORM,
+    NODE_CONDENSE,
+    NODE_PACK,
+    NODE_UNPACK,
+    NODE_INTERPOLATED_STRING,
+    NODE_TRAVERSE,
+    NODE_EACH, // Replaces TRAVERSE
+    NODE_UNTIL,
+    NODE_DOCSTRING,
+    NODE_CONSTRUCTOR_DECL,
+    NODE_ATTEMPT_TRAP_CONCLUDE,
+    NODE_METHOD_CALL,
+    NODE_MODULE,
+    NODE_BRING,
+    NODE_CONTRACT,
+    NODE_UNARY_OP
+} NodeType;
+
+
+typedef struct ASTNode ASTNode;
+
+// The root of a loaded AST. It also lists every node parsed for it, in
+// parse order, which is how heap snapshots (snapshot.h) refer to specs and
+// handlers, and keeps a hash of the JSON it was parsed from.
+typedef struct {
+    ASTNode **statements;
+    int num_statements;
+    ASTNode **nodes;
+    int num_nodes;
+    uint64_t source_hash;
+} ProgramNode;
+
+typedef struct {
+    ASTNode *left;
+    char *op;
+    ASTNode *right;
+} BinaryOpNode;
+
+typedef struct {
+    char *var_name;
+} VarAccessNode;
+
+typedef struct {
+    ASTNode *target;
+    ASTNode *value;
+} VarAssignNode;
+
+typedef struct {
+    char *const_name;
+    ASTNode *value;
+} ConstantDeclNode;
+
+typedef struct {
+    ASTNode *expression;
+} ExpressionStatementNode;
+
+typedef struct {
+    ASTNode **expressions;
+    int num_expressions;
+} ShowStatementNode;
+
+typedef struct {
+    char *original_type;
+    char *alias;
+} NickDeclNode;
+
+typedef struct {
+    char *name;
+    char **params;
+    int num_params;
+    ASTNode **body;
+    int num_body_statements;
+    char *docstring;
+    bool exposed;
+    bool shared;
+    char *func_type;
+    struct FunctionSymbol* symbol;  // made at load, shared by every value of the spec
+} FunctionDeclNode;
+
+
+
+typedef struct {
+    ASTNode *expression;
+} ReturnStatementNode;
+
+typedef struct {
+    char *function_name;
+    ASTNode **arguments;
+    int num_arguments;
+} FunctionCallNode;
+
+typedef struct {
+    ASTNode *blueprint_expr;
+    ASTNode **arguments;
+    int num_arguments;
+} SpawnNode;
+
+typedef struct {
+    char *child_blueprint_name;
+    char *parent_blueprint_name;
+} AdoptNode;
+
+typedef struct {
+    ASTNode *condition;
+    ASTNode **body;
+    int num_body_statements;
+    struct AlterClause *alter_clauses;
+    int num_alter_clauses;
+    ASTNode **altern_clause;
+    int num_altern_statements;
+} CheckStatementNode;
+
+typedef struct AlterClause {
+    ASTNode *condition;
+    ASTNode **body;
+    int num_body_statements;
+} AlterClause;
+
+typedef struct {
+    char *name;
+    char *parent;
+    ASTNode *constructor;
+    ASTNode **attributes;
+    int num_attributes;
+    ASTNode **methods;
+    int num_methods;
+    char *docstring;
+} BlueprintNode;
+
+typedef struct {
+    ASTNode **attempt_body;
+    int num_attempt_statements;
+    char *error_var;
+    ASTNode **trap_body;
+    int num_trap_statements;
+    ASTNode **conclude_body;
+    int num_conclude_statements;
+    bool peek;
+} AttemptTrapConcludeNode;
+
+
+
+typedef struct {
+    int dummy;
+} HaltNode;
+
+typedef struct {
+    int dummy;
+} ProceedNode;
+
+typedef struct {
+    ASTNode *duration;
+} WaitNode;
+
+
+
+typedef struct {
+    char *name;
+    ASTNode **body;
+    int num_body_statements;
+} BlameNode;
+
+typedef struct {
+    char *type_name;
+} TypeNode;
+
+typedef struct {
+    ASTNode *expression;
+} KindNode;
+
+typedef struct {
+    ASTNode *original;
+    ASTNode *alias;
+} NickNode;
+
+typedef struct {
+    ASTNode *declaration;
+} HiddenNode;
+
+typedef struct {
+    ASTNode *declaration;
+} ShieldedNode;
+
+typedef struct {
+    ASTNode *declaration;
+} InternalNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} EmbedNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} ParalNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} HoldNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} SignalNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} ListenNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} AskNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} AuthenNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} TransformNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} CondenseNode;
+
+typedef struct {
+    ASTNode **items;
+    int num_items;
+} PackNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} UnpackNode;
+
+typedef struct {
+    ASTNode *object;
+    char *attribute_name;
+} AttributeAccessNode;
+
+typedef struct {
+    char *name;
+    ASTNode **attributes;
+    int num_attributes;
+} DenNode;
+
+typedef struct {
+    ASTNode *source;
+    char *target_type;
+} ConvertNode;
+
+typedef struct {
+    char *name;
+    ASTNode **body;
+    int num_body_statements;
+} ToolkitNode;
+
+typedef struct {
+    char *toolkit_name;
+    char *file_path;
+} PlugNode;
+
+typedef struct {
+    char *name;
+    ASTNode **body;
+    int num_body_statements;
+} BridgeNode;
+
+typedef struct {
+    ASTNode **body;
+    int num_body_statements;
+} InletNode;
+
+typedef struct {
+    ASTNode *greeter;
+    ASTNode *implementation;
+} LinkNode;
+
+typedef struct {
+    char *identifier;
+} ExposeNode;
+
+typedef struct {
+    char *var_name;
+    ASTNode *start_val;
+    ASTNode *end_val;
+    ASTNode *step_val;
+    ASTNode **body;
+    int num_body_statements;
+} TraverseNode;
+
+typedef struct {
+    char *var_name;
+    ASTNode *iterable;
+    ASTNode **body;
+    int num_body_statements;
+} EachNode;
+
+typedef struct {
+    ASTNode *condition;
+    ASTNode **body;
+    int num_body_statements;
+} UntilNode;
+
+typedef struct {
+    ASTNode *object;
+    char *method_name;
+    ASTNode **args;
+    int num_args;
+} MethodCallNode;
+
+typedef struct {
+    char *name;
+    ASTNode **body;
+    int num_body_statements;
+} ModuleNode;
+
+typedef struct {
+    char *module;
+    char *source;
+} BringNode;
+
+typedef struct {
+    char *name;
+    // For now simple struct
+} ContractNode;
+
+typedef struct {
+    char *error_name;
+    ASTNode *message;
+} TriggerNode;
+
+typedef enum {
+    INTERPOLATED_STRING_PART_STRING,
+    INTERPOLATED_STRING_PART_EXPRESSION
+} InterpolatedStringPartType;
+
+typedef struct {
+    InterpolatedStringPartType type;
+    union {
+        char* string_val;
+        ASTNode* expression;
+    } data;
+    size_t length;          // of string_val, measured at load
+} InterpolatedStringPart;
+
+// The parts form a template: the literal total and the number of
+// expression slots are known at load, so evaluation only measures the
+// slots before writing the result into an exactly sized buffer
+typedef struct {
+    InterpolatedStringPart **parts;
+    int num_parts;
+    int num_slots;
+    size_t literal_length;
+} InterpolatedStringNode;
+
+typedef struct {
+    char **params;
+    int num_params;
+    ASTNode **body;
+    int num_body_statements;
+} ConstructorNode;
+
+typedef union {
+    ProgramNode program;
+    double number_val;
+    bool boolean_val;
+    char* string_val;
+    char* docstring_val;
+    BinaryOpNode binary_op;
+    VarAccessNode var_access;
+    VarAssignNode var_assign;
+    ConstantDeclNode constant_decl;
+    ExpressionStatementNode expr_statement;
+    ShowStatementNode show_statement;
+    NickDeclNode nick_decl;
+    FunctionDeclNode function_decl;
+    ReturnStatementNode return_statement;
+    FunctionCallNode function_call;
+    CheckStatementNode check_statement;
+    BlueprintNode blueprint;
+    AttributeAccessNode attribute_access;
+    SpawnNode spawn;
+    AdoptNode adopt;
+    DenNode den;
+    ConvertNode convert;
+    ToolkitNode toolkit;
+    PlugNode plug;
+    BridgeNode bridge;
+    InletNode inlet;
+    LinkNode link;
+    ExposeNode expose;
+    InterpolatedStringNode interpolated_string;
+    TraverseNode traverse; // Kept for legacy if needed, or mapped to Each
+    EachNode each;
+    UntilNode until;
+    MethodCallNode method_call;
+    ModuleNode module;
+    BringNode bring;
+    ContractNode contract;
+    struct {
+        char *op;
+        ASTNode *operand;
+    } unary_op;
+    HaltNode halt;
+    ProceedNode proceed;
+    WaitNode wait;
+    TriggerNode trigger;
+    BlameNode blame;
+    TypeNode type_node;
+    KindNode kind;
+    NickNode nick;
+    HiddenNode hidden;
+    ShieldedNode shielded;
+    InternalNode internal;
+    EmbedNode embed;
+    ParalNode paral;
+    HoldNode hold;
+    SignalNode signal_node;
+    ListenNode listen;
+    AskNode ask;
+    AuthenNode authen;
+    TransformNode transform;
+    CondenseNode condense;
+    PackNode pack;
+    UnpackNode unpack;
+    ConstructorNode constructor_decl;
+    AttemptTrapConcludeNode attempt_trap_conclude;
+    TriggerNode trigger_node;
+} ASTNodeData;
+
+struct ASTNode {
+    NodeType type;
+    int index;  // in its ProgramNode's nodes
+    ASTNodeData data;
+};
+
+// Runs a spec with the given arguments, taking ownership of them. Returns
+// the spec's forwarded value, or Nil.
+Value* call_spec(FunctionSymbol* func_sym, Value** args, int argc, Scope* scope) {
+    ASTNode* func_node = func_sym->node;
+    if (argc != func_node->data.function_decl.num_params) {
+        runtime_errorf("Function '%s' called with incorrect number of arguments.\n", func_sym->name);
+        for (int i = 0; i < argc; i++) free_value(args[i]);
+        return create_nil_value_helper();
+    }
+    if (func_sym->compiled) {
+        Value* compiled_result = func_sym->compiled(args, argc, scope);
+        if (compiled_result) return compiled_result;
+    }
+    // Parameters are always local, so a spec never writes to a caller's
+    // variable of the same name (which would also race under paral_*).
+    Scope* func_scope = create_scope(scope);
+    for (int i = 0; i < argc; i++) {
+        define_variable(func_scope, func_node->data.function_decl.params[i], args[i], false);
+    }
+
+    Value* result_val = NULL;
+    for (int i = 0; i < func_node->data.function_decl.num_body_statements; i++) {
+        ASTNode* statement_node = func_node->data.function_decl.body[i];
+        Value* statement_result = interpret_ast(statement_node, func_scope);
+
+        if (statement_node->type == NODE_RETURN_STATEMENT) {
+            result_val = statement_result;
+            break;
+        }
+        free_value(statement_result);
+    }
+
+    destroy_scope(func_scope);
+    return result_val ? result_val : create_nil_value_helper();
+}
+
+// ---------------------------------------------------------------------------
+// Iterators
+// ---------------------------------------------------------------------------
+
+// Pull-based iteration shared by each loops and the sequence builtins. A
+// source iterator walks a range, list, dict (keys), set, text (characters)
+// or file (lines) in place, the lines of a regular file being slices of its
+// contents; json records parse one line of another iterator at a time and
+// csv chunks read a block of rows at a time;
+// transform and filter wrap another iterator and
+// call their spec as each item is pulled, so a transform -> filter ->
+// condense chain handles one item at a time and never builds intermediate
+// lists. Iterators are single pass: copies share one cursor. A dict or set
+// being walked keeps its entries where they are (see DictObj.walks), so
+// keys added by the loop body are reached and none are skipped.
+typedef enum {
+    ITER_RANGE,
+    ITER_INT_RANGE,
+    ITER_LIST,
+    ITER_DICT,
+    ITER_SET,
+    ITER_TEXT,
+    ITER_LINES,
+    ITER_TEXT_LINES,
+    ITER_JSON,
+    ITER_CSV,
+    ITER_TRANSFORM,
+    ITER_FILTER
+} IterKind;
+
+typedef struct IterObj {
+    int refcount;
+    IterKind kind;
+    union {
+        struct { double next; double end; double step; } range;
+        struct { int64_t next; int64_t end; int64_t step; } int_range;
+        struct { ListObj* list; int pos; } list;
+        struct { DictObj* dict; int pos; } dict;
+        struct { SetObj* set; long pos; bool bits; } set;
+        struct { char* text; size_t pos; } text;
+        struct { FILE* file; char* buf; size_t cap; struct FileObj* handle; } lines;
+        struct { RopeObj* source; const char* chars; size_t length; size_t pos; } text_lines;
+        struct { struct IterObj* source; FunctionSymbol* fn; } adapter;
+        struct { struct IterObj* source; long line; } json;
+        struct { struct CsvReader* reader; long rows; } csv;
+    } as;
+} IterObj;
+
+static void csv_reader_free(struct CsvReader* r);
+static DictObj* csv_read_chunk(struct CsvReader* r, long max_rows);
+
+static IterObj* iter_new(IterKind kind) {
+    IterObj* it = (IterObj*)calloc(1, sizeof(IterObj));
+    it->refcount = 1;
+    it->kind = kind;
+    return it;
+}
+
+void iter_retain(IterObj* it) {
+    ref_retain(&it->refcount);
+}
+
+void iter_release(IterObj* it) {
+    if (!it || ref_release(&it->refcount) > 0) return;
+    switch (it->kind) {
+        case ITER_LIST: list_release(it->as.list.list); break;
+        case ITER_DICT:
+            ref_release(&it->as.dict.dict->walks);
+            dict_release(it->as.dict.dict);
+            break;
+        case ITER_SET:
+            ref_release(&it->as.set.set->walks);
+            if (it->as.set.set->hash) ref_release(&it->as.set.set->hash->walks);
+            set_release(it->as.set.set);
+            break;
+        case ITER_TEXT: free(it->as.text.text); break;
+        case ITER_LINES:
+            // A handle's stream is closed with the handle
+            if (it->as.lines.handle) file_release(it->as.lines.handle);
+            else if (it->as.lines.file) fclose(it->as.lines.file);
+            free(it->as.lines.buf);
+            break;
+        case ITER_TEXT_LINES: rope_release(it->as.text_lines.source); break;
+        case ITER_JSON: iter_release(it->as.json.source); break;
+        case ITER_CSV: csv_reader_free(it->as.csv.reader); break;
+        case ITER_TRANSFORM:
+        case ITER_FILTER: iter_release(it->as.adapter.source); break;
+        default: break;
+    }
+    free(it);
+}
+
+Value* create_iter_value_helper(IterObj* it) {
+    Value* val = alloc_value();
+    val->type = VAL_ITER;
+    val->as.iter = it;
+    return val;
+}
+
+static IterObj* file_lines_iter(struct FileObj* file);
+static Value* json_decode(const char* chars, size_t len, size_t* error_at);
+
+// Returns an iterator over a value (a new reference), or NULL if the value
+// is not iterable; a file handle gives its lines
+IterObj* iter_from_value(Value* val) {
+    IterObj* it;
+    switch (val->type) {
+        case VAL_ITER:
+            ref_retain(&val->as.iter->refcount);
+            return val->as.iter;
+        case VAL_FILE:
+            return file_lines_iter(val->as.file);
+        case VAL_RANGE:
+            if (fabs(val->as.range.start) <= INT_EXACT_LIMIT && fabs(val->as.range.end) <= INT_EXACT_LIMIT &&
+                val->as.range.start == (double)(int64_t)val->as.range.start &&
+                val->as.range.end == (double)(int64_t)val->as.range.end) {
+                // Integral bounds count with an exact int64 cursor
+                it = iter_new(ITER_INT_RANGE);
+                it->as.int_range.next = (int64_t)val->as.range.start;
+                it->as.int_range.end = (int64_t)val->as.range.end;
+                it->as.int_range.step = it->as.int_range.next > it->as.int_range.end ? -1 : 1;
+                return it;
+            }
+            it = iter_new(ITER_RANGE);
+            it->as.range.next = val->as.range.start;
+            it->as.range.end = val->as.range.end;
+            it->as.range.step = val->as.range.start > val->as.range.end ? -1.0 : 1.0;
+            return it;
+        case VAL_LIST:
+            it = iter_new(ITER_LIST);
+            it->as.list.list = val->as.list;
+            ref_retain(&val->as.list->refcount);
+            return it;
+        case VAL_DICT:
+            it = iter_new(ITER_DICT);
+            it->as.dict.dict = val->as.dict;
+            ref_retain(&val->as.dict->refcount);
+            ref_retain(&val->as.dict->walks);
+            return it;
+        case VAL_SET:
+            it = iter_new(ITER_SET);
+            it->as.set.set = val->as.set;
+            it->as.set.bits = val->as.set->bitset;
+            ref_retain(&val->as.set->refcount);
+            ref_retain(&val->as.set->walks);
+            if (val->as.set->hash) ref_retain(&val->as.set->hash->walks);
+            return it;
+        case VAL_STRING:
+        case VAL_ROPE: {
+            size_t len;
+            const char* chars = text_view(val, &len);
+            it = iter_new(ITER_TEXT);
+            it->as.text.text = (char*)malloc(len + 1);
+            memcpy(it->as.text.text, chars, len);
+            it->as.text.text[len] = '\0';
+            return it;
+        }
+        default:
+            return NULL;
+    }
+}
+
+// Yields the next item into *out (owned by the caller). Returns false once
+// the iterator is exhausted. Specs run with `scope` as their parent.
+bool iter_next(IterObj* it, Scope* scope, Value** out) {
+    switch (it->kind) {
+        case ITER_RANGE: {
+            double i = it->as.range.next;
+            if (it->as.range.step > 0 ? i > it->as.range.end : i < it->as.range.end) return false;
+            it->as.range.next = i + it->as.range.step;
+            *out = create_number_value_helper(i);
+            return true;
+        }
+        case ITER_INT_RANGE: {
+            int64_t i = it->as.int_range.next;
+            if (it->as.int_range.step > 0 ? i > it->as.int_range.end : i < it->as.int_range.end) return false;
+            it->as.int_range.next = i + it->as.int_range.step;
+            *out = create_int_value_helper(i);
+            return true;
+        }
+        case ITER_LIST: {
+            // Reads the live list, so items pushed during the walk are seen
+            ListObj* list = it->as.list.list;
+            if (it->as.list.pos >= list->count) return false;
+            *out = list_get(list, it->as.list.pos++);
+            return true;
+        }
+        case ITER_DICT: {
+            DictObj* dict = it->as.dict.dict;
+            while (it->as.dict.pos < dict->entry_count) {
+                DictEntry* entry = &dict->entries[it->as.dict.pos++];
+                if (entry->live) {
+                    *out = copy_value(&entry->key);
+                    return true;
+                }
+            }
+            return false;
+        }
+        case ITER_SET: {
+            SetObj* set = it->as.set.set;
+            if (it->as.set.bits && !set->bitset) {
+                // The set became a hash set mid-walk. Its first entries are
+                // the former bits in ascending order, so go on from the
+                // first one at or past the bit cursor.
+                DictObj* dict = set->hash;
+                int pos = 0;
+                while (pos < dict->entry_count &&
+                       (!dict->entries[pos].live ||
+                        (dict->entries[pos].key.type == VAL_INT && dict->entries[pos].key.as.integer >= 0 &&
+                         dict->entries[pos].key.as.integer < it->as.set.pos))) {
+                    pos++;
+                }
+                it->as.set.pos = pos;
+                it->as.set.bits = false;
+            }
+            if (!set->bitset) {
+                // Hash sets walk their table's entries like a dict
+                DictObj* dict = set->hash;
+                while (it->as.set.pos < dict->entry_count) {
+                    DictEntry* entry = &dict->entries[it->as.set.pos++];
+                    if (entry->live) {
+                        *out = copy_value(&entry->key);
+                        return true;
+                    }
+                }
+                return false;
+            }
+            for (long bit = it->as.set.pos; bit / 64 < set->word_count; ) {
+                uint64_t bits = set->words[bit / 64] >> (bit % 64);
+                if (bits) {
+                    bit += ctz64(bits);
+                    it->as.set.pos = bit + 1;
+                    *out = create_int_value_helper(bit);
+                    return true;
+                }
+                bit = (bit / 64 + 1) * 64;
+            }
+            it->as.set.pos = (long)set->word_count * 64;
+            return false;
+        }
+        case ITER_TEXT: {
+            // One UTF-8 character at a time
+            const unsigned char* p = (const unsigned char*)it->as.text.text + it->as.text.pos;
+            if (!*p) return false;
+            size_t n = 1;
+            if (*p >= 0xF0) n = 4;
+            else if (*p >= 0xE0) n = 3;
+            else if (*p >= 0xC0) n = 2;
+            for (size_t k = 1; k < n; k++) {
+                if ((p[k] & 0xC0) != 0x80) { n = k; break; }
+            }
+            char* ch = (char*)malloc(n + 1);
+            memcpy(ch, p, n);
+            ch[n] = '\0';
+            it->as.text.pos += n;
+            *out = alloc_value();
+            (*out)->type = VAL_STRING;
+            (*out)->as.string = ch;
+            return true;
+        }
+        case ITER_LINES: {
+            if (!it->as.lines.file) return false;
+            size_t len = 0;
+            for (;;) {
+                if (len + 2 > it->as.lines.cap) {
+                    it->as.lines.cap = it->as.lines.cap ? it->as.lines.cap * 2 : 256;
+                    it->as.lines.buf = (char*)realloc(it->as.lines.buf, it->as.lines.cap);
+                }
+                if (!fgets(it->as.lines.buf + len, (int)(it->as.lines.cap - len), it->as.lines.file)) break;
+                len += strlen(it->as.lines.buf + len);
+                if (len > 0 && it->as.lines.buf[len - 1] == '\n') break;
+            }
+            if (len == 0) {
+                // End of file: release the handle right away
+                if (!it->as.lines.handle) fclose(it->as.lines.file);
+                it->as.lines.file = NULL;
+                return false;
+            }
+            while (len > 0 && (it->as.lines.buf[len - 1] == '\n' || it->as.lines.buf[len - 1] == '\r')) len--;
+            it->as.lines.buf[len] = '\0';
+            *out = create_string_value_helper(it->as.lines.buf);
+            return true;
+        }
+        case ITER_TEXT_LINES: {
+            // Zero copy: each line is a slice of the contents
+            const char* chars = it->as.text_lines.chars;
+            size_t length = it->as.text_lines.length;
+            size_t pos = it->as.text_lines.pos;
+            if (pos >= length) return false;
+            const char* nl = (const char*)memchr(chars + pos, '\n', length - pos);
+            size_t end = nl ? (size_t)(nl - chars) : length;
+            it->as.text_lines.pos = end + 1;
+            if (end > pos && chars[end - 1] == '\r') end--;
+            ref_retain(&it->as.text_lines.source->refcount);
+            *out = create_rope_value_helper(rope_slice(it->as.text_lines.source, chars + pos, end - pos));
+            return true;
+        }
+        case ITER_JSON: {
+            // One record per line; blank lines are skipped
+            Value* line;
+            while (iter_next(it->as.json.source, scope, &line)) {
+                it->as.json.line++;
+                if (!is_text(line)) {
+                    runtime_errorf("Runtime Error: JSON record %ld is not text.\n", it->as.json.line);
+                    free_value(line);
+                    *out = create_nil_value_helper();
+                    return true;
+                }
+                size_t len;
+                const char* chars = text_view(line, &len);
+                size_t start = 0;
+                while (start < len && is_space(chars[start])) start++;
+                if (start == len) {
+                    free_value(line);
+                    continue;
+                }
+                size_t error_at;
+                *out = json_decode(chars, len, &error_at);
+                if (!*out) {
+                    runtime_errorf("Runtime Error: Line %ld is not valid JSON (at column %zu).\n", it->as.json.line, error_at + 1);
+                    *out = create_nil_value_helper();
+                }
+                free_value(line);
+                return true;
+            }
+            return false;
+        }
+        case ITER_CSV: {
+            DictObj* chunk = csv_read_chunk(it->as.csv.reader, it->as.csv.rows);
+            if (!chunk) return false;
+            *out = create_dict_value_helper(chunk);
+            return true;
+        }
+        case ITER_TRANSFORM: {
+            Value* item;
+            if (!iter_next(it->as.adapter.source, scope, &item)) return false;
+            *out = call_spec(it->as.adapter.fn, &item, 1, scope);
+            return true;
+        }
+        case ITER_FILTER: {
+            Value* item;
+            while (iter_next(it->as.adapter.source, scope, &item)) {
+                Value* arg = copy_value(item);
+                Value* keep = call_spec(it->as.adapter.fn, &arg, 1, scope);
+                bool keep_item = keep->type == VAL_BOOL && keep->as.boolean;
+                free_value(keep);
+                if (keep_item) {
+                    *out = item;
+                    return true;
+                }
+                free_value(item);
+            }
+            return false;
+        }
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// Native builtins and toolkits
+// ---------------------------------------------------------------------------
+
+// Natives receive already-evaluated arguments and return a new value. The
+// caller keeps ownership of the arguments. Methods get the receiver as args[0].
+typedef Value* (*NativeFn)(Value** args, int argc, Scope* scope);
+
+typedef struct {
+    const char* name;
+    NativeFn fn;
+} NativeEntry;
+
+typedef struct {
+    const char* name;
+    const NativeEntry* members;
+} NativeToolkit;
+
+static bool native_arity(const char* name, int argc, int expected) {
+    if (argc != expected) {
+        runtime_errorf("Runtime Error: '%s' expects %d argument(s), got %d.\n", name, expected, argc);
+        return false;
+    }
+    return true;
+}
+
+static bool number_arg(const char* name, Value* v) {
+    if (!is_number(v)) {
+        runtime_errorf("Runtime Error: '%s' expects a number.\n", name);
+        return false;
+    }
+    return true;
+}
+
+static bool text_arg(const char* name, Value* v) {
+    if (!is_text(v)) {
+        runtime_errorf("Runtime Error: '%s' expects a text.\n", name);
+        return false;
+    }
+    return true;
+}
+
+static Value* native_length(Value** args, int argc, Scope* scope) {
+    if (!native_arity("length", argc, 1)) return create_nil_value_helper();
+    if (args[0]->type == VAL_LIST) return create_int_value_helper(args[0]->as.list->count);
+    if (args[0]->type == VAL_DICT) return create_int_value_helper(args[0]->as.dict->count);
+    if (args[0]->type == VAL_SET) return create_int_value_helper(args[0]->as.set->count);
+    if (is_text(args[0])) return create_int_value_helper((int64_t)text_length(args[0]));
+    runtime_errorf("Runtime Error: 'length' expects a list, dict, set or text.\n");
+    return create_nil_value_helper();
+}
+
+// Resolves the spec and sequence arguments shared by the sequence builtins
+static bool sequence_args(const char* name, Value** args, IterObj** it) {
+    if (args[0]->type != VAL_FUNCTION) {
+        runtime_errorf("Runtime Error: '%s' expects a spec as its first argument.\n", name);
+        return false;
+    }
+    *it = iter_from_value(args[1]);
+    if (!*it) {
+        runtime_errorf("Runtime Error: '%s' expects a range, list, dict, set, text or iterator.\n", name);
+        return false;
+    }
+    return true;
+}
+
+static Value* native_transform(Value** args, int argc, Scope* scope) {
+    IterObj* source;
+    if (!native_arity("transform", argc, 2) || !sequence_args("transform", args, &source)) return create_nil_value_helper();
+    IterObj* it = iter_new(ITER_TRANSFORM);
+    it->as.adapter.source = source;
+    it->as.adapter.fn = args[0]->as.function;
+    return create_iter_value_helper(it);
+}
+
+static Value* native_filter(Value** args, int argc, Scope* scope) {
+    IterObj* source;
+    if (!native_arity("filter", argc, 2) || !sequence_args("filter", args, &source)) return create_nil_value_helper();
+    IterObj* it = iter_new(ITER_FILTER);
+    it->as.adapter.source = source;
+    it->as.adapter.fn = args[0]->as.function;
+    return create_iter_value_helper(it);
+}
+
+// Drains an iterator into a new list
+static ListObj* iter_collect(IterObj* it, Scope* scope) {
+    ListObj* list = list_new(0, true);
+    Value* item;
+    while (iter_next(it, scope, &item)) list_append(list, item);
+    return list;
+}
+
+static Value* native_map(Value** args, int argc, Scope* scope) {
+    Value* lazy = native_transform(args, argc, scope);
+    if (lazy->type != VAL_ITER) return lazy;
+    Value* result = create_list_value_helper(iter_collect(lazy->as.iter, scope));
+    free_value(lazy);
+    return result;
+}
+
+// Combiners condense can hand to a numeric kernel instead of calling the spec
+typedef enum { COMBINE_NONE, COMBINE_SUM, COMBINE_MIN, COMBINE_MAX } Combiner;
+
+static bool is_param_access(ASTNode* node, const char* name) {
+    return node->type == NODE_VAR_ACCESS && strcmp(node->data.var_access.var_name, name) == 0;
+}
+
+// Recognizes specs of the form `spec f with a, b: forward a + b done` (or
+// b + a, math~>min(a, b), math~>max(a, b))
+static Combiner recognize_combiner(FunctionSymbol* func_sym) {
+    FunctionDeclNode* decl = &func_sym->node->data.function_decl;
+    if (decl->num_params != 2 || decl->num_body_statements != 1) return COMBINE_NONE;
+    ASTNode* ret = decl->body[0];
+    if (ret->type != NODE_RETURN_STATEMENT || !ret->data.return_statement.expression) return COMBINE_NONE;
+    ASTNode* expr = ret->data.return_statement.expression;
+    const char* a = decl->params[0];
+    const char* b = decl->params[1];
+    if (expr->type == NODE_BINARY_OP && strcmp(expr->data.binary_op.op, "+") == 0) {
+        ASTNode* l = expr->data.binary_op.left;
+        ASTNode* r = expr->data.binary_op.right;
+        if ((is_param_access(l, a) && is_param_access(r, b)) || (is_param_access(l, b) && is_param_access(r, a))) return COMBINE_SUM;
+    }
+    if (expr->type == NODE_METHOD_CALL && expr->data.method_call.num_args == 2 &&
+        expr->data.method_call.object->type == NODE_VAR_ACCESS &&
+        strcmp(expr->data.method_call.object->data.var_access.var_name, "math") == 0 &&
+        is_param_access(expr->data.method_call.args[0], a) && is_param_access(expr->data.method_call.args[1], b)) {
+        if (strcmp(expr->data.method_call.method_name, "min") == 0) return COMBINE_MIN;
+        if (strcmp(expr->data.method_call.method_name, "max") == 0) return COMBINE_MAX;
+    }
+    return COMBINE_NONE;
+}
+
+static bool int_add(int64_t a, int64_t b, int64_t* out);
+
+// Sums a dense list onto the int start as `+` would fold it. kern_sum adds
+// in doubles, which is exact only while every partial sum stays within
+// 2^53; past that, integral items are added in int64. Returns NULL once the
+// int64 sum overflows, where `+` promotes to a decimal part way through.
+static Value* dense_sum(const double* x, int n, int64_t start) {
+    if (n == 0) return create_int_value_helper(start);
+    double low = kern_minmax(x, n, 0), high = kern_minmax(x, n, 1);
+    double bound = fmax(fabs(low), fabs(high)) * n + fabs((double)start);
+    if (bound <= INT_EXACT_LIMIT) return create_numeric_value_helper((double)start + kern_sum(x, n));
+    int64_t total = start;
+    for (int i = 0; i < n; i++) {
+        if (!(fabs(x[i]) <= INT_EXACT_LIMIT) || x[i] != (double)(int64_t)x[i]) {
+            // A fractional item: the fold is in doubles from here anyway
+            return create_numeric_value_helper((double)start + kern_sum(x, n));
+        }
+        if (!int_add(total, (int64_t)x[i], &total)) return NULL;
+    }
+    return create_int_value_helper(total);
+}
+
+// Folds a dense list with a recognized combiner. Returns NULL when the
+// combiner is not recognized and the spec has to be called, or when an
+// integral sum overflows and has to be promoted item by item.
+static Value* condense_dense(Combiner combiner, ListObj* list, Value* initial) {
+    if (combiner == COMBINE_NONE) return NULL;
+    if (list->count == 0) return initial ? copy_value(initial) : create_nil_value_helper();
+    double r;
+    if (combiner == COMBINE_SUM) {
+        if (!initial || initial->type == VAL_INT) {
+            return dense_sum(list->data.numbers, list->count, initial ? initial->as.integer : 0);
+        }
+        r = kern_sum(list->data.numbers, list->count);
+        if (initial) r = number_of(initial) + r;
+    } else {
+        int op = combiner == COMBINE_MAX;
+        r = kern_minmax(list->data.numbers, list->count, op);
+        if (initial) {
+            double i = number_of(initial);
+            r = op ? (i > r ? i : r) : (i < r ? i : r);
+        }
+    }
+    return create_numeric_value_helper(r);
+}
+
+// condense(spec, sequence[, initial]): folds the sequence with spec(acc, item).
+// Without an initial value the first item starts the fold.
+static Value* native_condense(Value** args, int argc, Scope* scope) {
+    IterObj* it;
+    if (argc != 2 && argc != 3) {
+        runtime_errorf("Runtime Error: 'condense' expects 2 or 3 argument(s), got %d.\n", argc);
+        return create_nil_value_helper();
+    }
+    if (args[0]->type == VAL_FUNCTION && args[1]->type == VAL_LIST && args[1]->as.list->dense &&
+        (argc == 2 || is_number(args[2]))) {
+        Value* fast = condense_dense(recognize_combiner(args[0]->as.function), args[1]->as.list, argc == 3 ? args[2] : NULL);
+        if (fast) return fast;
+    }
+    if (!sequence_args("condense", args, &it)) return create_nil_value_helper();
+    Value* acc = NULL;
+    if (argc == 3) acc = copy_value(args[2]);
+    else if (!iter_next(it, scope, &acc)) acc = create_nil_value_helper();
+    Value* item;
+    while (iter_next(it, scope, &item)) {
+        Value* call_args[2] = {acc, item};
+        acc = call_spec(args[0]->as.function, call_args, 2, scope);
+    }
+    iter_release(it);
+    return acc;
+}
+
+// Parallel forms of transform and condense. The list is cut into chunks that
+// the worker pool (workers.h) processes concurrently; each chunk runs its
+// spec calls under its own scratch scope, so tasks only share read access
+// to the caller's variables. Specs used this way must not assign to outer
+// variables or modify shared collections.
+#define PARAL_CHUNKS_PER_WORKER 4
+
+typedef struct {
+    FunctionSymbol* fn;
+    ListObj* list;
+    Scope* scope;
+    int chunk_size;
+    Value** results;    // one per item (transform) or per chunk (condense)
+    int stride;         // condense tree: distance between partials to combine
+} ParalJob;
+
+static bool paral_args(const char* name, Value** args) {
+    if (args[0]->type != VAL_FUNCTION) {
+        runtime_errorf("Runtime Error: '%s' expects a spec as its first argument.\n", name);
+        return false;
+    }
+    if (args[1]->type != VAL_LIST) {
+        runtime_errorf("Runtime Error: '%s' expects a list.\n", name);
+        return false;
+    }
+    return true;
+}
+
+static int paral_chunk_size(int count) {
+    int chunks = workers_count() * PARAL_CHUNKS_PER_WORKER;
+    int size = (count + chunks - 1) / chunks;
+    return size > 0 ? size : 1;
+}
+
+static void paral_transform_chunk(void* ctx, int task) {
+    ParalJob* job = (ParalJob*)ctx;
+    int start = task * job->chunk_size;
+    int end = start + job->chunk_size;
+    if (end > job->list->count) end = job->list->count;
+    Scope* scratch = create_scope(job->scope);
+    for (int i = start; i < end; i++) {
+        Value* item = list_get(job->list, i);
+        job->results[i] = call_spec(job->fn, &item, 1, scratch);
+    }
+    destroy_scope(scratch);
+}
+
+static Value* native_paral_transform(Value** args, int argc, Scope* scope) {
+    if (!native_arity("paral_transform", argc, 2) || !paral_args("paral_transform", args)) return create_nil_value_helper();
+    ParalJob job = {args[0]->as.function, args[1]->as.list, scope};
+    int count = job.list->count;
+    job.chunk_size = paral_chunk_size(count);
+    job.results = (Value**)malloc((count > 0 ? count : 1) * sizeof(Value*));
+    workers_run(paral_transform_chunk, &job, (count + job.chunk_size - 1) / job.chunk_size);
+    ListObj* out = list_new(count, true);
+    for (int i = 0; i < count; i++) list_append(out, job.results[i]);
+    free(job.results);
+    return create_list_value_helper(out);
+}
+
+// Folds one chunk left to right, starting from its first item
+static void paral_condense_chunk(void* ctx, int task) {
+    ParalJob* job = (ParalJob*)ctx;
+    int start = task * job->chunk_size;
+    int end = start + job->chunk_size;
+    if (end > job->list->count) end = job->list->count;
+    Scope* scratch = create_scope(job->scope);
+    Value* acc = list_get(job->list, start);
+    for (int i = start + 1; i < end; i++) {
+        Value* call_args[2] = {acc, list_get(job->list, i)};
+        acc = call_spec(job->fn, call_args, 2, scratch);
+    }
+    destroy_scope(scratch);
+    job->results[task] = acc;
+}
+
+// One level of the reduction tree: partial i absorbs partial i + stride
+static void paral_combine_pair(void* ctx, int task) {
+    ParalJob* job = (ParalJob*)ctx;
+    int left = task * job->stride * 2;
+    Scope* scratch = create_scope(job->scope);
+    Value* call_args[2] = {job->results[left], job->results[left + job->stride]};
+    job->results[left] = call_spec(job->fn, call_args, 2, scratch);
+    destroy_scope(scratch);
+}
+
+// paral_condense(spec, list, initial, associative). Only an associative
+// combiner can be regrouped, so without the flag this is plain condense.
+// With it, chunks fold in parallel and their partial results are combined
+// pairwise in a tree, always keeping left-to-right order.
+static Value* native_paral_condense(Value** args, int argc, Scope* scope) {
+    if (!native_arity("paral_condense", argc, 4) || !paral_args("paral_condense", args)) return create_nil_value_helper();
+    if (!value_to_bool(args[3])) return native_condense(args, 3, scope);
+    ParalJob job = {args[0]->as.function, args[1]->as.list, scope};
+    int count = job.list->count;
+    if (count == 0) return copy_value(args[2]);
+    job.chunk_size = paral_chunk_size(count);
+    int chunks = (count + job.chunk_size - 1) / job.chunk_size;
+    job.results = (Value**)malloc(chunks * sizeof(Value*));
+    workers_run(paral_condense_chunk, &job, chunks);
+    for (job.stride = 1; job.stride < chunks; job.stride *= 2) {
+        // Pairs whose right partner exists at this level
+        workers_run(paral_combine_pair, &job, (chunks - job.stride + 2 * job.stride - 1) / (2 * job.stride));
+    }
+    Value* call_args[2] = {copy_value(args[2]), job.results[0]};
+    free(job.results);
+    return call_spec(job.fn, call_args, 2, scope);
+}
+
+// ---------------------------------------------------------------------------
+// Sorting
+// ---------------------------------------------------------------------------
+
+// sort, sort_stable and sort_by order a snapshot of the sequence and return
+// a new list. Lists of numbers in the default order go through an LSD
+// radix sort on the doubles' bit patterns. Everything else sorts an array
+// of item positions: sort uses introsort (median-of-three or ninther
+// pivots, insertion sort for short runs, heapsort past the depth limit,
+// and pdqsort's check for already-partitioned input); sort_stable and
+// sort_by use merge sort. sort_by calls its key spec once per item and
+// sorts on the cached keys, radix-sorting them when they are all numbers.
+
+#define SORT_INSERTION_LIMIT 24
+
+typedef struct {
+    ListObj* list;          // items being ordered
+    Value* keys;            // sort_by: cached keys, one per item
+    FunctionSymbol* less;   // comparator spec, or NULL for the default order
+    Scope* scope;
+} SortCtx;
+
+// Default order: Nil, then On/Off, numbers, text; other values tie
+static int type_rank(const Value* v) {
+    switch (v->type) {
+        case VAL_NIL: return 0;
+        case VAL_BOOL: return 1;
+        case VAL_NUMBER:
+        case VAL_INT: return 2;
+        case VAL_STRING:
+        case VAL_ROPE: return 3;
+        default: return 4;
+    }
+}
+
+static int compare_values(const Value* a, const Value* b) {
+    int ra = type_rank(a), rb = type_rank(b);
+    if (ra != rb) return ra < rb ? -1 : 1;
+    switch (a->type) {
+        case VAL_BOOL: return (int)a->as.boolean - (int)b->as.boolean;
+        case VAL_NUMBER:
+        case VAL_INT: {
+            if (a->type == VAL_INT && b->type == VAL_INT) return a->as.integer < b->as.integer ? -1 : a->as.integer > b->as.integer;
+            double x = number_of(a), y = number_of(b);
+            return x < y ? -1 : x > y;
+        }
+        case VAL_STRING:
+        case VAL_ROPE: return text_compare(a, b);
+        default: return 0;
+    }
+}
+
+// Does item i sort before item j?
+static bool sort_less(SortCtx* ctx, int i, int j) {
+    if (ctx->keys) return compare_values(&ctx->keys[i], &ctx->keys[j]) < 0;
+    ListObj* list = ctx->list;
+    if (!ctx->less) {
+        if (list->dense) return list->data.numbers[i] < list->data.numbers[j];
+        return compare_values(&list->data.items[i], &list->data.items[j]) < 0;
+    }
+    // A comparator answers On (or a negative number) when a goes before b
+    Value* args[2] = {list_get(list, i), list_get(list, j)};
+    Value* result = call_spec(ctx->less, args, 2, ctx->scope);
+    bool less = (result->type == VAL_BOOL && result->as.boolean) ||
+                (is_number(result) && number_of(result) < 0);
+    free_value(result);
+    return less;
+}
+
+static void insertion_sort(int* a, int n, SortCtx* ctx) {
+    for (int i = 1; i < n; i++) {
+        int x = a[i];
+        int j = i;
+        for (; j > 0 && sort_less(ctx, x, a[j - 1]); j--) a[j] = a[j - 1];
+        a[j] = x;
+    }
+}
+
+// Like insertion_sort, but gives up (returning false) after a few moves
+static bool partial_insertion_sort(int* a, int n, SortCtx* ctx) {
+    int moves = 0;
+    for (int i = 1; i < n; i++) {
+        int x = a[i];
+        int j = i;
+        for (; j > 0 && sort_less(ctx, x, a[j - 1]); j--) a[j] = a[j - 1];
+        a[j] = x;
+        moves += i - j;
+        if (moves > 8) return false;
+    }
+    return true;
+}
+
+static void sift_down(int* a, int root, int n, SortCtx* ctx) {
+    for (;;) {
+        int child = 2 * root + 1;
+        if (child >= n) return;
+        if (child + 1 < n && sort_less(ctx, a[child], a[child + 1])) child++;
+        if (!sort_less(ctx, a[root], a[child])) return;
+        int t = a[root]; a[root] = a[child]; a[child] = t;
+        root = child;
+    }
+}
+
+static void heap_sort(int* a, int n, SortCtx* ctx) {
+    for (int i = n / 2 - 1; i >= 0; i--) sift_down(a, i, n, ctx);
+    for (int end = n - 1; end > 0; end--) {
+        int t = a[0]; a[0] = a[end]; a[end] = t;
+        sift_down(a, 0, end, ctx);
+    }
+}
+
+// Orders a[x], a[y], a[z] so the median ends up in a[y]
+static void sort3(int* a, int x, int y, int z, SortCtx* ctx) {
+    int t;
+    if (sort_less(ctx, a[y], a[x])) { t = a[x]; a[x] = a[y]; a[y] = t; }
+    if (sort_less(ctx, a[z], a[y])) { t = a[y]; a[y] = a[z]; a[z] = t; }
+    if (sort_less(ctx, a[y], a[x])) { t = a[x]; a[x] = a[y]; a[y] = t; }
+}
+
+// leftmost is false when a[-1] is an earlier pivot, which no item in a sorts
+// before
+static void intro_sort(int* a, int n, int depth, bool leftmost, SortCtx* ctx) {
+    while (n > SORT_INSERTION_LIMIT) {
+        if (depth-- == 0) {
+            heap_sort(a, n, ctx);
+            return;
+        }
+        int mid = n / 2;
+        if (n > 128) {
+            // Ninther: median of three medians
+            sort3(a, 0, mid, n - 1, ctx);
+            sort3(a, 1, mid - 1, n - 2, ctx);
+            sort3(a, 2, mid + 1, n - 3, ctx);
+            sort3(a, mid - 1, mid, mid + 1, ctx);
+        } else {
+            sort3(a, 0, mid, n - 1, ctx);
+        }
+        int t = a[0]; a[0] = a[mid]; a[mid] = t;
+        int pivot = a[0];
+        if (!leftmost && !sort_less(ctx, a[-1], pivot)) {
+            // The pivot equals the previous one: move its equals to the
+            // front and skip them, so runs of equal items cost one pass
+            int k = 1;
+            for (int i = 1; i < n; i++) {
+                if (!sort_less(ctx, pivot, a[i])) { t = a[i]; a[i] = a[k]; a[k] = t; k++; }
+            }
+            a += k;
+            n -= k;
+            continue;
+        }
+        // Hoare partition around the pivot in a[0]
+        int i = 0, j = n;
+        bool swapped = false;
+        for (;;) {
+            do i++; while (i < n && sort_less(ctx, a[i], pivot));
+            // Bounded too: a comparator that is not strict (x <= y) does
+            // not stop at the pivot in a[0]
+            do j--; while (j > 0 && sort_less(ctx, pivot, a[j]));
+            if (i >= j) break;
+            t = a[i]; a[i] = a[j]; a[j] = t;
+            swapped = true;
+        }
+        a[0] = a[j];
+        a[j] = pivot;
+        // Input that was already partitioned is often already sorted
+        if (!swapped && partial_insertion_sort(a, j, ctx) && partial_insertion_sort(a + j + 1, n - j - 1, ctx)) return;
+        // Recurse into the smaller side, loop on the larger
+        if (j < n - j - 1) {
+            intro_sort(a, j, depth, leftmost, ctx);
+            a += j + 1;
+            n -= j + 1;
+            leftmost = false;
+        } else {
+            intro_sort(a + j + 1, n - j - 1, depth, false, ctx);
+            n = j;
+        }
+    }
+    insertion_sort(a, n, ctx);
+}
+
+static void merge_sort(int* a, int* tmp, int n, SortCtx* ctx) {
+    if (n <= SORT_INSERTION_LIMIT) {
+        insertion_sort(a, n, ctx);
+        return;
+    }
+    int mid = n / 2;
+    merge_sort(a, tmp, mid, ctx);
+    merge_sort(a + mid, tmp, n - mid, ctx);
+    if (!sort_less(ctx, a[mid], a[mid - 1])) return; // halves already in order
+    memcpy(tmp, a, mid * sizeof(int));
+    int i = 0, j = mid, k = 0;
+    while (i < mid && j < n) {
+        // Take from the right only when strictly smaller: keeps equal items in order
+        a[k++] = sort_less(ctx, a[j], tmp[i]) ? a[j++] : tmp[i++];
+    }
+    while (i < mid) a[k++] = tmp[i++];
+}
+
+// Maps doubles to unsigned integers with the same order
+static inline uint64_t radix_key(double d) {
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return (u >> 63) ? ~u : u | 0x8000000000000000ULL;
+}
+
+static inline double radix_value(uint64_t k) {
+    uint64_t u = (k >> 63) ? k & 0x7FFFFFFFFFFFFFFFULL : ~k;
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+// Stable LSD radix sort of keys, one byte per pass, carrying idx along when
+// it is non-NULL. Passes where every key has the same byte are skipped.
+static void radix_sort(uint64_t* keys, int* idx, int n) {
+    size_t counts[8][256] = {{0}};
+    for (int i = 0; i < n; i++) {
+        for (int b = 0; b < 8; b++) counts[b][(keys[i] >> (8 * b)) & 0xFF]++;
+    }
+    uint64_t* key_buf = (uint64_t*)malloc(n * sizeof(uint64_t));
+    int* idx_buf = idx ? (int*)malloc(n * sizeof(int)) : NULL;
+    for (int b = 0; b < 8; b++) {
+        if (counts[b][(keys[0] >> (8 * b)) & 0xFF] == (size_t)n) continue;
+        size_t offsets[256];
+        size_t total = 0;
+        for (int v = 0; v < 256; v++) {
+            offsets[v] = total;
+            total += counts[b][v];
+        }
+        for (int i = 0; i < n; i++) {
+            size_t dst = offsets[(keys[i] >> (8 * b)) & 0xFF]++;
+            key_buf[dst] = keys[i];
+            if (idx) idx_buf[dst] = idx[i];
+        }
+        memcpy(keys, key_buf, n * sizeof(uint64_t));
+        if (idx) memcpy(idx, idx_buf, n * sizeof(int));
+    }
+    free(key_buf);
+    free(idx_buf);
+}
+
+// Turns any sequence into a list (a new reference)
+static ListObj* sequence_list(const char* name, Value* seq, Scope* scope) {
+    if (seq->type == VAL_LIST) {
+        ref_retain(&seq->as.list->refcount);
+        return seq->as.list;
+    }
+    IterObj* it = iter_from_value(seq);
+    if (!it) {
+        runtime_errorf("Runtime Error: '%s' expects a range, list, dict, set, text or iterator.\n", name);
+        return NULL;
+    }
+    ListObj* list = iter_collect(it, scope);
+    iter_release(it);
+    return list;
+}
+
+// Like sequence_list, but a list is copied: the specs a sort calls may push
+// onto or put into the list being sorted, and the sort works on the items
+// it started with
+static ListObj* sequence_snapshot(const char* name, Value* seq, Scope* scope) {
+    if (seq->type != VAL_LIST) return sequence_list(name, seq, scope);
+    ListObj* list = seq->as.list;
+    ListObj* copy = list_new(list->count, list->dense);
+    for (int i = 0; i < list->count; i++) list_append(copy, list_get(list, i));
+    return copy;
+}
+
+static ListObj* list_in_order(ListObj* list, int* order, int n) {
+    ListObj* out = list_new(n, list->dense);
+    for (int i = 0; i < n; i++) list_append(out, list_get(list, order[i]));
+    return out;
+}
+
+static Value* sort_native(const char* name, bool stable, Value** args, int argc, Scope* scope) {
+    if (argc != 1 && argc != 2) {
+        runtime_errorf("Runtime Error: '%s' expects 1 or 2 argument(s), got %d.\n", name, argc);
+        return create_nil_value_helper();
+    }
+    if (argc == 2 && args[1]->type != VAL_FUNCTION) {
+        runtime_errorf("Runtime Error: '%s' expects a comparator spec as its second argument.\n", name);
+        return create_nil_value_helper();
+    }
+    ListObj* list = argc == 2 ? sequence_snapshot(name, args[0], scope) : sequence_list(name, args[0], scope);
+    if (!list) return create_nil_value_helper();
+    int n = list->count;
+    ListObj* out;
+    if (argc == 1 && list->dense && n > 1) {
+        uint64_t* keys = (uint64_t*)malloc(n * sizeof(uint64_t));
+        for (int i = 0; i < n; i++) keys[i] = radix_key(list->data.numbers[i]);
+        radix_sort(keys, NULL, n);
+        out = list_new(n, true);
+        for (int i = 0; i < n; i++) out->data.numbers[i] = radix_value(keys[i]);
+        out->count = n;
+        free(keys);
+    } else {
+        SortCtx ctx = {list, NULL, argc == 2 ? args[1]->as.function : NULL, scope};
+        int* order = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+        for (int i = 0; i < n; i++) order[i] = i;
+        if (stable) {
+            int* tmp = (int*)malloc((n / 2 + 1) * sizeof(int));
+            merge_sort(order, tmp, n, &ctx);
+            free(tmp);
+        } else if (ctx.less && n > 1 && sort_less(&ctx, 0, 0)) {
+            // A comparator that puts an item before itself breaks the
+            // pivot invariants intro_sort relies on; heapsort needs none
+            heap_sort(order, n, &ctx);
+        } else {
+            int depth = 0;
+            for (int m = n; m > 1; m >>= 1) depth += 2;
+            intro_sort(order, n, depth, true, &ctx);
+        }
+        out = list_in_order(list, order, n);
+        free(order);
+    }
+    list_release(list);
+    return create_list_value_helper(out);
+}
+
+static Value* native_sort(Value** args, int argc, Scope* scope) {
+    return sort_native("sort", false, args, argc, scope);
+}
+
+static Value* native_sort_stable(Value** args, int argc, Scope* scope) {
+    return sort_native("sort_stable", true, args, argc, scope);
+}
+
+// sort_by(sequence, key_spec): stable sort on key_spec(item), computed once
+// per item
+static Value* native_sort_by(Value** args, int argc, Scope* scope) {
+    if (!native_arity("sort_by", argc, 2)) return create_nil_value_helper();
+    if (args[1]->type != VAL_FUNCTION) {
+        runtime_errorf("Runtime Error: 'sort_by' expects a key spec as its second argument.\n");
+        return create_nil_value_helper();
+    }
+    ListObj* list = sequence_snapshot("sort_by", args[0], scope);
+    if (!list) return create_nil_value_helper();
+    int n = list->count;
+    Value* keys = (Value*)malloc((n > 0 ? n : 1) * sizeof(Value));
+    bool numeric = true;
+    for (int i = 0; i < n; i++) {
+        Value* item = list_get(list, i);
+        Value* key = call_spec(args[1]->as.function, &item, 1, scope);
+        keys[i] = *key;
+        slab_free(&value_slab, key);
+        if (!fits_dense(&keys[i])) numeric = false;
+    }
+    int* order = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    for (int i = 0; i < n; i++) order[i] = i;
+    if (numeric && n > 1) {
+        uint64_t* bits = (uint64_t*)malloc(n * sizeof(uint64_t));
+        for (int i = 0; i < n; i++) bits[i] = radix_key(number_of(&keys[i]));
+        radix_sort(bits, order, n);
+        free(bits);
+    } else {
+        SortCtx ctx = {list, keys, NULL, scope};
+        int* tmp = (int*)malloc((n / 2 + 1) * sizeof(int));
+        merge_sort(order, tmp, n, &ctx);
+        free(tmp);
+    }
+    ListObj* out = list_in_order(list, order, n);
+    for (int i = 0; i < n; i++) clear_value(&keys[i]);
+    free(keys);
+    free(order);
+    list_release(list);
+    return create_list_value_helper(out);
+}
+
+// ---------------------------------------------------------------------------
+// Files
+// ---------------------------------------------------------------------------
+
+// Default write buffer; file~>open(path, "w", size) picks another
+#define FILE_WRITE_BUFFER (64 * 1024)
+
+void file_release(FileObj* file) {
+    if (!file || ref_release(&file->refcount) > 0) return;
+    if (file->stream) fclose(file->stream);
+    if (file->contents) rope_release(file->contents);
+    free(file->buffer);
+    free(file->path);
+    free(file);
+}
+
+static Value* create_file_value_helper(FileObj* file) {
+    Value* val = alloc_value();
+    val->type = VAL_FILE;
+    val->as.file = file;
+    return val;
+}
+
+static const char* rope_chars(RopeObj* rope) {
+    return rope->view ? rope->view : rope_flatten(rope);
+}
+
+static IterObj* text_lines_iter(RopeObj* source) {
+    IterObj* it = iter_new(ITER_TEXT_LINES);
+    it->as.text_lines.source = source;
+    it->as.text_lines.chars = rope_chars(source);
+    it->as.text_lines.length = source->length;
+    it->as.text_lines.pos = 0;
+    return it;
+}
+
+static IterObj* file_lines_iter(FileObj* file) {
+    if (file->contents) {
+        ref_retain(&file->contents->refcount);
+        return text_lines_iter(file->contents);
+    }
+    IterObj* it = iter_new(ITER_LINES);
+    ref_retain(&file->refcount);
+    it->as.lines.file = file->stream;
+    it->as.lines.handle = file;
+    return it;
+}
+
+// A handle that is still open, for reading or for writing
+static FileObj* file_arg(const char* name, Value* v, bool writing) {
+    if (v->type != VAL_FILE) {
+        runtime_errorf("Runtime Error: '%s' expects a file handle.\n", name);
+        return NULL;
+    }
+    FileObj* file = v->as.file;
+    if (!file->contents && !file->stream) {
+        runtime_errorf("Runtime Error: '%s' on closed file '%s'.\n", name, file->path);
+        return NULL;
+    }
+    if (file->writing != writing) {
+        runtime_errorf("Runtime Error: '%s' needs a file opened for %s.\n", name, writing ? "writing" : "reading");
+        return NULL;
+    }
+    return file;
+}
+
+// file~>open(path, mode, buffer_size): mode is "r" (the default), "w" or
+// "a"; buffer_size sets the write buffer in bytes
+static Value* native_file_open(Value** args, int argc, Scope* scope) {
+    if (argc < 1 || argc > 3) {
+        runtime_errorf("Runtime Error: 'open' expects 1 to 3 arguments, got %d.\n", argc);
+        return create_nil_value_helper();
+    }
+    if (!text_arg("open", args[0]) || (argc > 1 && !text_arg("open", args[1]))) return create_nil_value_helper();
+    const char* path = text_of(args[0]);
+    const char* mode = argc > 1 ? text_of(args[1]) : "r";
+    if (strcmp(mode, "r") != 0 && strcmp(mode, "w") != 0 && strcmp(mode, "a") != 0) {
+        runtime_errorf("Runtime Error: 'open' expects mode \"r\", \"w\" or \"a\", got \"%s\".\n", mode);
+        return create_nil_value_helper();
+    }
+    size_t buffer_size = FILE_WRITE_BUFFER;
+    if (argc > 2) {
+        if (!number_arg("open", args[2]) || number_of(args[2]) < 1) {
+            runtime_errorf("Runtime Error: 'open' expects a positive buffer size.\n");
+            return create_nil_value_helper();
+        }
+        buffer_size = (size_t)number_of(args[2]);
+    }
+    FileObj* file = (FileObj*)calloc(1, sizeof(FileObj));
+    file->refcount = 1;
+    file->path = strdup(path);
+    file->writing = mode[0] != 'r';
+    if (file->writing) {
+        file->stream = fopen(path, mode[0] == 'w' ? "wb" : "ab");
+        if (file->stream) {
+            file->buffer = (char*)malloc(buffer_size);
+            setvbuf(file->stream, file->buffer, _IOFBF, buffer_size);
+        }
+    } else {
+        FileMap map;
+        FileMapStatus status = filemap_open(path, &map);
+        if (status == FILEMAP_OK) file->contents = rope_from_map(&map);
+        else if (status == FILEMAP_NOT_REGULAR) file->stream = fopen(path, "rb");
+    }
+    if (!file->contents && !file->stream) {
+        runtime_errorf("Runtime Error: Could not open file '%s'.\n", path);
+        file_release(file);
+        return create_nil_value_helper();
+    }
+    return create_file_value_helper(file);
+}
+
+// file~>read(handle): everything not yet read; for a regular file, a slice
+// of its contents
+static Value* native_file_read(Value** args, int argc, Scope* scope) {
+    if (!native_arity("read", argc, 1)) return create_nil_value_helper();
+    FileObj* file = file_arg("read", args[0], false);
+    if (!file) return create_nil_value_helper();
+    if (file->contents) {
+        ref_retain(&file->contents->refcount);
+        return create_rope_value_helper(rope_slice(file->contents, rope_chars(file->contents), file->contents->length));
+    }
+    StrBuf sb;
+    strbuf_init(&sb, 4096);
+    size_t n;
+    do {
+        strbuf_reserve(&sb, 4096);
+        n = fread(sb.data + sb.len, 1, 4096, file->stream);
+        sb.len += n;
+    } while (n > 0);
+    sb.data[sb.len] = '\0';
+    Value* result = alloc_value();
+    result->type = VAL_STRING;
+    result->as.string = sb.data;
+    return result;
+}
+
+// file~>write(handle, value): writes the value's text form
+static Value* native_file_write(Value** args, int argc, Scope* scope) {
+    if (!native_arity("write", argc, 2)) return create_nil_value_helper();
+    FileObj* file = file_arg("write", args[0], true);
+    if (!file) return create_nil_value_helper();
+    Value* v = args[1];
+    if (is_text(v)) {
+        size_t len;
+        const char* chars = text_view(v, &len);
+        fwrite(chars, 1, len, file->stream);
+    } else if (is_number(v)) {
+        char digits[NUMFMT_MAX];
+        size_t len = v->type == VAL_INT ? numfmt_int(digits, v->as.integer) : numfmt_double(digits, v->as.number);
+        fwrite(digits, 1, len, file->stream);
+    } else {
+        char* str = value_to_string(v);
+        fputs(str, file->stream);
+        free(str);
+    }
+    return create_nil_value_helper();
+}
+
+static Value* native_file_flush(Value** args, int argc, Scope* scope) {
+    if (!native_arity("flush", argc, 1)) return create_nil_value_helper();
+    FileObj* file = file_arg("flush", args[0], true);
+    if (file) fflush(file->stream);
+    return create_nil_value_helper();
+}
+
+// file~>lines(handle): an iterator over the remaining lines
+static Value* native_file_lines(Value** args, int argc, Scope* scope) {
+    if (!native_arity("lines", argc, 1)) return create_nil_value_helper();
+    FileObj* file = file_arg("lines", args[0], false);
+    if (!file) return create_nil_value_helper();
+    return create_iter_value_helper(file_lines_iter(file));
+}
+
+// file~>close(handle): flushes writes; text already read stays valid
+static Value* native_file_close(Value** args, int argc, Scope* scope) {
+    if (!native_arity("close", argc, 1)) return create_nil_value_helper();
+    if (args[0]->type != VAL_FILE) {
+        runtime_errorf("Runtime Error: 'close' expects a file handle.\n");
+        return create_nil_value_helper();
+    }
+    FileObj* file = args[0]->as.file;
+    if (file->stream) {
+        fclose(file->stream);
+        file->stream = NULL;
+    }
+    if (file->contents) {
+        rope_release(file->contents);
+        file->contents = NULL;
+    }
+    free(file->buffer);
+    file->buffer = NULL;
+    return create_nil_value_helper();
+}
+
+static Value* native_file_exists(Value** args, int argc, Scope* scope) {
+    if (!native_arity("exists", argc, 1) || !text_arg("exists", args[0])) return create_nil_value_helper();
+    return create_bool_value_helper(filemap_exists(text_of(args[0])));
+}
+
+// ---------------------------------------------------------------------------
+// Asynchronous I/O
+// ---------------------------------------------------------------------------
+
+void pending_release(PendingObj* pending) {
+    if (!pending || ref_release(&pending->refcount) > 0) return;
+    ioq_free(pending->op);
+    if (pending->text) rope_release(pending->text);
+    free(pending->path);
+    free(pending);
+}
+
+static Value* create_pending_value_helper(const char* path, IoqOp* op) {
+    PendingObj* pending = (PendingObj*)calloc(1, sizeof(PendingObj));
+    pending->refcount = 1;
+    pending->path = strdup(path);
+    pending->op = op;
+    Value* val = alloc_value();
+    val->type = VAL_PENDING;
+    val->as.pending = pending;
+    return val;
+}
+
+// Waits for the operation: the text read, On once written, or Nil on failure
+static Value* pending_result(PendingObj* pending) {
+    IoqOp* op = pending->op;
+    ioq_wait(op);
+    if (op->error) {
+        runtime_errorf("Runtime Error: Could not %s '%s': %s.\n", op->kind == IOQ_READ ? "read" : "write", pending->path, strerror(op->error));
+        return create_nil_value_helper();
+    }
+    if (op->kind == IOQ_WRITE) return create_bool_value_helper(true);
+    if (!pending->text) {
+        pending->text = rope_adopt(op->data, op->length);
+        op->data = NULL;
+    }
+    ref_retain(&pending->text->refcount);
+    return create_rope_value_helper(pending->text);
+}
+
+// io~>read(path): starts reading the whole file and returns a Pending
+static Value* native_io_read(Value** args, int argc, Scope* scope) {
+    if (!native_arity("read", argc, 1) || !text_arg("read", args[0])) return create_nil_value_helper();
+    const char* path = text_of(args[0]);
+    return create_pending_value_helper(path, ioq_read(path));
+}
+
+// io~>write(path, value): starts replacing the file with the value's text
+// form and returns a Pending
+static Value* native_io_write(Value** args, int argc, Scope* scope) {
+    if (!native_arity("write", argc, 2) || !text_arg("write", args[0])) return create_nil_value_helper();
+    const char* path = text_of(args[0]);
+    char* data;
+    size_t length;
+    if (is_text(args[1])) {
+        const char* chars = text_view(args[1], &length);
+        data = (char*)malloc(length + 1);
+        memcpy(data, chars, length);
+    } else {
+        data = value_to_string(args[1]);
+        length = strlen(data);
+    }
+    return create_pending_value_helper(path, ioq_write(path, data, length));
+}
+
+// io~>collect(pending) or io~>collect(list of pendings): the result, or a list of
+// results in the same order
+static Value* native_io_collect(Value** args, int argc, Scope* scope) {
+    if (!native_arity("collect", argc, 1)) return create_nil_value_helper();
+    if (args[0]->type == VAL_PENDING) return pending_result(args[0]->as.pending);
+    if (args[0]->type == VAL_LIST && !args[0]->as.list->dense) {
+        ListObj* list = args[0]->as.list;
+        ListObj* results = list_new(list->count, false);
+        for (int i = 0; i < list->count; i++) {
+            Value* item = &list->data.items[i];
+            list_append(results, item->type == VAL_PENDING ? pending_result(item->as.pending) : copy_value(item));
+        }
+        return create_list_value_helper(results);
+    }
+    runtime_errorf("Runtime Error: 'collect' expects a pending operation or a list of them.\n");
+    return create_nil_value_helper();
+}
+
+// io~>ready(pending): whether the operation has finished, without waiting
+static Value* native_io_ready(Value** args, int argc, Scope* scope) {
+    if (!native_arity("ready", argc, 1)) return create_nil_value_helper();
+    if (args[0]->type != VAL_PENDING) {
+        runtime_errorf("Runtime Error: 'ready' expects a pending operation.\n");
+        return create_nil_value_helper();
+    }
+    return create_bool_value_helper(ioq_ready(args[0]->as.pending->op));
+}
+
+// io~>flush() flushes show's output; io~>flush(handle) a file handle
+static Value* native_io_flush(Value** args, int argc, Scope* scope) {
+    if (argc == 0) {
+        fflush(stdout);
+        return create_nil_value_helper();
+    }
+    return native_file_flush(args, argc, scope);
+}
+
+// io~>backend(): "io_uring", "threads" or "sync"
+static Value* native_io_backend(Value** args, int argc, Scope* scope) {
+    if (!native_arity("backend", argc, 0)) return create_nil_value_helper();
+    return create_string_value_helper(ioq_backend());
+}
+
+// ---------------------------------------------------------------------------
+// Networking
+// ---------------------------------------------------------------------------
+
+static void web_server_free(struct WebServer* web);
+
+// Closes the connection, first giving queued output a chance to go out
+static void socket_close(SocketObj* socket) {
+    if (!socket->conn) return;
+    BeaconRuntime* rt = socket->runtime;
+    if (socket->web) web_server_free(socket->web);
+    socket->web = NULL;
+    if (!socket->conn->listener) net_wait(socket->conn, NET_WAIT_SENT, 0, net_timeout_ms);
+    net_close(socket->conn);
+    socket->conn = NULL;
+    if (!rt) return;
+    for (int i = 0; i < rt->net_listener_count; i++) {
+        if (rt->net_listeners[i] == socket) {
+            rt->net_listeners[i] = rt->net_listeners[--rt->net_listener_count];
+            break;
+        }
+    }
+}
+
+void socket_release(SocketObj* socket) {
+    if (!socket || ref_release(&socket->refcount) > 0) return;
+    socket_close(socket);
+    free(socket->address);
+    free(socket);
+}
+
+static Value* create_socket_value_helper(NetConn* conn, const char* address) {
+    SocketObj* socket = (SocketObj*)calloc(1, sizeof(SocketObj));
+    socket->refcount = 1;
+    socket->conn = conn;
+    socket->address = strdup(address);
+    Value* val = alloc_value();
+    val->type = VAL_SOCKET;
+    val->as.socket = socket;
+    return val;
+}
+
+// The open connection or listener in v, or NULL after reporting why not
+static SocketObj* socket_arg(const char* name, Value* v, bool listener) {
+    if (v->type != VAL_SOCKET) {
+        runtime_errorf("Runtime Error: '%s' expects a %s.\n", name, listener ? "listener" : "connection");
+        return NULL;
+    }
+    SocketObj* socket = v->as.socket;
+    if (!socket->conn) {
+        runtime_errorf("Runtime Error: '%s' on a closed socket.\n", name);
+        return NULL;
+    }
+    if (socket->conn->listener != listener) {
+        runtime_errorf("Runtime Error: '%s' expects a %s, not %s.\n", name, listener ? "listener" : "connection", socket->address);
+        return NULL;
+    }
+    return socket;
+}
+
+// Splits "host:port" (or "[v6 host]:port"); a bare port number leaves host
+// NULL. The host is copied into buf.
+static bool net_address(const char* name, Value* v, char* buf, size_t size, const char** host, int* port) {
+    *host = NULL;
+    if (is_number(v)) {
+        *port = (int)number_of(v);
+    } else if (is_text(v)) {
+        const char* text = text_of(v);
+        const char* colon = strrchr(text, ':');
+        if (!colon || colon == text || (size_t)(colon - text) >= size) {
+            runtime_errorf("Runtime Error: '%s' expects an address like host:port, not '%s'.\n", name, text);
+            return false;
+        }
+        size_t len = (size_t)(colon - text);
+        if (text[0] == '[' && text[len - 1] == ']') {
+            memcpy(buf, text + 1, len - 2);
+            buf[len - 2] = '\0';
+        } else {
+            memcpy(buf, text, len);
+            buf[len] = '\0';
+        }
+        *host = buf;
+        *port = atoi(colon + 1);
+    } else {
+        runtime_errorf("Runtime Error: '%s' expects an address or a port.\n", name);
+        return false;
+    }
+    if (*port < 0 || *port > 65535) {
+        runtime_errorf("Runtime Error: '%s' got port %d, which is out of range.\n", name, *port);
+        return false;
+    }
+    return true;
+}
+
+// Runs the listener's handler on its oldest waiting connection; false if
+// none is waiting
+static bool net_handle_one(SocketObj* listener, Scope* scope) {
+    NetConn* conn = listener->conn ? net_take_accepted(listener->conn) : NULL;
+    if (!conn) return false;
+    char peer[80];
+    net_peer_name(conn, peer, sizeof(peer));
+    Value* arg = create_socket_value_helper(conn, peer);
+    ref_retain(&listener->refcount);
+    free_value(call_spec(listener->handler, &arg, 1, scope));
+    socket_release(listener);
+    return true;
+}
+
+// Hands every connection accepted so far to its listener's handler
+static void net_dispatch(Scope* scope) {
+    BeaconRuntime* rt = current_runtime();
+    if (rt->net_listener_count == 0) return;
+    net_poll(0);
+    bool handled = true;
+    while (handled) {
+        handled = false;
+        for (int i = 0; i < rt->net_listener_count; i++) {
+            if (net_handle_one(rt->net_listeners[i], scope)) handled = true;
+        }
+    }
+}
+
+// net~>listen(address, handler): a listener on "host:port", or on every
+// interface for a bare port number (0 picks a free port). Connections go to
+// the handler spec, one at a time, in net~>serve or at the next hold.
+static Value* native_net_listen(Value** args, int argc, Scope* scope) {
+    BeaconRuntime* rt = current_runtime();
+    if (argc < 1 || argc > 2) {
+        runtime_errorf("Runtime Error: 'listen' expects an address and an optional handler spec.\n");
+        return create_nil_value_helper();
+    }
+    if (argc == 2 && args[1]->type != VAL_FUNCTION) {
+        runtime_errorf("Runtime Error: 'listen' expects a spec to handle connections.\n");
+        return create_nil_value_helper();
+    }
+    char buf[256];
+    const char* host;
+    int port;
+    if (!net_address("listen", args[0], buf, sizeof(buf), &host, &port)) return create_nil_value_helper();
+    int error = 0;
+    NetConn* conn = net_listen(host, port, &error);
+    if (!conn) {
+        runtime_errorf("Runtime Error: Could not listen on port %d: %s.\n", port, strerror(error));
+        return create_nil_value_helper();
+    }
+    char address[300];
+    snprintf(address, sizeof(address), "%s:%d", host ? host : "*", net_port(conn));
+    Value* val = create_socket_value_helper(conn, address);
+    if (argc == 2) {
+        SocketObj* socket = val->as.socket;
+        socket->handler = args[1]->as.function;
+        socket->runtime = rt;
+        if (rt->net_listener_count == rt->net_listener_capacity) {
+            rt->net_listener_capacity = rt->net_listener_capacity ? rt->net_listener_capacity * 2 : 4;
+            rt->net_listeners = (SocketObj**)realloc(rt->net_listeners, rt->net_listener_capacity * sizeof(SocketObj*));
+        }
+        rt->net_listeners[rt->net_listener_count++] = socket;
+    }
+    return val;
+}
+
+// net~>connect(address): a connection to "host:port", once it is open
+static Value* native_net_connect(Value** args, int argc, Scope* scope) {
+    if (!native_arity("connect", argc, 1)) return create_nil_value_helper();
+    char host[256];
+    const char* h;
+    int port;
+    if (!net_address("connect", args[0], host, sizeof(host), &h, &port)) return create_nil_value_helper();
+    if (!h) h = "127.0.0.1";
+    int error = 0;
+    NetConn* conn = net_connect(h, port, &error);
+    if (conn && !net_wait(conn, NET_WAIT_CONNECT, 0, net_timeout_ms)) error = ETIMEDOUT;
+    else if (conn) error = conn->error;
+    if (!conn || error) {
+        runtime_errorf("Runtime Error: Could not connect to %s:%d: %s.\n", h, port, strerror(error));
+        net_close(conn);
+        return create_nil_value_helper();
+    }
+    char address[300];
+    snprintf(address, sizeof(address), "%s:%d", h, port);
+    return create_socket_value_helper(conn, address);
+}
+
+// net~>send(connection, data, ...): sends the text form of each value in
+// one gathered write. On, or Off once the connection has failed.
+static Value* native_net_send(Value** args, int argc, Scope* scope) {
+    if (argc < 2) {
+        runtime_errorf("Runtime Error: 'send' expects a connection and data to send.\n");
+        return create_nil_value_helper();
+    }
+    SocketObj* socket = socket_arg("send", args[0], false);
+    if (!socket) return create_nil_value_helper();
+    int count = argc - 1;
+    struct iovec* iov = (struct iovec*)malloc(count * sizeof(struct iovec));
+    char** temps = (char**)calloc(count, sizeof(char*));
+    for (int i = 0; i < count; i++) {
+        size_t len;
+        const char* chars;
+        if (is_text(args[i + 1])) {
+            chars = text_view(args[i + 1], &len);
+        } else {
+            temps[i] = value_to_string(args[i + 1]);
+            chars = temps[i];
+            len = strlen(chars);
+        }
+        iov[i].iov_base = (void*)chars;
+        iov[i].iov_len = len;
+    }
+    bool ok = net_send(socket->conn, iov, count);
+    for (int i = 0; i < count; i++) free(temps[i]);
+    free(temps);
+    free(iov);
+    if (!ok) runtime_errorf("Runtime Error: Could not send to %s: %s.\n", socket->address, strerror(socket->conn->error));
+    return create_bool_value_helper(ok);
+}
+
+// net~>receive(connection) gives whatever has arrived, waiting for at
+// least one byte; net~>receive(connection, count) waits for count bytes.
+// Nil once the peer has closed and everything has been received.
+static Value* native_net_receive(Value** args, int argc, Scope* scope) {
+    if (argc < 1 || argc > 2) {
+        runtime_errorf("Runtime Error: 'receive' expects a connection and an optional byte count.\n");
+        return create_nil_value_helper();
+    }
+    SocketObj* socket = socket_arg("receive", args[0], false);
+    if (!socket) return create_nil_value_helper();
+    size_t want = 1;
+    if (argc == 2) {
+        if (!is_number(args[1]) || number_of(args[1]) < 1) {
+            runtime_errorf("Runtime Error: 'receive' expects a positive byte count.\n");
+            return create_nil_value_helper();
+        }
+        want = (size_t)number_of(args[1]);
+    }
+    NetConn* conn = socket->conn;
+    if (!net_wait(conn, NET_WAIT_INPUT, want, net_timeout_ms)) {
+        runtime_errorf("Runtime Error: Timed out receiving from %s.\n", socket->address);
+        return create_nil_value_helper();
+    }
+    size_t have = netbuf_size(&conn->in);
+    if (have == 0) {
+        if (conn->error) runtime_errorf("Runtime Error: Could not receive from %s: %s.\n", socket->address, strerror(conn->error));
+        return create_nil_value_helper();
+    }
+    size_t n = argc == 2 && have > want ? want : have;
+    RopeObj* text = rope_leaf(conn->in.data + conn->in.start, n);
+    netbuf_consume(&conn->in, n);
+    net_update(conn);
+    return create_rope_value_helper(text);
+}
+
+// net~>close(socket): closes a connection (after sending what is queued)
+// or stops a listener
+static Value* native_net_close(Value** args, int argc, Scope* scope) {
+    if (!native_arity("close", argc, 1)) return create_nil_value_helper();
+    if (args[0]->type != VAL_SOCKET) {
+        runtime_errorf("Runtime Error: 'close' expects a socket.\n");
+        return create_nil_value_helper();
+    }
+    socket_close(args[0]->as.socket);
+    return create_nil_value_helper();
+}
+
+// net~>serve(listener, count): hands connections to the listener's handler
+// as they arrive, until count have been handled (for ever without a count,
+// or until the handler closes the listener). Returns how many were handled.
+static Value* native_web_serve(Value** args, int argc, Scope* scope);
+
+static Value* native_net_serve(Value** args, int argc, Scope* scope) {
+    if (argc >= 1 && args[0]->type == VAL_SOCKET && args[0]->as.socket->web) return native_web_serve(args, argc, scope);
+    if (argc < 1 || argc > 2) {
+        runtime_errorf("Runtime Error: 'serve' expects a listener and an optional number of connections.\n");
+        return create_nil_value_helper();
+    }
+    SocketObj* listener = socket_arg("serve", args[0], true);
+    if (!listener) return create_nil_value_helper();
+    if (!listener->handler) {
+        runtime_errorf("Runtime Error: 'serve' needs a listener made with a handler spec.\n");
+        return create_nil_value_helper();
+    }
+    long limit = argc == 2 && is_number(args[1]) ? (long)number_of(args[1]) : -1;
+    long handled = 0;
+    ref_retain(&listener->refcount);
+    while (listener->conn && (limit < 0 || handled < limit)) {
+        if (net_handle_one(listener, scope)) handled++;
+        else net_wait(listener->conn, NET_WAIT_ACCEPT, 0, -1);
+    }
+    socket_release(listener);
+    return create_int_value_helper(handled);
+}
+
+// net~>port(socket): the local port, e.g. of a listener opened on port 0
+static Value* native_net_port(Value** args, int argc, Scope* scope) {
+    if (!native_arity("port", argc, 1)) return create_nil_value_helper();
+    if (args[0]->type != VAL_SOCKET || !args[0]->as.socket->conn) {
+        runtime_errorf("Runtime Error: 'port' expects an open socket.\n");
+        return create_nil_value_helper();
+    }
+    return create_int_value_helper(net_port(args[0]->as.socket->conn));
+}
+
+// net~>timeout(ms): how long connect and receive wait before giving up;
+// returns the previous setting
+static Value* native_net_timeout(Value** args, int argc, Scope* scope) {
+    if (!native_arity("timeout", argc, 1)) return create_nil_value_helper();
+    if (!is_number(args[0]) || number_of(args[0]) < 0) {
+        runtime_errorf("Runtime Error: 'timeout' expects a number of milliseconds.\n");
+        return create_nil_value_helper();
+    }
+    int previous = net_timeout_ms;
+    net_timeout_ms = (int)number_of(args[0]);
+    return create_int_value_helper(previous);
+}
+
+// net~>ping(host, port): milliseconds to open a TCP connection to host
+// (port 80 by default), or Nil if it cannot be reached
+static Value* native_net_ping(Value** args, int argc, Scope* scope) {
+    if (argc < 1 || argc > 2 || !text_arg("ping", args[0])) {
+        if (argc < 1 || argc > 2) runtime_errorf("Runtime Error: 'ping' expects a host and an optional port.\n");
+        return create_nil_value_helper();
+    }
+    int port = argc == 2 && is_number(args[1]) ? (int)number_of(args[1]) : 80;
+    double start = net_now_ms();
+    int error = 0;
+    NetConn* conn = net_connect(text_of(args[0]), port, &error);
+    bool reached = conn && net_wait(conn, NET_WAIT_CONNECT, 0, net_timeout_ms) && !conn->error;
+    net_close(conn);
+    return reached ? create_number_value_helper(net_now_ms() - start) : create_nil_value_helper();
+}
+
+// lines(path): lazily yields the lines of a text file
+static Value* native_lines(Value** args, int argc, Scope* scope) {
+    if (!native_arity("lines", argc, 1)) return create_nil_value_helper();
+    if (!is_text(args[0])) {
+        runtime_errorf("Runtime Error: 'lines' expects a file path.\n");
+        return create_nil_value_helper();
+    }
+    const char* path = text_of(args[0]);
+    FileMap map;
+    FileMapStatus status = filemap_open(path, &map);
+    if (status == FILEMAP_OK) return create_iter_value_helper(text_lines_iter(rope_from_map(&map)));
+    FILE* file = status == FILEMAP_NOT_REGULAR ? fopen(path, "r") : NULL;
+    if (!file) {
+        runtime_errorf("Runtime Error: Could not open file '%s'.\n", path);
+        return create_nil_value_helper();
+    }
+    IterObj* it = iter_new(ITER_LINES);
+    it->as.lines.file = file;
+    return create_iter_value_helper(it);
+}
+
+static Value* native_list_at(Value** args, int argc, Scope* scope) {
+    int index;
+    if (!native_arity("at", argc, 2)) return create_nil_value_helper();
+    if (!list_index_arg(args[0]->as.list, args[1], &index)) return create_nil_value_helper();
+    return list_get(args[0]->as.list, index);
+}
+
+static Value* native_list_put(Value** args, int argc, Scope* scope) {
+    int index;
+    if (!native_arity("put", argc, 3)) return create_nil_value_helper();
+    if (list_index_arg(args[0]->as.list, args[1], &index)) {
+        list_set(args[0]->as.list, index, copy_value(args[2]));
+    }
+    return create_nil_value_helper();
+}
+
+static Value* native_list_push(Value** args, int argc, Scope* scope) {
+    if (!native_arity("push", argc, 2)) return create_nil_value_helper();
+    list_append(args[0]->as.list, copy_value(args[1]));
+    return create_nil_value_helper();
+}
+
+static Value* native_list_length(Value** args, int argc, Scope* scope) {
+    return create_int_value_helper(args[0]->as.list->count);
+}
+
+static Value* native_collection_list(Value** args, int argc, Scope* scope) {
+    // A single iterator argument is drained into the list
+    if (argc == 1 && args[0]->type == VAL_ITER) {
+        return create_list_value_helper(iter_collect(args[0]->as.iter, scope));
+    }
+    ListObj* list = list_new(argc, true);
+    for (int i = 0; i < argc; i++) {
+        list_append(list, copy_value(args[i]));
+    }
+    return create_list_value_helper(list);
+}
+
+static Value* native_dict_get(Value** args, int argc, Scope* scope) {
+    if (!native_arity("get", argc, 2)) return create_nil_value_helper();
+    Value* found = dict_lookup(args[0]->as.dict, args[1]);
+    return found ? copy_value(found) : create_nil_value_helper();
+}
+
+static Value* native_dict_set(Value** args, int argc, Scope* scope) {
+    if (!native_arity("set", argc, 3)) return create_nil_value_helper();
+    dict_set(args[0]->as.dict, args[1], copy_value(args[2]));
+    return create_nil_value_helper();
+}
+
+static Value* native_dict_contains(Value** args, int argc, Scope* scope) {
+    if (!native_arity("contains", argc, 2)) return create_nil_value_helper();
+    return create_bool_value_helper(dict_lookup(args[0]->as.dict, args[1]) != NULL);
+}
+
+static Value* native_dict_remove(Value** args, int argc, Scope* scope) {
+    if (!native_arity("remove", argc, 2)) return create_nil_value_helper();
+    return create_bool_value_helper(dict_remove(args[0]->as.dict, args[1]));
+}
+
+static Value* native_dict_length(Value** args, int argc, Scope* scope) {
+    return create_int_value_helper(args[0]->as.dict->count);
+}
+
+static Value* native_dict_keys(Value** args, int argc, Scope* scope) {
+    return create_list_value_helper(dict_collect(args[0]->as.dict, false));
+}
+
+static Value* native_dict_values(Value** args, int argc, Scope* scope) {
+    return create_list_value_helper(dict_collect(args[0]->as.dict, true));
+}
+
+static Value* native_set_add(Value** args, int argc, Scope* scope) {
+    if (!native_arity("add", argc, 2)) return create_nil_value_helper();
+    set_add(args[0]->as.set, args[1]);
+    return create_nil_value_helper();
+}
+
+static Value* native_set_contains(Value** args, int argc, Scope* scope) {
+    if (!native_arity("contains", argc, 2)) return create_nil_value_helper();
+    return create_bool_value_helper(set_contains(args[0]->as.set, args[1]));
+}
+
+static Value* native_set_remove(Value** args, int argc, Scope* scope) {
+    if (!native_arity("remove", argc, 2)) return create_nil_value_helper();
+    return create_bool_value_helper(set_remove(args[0]->as.set, args[1]));
+}
+
+static Value* native_set_length(Value** args, int argc, Scope* scope) {
+    return create_int_value_helper(args[0]->as.set->count);
+}
+
+static Value* native_set_items(Value** args, int argc, Scope* scope) {
+    return create_list_value_helper(set_items(args[0]->as.set));
+}
+
+static Value* set_op_native(const char* name, SetOp op, Value** args, int argc) {
+    if (!native_arity(name, argc, 2)) return create_nil_value_helper();
+    if (args[1]->type != VAL_SET) {
+        runtime_errorf("Runtime Error: '%s' expects a set.\n", name);
+        return create_nil_value_helper();
+    }
+    return create_set_value_helper(set_combine(args[0]->as.set, args[1]->as.set, op));
+}
+
+static Value* native_set_union(Value** args, int argc, Scope* scope) {
+    return set_op_native("union", SET_UNION, args, argc);
+}
+
+static Value* native_set_intersect(Value** args, int argc, Scope* scope) {
+    return set_op_native("intersect", SET_INTERSECT, args, argc);
+}
+
+static Value* native_set_difference(Value** args, int argc, Scope* scope) {
+    return set_op_native("difference", SET_DIFFERENCE, args, argc);
+}
+
+// collection~>set(a, b, ...) or collection~>set(list)
+static Value* native_collection_set(Value** args, int argc, Scope* scope) {
+    SetObj* set = set_new();
+    if (argc == 1 && args[0]->type == VAL_LIST) {
+        ListObj* list = args[0]->as.list;
+        for (int i = 0; i < list->count; i++) {
+            Value* item = list_get(list, i);
+            set_add(set, item);
+            free_value(item);
+        }
+    } else {
+        for (int i = 0; i < argc; i++) set_add(set, args[i]);
+    }
+    return create_set_value_helper(set);
+}
+
+static Value* native_collection_dict(Value** args, int argc, Scope* scope) {
+    if (argc % 2 != 0) {
+        runtime_errorf("Runtime Error: 'dict' expects key, value pairs.\n");
+        return create_nil_value_helper();
+    }
+    DictObj* dict = dict_new();
+    for (int i = 0; i < argc; i += 2) {
+        dict_set(dict, args[i], copy_value(args[i + 1]));
+    }
+    return create_dict_value_helper(dict);
+}
+
+// Wall-clock seconds, for timing Beacon code
+static Value* native_time_now(Value** args, int argc, Scope* scope) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return create_number_value_helper((double)ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static const NativeEntry native_builtins[] = {
+    {"length", native_length},
+    {"time_now", native_time_now},
+    {"transform", native_transform},
+    {"filter", native_filter},
+    {"map", native_map},
+    {"condense", native_condense},
+    {"lines", native_lines},
+    {"paral_transform", native_paral_transform},
+    {"paral_condense", native_paral_condense},
+    {"sort", native_sort},
+    {"sort_stable", native_sort_stable},
+    {"sort_by", native_sort_by},
+    {NULL, NULL}
+};
+
+static const NativeEntry list_methods[] = {
+    {"at", native_list_at},
+    {"put", native_list_put},
+    {"push", native_list_push},
+    {"length", native_list_length},
+    {NULL, NULL}
+};
+
+static const NativeEntry dict_methods[] = {
+    {"get", native_dict_get},
+    {"set", native_dict_set},
+    {"contains", native_dict_contains},
+    {"remove", native_dict_remove},
+    {"length", native_dict_length},
+    {"keys", native_dict_keys},
+    {"values", native_dict_values},
+    {NULL, NULL}
+};
+
+static const NativeEntry set_methods[] = {
+    {"add", native_set_add},
+    {"contains", native_set_contains},
+    {"remove", native_set_remove},
+    {"length", native_set_length},
+    {"items", native_set_items},
+    {"union", native_set_union},
+    {"intersect", native_set_intersect},
+    {"difference", native_set_difference},
+    {NULL, NULL}
+};
+
+// --- math toolkit -----------------------------------------------------------
+
+// Vector functions work on lists that hold only numbers
+static bool numbers_arg(const char* name, Value* v) {
+    if (v->type != VAL_LIST || !v->as.list->dense) {
+        runtime_errorf("Runtime Error: '%s' expects a list of numbers.\n", name);
+        return false;
+    }
+    return true;
+}
+
+static ListObj* numbers_list(int count) {
+    ListObj* list = list_new(count, true);
+    list->count = count;
+    return list;
+}
+
+static Value* native_math_abs(Value** args, int argc, Scope* scope) {
+    if (!native_arity("abs", argc, 1) || !number_arg("abs", args[0])) return create_nil_value_helper();
+    if (args[0]->type == VAL_INT && args[0]->as.integer != INT64_MIN) {
+        return create_int_value_helper(args[0]->as.integer < 0 ? -args[0]->as.integer : args[0]->as.integer);
+    }
+    return create_number_value_helper(fabs(number_of(args[0])));
+}
+
+static Value* native_math_round(Value** args, int argc, Scope* scope) {
+    if (!native_arity("round", argc, 1) || !number_arg("round", args[0])) return create_nil_value_helper();
+    if (args[0]->type == VAL_INT) return copy_value(args[0]);
+    return create_numeric_value_helper(round(args[0]->as.number));
+}
+
+static Value* native_math_pow(Value** args, int argc, Scope* scope) {
+    if (!native_arity("pow", argc, 2) || !number_arg("pow", args[0]) || !number_arg("pow", args[1])) return create_nil_value_helper();
+    return create_numeric_value_helper(pow(number_of(args[0]), number_of(args[1])));
+}
+
+static Value* native_math_random(Value** args, int argc, Scope* scope) {
+    return create_number_value_helper((double)rand() / ((double)RAND_MAX + 1));
+}
+
+// min/max take two numbers or one list of numbers
+static Value* math_minmax(const char* name, int op, Value** args, int argc) {
+    if (argc == 1) {
+        if (!numbers_arg(name, args[0])) return create_nil_value_helper();
+        ListObj* list = args[0]->as.list;
+        if (list->count == 0) return create_nil_value_helper();
+        return create_numeric_value_helper(kern_minmax(list->data.numbers, list->count, op));
+    }
+    if (!native_arity(name, argc, 2) || !number_arg(name, args[0]) || !number_arg(name, args[1])) return create_nil_value_helper();
+    int c = compare_values(args[0], args[1]);
+    return copy_value(op ? (c >= 0 ? args[0] : args[1]) : (c <= 0 ? args[0] : args[1]));
+}
+
+static Value* native_math_min(Value** args, int argc, Scope* scope) {
+    return math_minmax("min", 0, args, argc);
+}
+
+static Value* native_math_max(Value** args, int argc, Scope* scope) {
+    return math_minmax("max", 1, args, argc);
+}
+
+static Value* native_math_sum(Value** args, int argc, Scope* scope) {
+    if (!native_arity("sum", argc, 1) || !numbers_arg("sum", args[0])) return create_nil_value_helper();
+    ListObj* list = args[0]->as.list;
+    Value* total = dense_sum(list->data.numbers, list->count, 0);
+    return total ? total : create_numeric_value_helper(kern_sum(list->data.numbers, list->count));
+}
+
+static bool same_length(const char* name, ListObj* a, ListObj* b) {
+    if (a->count != b->count) {
+        runtime_errorf("Runtime Error: '%s' expects lists of the same length (%d and %d).\n", name, a->count, b->count);
+        return false;
+    }
+    return true;
+}
+
+static Value* native_math_dot(Value** args, int argc, Scope* scope) {
+    if (!native_arity("dot", argc, 2) || !numbers_arg("dot", args[0]) || !numbers_arg("dot", args[1])) return create_nil_value_helper();
+    ListObj* a = args[0]->as.list;
+    ListObj* b = args[1]->as.list;
+    if (!same_length("dot", a, b)) return create_nil_value_helper();
+    return create_number_value_helper(kern_dot(a->data.numbers, b->data.numbers, a->count));
+}
+
+static Value* math_elementwise(const char* name, int op, Value** args, int argc) {
+    if (!native_arity(name, argc, 2) || !numbers_arg(name, args[0]) || !numbers_arg(name, args[1])) return create_nil_value_helper();
+    ListObj* a = args[0]->as.list;
+    ListObj* b = args[1]->as.list;
+    if (!same_length(name, a, b)) return create_nil_value_helper();
+    ListObj* out = numbers_list(a->count);
+    kern_binary(out->data.numbers, a->data.numbers, b->data.numbers, a->count, op);
+    return create_list_value_helper(out);
+}
+
+static Value* native_math_add(Value** args, int argc, Scope* scope) {
+    return math_elementwise("add", 0, args, argc);
+}
+
+static Value* native_math_mul(Value** args, int argc, Scope* scope) {
+    return math_elementwise("mul", 1, args, argc);
+}
+
+static Value* native_math_scale(Value** args, int argc, Scope* scope) {
+    if (!native_arity("scale", argc, 2) || !numbers_arg("scale", args[0]) || !number_arg("scale", args[1])) return create_nil_value_helper();
+    ListObj* x = args[0]->as.list;
+    ListObj* out = numbers_list(x->count);
+    kern_scale(out->data.numbers, x->data.numbers, number_of(args[1]), x->count);
+    return create_list_value_helper(out);
+}
+
+static Value* native_math_prefix_sum(Value** args, int argc, Scope* scope) {
+    if (!native_arity("prefix_sum", argc, 1) || !numbers_arg("prefix_sum", args[0])) return create_nil_value_helper();
+    ListObj* x = args[0]->as.list;
+    ListObj* out = numbers_list(x->count);
+    kern_prefix_sum(out->data.numbers, x->data.numbers, x->count);
+    return create_list_value_helper(out);
+}
+
+// less/greater/equal(list, number): a list of On/Off, one per item
+static Value* math_compare(const char* name, KernCompare op, Value** args, int argc) {
+    if (!native_arity(name, argc, 2) || !numbers_arg(name, args[0]) || !number_arg(name, args[1])) return create_nil_value_helper();
+    ListObj* x = args[0]->as.list;
+    unsigned char* mask = (unsigned char*)malloc(x->count > 0 ? x->count : 1);
+    kern_compare(mask, x->data.numbers, number_of(args[1]), x->count, op);
+    ListObj* out = list_new(x->count, false);
+    for (int i = 0; i < x->count; i++) {
+        out->data.items[i].type = VAL_BOOL;
+        out->data.items[i].as.boolean = mask[i];
+    }
+    out->count = x->count;
+    free(mask);
+    return create_list_value_helper(out);
+}
+
+static Value* native_math_less(Value** args, int argc, Scope* scope) {
+    return math_compare("less", KERN_LESS, args, argc);
+}
+
+static Value* native_math_greater(Value** args, int argc, Scope* scope) {
+    return math_compare("greater", KERN_GREATER, args, argc);
+}
+
+static Value* native_math_equal(Value** args, int argc, Scope* scope) {
+    return math_compare("equal", KERN_EQUAL, args, argc);
+}
+
+static const NativeEntry math_members[] = {
+    {"abs", native_math_abs},
+    {"round", native_math_round},
+    {"pow", native_math_pow},
+    {"min", native_math_min},
+    {"max", native_math_max},
+    {"random", native_math_random},
+    {"sum", native_math_sum},
+    {"dot", native_math_dot},
+    {"add", native_math_add},
+    {"mul", native_math_mul},
+    {"scale", native_math_scale},
+    {"prefix_sum", native_math_prefix_sum},
+    {"less", native_math_less},
+    {"greater", native_math_greater},
+    {"equal", native_math_equal},
+    {NULL, NULL}
+};
+
+// ---------------------------------------------------------------------------
+// Text toolkit
+// ---------------------------------------------------------------------------
+
+// The rope that holds arg's characters, to cut slices from. A plain
+// string argument is a temporary owned by call_native, so its buffer is
+// taken over rather than copied.
+static RopeObj* text_source(Value* arg, const char** chars, size_t* len) {
+    if (arg->type == VAL_ROPE) {
+        *chars = text_view(arg, len);
+        ref_retain(&arg->as.rope->refcount);
+        return arg->as.rope;
+    }
+    *len = strlen(arg->as.string);
+    RopeObj* rope = rope_adopt(arg->as.string, *len);
+    arg->type = VAL_NIL;
+    *chars = rope->flat;
+    return rope;
+}
+
+// text~>trim(text): the text without leading and trailing whitespace
+static Value* native_text_trim(Value** args, int argc, Scope* scope) {
+    if (!native_arity("trim", argc, 1) || !text_arg("trim", args[0])) return create_nil_value_helper();
+    const char* chars;
+    size_t len;
+    RopeObj* source = text_source(args[0], &chars, &len);
+    size_t start = 0, end = len;
+    while (start < end && is_space(chars[start])) start++;
+    while (end > start && is_space(chars[end - 1])) end--;
+    return create_rope_value_helper(rope_slice(source, chars + start, end - start));
+}
+
+// text~>split(text, delimiter): the pieces between delimiters, as slices
+// of the original text
+static Value* native_text_split(Value** args, int argc, Scope* scope) {
+    if (!native_arity("split", argc, 2) || !text_arg("split", args[0]) || !text_arg("split", args[1])) return create_nil_value_helper();
+    size_t delim_len;
+    const char* delim = text_view(args[1], &delim_len);
+    if (delim_len == 0) {
+        runtime_errorf("Runtime Error: 'split' expects a non-empty delimiter.\n");
+        return create_nil_value_helper();
+    }
+    const char* chars;
+    size_t len;
+    RopeObj* source = text_source(args[0], &chars, &len);
+    ListObj* pieces = list_new(8, false);
+    size_t pos = 0;
+    for (;;) {
+        size_t at = scan_find(chars + pos, len - pos, delim, delim_len);
+        size_t piece_len = at == SCAN_NONE ? len - pos : at;
+        ref_retain(&source->refcount);
+        list_reserve(pieces, pieces->count + 1);
+        Value* piece = &pieces->data.items[pieces->count++];
+        piece->type = VAL_ROPE;
+        piece->as.rope = rope_slice(source, chars + pos, piece_len);
+        if (at == SCAN_NONE) break;
+        pos += at + delim_len;
+    }
+    rope_release(source);
+    return create_list_value_helper(pieces);
+}
+
+// text~>join(list, delimiter): the items' text forms, delimiter between them
+static Value* native_text_join(Value** args, int argc, Scope* scope) {
+    if (!native_arity("join", argc, 2) || !text_arg("join", args[1])) return create_nil_value_helper();
+    if (args[0]->type != VAL_LIST) {
+        runtime_errorf("Runtime Error: 'join' expects a list.\n");
+        return create_nil_value_helper();
+    }
+    ListObj* list = args[0]->as.list;
+    size_t delim_len;
+    const char* delim = text_view(args[1], &delim_len);
+    StrBuf sb;
+    strbuf_init(&sb, 64);
+    for (int i = 0; i < list->count; i++) {
+        if (i > 0) strbuf_append_n(&sb, delim, delim_len);
+        if (list->dense) {
+            Value number;
+            set_numeric(&number, list->data.numbers[i]);
+            strbuf_append_number(&sb, &number);
+        } else {
+            strbuf_append_value(&sb, &list->data.items[i]);
+        }
+    }
+    Value* result = alloc_value();
+    result->type = VAL_STRING;
+    result->as.string = sb.data;
+    return result;
+}
+
+// text~>replace(text, old, new): every non-overlapping old replaced by new
+static Value* native_text_replace(Value** args, int argc, Scope* scope) {
+    if (!native_arity("replace", argc, 3) || !text_arg("replace", args[0]) || !text_arg("replace", args[1]) || !text_arg("replace", args[2])) return create_nil_value_helper();
+    size_t len, old_len, new_len;
+    const char* chars = text_view(args[0], &len);
+    const char* old = text_view(args[1], &old_len);
+    const char* with = text_view(args[2], &new_len);
+    if (old_len == 0) {
+        runtime_errorf("Runtime Error: 'replace' expects a non-empty text to replace.\n");
+        return create_nil_value_helper();
+    }
+    size_t count = scan_count(chars, len, old, old_len);
+    if (count == 0) return copy_value(args[0]);
+    // Counting first sizes the result exactly
+    char* out = (char*)malloc(len - count * old_len + count * new_len + 1);
+    size_t pos = 0, written = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t at = scan_find(chars + pos, len - pos, old, old_len);
+        memcpy(out + written, chars + pos, at);
+        written += at;
+        memcpy(out + written, with, new_len);
+        written += new_len;
+        pos += at + old_len;
+    }
+    memcpy(out + written, chars + pos, len - pos);
+    written += len - pos;
+    out[written] = '\0';
+    Value* result = alloc_value();
+    result->type = VAL_STRING;
+    result->as.string = out;
+    return result;
+}
+
+// text~>format(template, values): {} takes the next value and {n} value n,
+// from a list of values or a single value
+static Value* native_text_format(Value** args, int argc, Scope* scope) {
+    if (!native_arity("format", argc, 2) || !text_arg("format", args[0])) return create_nil_value_helper();
+    ListObj* values = args[1]->type == VAL_LIST ? args[1]->as.list : NULL;
+    int value_count = values ? values->count : 1;
+    size_t len;
+    const char* chars = text_view(args[0], &len);
+    StrBuf sb;
+    strbuf_init(&sb, len + 32);
+    int next = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        const char* open = (const char*)memchr(chars + pos, '{', len - pos);
+        size_t literal = open ? (size_t)(open - (chars + pos)) : len - pos;
+        strbuf_append_n(&sb, chars + pos, literal);
+        pos += literal;
+        if (!open) break;
+        size_t close = pos + 1;
+        int index = 0;
+        bool numbered = false;
+        while (close < len && chars[close] >= '0' && chars[close] <= '9' && index < 100000) {
+            index = index * 10 + (chars[close++] - '0');
+            numbered = true;
+        }
+        if (close >= len || chars[close] != '}') {
+            // Not a placeholder: keep the brace
+            strbuf_append_n(&sb, "{", 1);
+            pos++;
+            continue;
+        }
+        if (!numbered) index = next++;
+        if (index >= value_count) {
+            runtime_errorf("Runtime Error: 'format' has no value for placeholder %d.\n", index);
+            free(sb.data);
+            return create_nil_value_helper();
+        }
+        if (values) {
+            Value* item = list_get(values, index);
+            strbuf_append_value(&sb, item);
+            free_value(item);
+        } else {
+            strbuf_append_value(&sb, args[1]);
+        }
+        pos = close + 1;
+    }
+    Value* result = alloc_value();
+    result->type = VAL_STRING;
+    result->as.string = sb.data;
+    return result;
+}
+
+// text~>find(text, part): position of the first occurrence, Nil when absent
+static Value* native_text_find(Value** args, int argc, Scope* scope) {
+    if (!native_arity("find", argc, 2) || !text_arg("find", args[0]) || !text_arg("find", args[1])) return create_nil_value_helper();
+    size_t len, part_len;
+    const char* chars = text_view(args[0], &len);
+    const char* part = text_view(args[1], &part_len);
+    size_t at = scan_find(chars, len, part, part_len);
+    if (at == SCAN_NONE) return create_nil_value_helper();
+    return create_int_value_helper((int64_t)at);
+}
+
+// text~>count(text, part): number of non-overlapping occurrences
+static Value* native_text_count(Value** args, int argc, Scope* scope) {
+    if (!native_arity("count", argc, 2) || !text_arg("count", args[0]) || !text_arg("count", args[1])) return create_nil_value_helper();
+    size_t len, part_len;
+    const char* chars = text_view(args[0], &len);
+    const char* part = text_view(args[1], &part_len);
+    if (part_len == 0) {
+        runtime_errorf("Runtime Error: 'count' expects a non-empty text to count.\n");
+        return create_nil_value_helper();
+    }
+    return create_int_value_helper((int64_t)scan_count(chars, len, part, part_len));
+}
+
+// Also the methods of Text values: line~>split(",")
+static const NativeEntry text_members[] = {
+    {"trim", native_text_trim},
+    {"split", native_text_split},
+    {"join", native_text_join},
+    {"replace", native_text_replace},
+    {"format", native_text_format},
+    {"find", native_text_find},
+    {"count", native_text_count},
+    {NULL, NULL}
+};
+
+// ---------------------------------------------------------------------------
+// Serialization
+// ---------------------------------------------------------------------------
+
+// A new instance of a blueprint with its own copies of the blueprint's
+// attributes and methods, and self; the constructor is left to the caller
+Value* blueprint_instantiate(Value* blueprint_val) {
+    Scope* instance_scope = create_scope(blueprint_val->as.blueprint.scope);
+    for (int i = 0; i < blueprint_val->as.blueprint.scope->symbol_count; i++) {
+        set_variable(instance_scope, blueprint_val->as.blueprint.scope->symbols[i].name, copy_value(blueprint_val->as.blueprint.scope->symbols[i].value));
+    }
+    Value* instance = alloc_value();
+    instance->type = VAL_BLUEPRINT_INSTANCE;
+    instance->as.blueprint_instance.blueprint_scope = blueprint_val->as.blueprint.scope;
+    instance->as.blueprint_instance.instance_scope = instance_scope;
+    instance->as.blueprint_instance.blueprint_name = blueprint_val->as.blueprint.name;
+    // Important: Pass a COPY of the instance as 'self' so instance_scope owns its own Value struct.
+    set_variable(instance_scope, "self", copy_value(instance));
+    return instance;
+}
+
+// Short texts are copied out on unpack; longer ones become slices of the
+// packed data, which keeps the whole of it alive as long as they are
+#define SERIAL_SLICE_MIN 32
+
+static void serial_put_tag(StrBuf* sb, SerialTag tag) {
+    strbuf_reserve(sb, 1);
+    sb->data[sb->len++] = (char)tag;
+}
+
+static void serial_put_length(StrBuf* sb, uint64_t n) {
+    strbuf_reserve(sb, SERIAL_VARINT_MAX);
+    sb->len += serial_put_varint(sb->data + sb->len, n);
+}
+
+static void serial_put_chars(StrBuf* sb, const char* chars, size_t len) {
+    serial_put_length(sb, len);
+    strbuf_append_n(sb, chars, len);
+}
+
+// Instance fields that get packed: everything but methods and self
+static bool serial_is_field(const Symbol* symbol) {
+    return symbol->value->type != VAL_FUNCTION && strcmp(symbol->name, "self") != 0;
+}
+
+static bool serial_encode(StrBuf* sb, const Value* val, int depth) {
+    if (depth > SERIAL_MAX_DEPTH) {
+        runtime_errorf("Runtime Error: 'pack' cannot store values nested more than %d deep (is a list inside itself?).\n", SERIAL_MAX_DEPTH);
+        return false;
+    }
+    switch (val->type) {
+        case VAL_NIL:
+            serial_put_tag(sb, SERIAL_NIL);
+            return true;
+        case VAL_BOOL:
+            serial_put_tag(sb, val->as.boolean ? SERIAL_ON : SERIAL_OFF);
+            return true;
+        case VAL_NUMBER:
+            serial_put_tag(sb, SERIAL_NUMBER);
+            strbuf_reserve(sb, 8);
+            serial_put_f64(sb->data + sb->len, val->as.number);
+            sb->len += 8;
+            return true;
+        case VAL_INT:
+            serial_put_tag(sb, SERIAL_INT);
+            serial_put_length(sb, serial_zigzag(val->as.integer));
+            return true;
+        case VAL_STRING:
+        case VAL_ROPE: {
+            size_t len;
+            const char* chars = text_view(val, &len);
+            serial_put_tag(sb, SERIAL_TEXT);
+            serial_put_chars(sb, chars, len);
+            return true;
+        }
+        case VAL_LIST: {
+            ListObj* list = val->as.list;
+            if (list->dense) {
+                serial_put_tag(sb, SERIAL_NUMBERS);
+                serial_put_length(sb, (uint64_t)list->count);
+                strbuf_reserve(sb, (size_t)list->count * 8);
+                serial_put_f64s(sb->data + sb->len, list->data.numbers, (size_t)list->count);
+                sb->len += (size_t)list->count * 8;
+                return true;
+            }
+            serial_put_tag(sb, SERIAL_LIST);
+            serial_put_length(sb, (uint64_t)list->count);
+            for (int i = 0; i < list->count; i++) {
+                if (!serial_encode(sb, &list->data.items[i], depth + 1)) return false;
+            }
+            return true;
+        }
+        case VAL_DICT: {
+            DictObj* dict = val->as.dict;
+            serial_put_tag(sb, SERIAL_DICT);
+            serial_put_length(sb, (uint64_t)dict->count);
+            for (int i = 0; i < dict->entry_count; i++) {
+                DictEntry* entry = &dict->entries[i];
+                if (!entry->live) continue;
+                if (!serial_encode(sb, &entry->key, depth + 1) || !serial_encode(sb, &entry->value, depth + 1)) return false;
+            }
+            return true;
+        }
+        case VAL_SET: {
+            SetObj* set = val->as.set;
+            serial_put_tag(sb, SERIAL_SET);
+            serial_put_length(sb, (uint64_t)set->count);
+            if (!set->bitset) {
+                for (int i = 0; i < set->hash->entry_count; i++) {
+                    DictEntry* entry = &set->hash->entries[i];
+                    if (entry->live && !serial_encode(sb, &entry->key, depth + 1)) return false;
+                }
+                return true;
+            }
+            for (int w = 0; w < set->word_count; w++) {
+                for (uint64_t bits = set->words[w]; bits; bits &= bits - 1) {
+                    serial_put_tag(sb, SERIAL_INT);
+                    serial_put_length(sb, serial_zigzag(w * 64 + ctz64(bits)));
+                }
+            }
+            return true;
+        }
+        case VAL_BLUEPRINT_INSTANCE: {
+            const char* name = val->as.blueprint_instance.blueprint_name;
+            Scope* fields = val->as.blueprint_instance.instance_scope;
+            if (!name) {
+                runtime_errorf("Runtime Error: 'pack' cannot store an instance without a blueprint name.\n");
+                return false;
+            }
+            int count = 0;
+            for (int i = 0; i < fields->symbol_count; i++) count += serial_is_field(&fields->symbols[i]);
+            serial_put_tag(sb, SERIAL_INSTANCE);
+            serial_put_chars(sb, name, strlen(name));
+            serial_put_length(sb, (uint64_t)count);
+            for (int i = 0; i < fields->symbol_count; i++) {
+                Symbol* field = &fields->symbols[i];
+                if (!serial_is_field(field)) continue;
+                serial_put_chars(sb, field->name, strlen(field->name));
+                if (!serial_encode(sb, field->value, depth + 1)) return false;
+            }
+            return true;
+        }
+        default:
+            runtime_errorf("Runtime Error: 'pack' cannot store specs, blueprints, toolkits, iterators, files or pending operations.\n");
+            return false;
+    }
+}
+
+// Decodes one value. On bad input r->failed is set and the result is
+// whatever was decoded so far, for the caller to free.
+static Value* serial_decode(SerialReader* r, RopeObj* source, Scope* scope, int depth) {
+    if (depth > SERIAL_MAX_DEPTH) {
+        serial_fail(r);
+        return create_nil_value_helper();
+    }
+    switch (serial_get_byte(r)) {
+        case SERIAL_NIL: return create_nil_value_helper();
+        case SERIAL_OFF: return create_bool_value_helper(false);
+        case SERIAL_ON: return create_bool_value_helper(true);
+        case SERIAL_NUMBER: return create_number_value_helper(serial_get_f64(r));
+        case SERIAL_INT: return create_int_value_helper(serial_get_zigzag(r));
+        case SERIAL_TEXT: {
+            uint64_t len = serial_get_varint(r);
+            const char* chars = len <= SIZE_MAX ? serial_get_bytes(r, (size_t)len) : NULL;
+            if (!chars) return create_nil_value_helper();
+            if (len < SERIAL_SLICE_MIN && !memchr(chars, '\0', (size_t)len)) {
+                Value* val = alloc_value();
+                val->type = VAL_STRING;
+                val->as.string = (char*)malloc((size_t)len + 1);
+                memcpy(val->as.string, chars, (size_t)len);
+                val->as.string[len] = '\0';
+                return val;
+            }
+            ref_retain(&source->refcount);
+            return create_rope_value_helper(rope_slice(source, chars, (size_t)len));
+        }
+        case SERIAL_NUMBERS: {
+            size_t count = serial_get_count(r, 8);
+            ListObj* list = list_new((int)count, true);
+            serial_get_f64s(r, list->data.numbers, count);
+            list->count = (int)count;
+            return create_list_value_helper(list);
+        }
+        case SERIAL_LIST: {
+            size_t count = serial_get_count(r, 1);
+            ListObj* list = list_new((int)count, false);
+            for (size_t i = 0; i < count && !r->failed; i++) {
+                list_append(list, serial_decode(r, source, scope, depth + 1));
+            }
+            return create_list_value_helper(list);
+        }
+        case SERIAL_DICT: {
+            size_t count = serial_get_count(r, 2);
+            DictObj* dict = dict_new();
+            for (size_t i = 0; i < count && !r->failed; i++) {
+                Value* key = serial_decode(r, source, scope, depth + 1);
+                dict_set(dict, key, serial_decode(r, source, scope, depth + 1));
+                free_value(key);
+            }
+            return create_dict_value_helper(dict);
+        }
+        case SERIAL_SET: {
+            size_t count = serial_get_count(r, 1);
+            SetObj* set = set_new();
+            for (size_t i = 0; i < count && !r->failed; i++) {
+                Value* member = serial_decode(r, source, scope, depth + 1);
+                set_add(set, member);
+                free_value(member);
+            }
+            return create_set_value_helper(set);
+        }
+        case SERIAL_INSTANCE: {
+            uint64_t name_len = serial_get_varint(r);
+            const char* name_chars = name_len <= SIZE_MAX ? serial_get_bytes(r, (size_t)name_len) : NULL;
+            if (!name_chars) return create_nil_value_helper();
+            char* name = strndup(name_chars, (size_t)name_len);
+            Value* blueprint_val = get_variable(scope, name);
+            if (!blueprint_val || blueprint_val->type != VAL_BLUEPRINT) {
+                runtime_errorf("Runtime Error: 'unpack' found an instance of '%s', which is not a blueprint here.\n", name);
+                free_value(blueprint_val);
+                free(name);
+                serial_fail(r);
+                return create_nil_value_helper();
+            }
+            Value* instance = blueprint_instantiate(blueprint_val);
+            free_value(blueprint_val);
+            free(name);
+            Scope* fields = instance->as.blueprint_instance.instance_scope;
+            size_t count = serial_get_count(r, 2);
+            for (size_t i = 0; i < count && !r->failed; i++) {
+                uint64_t field_len = serial_get_varint(r);
+                const char* field_chars = field_len <= SIZE_MAX ? serial_get_bytes(r, (size_t)field_len) : NULL;
+                if (!field_chars) break;
+                char* field = strndup(field_chars, (size_t)field_len);
+                define_variable(fields, field, serial_decode(r, source, scope, depth + 1), false);
+                free(field);
+            }
+            return instance;
+        }
+        default:
+            serial_fail(r);
+            return create_nil_value_helper();
+    }
+}
+
+// serial~>pack(value): a compact binary form of the value, as Text
+static Value* native_serial_pack(Value** args, int argc, Scope* scope) {
+    if (!native_arity("pack", argc, 1)) return create_nil_value_helper();
+    StrBuf sb;
+    strbuf_init(&sb, 64);
+    strbuf_append_n(&sb, SERIAL_MAGIC, SERIAL_MAGIC_SIZE);
+    if (!serial_encode(&sb, args[0], 0)) {
+        free(sb.data);
+        return create_nil_value_helper();
+    }
+    return create_rope_value_helper(rope_adopt(sb.data, sb.len));
+}
+
+// serial~>unpack(data): the value packed into data. Long texts in the
+// result are slices of data rather than copies.
+static Value* native_serial_unpack(Value** args, int argc, Scope* scope) {
+    if (!native_arity("unpack", argc, 1) || !text_arg("unpack", args[0])) return create_nil_value_helper();
+    const char* chars;
+    size_t len;
+    RopeObj* source = text_source(args[0], &chars, &len);
+    SerialReader reader = {chars, len, 0, false};
+    const char* magic = serial_get_bytes(&reader, SERIAL_MAGIC_SIZE);
+    Value* result = NULL;
+    if (magic && memcmp(magic, SERIAL_MAGIC, SERIAL_MAGIC_SIZE) == 0) {
+        result = serial_decode(&reader, source, scope, 0);
+    }
+    rope_release(source);
+    if (!result || reader.failed || reader.pos != reader.length) {
+        runtime_errorf("Runtime Error: 'unpack' expects data made by serial~>pack.\n");
+        free_value(result);
+        return create_nil_value_helper();
+    }
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// JSON
+// ---------------------------------------------------------------------------
+
+// Output is built in a per-thread buffer that is reused from call to call;
+// one that grew past this for a huge document is let go afterwards
+#define JSON_BUFFER_KEEP (1 << 20)
+
+static WORKERS_THREAD_LOCAL StrBuf json_buffer;
+
+static StrBuf* json_buffer_start(void) {
+    if (!json_buffer.data) strbuf_init(&json_buffer, 256);
+    json_buffer.len = 0;
+    return &json_buffer;
+}
+
+static void json_buffer_done(void) {
+    if (json_buffer.cap > JSON_BUFFER_KEEP) {
+        free(json_buffer.data);
+        json_buffer.data = NULL;
+    }
+}
+
+static Value* json_to_value(cJSON* item) {
+    if (cJSON_IsTrue(item)) return create_bool_value_helper(true);
+    if (cJSON_IsFalse(item)) return create_bool_value_helper(false);
+    if (cJSON_IsNumber(item)) return create_numeric_value_helper(item->valuedouble);
+    if (cJSON_IsString(item)) {
+        // Take over cJSON's copy of the string rather than copying it again
+        Value* val = alloc_value();
+        val->type = VAL_STRING;
+        val->as.string = item->valuestring;
+        item->valuestring = NULL;
+        return val;
+    }
+    if (cJSON_IsArray(item)) {
+        ListObj* list = list_new(cJSON_GetArraySize(item), true);
+        for (cJSON* child = item->child; child; child = child->next) list_append(list, json_to_value(child));
+        return create_list_value_helper(list);
+    }
+    if (cJSON_IsObject(item)) {
+        DictObj* dict = dict_new();
+        for (cJSON* child = item->child; child; child = child->next) {
+            Value key = {VAL_STRING};
+            key.as.string = child->string;
+            dict_set(dict, &key, json_to_value(child));
+        }
+        return create_dict_value_helper(dict);
+    }
+    return create_nil_value_helper();
+}
+
+// The value of the JSON document in chars, or NULL with *error_at set to
+// the offset where parsing failed
+static Value* json_decode(const char* chars, size_t len, size_t* error_at) {
+    const char* end = NULL;
+    cJSON* root = cJSON_ParseWithLengthOpts(chars, len, &end, false);
+    if (root) {
+        // Only whitespace may follow the document
+        while (end < chars + len && is_space(*end)) end++;
+        if (end == chars + len) {
+            Value* val = json_to_value(root);
+            cJSON_Delete(root);
+            return val;
+        }
+        cJSON_Delete(root);
+    }
+    *error_at = end && end >= chars ? (size_t)(end - chars) : 0;
+    return NULL;
+}
+
+static void json_append_string(StrBuf* sb, const char* chars, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    strbuf_append_n(sb, "\"", 1);
+    size_t run = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)chars[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        strbuf_append_n(sb, chars + run, i - run);
+        run = i + 1;
+        char escape[6] = {'\\', 0};
+        switch (c) {
+            case '"': escape[1] = '"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            default:
+                memcpy(escape + 1, "u00", 3);
+                escape[4] = hex[c >> 4];
+                escape[5] = hex[c & 15];
+                strbuf_append_n(sb, escape, 6);
+                continue;
+        }
+        strbuf_append_n(sb, escape, 2);
+    }
+    strbuf_append_n(sb, chars + run, len - run);
+    strbuf_append_n(sb, "\"", 1);
+}
+
+static void json_append_number(StrBuf* sb, const Value* val) {
+    // JSON has no NaN or infinity
+    if (val->type == VAL_NUMBER && !isfinite(val->as.number)) strbuf_append(sb, "null");
+    else strbuf_append_number(sb, val);
+}
+
+// Object keys must be strings: other keys are written as their text form
+static void json_append_key(StrBuf* sb, Value* key) {
+    if (is_text(key)) {
+        size_t len;
+        const char* chars = text_view(key, &len);
+        json_append_string(sb, chars, len);
+        return;
+    }
+    strbuf_append_n(sb, "\"", 1);
+    strbuf_append_value(sb, key);
+    strbuf_append_n(sb, "\"", 1);
+}
+
+static bool json_encode(StrBuf* sb, Value* val, int depth) {
+    if (depth > CJSON_NESTING_LIMIT) {
+        runtime_errorf("Runtime Error: 'json' cannot write values nested more than %d deep (is a list inside itself?).\n", CJSON_NESTING_LIMIT);
+        return false;
+    }
+    switch (val->type) {
+        case VAL_NIL:
+            strbuf_append(sb, "null");
+            return true;
+        case VAL_BOOL:
+            strbuf_append(sb, val->as.boolean ? "true" : "false");
+            return true;
+        case VAL_INT:
+        case VAL_NUMBER:
+            json_append_number(sb, val);
+            return true;
+        case VAL_STRING:
+        case VAL_ROPE: {
+            size_t len;
+            const char* chars = text_view(val, &len);
+            json_append_string(sb, chars, len);
+            return true;
+        }
+        case VAL_LIST: {
+            ListObj* list = val->as.list;
+            strbuf_append_n(sb, "[", 1);
+            for (int i = 0; i < list->count; i++) {
+                if (i > 0) strbuf_append_n(sb, ",", 1);
+                if (list->dense) {
+                    Value item;
+                    set_numeric(&item, list->data.numbers[i]);
+                    json_append_number(sb, &item);
+                } else if (!json_encode(sb, &list->data.items[i], depth + 1)) {
+                    return false;
+                }
+            }
+            strbuf_append_n(sb, "]", 1);
+            return true;
+        }
+        case VAL_SET: {
+            ListObj* items = set_items(val->as.set);
+            Value list_val = {VAL_LIST};
+            list_val.as.list = items;
+            bool ok = json_encode(sb, &list_val, depth);
+            list_release(items);
+            return ok;
+        }
+        case VAL_DICT: {
+            DictObj* dict = val->as.dict;
+            bool first = true;
+            strbuf_append_n(sb, "{", 1);
+            for (int i = 0; i < dict->entry_count; i++) {
+                DictEntry* entry = &dict->entries[i];
+                if (!entry->live) continue;
+                if (!first) strbuf_append_n(sb, ",", 1);
+                first = false;
+                json_append_key(sb, &entry->key);
+                strbuf_append_n(sb, ":", 1);
+                if (!json_encode(sb, &entry->value, depth + 1)) return false;
+            }
+            strbuf_append_n(sb, "}", 1);
+            return true;
+        }
+        case VAL_BLUEPRINT_INSTANCE: {
+            // An object of the instance's fields
+            Scope* fields = val->as.blueprint_instance.instance_scope;
+            bool first = true;
+            strbuf_append_n(sb, "{", 1);
+            for (int i = 0; i < fields->symbol_count; i++) {
+                Symbol* field = &fields->symbols[i];
+                if (!serial_is_field(field)) continue;
+                if (!first) strbuf_append_n(sb, ",", 1);
+                first = false;
+                json_append_string(sb, field->name, strlen(field->name));
+                strbuf_append_n(sb, ":", 1);
+                if (!json_encode(sb, field->value, depth + 1)) return false;
+            }
+            strbuf_append_n(sb, "}", 1);
+            return true;
+        }
+        default:
+            runtime_errorf("Runtime Error: 'json' cannot write specs, blueprints, toolkits, iterators, files or pending operations.\n");
+            return false;
+    }
+}
+
+// json~>parse(text): the value of a JSON document. Objects become dicts,
+// arrays lists and null Nil.
+static Value* native_json_parse(Value** args, int argc, Scope* scope) {
+    if (!native_arity("parse", argc, 1) || !text_arg("parse", args[0])) return create_nil_value_helper();
+    size_t len, error_at;
+    const char* chars = text_view(args[0], &len);
+    Value* val = json_decode(chars, len, &error_at);
+    if (!val) {
+        runtime_errorf("Runtime Error: 'parse' was given invalid JSON (at offset %zu).\n", error_at);
+        return create_nil_value_helper();
+    }
+    return val;
+}
+
+// json~>text(value): the value as compact JSON
+static Value* native_json_text(Value** args, int argc, Scope* scope) {
+    if (!native_arity("text", argc, 1)) return create_nil_value_helper();
+    StrBuf* sb = json_buffer_start();
+    Value* result = json_encode(sb, args[0], 0) ? create_string_value_helper(sb->data) : create_nil_value_helper();
+    json_buffer_done();
+    return result;
+}
+
+// json~>write(handle, value): writes the value to a file handle as one line
+// of JSON, straight from the reusable buffer
+static Value* native_json_write(Value** args, int argc, Scope* scope) {
+    if (!native_arity("write", argc, 2)) return create_nil_value_helper();
+    FileObj* file = file_arg("write", args[0], true);
+    if (!file) return create_nil_value_helper();
+    StrBuf* sb = json_buffer_start();
+    if (json_encode(sb, args[1], 0)) {
+        strbuf_append_n(sb, "\n", 1);
+        fwrite(sb->data, 1, sb->len, file->stream);
+    }
+    json_buffer_done();
+    return create_nil_value_helper();
+}
+
+// json~>records(source): an iterator over newline-delimited JSON, parsing
+// one line at a time. The source is a file path, a file handle or any
+// iterable of text lines.
+static Value* native_json_records(Value** args, int argc, Scope* scope) {
+    if (!native_arity("records", argc, 1)) return create_nil_value_helper();
+    IterObj* source;
+    if (is_text(args[0])) {
+        Value* lines = native_lines(args, argc, scope);
+        if (lines->type != VAL_ITER) return lines;
+        source = lines->as.iter;
+        ref_retain(&source->refcount);
+        free_value(lines);
+    } else {
+        source = iter_from_value(args[0]);
+        if (!source) {
+            runtime_errorf("Runtime Error: 'records' expects a file path, a file handle or lines of text.\n");
+            return create_nil_value_helper();
+        }
+    }
+    IterObj* it = iter_new(ITER_JSON);
+    it->as.json.source = source;
+    it->as.json.line = 0;
+    return create_iter_value_helper(it);
+}
+
+static const NativeEntry json_members[] = {
+    {"parse", native_json_parse},
+    {"text", native_json_text},
+    {"write", native_json_write},
+    {"records", native_json_records},
+    {NULL, NULL}
+};
+
+// ---------------------------------------------------------------------------
+// CSV
+// ---------------------------------------------------------------------------
+
+// Like serial~>unpack, short text fields are copied out and longer ones are
+// slices of the file's contents
+#define CSV_SLICE_MIN 32
+
+typedef struct {
+    const char* chars;
+    size_t length;
+    bool quoted;
+    bool escaped;   // quoted with doubled quotes inside
+} CsvField;
+
+typedef struct CsvReader {
+    RopeObj* source;
+    const char* chars;
+    size_t length;
+    size_t pos;
+    bool after_delim;   // a delimiter was just read, so one more field follows
+    char delim;
+    bool header;
+    int num_columns;    // 0 until the first row is read
+    Value* names;       // column keys: header texts, or 0, 1, 2... without one
+    CsvField* row;
+    int row_count;
+    int row_capacity;
+    long rows_read;
+    bool warned;
+} CsvReader;
+
+static CsvReader* csv_reader_new(RopeObj* source, char delim, bool header) {
+    CsvReader* r = (CsvReader*)calloc(1, sizeof(CsvReader));
+    r->source = source;
+    r->chars = rope_chars(source);
+    r->length = source->length;
+    r->delim = delim;
+    r->header = header;
+    // A byte order mark is not part of the first column's name
+    if (r->length >= 3 && memcmp(r->chars, "\xEF\xBB\xBF", 3) == 0) r->pos = 3;
+    return r;
+}
+
+static void csv_reader_free(CsvReader* r) {
+    if (!r) return;
+    for (int i = 0; i < r->num_columns; i++) clear_value(&r->names[i]);
+    free(r->names);
+    free(r->row);
+    rope_release(r->source);
+    free(r);
+}
+
+// Reads the next field into f; false at the end of the input. *last is
+// set when the field ends its row.
+static bool csv_next_field(CsvReader* r, CsvField* f, bool* last) {
+    const char* c = r->chars;
+    size_t n = r->length;
+    size_t pos = r->pos;
+    if (pos >= n && !r->after_delim) return false;
+    r->after_delim = false;
+    f->quoted = pos < n && c[pos] == '"';
+    f->escaped = false;
+    if (f->quoted) {
+        size_t start = ++pos;
+        size_t end = n;
+        for (;;) {
+            const char* q = (const char*)memchr(c + pos, '"', n - pos);
+            if (!q) {
+                pos = n;  // unterminated: the rest of the input
+                break;
+            }
+            pos = (size_t)(q - c) + 1;
+            if (pos < n && c[pos] == '"') {
+                f->escaped = true;
+                pos++;
+                continue;
+            }
+            end = (size_t)(q - c);
+            break;
+        }
+        f->chars = c + start;
+        f->length = end - start;
+        // Anything between the closing quote and the delimiter is dropped
+        while (pos < n && c[pos] != r->delim && c[pos] != '\n' && c[pos] != '\r') pos++;
+    } else {
+        size_t start = pos;
+        for (;;) {
+            pos += csv_scan(c + pos, n - pos, r->delim);
+            if (pos < n && c[pos] == '"') {
+                pos++;  // a quote inside an unquoted field is just a character
+                continue;
+            }
+            break;
+        }
+        f->chars = c + start;
+        f->length = pos - start;
+    }
+    if (pos >= n) {
+        *last = true;
+    } else if (c[pos] == r->delim) {
+        pos++;
+        r->after_delim = true;
+        *last = false;
+    } else {
+        if (c[pos] == '\r') pos++;
+        if (pos < n && c[pos] == '\n') pos++;
+        *last = true;
+    }
+    r->pos = pos;
+    return true;
+}
+
+// Reads the fields of the next non-blank row into r->row; false at the end
+static bool csv_read_row(CsvReader* r) {
+    for (;;) {
+        r->row_count = 0;
+        CsvField f;
+        bool last = false;
+        while (!last && csv_next_field(r, &f, &last)) {
+            if (r->row_count == r->row_capacity) {
+                r->row_capacity = r->row_capacity ? r->row_capacity * 2 : 16;
+                r->row = (CsvField*)realloc(r->row, r->row_capacity * sizeof(CsvField));
+            }
+            r->row[r->row_count++] = f;
+        }
+        if (r->row_count == 0) return false;
+        if (r->row_count > 1 || r->row[0].length > 0 || r->row[0].quoted) return true;
+    }
+}
+
+// The field as Text, undoing doubled quotes
+static Value* csv_field_text(CsvReader* r, const CsvField* f) {
+    if (f->escaped) {
+        char* text = (char*)malloc(f->length + 1);
+        size_t len = 0;
+        for (size_t i = 0; i < f->length; i++) {
+            text[len++] = f->chars[i];
+            if (f->chars[i] == '"' && i + 1 < f->length && f->chars[i + 1] == '"') i++;
+        }
+        text[len] = '\0';
+        Value* val = alloc_value();
+        val->type = VAL_STRING;
+        val->as.string = text;
+        return val;
+    }
+    if (f->length < CSV_SLICE_MIN) {
+        Value* val = alloc_value();
+        val->type = VAL_STRING;
+        val->as.string = (char*)malloc(f->length + 1);
+        memcpy(val->as.string, f->chars, f->length);
+        val->as.string[f->length] = '\0';
+        return val;
+    }
+    ref_retain(&r->source->refcount);
+    return create_rope_value_helper(rope_slice(r->source, f->chars, f->length));
+}
+
+// Appends a field to its column: a number when it reads as one, Nil when
+// empty, Text otherwise. Numbers go straight into dense columns.
+static void csv_append_field(CsvReader* r, ListObj* column, const CsvField* f) {
+    double number;
+    if (!f->escaped && csv_number(f->chars, f->length, &number)) {
+        if (column->dense) {
+            list_reserve(column, column->count + 1);
+            column->data.numbers[column->count++] = number;
+        } else {
+            list_append(column, create_numeric_value_helper(number));
+        }
+        return;
+    }
+    if (f->length == 0 && !f->quoted) {
+        list_append(column, create_nil_value_helper());
+        return;
+    }
+    list_append(column, csv_field_text(r, f));
+}
+
+// Sets up the column keys from the header row, or from the width of the
+// first row when there is no header. False if the input is empty.
+static bool csv_read_names(CsvReader* r) {
+    if (!csv_read_row(r)) return false;
+    r->num_columns = r->row_count;
+    r->names = (Value*)malloc(r->num_columns * sizeof(Value));
+    for (int i = 0; i < r->num_columns; i++) {
+        if (!r->header) {
+            r->names[i].type = VAL_INT;
+            r->names[i].as.integer = i;
+            continue;
+        }
+        Value* name = csv_field_text(r, &r->row[i]);
+        r->names[i] = *name;
+        slab_free(&value_slab, name);
+    }
+    if (r->header) r->row_count = 0;
+    return true;
+}
 
+// Reads up to max_rows rows (all of them for 0) into a dict of columns.
+// NULL once the input is exhausted, except that the first chunk of an
+// input with a header but no rows is a dict of empty columns.
+static DictObj* csv_read_chunk(CsvReader* r, long max_rows) {
+    bool first = r->num_columns == 0;
+    if (first && !csv_read_names(r)) return NULL;
+    // Without a header the first row has already been read
+    bool pending = first && !r->header;
+    long capacity = max_rows > 0 && max_rows < 1024 ? max_rows : 1024;
+    ListObj** columns = (ListObj**)malloc(r->num_columns * sizeof(ListObj*));
+    for (int i = 0; i < r->num_columns; i++) columns[i] = list_new((int)capacity, true);
+    long rows = 0;
+    while ((max_rows <= 0 || rows < max_rows) && (pending || csv_read_row(r))) {
+        pending = false;
+        r->rows_read++;
+        if (r->row_count > r->num_columns && !r->warned) {
+            runtime_errorf("Runtime Error: CSV row %ld has %d fields where %d were expected; the extra ones are dropped.\n",
+                    r->rows_read, r->row_count, r->num_columns);
+            r->warned = true;
+        }
+        for (int i = 0; i < r->num_columns; i++) {
+            if (i < r->row_count) csv_append_field(r, columns[i], &r->row[i]);
+            else list_append(columns[i], create_nil_value_helper());
+        }
+        rows++;
+    }
+    if (rows == 0 && !(first && r->header)) {
+        for (int i = 0; i < r->num_columns; i++) list_release(columns[i]);
+        free(columns);
+        return NULL;
+    }
+    DictObj* dict = dict_new();
+    for (int i = 0; i < r->num_columns; i++) {
+        // A repeated column name gets the column's position appended
+        Value key = r->names[i];
+        Value* renamed = NULL;
+        if (dict_lookup(dict, &key)) {
+            StrBuf sb;
+            strbuf_init(&sb, 32);
+            strbuf_append_value(&sb, &key);
+            strbuf_append(&sb, "_");
+            Value position = {VAL_INT};
+            position.as.integer = i;
+            strbuf_append_number(&sb, &position);
+            renamed = alloc_value();
+            renamed->type = VAL_STRING;
+            renamed->as.string = sb.data;
+        }
+        dict_set(dict, renamed ? renamed : &key, create_list_value_helper(columns[i]));
+        free_value(renamed);
+    }
+    free(columns);
+    return dict;
+}
 
+// The optional delimiter and header arguments starting at args[first]
+static bool csv_options(const char* name, Value** args, int argc, int first, char* delim, bool* header) {
+    *delim = ',';
+    *header = true;
+    if (argc > first) {
+        size_t len;
+        const char* chars = is_text(args[first]) ? text_view(args[first], &len) : NULL;
+        if (!chars || len != 1 || chars[0] == '"' || chars[0] == '\n' || chars[0] == '\r') {
+            runtime_errorf("Runtime Error: '%s' expects a single-character delimiter.\n", name);
+            return false;
+        }
+        *delim = chars[0];
+    }
+    if (argc > first + 1) {
+        if (args[first + 1]->type != VAL_BOOL) {
+            runtime_errorf("Runtime Error: '%s' expects On or Off for the header.\n", name);
+            return false;
+        }
+        *header = args[first + 1]->as.boolean;
+    }
+    if (argc > first + 2) {
+        runtime_errorf("Runtime Error: '%s' expects at most %d arguments.\n", name, first + 2);
+        return false;
+    }
+    return true;
+}
 
-typedef struct {
-    char *name;
-    ASTNode **body;
-    int num_body_statements;
-} BlameNode;
+// The whole of a file as a rope: mapped when it is a regular file
+static RopeObj* csv_open(const char* path) {
+    FileMap map;
+    FileMapStatus status = filemap_open(path, &map);
+    if (status == FILEMAP_OK) return rope_from_map(&map);
+    FILE* file = status == FILEMAP_NOT_REGULAR ? fopen(path, "rb") : NULL;
+    if (!file) {
+        runtime_errorf("Runtime Error: Could not open file '%s'.\n", path);
+        return NULL;
+    }
+    StrBuf sb;
+    strbuf_init(&sb, 4096);
+    size_t n;
+    do {
+        strbuf_reserve(&sb, 4096);
+        n = fread(sb.data + sb.len, 1, 4096, file);
+        sb.len += n;
+    } while (n > 0);
+    fclose(file);
+    sb.data[sb.len] = '\0';
+    return rope_adopt(sb.data, sb.len);
+}
 
-typedef struct {
-    char *type_name;
-} TypeNode;
+static Value* csv_read_all(RopeObj* source, char delim, bool header) {
+    CsvReader* r = csv_reader_new(source, delim, header);
+    DictObj* dict = csv_read_chunk(r, 0);
+    csv_reader_free(r);
+    return create_dict_value_helper(dict ? dict : dict_new());
+}
 
-typedef struct {
-    ASTNode *expression;
-} KindNode;
+// csv~>read(path, delimiter, header): the whole file as a dict from column
+// name to a list of the column's values
+static Value* native_csv_read(Value** args, int argc, Scope* scope) {
+    char delim;
+    bool header;
+    if (argc < 1 || !text_arg("read", args[0]) || !csv_options("read", args, argc, 1, &delim, &header)) return create_nil_value_helper();
+    RopeObj* source = csv_open(text_of(args[0]));
+    return source ? csv_read_all(source, delim, header) : create_nil_value_helper();
+}
 
-typedef struct {
-    ASTNode *original;
-    ASTNode *alias;
-} NickNode;
+// csv~>parse(text, delimiter, header): like read, from text in memory
+static Value* native_csv_parse(Value** args, int argc, Scope* scope) {
+    char delim;
+    bool header;
+    if (argc < 1 || !text_arg("parse", args[0]) || !csv_options("parse", args, argc, 1, &delim, &header)) return create_nil_value_helper();
+    const char* chars;
+    size_t len;
+    return csv_read_all(text_source(args[0], &chars, &len), delim, header);
+}
 
-typedef struct {
-    ASTNode *declaration;
-} HiddenNode;
+// csv~>chunks(path, rows, delimiter, header): an iterator over dicts of
+// columns holding up to `rows` rows each
+static Value* native_csv_chunks(Value** args, int argc, Scope* scope) {
+    char delim;
+    bool header;
+    if (argc < 2 || !text_arg("chunks", args[0]) || !csv_options("chunks", args, argc, 2, &delim, &header)) {
+        if (argc < 2) runtime_errorf("Runtime Error: 'chunks' expects a path and a number of rows.\n");
+        return create_nil_value_helper();
+    }
+    if (!is_number(args[1]) || number_of(args[1]) < 1) {
+        runtime_errorf("Runtime Error: 'chunks' expects a positive number of rows.\n");
+        return create_nil_value_helper();
+    }
+    RopeObj* source = csv_open(text_of(args[0]));
+    if (!source) return create_nil_value_helper();
+    IterObj* it = iter_new(ITER_CSV);
+    it->as.csv.reader = csv_reader_new(source, delim, header);
+    it->as.csv.rows = (long)number_of(args[1]);
+    return create_iter_value_helper(it);
+}
 
-typedef struct {
-    ASTNode *declaration;
-} ShieldedNode;
+// ---------------------------------------------------------------------------
+// Web
+// ---------------------------------------------------------------------------
 
-typedef struct {
-    ASTNode *declaration;
-} InternalNode;
+// web~>serve reads requests from every open connection, runs the handler
+// spec on a batch of them at once on the worker pool, then writes the
+// responses in order. Each chunk of the batch calls the handler under its
+// own scratch scope, as paral_transform does, so handlers run side by side
+// in isolated contexts and must not assign to outer variables. Requests
+// pipelined on one connection simply land in the same batch.
+#define WEB_BATCH_MAX 256
 
 typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} EmbedNode;
+    NetConn* net;
+    bool closing;       // close once the queued output has gone out
+} WebConn;
 
-typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} ParalNode;
+typedef struct WebServer {
+    WebConn* conns;
+    int count;
+    int capacity;
+} WebServer;
 
 typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} HoldNode;
+    WebConn* conn;
+    Value* request;     // handed to the handler
+    Value* response;    // what it returned
+    int refuse;         // a status to answer with instead of calling it
+    bool keep_alive;
+    bool head_only;
+} WebJob;
 
 typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} SignalNode;
+    FunctionSymbol* handler;
+    Scope* scope;
+    WebJob* jobs;
+    int chunk_size;
+    int count;
+} WebBatch;
+
+// Response heads are built in one buffer reused from response to response
+static WORKERS_THREAD_LOCAL StrBuf web_head;
+
+static void web_server_free(WebServer* web) {
+    if (!web) return;
+    for (int i = 0; i < web->count; i++) net_close(web->conns[i].net);
+    free(web->conns);
+    free(web);
+}
 
-typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} ListenNode;
+static Value* web_text(const char* p, size_t n) {
+    Value* val = alloc_value();
+    val->type = VAL_STRING;
+    val->as.string = (char*)malloc(n + 1);
+    memcpy(val->as.string, p, n);
+    val->as.string[n] = '\0';
+    return val;
+}
 
-typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} AskNode;
+// The request as a dict: method, path, query, headers (names lowercased)
+// and body
+static Value* web_request_value(const HttpRequest* req, const char* body) {
+    DictObj* dict = dict_new();
+    Value key = {VAL_STRING};
+    key.as.string = "method";
+    dict_set(dict, &key, web_text(req->method, req->method_len));
+    const char* question = (const char*)memchr(req->target, '?', req->target_len);
+    size_t path_len = question ? (size_t)(question - req->target) : req->target_len;
+    key.as.string = "path";
+    dict_set(dict, &key, web_text(req->target, path_len));
+    key.as.string = "query";
+    dict_set(dict, &key, question ? web_text(question + 1, req->target_len - path_len - 1) : web_text("", 0));
+    DictObj* headers = dict_new();
+    char name[256];
+    for (int i = 0; i < req->num_headers; i++) {
+        const HttpHeader* h = &req->headers[i];
+        size_t n = h->name_len < sizeof(name) - 1 ? h->name_len : sizeof(name) - 1;
+        for (size_t j = 0; j < n; j++) name[j] = (h->name[j] >= 'A' && h->name[j] <= 'Z') ? (char)(h->name[j] + 32) : h->name[j];
+        name[n] = '\0';
+        key.as.string = name;
+        Value* existing = dict_lookup(headers, &key);
+        if (existing) {
+            // A repeated header is one comma-separated list
+            StrBuf sb;
+            strbuf_init(&sb, 64);
+            strbuf_append_value(&sb, existing);
+            strbuf_append(&sb, ", ");
+            strbuf_append_n(&sb, h->value, h->value_len);
+            Value* joined = alloc_value();
+            joined->type = VAL_STRING;
+            joined->as.string = sb.data;
+            dict_set(headers, &key, joined);
+        } else {
+            dict_set(headers, &key, web_text(h->value, h->value_len));
+        }
+    }
+    key.as.string = "headers";
+    dict_set(dict, &key, create_dict_value_helper(headers));
+    key.as.string = "body";
+    dict_set(dict, &key, create_rope_value_helper(rope_leaf(body, req->content_length)));
+    return create_dict_value_helper(dict);
+}
 
-typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} AuthenNode;
+// Takes up to max complete requests off the front of the connection's
+// input. A malformed request is answered with its status and ends the
+// connection.
+static int web_take_requests(WebConn* wc, WebJob* jobs, int max) {
+    NetConn* net = wc->net;
+    int taken = 0;
+    while (taken < max && !wc->closing) {
+        const char* data = net->in.data + net->in.start;
+        size_t size = netbuf_size(&net->in);
+        if (size == 0) break;
+        HttpRequest req;
+        HttpStatus status = http_parse_request(data, size, &req);
+        if (status == HTTP_INCOMPLETE) break;
+        WebJob* job = &jobs[taken];
+        memset(job, 0, sizeof(*job));
+        job->conn = wc;
+        if (status != HTTP_OK) {
+            job->refuse = status;
+            netbuf_consume(&net->in, size);
+            wc->closing = true;
+            taken++;
+            break;
+        }
+        if (size - req.head_length < req.content_length) break;  // body still arriving
+        job->request = web_request_value(&req, data + req.head_length);
+        job->keep_alive = req.keep_alive;
+        job->head_only = http_token_equals(req.method, req.method_len, "head");
+        if (!req.keep_alive) wc->closing = true;
+        netbuf_consume(&net->in, req.head_length + req.content_length);
+        taken++;
+    }
+    net_update(net);
+    return taken;
+}
+
+static void web_run_chunk(void* ctx, int task) {
+    WebBatch* batch = (WebBatch*)ctx;
+    int start = task * batch->chunk_size;
+    int end = start + batch->chunk_size;
+    if (end > batch->count) end = batch->count;
+    Scope* scratch = create_scope(batch->scope);
+    for (int i = start; i < end; i++) {
+        WebJob* job = &batch->jobs[i];
+        if (job->refuse) continue;
+        Value* arg = job->request;
+        job->request = NULL;
+        job->response = call_spec(batch->handler, &arg, 1, scratch);
+    }
+    destroy_scope(scratch);
+}
+
+static Value* web_field(Value* dict, const char* name) {
+    Value key = {VAL_STRING};
+    key.as.string = (char*)name;
+    return dict_lookup(dict->as.dict, &key);
+}
+
+// Whether a handler's dict is a full response rather than JSON data
+static bool web_is_response(Value* v) {
+    if (v->type != VAL_DICT) return false;
+    Value* status = web_field(v, "status");
+    return status && is_number(status);
+}
+
+// Writes the response for one request: Text is sent as plain text, a dict
+// with a numeric status as that response, Nil as 404 and anything else as
+// JSON
+static void web_respond(WebJob* job) {
+    int status = 200;
+    const char* type = "text/plain; charset=utf-8";
+    const char* body = "";
+    size_t body_len = 0;
+    Value* headers = NULL;
+    Value* content = job->response;
+    if (job->refuse) {
+        status = job->refuse;
+        content = NULL;
+        body = http_reason(status);
+        body_len = strlen(body);
+    } else if (!content || content->type == VAL_NIL) {
+        status = 404;
+        body = http_reason(status);
+        body_len = strlen(body);
+        content = NULL;
+    } else if (web_is_response(content)) {
+        status = (int)number_of(web_field(content, "status"));
+        Value* given_type = web_field(content, "type");
+        if (given_type && is_text(given_type)) type = text_of(given_type);
+        headers = web_field(content, "headers");
+        content = web_field(content, "body");
+        if (content && content->type == VAL_NIL) content = NULL;
+    }
+    bool json = false;
+    if (content && is_text(content)) {
+        body = text_view(content, &body_len);
+    } else if (content) {
+        StrBuf* sb = json_buffer_start();
+        if (json_encode(sb, content, 0)) {
+            body = sb->data;
+            body_len = sb->len;
+            if (!job->response || !web_is_response(job->response) || !web_field(job->response, "type")) type = "application/json";
+            json = true;
+        } else {
+            status = 500;
+            body = http_reason(status);
+            body_len = strlen(body);
+        }
+    }
+
+    if (!web_head.data) strbuf_init(&web_head, 256);
+    web_head.len = 0;
+    char line[64];
+    snprintf(line, sizeof(line), "HTTP/1.1 %d ", status);
+    strbuf_append(&web_head, line);
+    strbuf_append(&web_head, http_reason(status));
+    strbuf_append(&web_head, "\r\nContent-Type: ");
+    strbuf_append(&web_head, type);
+    snprintf(line, sizeof(line), "\r\nContent-Length: %zu\r\n", body_len);
+    strbuf_append(&web_head, line);
+    if (!job->keep_alive) strbuf_append(&web_head, "Connection: close\r\n");
+    if (headers && headers->type == VAL_DICT) {
+        DictObj* dict = headers->as.dict;
+        for (int i = 0; i < dict->entry_count; i++) {
+            DictEntry* entry = &dict->entries[i];
+            if (!entry->live) continue;
+            strbuf_append_value(&web_head, &entry->key);
+            strbuf_append(&web_head, ": ");
+            strbuf_append_value(&web_head, &entry->value);
+            strbuf_append(&web_head, "\r\n");
+        }
+    }
+    strbuf_append(&web_head, "\r\n");
+
+    struct iovec iov[2] = {{web_head.data, web_head.len}, {(void*)body, body_len}};
+    net_send(job->conn->net, iov, job->head_only || body_len == 0 ? 1 : 2);
+    if (json) json_buffer_done();
+}
+
+// Closes connections that are finished: refused or told to close once
+// their output is out, or closed by the client with no request left
+static void web_sweep(WebServer* web) {
+    int live = 0;
+    for (int i = 0; i < web->count; i++) {
+        WebConn* wc = &web->conns[i];
+        NetConn* net = wc->net;
+        bool done = net->error || (wc->closing && netbuf_size(&net->out) == 0) ||
+                    (net->eof && netbuf_size(&net->out) == 0);
+        if (done) net_close(net);
+        else web->conns[live++] = *wc;
+    }
+    web->count = live;
+}
+
+// web~>listen(address, handler): an HTTP server on "host:port", or on every
+// interface for a bare port number (0 picks a free one). Requests are
+// answered while the script is in web~>serve.
+static Value* native_web_listen(Value** args, int argc, Scope* scope) {
+    if (!native_arity("listen", argc, 2)) return create_nil_value_helper();
+    if (args[1]->type != VAL_FUNCTION) {
+        runtime_errorf("Runtime Error: 'listen' expects a spec to handle requests.\n");
+        return create_nil_value_helper();
+    }
+    char buf[256];
+    const char* host;
+    int port;
+    if (!net_address("listen", args[0], buf, sizeof(buf), &host, &port)) return create_nil_value_helper();
+    int error = 0;
+    NetConn* conn = net_listen(host, port, &error);
+    if (!conn) {
+        runtime_errorf("Runtime Error: Could not listen on port %d: %s.\n", port, strerror(error));
+        return create_nil_value_helper();
+    }
+    char address[300];
+    snprintf(address, sizeof(address), "%s:%d", host ? host : "*", net_port(conn));
+    Value* val = create_socket_value_helper(conn, address);
+    val->as.socket->handler = args[1]->as.function;
+    val->as.socket->web = (WebServer*)calloc(1, sizeof(WebServer));
+    return val;
+}
+
+// web~>serve(server, count): answers requests until count have been
+// answered (for ever without a count). Returns how many were answered.
+static Value* native_web_serve(Value** args, int argc, Scope* scope) {
+    if (argc < 1 || argc > 2 || args[0]->type != VAL_SOCKET || !args[0]->as.socket->web) {
+        runtime_errorf("Runtime Error: 'serve' expects a server from web~>listen and an optional number of requests.\n");
+        return create_nil_value_helper();
+    }
+    SocketObj* server = args[0]->as.socket;
+    long limit = argc == 2 && is_number(args[1]) ? (long)number_of(args[1]) : -1;
+    long answered = 0;
+    WebJob* jobs = (WebJob*)malloc(WEB_BATCH_MAX * sizeof(WebJob));
+    ref_retain(&server->refcount);
+    while (server->conn && (limit < 0 || answered < limit)) {
+        WebServer* web = server->web;
+        NetConn* accepted;
+        while ((accepted = net_take_accepted(server->conn))) {
+            if (web->count == web->capacity) {
+                web->capacity = web->capacity ? web->capacity * 2 : 16;
+                web->conns = (WebConn*)realloc(web->conns, web->capacity * sizeof(WebConn));
+            }
+            web->conns[web->count].net = accepted;
+            web->conns[web->count].closing = false;
+            web->count++;
+        }
+        int room = limit < 0 || limit - answered > WEB_BATCH_MAX ? WEB_BATCH_MAX : (int)(limit - answered);
+        int count = 0;
+        for (int i = 0; i < web->count && count < room; i++) {
+            count += web_take_requests(&web->conns[i], jobs + count, room - count);
+        }
+        if (count > 0) {
+            WebBatch batch = {server->handler, scope, jobs, paral_chunk_size(count), count};
+            workers_run(web_run_chunk, &batch, (count + batch.chunk_size - 1) / batch.chunk_size);
+            for (int i = 0; i < count; i++) {
+                web_respond(&jobs[i]);
+                free_value(jobs[i].request);
+                free_value(jobs[i].response);
+            }
+            answered += count;
+            if (count == room) continue;  // there may be more waiting
+        }
+        web_sweep(web);
+        if (limit < 0 || answered < limit) net_poll(-1);
+    }
+    free(jobs);
+    // Let the last responses go out before handing back to the script
+    if (server->web) {
+        for (int i = 0; i < server->web->count; i++) net_wait(server->web->conns[i].net, NET_WAIT_SENT, 0, net_timeout_ms);
+        web_sweep(server->web);
+    }
+    socket_release(server);
+    return create_int_value_helper(answered);
+}
+
+// web~>response(status, body, type): a full response for a handler to
+// return; a body that is not Text is sent as JSON
+static Value* native_web_response(Value** args, int argc, Scope* scope) {
+    if (argc < 1 || argc > 3 || !is_number(args[0])) {
+        runtime_errorf("Runtime Error: 'response' expects a status, and optionally a body and a content type.\n");
+        return create_nil_value_helper();
+    }
+    DictObj* dict = dict_new();
+    Value key = {VAL_STRING};
+    key.as.string = "status";
+    dict_set(dict, &key, copy_value(args[0]));
+    key.as.string = "body";
+    dict_set(dict, &key, argc > 1 ? copy_value(args[1]) : create_nil_value_helper());
+    if (argc > 2) {
+        key.as.string = "type";
+        dict_set(dict, &key, copy_value(args[2]));
+    }
+    key.as.string = "headers";
+    dict_set(dict, &key, create_dict_value_helper(dict_new()));
+    return create_dict_value_helper(dict);
+}
+
+// ---------------------------------------------------------------------------
+// Snapshots
+// ---------------------------------------------------------------------------
+
+// Writing and reading the heap snapshots behind snapshot~>point; the format
+// is described in snapshot.h. run_program writes one when a run reaches the
+// point, and restores from it instead of running the statements before it.
+
+// Texts this long or longer are restored as slices of the mapped snapshot
+#define SNAPSHOT_SLICE_MIN 32
 
 typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} TransformNode;
+    char* path;
+    ASTNode* ast;
+} SnapshotModule;
 
 typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} CondenseNode;
+    StrBuf body;
+    SnapshotIds ids;
+    ASTNode* program;
+    SnapshotModule* modules;    // brought in before the point
+    int module_count;
+    int module_capacity;
+    const char* symbol;         // the global being written, for messages
+} SnapshotWriter;
+
+static bool ast_owns_node(const ASTNode* ast, const ASTNode* node) {
+    return ast->type == NODE_PROGRAM && node->index >= 0 && node->index < ast->data.program.num_nodes &&
+           ast->data.program.nodes[node->index] == node;
+}
+
+static void snapshot_put_tag(SnapshotWriter* w, SnapshotTag tag) {
+    strbuf_reserve(&w->body, 1);
+    w->body.data[w->body.len++] = (char)tag;
+}
+
+static void snapshot_put_f64(SnapshotWriter* w, double d) {
+    strbuf_reserve(&w->body, 8);
+    serial_put_f64(w->body.data + w->body.len, d);
+    w->body.len += 8;
+}
+
+// A node as its module number and position; 0 for none
+static bool snapshot_put_node(SnapshotWriter* w, ASTNode* node) {
+    if (!node) {
+        serial_put_length(&w->body, 0);
+        return true;
+    }
+    int module = 0;
+    if (ast_owns_node(w->program, node)) module = 1;
+    for (int i = 0; i < w->module_count && !module; i++) {
+        if (ast_owns_node(w->modules[i].ast, node)) module = i + 2;
+    }
+    if (!module) {
+        char* path = NULL;
+        ASTNode* ast = ast_cache_owner(node, &path);
+        if (!ast) {
+            runtime_errorf("Runtime Error: snapshot cannot store '%s': it refers to a module that has changed since it was brought in.\n", w->symbol);
+            return false;
+        }
+        if (w->module_count == w->module_capacity) {
+            w->module_capacity = w->module_capacity ? w->module_capacity * 2 : 4;
+            w->modules = (SnapshotModule*)realloc(w->modules, w->module_capacity * sizeof(SnapshotModule));
+        }
+        w->modules[w->module_count].path = path;
+        w->modules[w->module_count].ast = ast;
+        module = ++w->module_count + 1;
+    }
+    serial_put_length(&w->body, (uint64_t)module);
+    serial_put_length(&w->body, (uint64_t)node->index);
+    return true;
+}
+
+// An object's id. True when this is its first reference, which the caller
+// follows with the object's contents.
+static bool snapshot_put_ref(SnapshotWriter* w, const void* object) {
+    uint32_t id = object ? snapshot_ids_find(&w->ids, object) : 0;
+    if (object && !id) {
+        serial_put_length(&w->body, snapshot_ids_add(&w->ids, object));
+        return true;
+    }
+    serial_put_length(&w->body, id);
+    return false;
+}
+
+static bool snapshot_put_value(SnapshotWriter* w, const Value* val, int depth);
+
+static bool snapshot_put_symbols(SnapshotWriter* w, Scope* scope, int depth) {
+    serial_put_length(&w->body, (uint64_t)scope->symbol_count);
+    for (int i = 0; i < scope->symbol_count; i++) {
+        Symbol* symbol = &scope->symbols[i];
+        serial_put_chars(&w->body, symbol->name, strlen(symbol->name));
+        strbuf_append_n(&w->body, symbol->is_constant ? "\1" : "\0", 1);
+        if (!snapshot_put_value(w, symbol->value, depth)) return false;
+    }
+    return true;
+}
+
+static bool snapshot_put_scope(SnapshotWriter* w, Scope* scope, int depth) {
+    if (!snapshot_put_ref(w, scope)) return true;
+    if (depth > SERIAL_MAX_DEPTH) {
+        runtime_errorf("Runtime Error: snapshot cannot store '%s': it is nested more than %d deep.\n", w->symbol, SERIAL_MAX_DEPTH);
+        return false;
+    }
+    return snapshot_put_scope(w, scope->parent, depth + 1) && snapshot_put_symbols(w, scope, depth + 1);
+}
+
+static void snapshot_put_name(SnapshotWriter* w, const char* name) {
+    if (snapshot_put_ref(w, name)) serial_put_chars(&w->body, name, strlen(name));
+}
+
+static bool snapshot_put_value(SnapshotWriter* w, const Value* val, int depth) {
+    if (depth > SERIAL_MAX_DEPTH) {
+        runtime_errorf("Runtime Error: snapshot cannot store '%s': it is nested more than %d deep.\n", w->symbol, SERIAL_MAX_DEPTH);
+        return false;
+    }
+    switch (val->type) {
+        case VAL_NIL:
+            snapshot_put_tag(w, SNAPSHOT_NIL);
+            return true;
+        case VAL_BOOL:
+            snapshot_put_tag(w, val->as.boolean ? SNAPSHOT_ON : SNAPSHOT_OFF);
+            return true;
+        case VAL_NUMBER:
+            snapshot_put_tag(w, SNAPSHOT_NUMBER);
+            snapshot_put_f64(w, val->as.number);
+            return true;
+        case VAL_INT:
+            snapshot_put_tag(w, SNAPSHOT_INT);
+            serial_put_length(&w->body, serial_zigzag(val->as.integer));
+            return true;
+        case VAL_STRING:
+        case VAL_ROPE: {
+            size_t len;
+            const char* chars = text_view(val, &len);
+            snapshot_put_tag(w, SNAPSHOT_TEXT);
+            serial_put_chars(&w->body, chars, len);
+            return true;
+        }
+        case VAL_RANGE:
+            snapshot_put_tag(w, SNAPSHOT_RANGE);
+            snapshot_put_f64(w, val->as.range.start);
+            snapshot_put_f64(w, val->as.range.end);
+            return true;
+        case VAL_FUNCTION:
+            snapshot_put_tag(w, SNAPSHOT_SPEC);
+            serial_put_chars(&w->body, val->as.function->name, strlen(val->as.function->name));
+            return snapshot_put_node(w, val->as.function->node);
+        case VAL_LIST: {
+            ListObj* list = val->as.list;
+            snapshot_put_tag(w, SNAPSHOT_LIST);
+            if (!snapshot_put_ref(w, list)) return true;
+            strbuf_append_n(&w->body, list->dense ? "\1" : "\0", 1);
+            serial_put_length(&w->body, (uint64_t)list->count);
+            if (list->dense) {
+                strbuf_reserve(&w->body, (size_t)list->count * 8);
+                serial_put_f64s(w->body.data + w->body.len, list->data.numbers, (size_t)list->count);
+                w->body.len += (size_t)list->count * 8;
+                return true;
+            }
+            for (int i = 0; i < list->count; i++) {
+                if (!snapshot_put_value(w, &list->data.items[i], depth + 1)) return false;
+            }
+            return true;
+        }
+        case VAL_DICT: {
+            DictObj* dict = val->as.dict;
+            snapshot_put_tag(w, SNAPSHOT_DICT);
+            if (!snapshot_put_ref(w, dict)) return true;
+            serial_put_length(&w->body, (uint64_t)dict->count);
+            for (int i = 0; i < dict->entry_count; i++) {
+                DictEntry* entry = &dict->entries[i];
+                if (!entry->live) continue;
+                if (!snapshot_put_value(w, &entry->key, depth + 1) || !snapshot_put_value(w, &entry->value, depth + 1)) return false;
+            }
+            return true;
+        }
+        case VAL_SET: {
+            SetObj* set = val->as.set;
+            snapshot_put_tag(w, SNAPSHOT_SET);
+            if (!snapshot_put_ref(w, set)) return true;
+            serial_put_length(&w->body, (uint64_t)set->count);
+            if (!set->bitset) {
+                for (int i = 0; i < set->hash->entry_count; i++) {
+                    DictEntry* entry = &set->hash->entries[i];
+                    if (entry->live && !snapshot_put_value(w, &entry->key, depth + 1)) return false;
+                }
+                return true;
+            }
+            for (int word = 0; word < set->word_count; word++) {
+                for (uint64_t bits = set->words[word]; bits; bits &= bits - 1) {
+                    snapshot_put_tag(w, SNAPSHOT_INT);
+                    serial_put_length(&w->body, serial_zigzag(word * 64 + ctz64(bits)));
+                }
+            }
+            return true;
+        }
+        case VAL_BLUEPRINT:
+            snapshot_put_tag(w, SNAPSHOT_BLUEPRINT);
+            snapshot_put_name(w, val->as.blueprint.name);
+            return snapshot_put_scope(w, val->as.blueprint.scope, depth + 1) &&
+                   snapshot_put_node(w, val->as.blueprint.constructor);
+        case VAL_BLUEPRINT_INSTANCE:
+            snapshot_put_tag(w, SNAPSHOT_INSTANCE);
+            snapshot_put_name(w, val->as.blueprint_instance.blueprint_name);
+            return snapshot_put_scope(w, val->as.blueprint_instance.blueprint_scope, depth + 1) &&
+                   snapshot_put_scope(w, val->as.blueprint_instance.instance_scope, depth + 1);
+        case VAL_TOOLKIT:
+            snapshot_put_tag(w, SNAPSHOT_TOOLKIT);
+            return snapshot_put_scope(w, val->as.toolkit.toolkit_scope, depth + 1) &&
+                   snapshot_put_scope(w, val->as.toolkit.exports, depth + 1);
+        case VAL_BRIDGE:
+            snapshot_put_tag(w, SNAPSHOT_BRIDGE);
+            return snapshot_put_scope(w, val->as.bridge.bridge_scope, depth + 1);
+        default:
+            runtime_errorf("Runtime Error: snapshot cannot store '%s': it holds an iterator, file, pending operation or connection.\n", w->symbol);
+            return false;
+    }
+}
+
+// Writes rt's globals, listeners and paral queue to path, for a later run
+// of program to resume at statement resume_at. The file is written beside
+// path and renamed into place, so a reader never sees half of one.
+static bool snapshot_write(BeaconRuntime* rt, ASTNode* program, int resume_at, const char* path) {
+    if (rt->net_listener_count > 0) {
+        runtime_errorf("Runtime Error: snapshot cannot store open net listeners; listen after snapshot~>point.\n");
+        return false;
+    }
+    SnapshotWriter w = {{0}};
+    strbuf_init(&w.body, 4096);
+    snapshot_ids_init(&w.ids);
+    snapshot_ids_add(&w.ids, rt->globals);  // SNAPSHOT_GLOBALS
+    w.program = program;
+    bool ok = true;
+    serial_put_length(&w.body, (uint64_t)rt->globals->symbol_count);
+    for (int i = 0; i < rt->globals->symbol_count && ok; i++) {
+        Symbol* symbol = &rt->globals->symbols[i];
+        w.symbol = symbol->name;
+        serial_put_chars(&w.body, symbol->name, strlen(symbol->name));
+        strbuf_append_n(&w.body, symbol->is_constant ? "\1" : "\0", 1);
+        ok = snapshot_put_value(&w, symbol->value, 0);
+    }
+    w.symbol = "listen";
+    serial_put_length(&w.body, (uint64_t)rt->event_registry_count);
+    for (int i = 0; i < rt->event_registry_count && ok; i++) {
+        EventEntry* entry = &rt->event_registry[i];
+        serial_put_chars(&w.body, entry->event_name, strlen(entry->event_name));
+        serial_put_length(&w.body, (uint64_t)entry->num_handlers);
+        for (int j = 0; j < entry->num_handlers && ok; j++) ok = snapshot_put_node(&w, entry->handlers[j]);
+    }
+    w.symbol = "paral";
+    serial_put_length(&w.body, (uint64_t)rt->paral_queue_count);
+    for (int i = 0; i < rt->paral_queue_count && ok; i++) ok = snapshot_put_node(&w, rt->paral_queue[i]);
+
+    if (ok) {
+        StrBuf head;
+        strbuf_init(&head, 256);
+        strbuf_append_n(&head, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+        strbuf_reserve(&head, 8);
+        snapshot_put_u64(head.data + head.len, program->data.program.source_hash);
+        head.len += 8;
+        serial_put_length(&head, (uint64_t)resume_at);
+        serial_put_length(&head, (uint64_t)w.module_count);
+        for (int i = 0; i < w.module_count; i++) {
+            serial_put_chars(&head, w.modules[i].path, strlen(w.modules[i].path));
+            strbuf_reserve(&head, 8);
+            snapshot_put_u64(head.data + head.len, w.modules[i].ast->data.program.source_hash);
+            head.len += 8;
+        }
+        size_t path_len = strlen(path);
+        char* temp = (char*)malloc(path_len + 5);
+        memcpy(temp, path, path_len);
+        memcpy(temp + path_len, ".tmp", 5);
+        FILE* out = fopen(temp, "wb");
+        ok = out && fwrite(head.data, 1, head.len, out) == head.len &&
+             fwrite(w.body.data, 1, w.body.len, out) == w.body.len;
+        if (out && fclose(out) != 0) ok = false;
+        if (ok && rename(temp, path) != 0) ok = false;
+        if (!ok) {
+            runtime_errorf("Runtime Error: Could not write snapshot '%s'.\n", path);
+            remove(temp);
+        }
+        free(temp);
+        free(head.data);
+    }
+    for (int i = 0; i < w.module_count; i++) free(w.modules[i].path);
+    free(w.modules);
+    snapshot_ids_free(&w.ids);
+    free(w.body.data);
+    return ok;
+}
 
 typedef struct {
-    ASTNode **items;
-    int num_items;
-} PackNode;
+    SnapshotObjKind kind;
+    void* object;
+} SnapshotObject;
 
 typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} UnpackNode;
+    SerialReader r;
+    RopeObj* source;            // the mapped snapshot, which long texts slice
+    SnapshotObject* objects;    // by id - 1
+    int object_count;
+    int object_capacity;
+    ASTNode** modules;          // by module number - 1
+    int module_count;
+} SnapshotReader;
+
+static void snapshot_add_object(SnapshotReader* s, SnapshotObjKind kind, void* object) {
+    if (s->object_count == s->object_capacity) {
+        s->object_capacity = s->object_capacity ? s->object_capacity * 2 : 64;
+        s->objects = (SnapshotObject*)realloc(s->objects, s->object_capacity * sizeof(SnapshotObject));
+    }
+    s->objects[s->object_count].kind = kind;
+    s->objects[s->object_count].object = object;
+    s->object_count++;
+}
+
+// Reads a reference to an object of the given kind. Returns the object if
+// it was read before; if the reference introduces it, sets *fresh instead,
+// and the caller makes it, adds it and reads its contents.
+static void* snapshot_get_ref(SnapshotReader* s, SnapshotObjKind kind, bool* fresh) {
+    uint64_t id = serial_get_varint(&s->r);
+    *fresh = !s->r.failed && id == (uint64_t)s->object_count + 1;
+    if (id == 0 || *fresh) return NULL;
+    if (id > (uint64_t)s->object_count || s->objects[id - 1].kind != kind) {
+        serial_fail(&s->r);
+        return NULL;
+    }
+    return s->objects[id - 1].object;
+}
+
+static char* snapshot_get_chars(SnapshotReader* s) {
+    uint64_t len = serial_get_varint(&s->r);
+    const char* chars = len <= SIZE_MAX ? serial_get_bytes(&s->r, (size_t)len) : NULL;
+    return chars ? strndup(chars, (size_t)len) : NULL;
+}
+
+static ASTNode* snapshot_get_node(SnapshotReader* s) {
+    uint64_t module = serial_get_varint(&s->r);
+    if (module == 0) return NULL;
+    uint64_t index = serial_get_varint(&s->r);
+    if (module > (uint64_t)s->module_count || index >= (uint64_t)s->modules[module - 1]->data.program.num_nodes) {
+        serial_fail(&s->r);
+        return NULL;
+    }
+    return s->modules[module - 1]->data.program.nodes[index];
+}
+
+static Value* snapshot_get_value(SnapshotReader* s, int depth);
+
+static void snapshot_get_symbols(SnapshotReader* s, Scope* scope, int depth) {
+    size_t count = serial_get_count(&s->r, 3);
+    for (size_t i = 0; i < count && !s->r.failed; i++) {
+        char* name = snapshot_get_chars(s);
+        bool is_constant = serial_get_byte(&s->r) != 0;
+        Value* value = snapshot_get_value(s, depth);
+        if (name) define_variable(scope, name, value, is_constant);
+        else free_value(value);
+        free(name);
+    }
+}
+
+static Scope* snapshot_get_scope(SnapshotReader* s, int depth) {
+    bool fresh;
+    Scope* scope = (Scope*)snapshot_get_ref(s, SNAPSHOT_OBJ_SCOPE, &fresh);
+    if (!fresh) return scope;
+    if (depth > SERIAL_MAX_DEPTH) {
+        serial_fail(&s->r);
+        return NULL;
+    }
+    scope = create_scope(NULL);
+    snapshot_add_object(s, SNAPSHOT_OBJ_SCOPE, scope);
+    scope->parent = snapshot_get_scope(s, depth + 1);
+    snapshot_get_symbols(s, scope, depth + 1);
+    return scope;
+}
+
+static const char* snapshot_get_name(SnapshotReader* s) {
+    bool fresh;
+    char* name = (char*)snapshot_get_ref(s, SNAPSHOT_OBJ_NAME, &fresh);
+    if (!fresh) return name;
+    // Blueprint names are never freed (see clear_value), and neither are these
+    name = snapshot_get_chars(s);
+    snapshot_add_object(s, SNAPSHOT_OBJ_NAME, name);
+    return name;
+}
+
+// Decodes one value. On bad input s->r.failed is set and the result is
+// whatever was decoded so far, for the caller to free.
+static Value* snapshot_get_value(SnapshotReader* s, int depth) {
+    if (depth > SERIAL_MAX_DEPTH) {
+        serial_fail(&s->r);
+        return create_nil_value_helper();
+    }
+    switch (serial_get_byte(&s->r)) {
+        case SNAPSHOT_NIL: return create_nil_value_helper();
+        case SNAPSHOT_OFF: return create_bool_value_helper(false);
+        case SNAPSHOT_ON: return create_bool_value_helper(true);
+        case SNAPSHOT_NUMBER: return create_number_value_helper(serial_get_f64(&s->r));
+        case SNAPSHOT_INT: return create_int_value_helper(serial_get_zigzag(&s->r));
+        case SNAPSHOT_TEXT: {
+            uint64_t len = serial_get_varint(&s->r);
+            const char* chars = len <= SIZE_MAX ? serial_get_bytes(&s->r, (size_t)len) : NULL;
+            if (!chars) return create_nil_value_helper();
+            if (len < SNAPSHOT_SLICE_MIN && !memchr(chars, '\0', (size_t)len)) {
+                Value* val = alloc_value();
+                val->type = VAL_STRING;
+                val->as.string = strndup(chars, (size_t)len);
+                return val;
+            }
+            ref_retain(&s->source->refcount);
+            return create_rope_value_helper(rope_slice(s->source, chars, (size_t)len));
+        }
+        case SNAPSHOT_RANGE: {
+            Value* val = alloc_value();
+            val->type = VAL_RANGE;
+            val->as.range.start = serial_get_f64(&s->r);
+            val->as.range.end = serial_get_f64(&s->r);
+            return val;
+        }
+        case SNAPSHOT_SPEC: {
+            char* name = snapshot_get_chars(s);
+            ASTNode* node = snapshot_get_node(s);
+            if (!name || !node || (node->type != NODE_FUNCTION_DECL && node->type != NODE_DEN && node->type != NODE_CONSTRUCTOR_DECL)) {
+                free(name);
+                serial_fail(&s->r);
+                return create_nil_value_helper();
+            }
+            Value* val = alloc_value();
+            val->type = VAL_FUNCTION;
+            if (node->type == NODE_FUNCTION_DECL) {
+                val->as.function = node->data.function_decl.symbol;
+            } else {
+                // Like the ones den and prep make, these stay for the life of the process
+                FunctionSymbol* func_sym = (FunctionSymbol*)malloc(sizeof(FunctionSymbol));
+                strncpy(func_sym->name, name, 49);
+                func_sym->name[49] = '\0';
+                func_sym->node = node;
+                func_sym->compiled = NULL;
+                val->as.function = func_sym;
+            }
+            free(name);
+            return val;
+        }
+        case SNAPSHOT_LIST: {
+            bool fresh;
+            ListObj* list = (ListObj*)snapshot_get_ref(s, SNAPSHOT_OBJ_LIST, &fresh);
+            if (!fresh) {
+                if (!list) return create_nil_value_helper();
+                ref_retain(&list->refcount);
+                return create_list_value_helper(list);
+            }
+            bool dense = serial_get_byte(&s->r) != 0;
+            size_t count = serial_get_count(&s->r, dense ? 8 : 1);
+            list = list_new((int)count, dense);
+            snapshot_add_object(s, SNAPSHOT_OBJ_LIST, list);
+            Value* val = create_list_value_helper(list);
+            if (dense) {
+                serial_get_f64s(&s->r, list->data.numbers, count);
+                if (!s->r.failed) list->count = (int)count;
+                return val;
+            }
+            for (size_t i = 0; i < count && !s->r.failed; i++) list_append(list, snapshot_get_value(s, depth + 1));
+            return val;
+        }
+        case SNAPSHOT_DICT: {
+            bool fresh;
+            DictObj* dict = (DictObj*)snapshot_get_ref(s, SNAPSHOT_OBJ_DICT, &fresh);
+            if (!fresh) {
+                if (!dict) return create_nil_value_helper();
+                ref_retain(&dict->refcount);
+                return create_dict_value_helper(dict);
+            }
+            size_t count = serial_get_count(&s->r, 2);
+            dict = dict_new();
+            snapshot_add_object(s, SNAPSHOT_OBJ_DICT, dict);
+            Value* val = create_dict_value_helper(dict);
+            for (size_t i = 0; i < count && !s->r.failed; i++) {
+                Value* key = snapshot_get_value(s, depth + 1);
+                dict_set(dict, key, snapshot_get_value(s, depth + 1));
+                free_value(key);
+            }
+            return val;
+        }
+        case SNAPSHOT_SET: {
+            bool fresh;
+            SetObj* set = (SetObj*)snapshot_get_ref(s, SNAPSHOT_OBJ_SET, &fresh);
+            if (!fresh) {
+                if (!set) return create_nil_value_helper();
+                ref_retain(&set->refcount);
+                return create_set_value_helper(set);
+            }
+            size_t count = serial_get_count(&s->r, 1);
+            set = set_new();
+            snapshot_add_object(s, SNAPSHOT_OBJ_SET, set);
+            Value* val = create_set_value_helper(set);
+            for (size_t i = 0; i < count && !s->r.failed; i++) {
+                Value* member = snapshot_get_value(s, depth + 1);
+                set_add(set, member);
+                free_value(member);
+            }
+            return val;
+        }
+        case SNAPSHOT_BLUEPRINT: {
+            const char* name = snapshot_get_name(s);
+            Scope* scope = snapshot_get_scope(s, depth + 1);
+            ASTNode* constructor = snapshot_get_node(s);
+            if (!name || !scope) {
+                serial_fail(&s->r);
+                return create_nil_value_helper();
+            }
+            Value* val = alloc_value();
+            val->type = VAL_BLUEPRINT;
+            val->as.blueprint.name = (char*)name;
+            val->as.blueprint.scope = scope;
+            val->as.blueprint.constructor = constructor;
+            return val;
+        }
+        case SNAPSHOT_INSTANCE: {
+            const char* name = snapshot_get_name(s);
+            Scope* blueprint_scope = snapshot_get_scope(s, depth + 1);
+            Scope* instance_scope = snapshot_get_scope(s, depth + 1);
+            if (!blueprint_scope || !instance_scope) {
+                serial_fail(&s->r);
+                return create_nil_value_helper();
+            }
+            Value* val = alloc_value();
+            val->type = VAL_BLUEPRINT_INSTANCE;
+            val->as.blueprint_instance.blueprint_name = name;
+            val->as.blueprint_instance.blueprint_scope = blueprint_scope;
+            val->as.blueprint_instance.instance_scope = instance_scope;
+            return val;
+        }
+        case SNAPSHOT_TOOLKIT: {
+            Scope* toolkit_scope = snapshot_get_scope(s, depth + 1);
+            Scope* exports = snapshot_get_scope(s, depth + 1);
+            if (!toolkit_scope || !exports) {
+                serial_fail(&s->r);
+                return create_nil_value_helper();
+            }
+            Value* val = alloc_value();
+            val->type = VAL_TOOLKIT;
+            val->as.toolkit.toolkit_scope = toolkit_scope;
+            val->as.toolkit.exports = exports;
+            return val;
+        }
+        case SNAPSHOT_BRIDGE: {
+            Scope* bridge_scope = snapshot_get_scope(s, depth + 1);
+            if (!bridge_scope) {
+                serial_fail(&s->r);
+                return create_nil_value_helper();
+            }
+            Value* val = alloc_value();
+            val->type = VAL_BRIDGE;
+            val->as.bridge.bridge_scope = bridge_scope;
+            return val;
+        }
+        default:
+            serial_fail(&s->r);
+            return create_nil_value_helper();
+    }
+}
 
-typedef struct {
-    ASTNode *object;
-    char *attribute_name;
-} AttributeAccessNode;
+// Checks the header of the snapshot at path against program and the point
+// at statement resume_at - 1, and loads the modules it names. False, with
+// nothing changed, when there is no snapshot or it was made by a different
+// program or modules.
+static bool snapshot_open(SnapshotReader* s, ASTNode* program, int resume_at, const char* path) {
+    FileMap map;
+    if (filemap_open(path, &map) != FILEMAP_OK) return false;
+    memset(s, 0, sizeof(*s));
+    s->r.data = map.data;
+    s->r.length = map.size;
+    s->source = rope_from_map(&map);
+    const char* magic = serial_get_bytes(&s->r, SNAPSHOT_MAGIC_SIZE);
+    bool ok = magic && memcmp(magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) == 0 &&
+              snapshot_get_u64(&s->r) == program->data.program.source_hash &&
+              serial_get_varint(&s->r) == (uint64_t)resume_at;
+    size_t count = ok ? serial_get_count(&s->r, 9) : 0;
+    s->modules = (ASTNode**)malloc((count + 1) * sizeof(ASTNode*));
+    s->modules[s->module_count++] = program;
+    for (size_t i = 0; i < count && ok && !s->r.failed; i++) {
+        char* module_path = snapshot_get_chars(s);
+        uint64_t hash = snapshot_get_u64(&s->r);
+        ASTNode* module = module_path ? ast_cache_get(module_path) : NULL;
+        ok = module && module->type == NODE_PROGRAM && module->data.program.source_hash == hash;
+        s->modules[s->module_count++] = module;
+        free(module_path);
+    }
+    if (!ok || s->r.failed) {
+        free(s->modules);
+        rope_release(s->source);
+        return false;
+    }
+    return true;
+}
 
-typedef struct {
-    char *name;
-    ASTNode **attributes;
-    int num_attributes;
-} DenNode;
+// Rebuilds the globals, listeners and paral queue of rt, which must be
+// current, from an opened snapshot. False if the rest of it turns out to
+// be damaged, in which case rt is left for the caller to reset.
+static bool snapshot_restore(BeaconRuntime* rt, SnapshotReader* s) {
+    snapshot_add_object(s, SNAPSHOT_OBJ_SCOPE, rt->globals);  // SNAPSHOT_GLOBALS
+    snapshot_get_symbols(s, rt->globals, 0);
+    size_t events = serial_get_count(&s->r, 2);
+    for (size_t i = 0; i < events && !s->r.failed; i++) {
+        char* event_name = snapshot_get_chars(s);
+        size_t count = serial_get_count(&s->r, 1);
+        ASTNode** handlers = (ASTNode**)malloc((count + 1) * sizeof(ASTNode*));
+        for (size_t j = 0; j < count && !s->r.failed; j++) {
+            handlers[j] = snapshot_get_node(s);
+            if (!handlers[j]) serial_fail(&s->r);
+        }
+        if (event_name && !s->r.failed) register_listener(event_name, handlers, (int)count);
+        free(handlers);
+        free(event_name);
+    }
+    size_t queued = serial_get_count(&s->r, 1);
+    for (size_t i = 0; i < queued && !s->r.failed; i++) {
+        ASTNode* node = snapshot_get_node(s);
+        if (!node) serial_fail(&s->r);
+        else enqueue_paral(&node, 1);
+    }
+    bool ok = !s->r.failed && s->r.pos == s->r.length;
+    free(s->objects);
+    free(s->modules);
+    rope_release(s->source);
+    return ok;
+}
 
-typedef struct {
-    ASTNode *source;
-    char *target_type;
-} ConvertNode;
+// snapshot~>point(file): where a program's setup ends. run_program acts on
+// it when it is a statement of its own at the top level (see above), so a
+// call that gets here is anywhere else.
+static Value* native_snapshot_point(Value** args, int argc, Scope* scope) {
+    runtime_errorf("Runtime Error: 'point' must be a statement of its own at the top level of the program, with its file name written out.\n");
+    return create_nil_value_helper();
+}
 
-typedef struct {
-    char *name;
-    ASTNode **body;
-    int num_body_statements;
-} ToolkitNode;
+// snapshot~>resumed(): On when this run started from a snapshot
+static Value* native_snapshot_resumed(Value** args, int argc, Scope* scope) {
+    if (!native_arity("resumed", argc, 0)) return create_nil_value_helper();
+    return create_bool_value_helper(current_runtime()->resumed);
+}
 
-typedef struct {
-    char *toolkit_name;
-    char *file_path;
-} PlugNode;
+static const NativeEntry web_members[] = {
+    {"listen", native_web_listen},
+    {"serve", native_web_serve},
+    {"response", native_web_response},
+    {NULL, NULL}
+};
 
-typedef struct {
-    char *name;
-    ASTNode **body;
-    int num_body_statements;
-} BridgeNode;
+static const NativeEntry csv_members[] = {
+    {"read", native_csv_read},
+    {"parse", native_csv_parse},
+    {"chunks", native_csv_chunks},
+    {NULL, NULL}
+};
 
-typedef struct {
-    ASTNode **body;
-    int num_body_statements;
-} InletNode;
+static const NativeEntry file_members[] = {
+    {"open", native_file_open},
+    {"exists", native_file_exists},
+    {"read", native_file_read},
+    {"write", native_file_write},
+    {"flush", native_file_flush},
+    {"lines", native_file_lines},
+    {"close", native_file_close},
+    {NULL, NULL}
+};
 
-typedef struct {
-    ASTNode *greeter;
-    ASTNode *implementation;
-} LinkNode;
+// Methods of file handles: log~>write(line)
+static const NativeEntry file_methods[] = {
+    {"read", native_file_read},
+    {"write", native_file_write},
+    {"flush", native_file_flush},
+    {"lines", native_file_lines},
+    {"close", native_file_close},
+    {NULL, NULL}
+};
 
-typedef struct {
-    char *identifier;
-} ExposeNode;
+static const NativeEntry io_members[] = {
+    {"read", native_io_read},
+    {"write", native_io_write},
+    {"collect", native_io_collect},
+    {"ready", native_io_ready},
+    {"flush", native_io_flush},
+    {"backend", native_io_backend},
+    {NULL, NULL}
+};
 
-typedef struct {
-    char *var_name;
-    ASTNode *start_val;
-    ASTNode *end_val;
-    ASTNode *step_val;
-    ASTNode **body;
-    int num_body_statements;
-} TraverseNode;
+// Methods of pending operations: page~>collect()
+static const NativeEntry pending_methods[] = {
+    {"collect", native_io_collect},
+    {"ready", native_io_ready},
+    {NULL, NULL}
+};
 
-typedef struct {
-    char *var_name;
-    ASTNode *iterable;
-    ASTNode **body;
-    int num_body_statements;
-} EachNode;
+static const NativeEntry net_members[] = {
+    {"listen", native_net_listen},
+    {"connect", native_net_connect},
+    {"send", native_net_send},
+    {"receive", native_net_receive},
+    {"close", native_net_close},
+    {"serve", native_net_serve},
+    {"port", native_net_port},
+    {"timeout", native_net_timeout},
+    {"ping", native_net_ping},
+    {NULL, NULL}
+};
 
-typedef struct {
-    ASTNode *condition;
-    ASTNode **body;
-    int num_body_statements;
-} UntilNode;
+// Methods of sockets: conn~>send(data), server~>serve()
+static const NativeEntry socket_methods[] = {
+    {"send", native_net_send},
+    {"receive", native_net_receive},
+    {"close", native_net_close},
+    {"serve", native_net_serve},
+    {"port", native_net_port},
+    {NULL, NULL}
+};
 
-typedef struct {
-    ASTNode *object;
-    char *method_name;
-    ASTNode **args;
-    int num_args;
-} MethodCallNode;
+static const NativeEntry serial_members[] = {
+    {"pack", native_serial_pack},
+    {"unpack", native_serial_unpack},
+    {NULL, NULL}
+};
 
-typedef struct {
-    char *name;
-    ASTNode **body;
-    int num_body_statements;
-} ModuleNode;
+static const NativeEntry snapshot_members[] = {
+    {"point", native_snapshot_point},
+    {"resumed", native_snapshot_resumed},
+    {NULL, NULL}
+};
 
-typedef struct {
-    char *module;
-    char *source;
-} BringNode;
+static const NativeEntry collection_members[] = {
+    {"list", native_collection_list},
+    {"dict", native_collection_dict},
+    {"set", native_collection_set},
+    {NULL, NULL}
+};
 
-typedef struct {
-    char *name;
-    // For now simple struct
-} ContractNode;
+static const NativeToolkit native_toolkits[] = {
+    {"collection", collection_members},
+    {"math", math_members},
+    {"text", text_members},
+    {"file", file_members},
+    {"io", io_members},
+    {"serial", serial_members},
+    {"json", json_members},
+    {"csv", csv_members},
+    {"net", net_members},
+    {"web", web_members},
+    {"snapshot", snapshot_members},
+    {NULL, NULL}
+};
 
-typedef struct {
-    char *error_name;
-    ASTNode *message;
-} TriggerNode;
+static NativeFn find_native(const NativeEntry* table, const char* name) {
+    for (int i = 0; table[i].name; i++) {
+        if (strcmp(table[i].name, name) == 0) return table[i].fn;
+    }
+    return NULL;
+}
 
-typedef enum {
-    INTERPOLATED_STRING_PART_STRING,
-    INTERPOLATED_STRING_PART_EXPRESSION
-} InterpolatedStringPartType;
+// Methods callable with ~> on built-in value types
+static const NativeEntry* native_methods_for(const Value* val) {
+    switch (val->type) {
+        case VAL_LIST: return list_methods;
+        case VAL_DICT: return dict_methods;
+        case VAL_SET: return set_methods;
+        case VAL_STRING:
+        case VAL_ROPE: return text_members;
+        case VAL_FILE: return file_methods;
+        case VAL_PENDING: return pending_methods;
+        case VAL_SOCKET: return socket_methods;
+        default: return NULL;
+    }
+}
 
-typedef struct {
-    InterpolatedStringPartType type;
-    union {
-        char* string_val;
-        ASTNode* expression;
-    } data;
-} InterpolatedStringPart;
+static const char* native_type_name(const Value* val) {
+    switch (val->type) {
+        case VAL_LIST: return "List";
+        case VAL_DICT: return "Dict";
+        case VAL_SET: return "Set";
+        case VAL_STRING:
+        case VAL_ROPE: return "Text";
+        case VAL_FILE: return "File";
+        case VAL_PENDING: return "Pending";
+        case VAL_SOCKET: return "Socket";
+        default: return "Value";
+    }
+}
 
-typedef struct {
-    InterpolatedStringPart **parts;
-    int num_parts;
-} InterpolatedStringNode;
+static const NativeToolkit* find_native_toolkit(const char* name) {
+    for (int i = 0; native_toolkits[i].name; i++) {
+        if (strcmp(native_toolkits[i].name, name) == 0) return &native_toolkits[i];
+    }
+    return NULL;
+}
 
-typedef struct {
-    char **params;
-    int num_params;
-    ASTNode **body;
-    int num_body_statements;
-} ConstructorNode;
+// Evaluates call arguments into args[offset..], runs fn, and frees them again
+static Value* call_native(NativeFn fn, Value* receiver, ASTNode** arg_nodes, int num_args, Scope* scope) {
+    int offset = receiver ? 1 : 0;
+    Value* stack_args[8];
+    Value** args = (num_args + offset <= 8) ? stack_args : (Value**)malloc((num_args + offset) * sizeof(Value*));
+    if (receiver) args[0] = receiver;
+    for (int i = 0; i < num_args; i++) {
+        args[i + offset] = interpret_ast(arg_nodes[i], scope);
+    }
+    Value* result = fn(args, num_args + offset, scope);
+    for (int i = 0; i < num_args; i++) {
+        free_value(args[i + offset]);
+    }
+    if (args != stack_args) free(args);
+    return result;
+}
 
-typedef union {
-    ProgramNode program;
-    double number_val;
-    bool boolean_val;
-    char* string_val;
-    char* docstring_val;
-    BinaryOpNode binary_op;
-    VarAccessNode var_access;
-    VarAssignNode var_assign;
-    ConstantDeclNode constant_decl;
-    ExpressionStatementNode expr_statement;
-    ShowStatementNode show_statement;
-    NickDeclNode nick_decl;
-    FunctionDeclNode function_decl;
-    ReturnStatementNode return_statement;
-    FunctionCallNode function_call;
-    CheckStatementNode check_statement;
-    BlueprintNode blueprint;
-    AttributeAccessNode attribute_access;
-    SpawnNode spawn;
-    AdoptNode adopt;
-    DenNode den;
-    ConvertNode convert;
-    ToolkitNode toolkit;
-    PlugNode plug;
-    BridgeNode bridge;
-    InletNode inlet;
-    LinkNode link;
-    ExposeNode expose;
-    InterpolatedStringNode interpolated_string;
-    TraverseNode traverse; // Kept for legacy if needed, or mapped to Each
-    EachNode each;
-    UntilNode until;
-    MethodCallNode method_call;
-    ModuleNode module;
-    BringNode bring;
-    ContractNode contract;
-    struct {
-        char *op;
-        ASTNode *operand;
-    } unary_op;
-    HaltNode halt;
-    ProceedNode proceed;
-    WaitNode wait;
-    TriggerNode trigger;
-    BlameNode blame;
-    TypeNode type_node;
-    KindNode kind;
-    NickNode nick;
-    HiddenNode hidden;
-    ShieldedNode shielded;
-    InternalNode internal;
-    EmbedNode embed;
-    ParalNode paral;
-    HoldNode hold;
-    SignalNode signal_node;
-    ListenNode listen;
-    AskNode ask;
-    AuthenNode authen;
-    TransformNode transform;
-    CondenseNode condense;
-    PackNode pack;
-    UnpackNode unpack;
-    ConstructorNode constructor_decl;
-    AttemptTrapConcludeNode attempt_trap_conclude;
-    TriggerNode trigger_node;
-} ASTNodeData;
+static HostNative* find_host_native(const char* name) {
+    BeaconRuntime* rt = current_runtime();
+    for (int i = 0; i < rt->native_count; i++) {
+        if (strcmp(rt->natives[i].name, name) == 0) return &rt->natives[i];
+    }
+    return NULL;
+}
 
-struct ASTNode {
-    NodeType type;
-    ASTNodeData data;
-};
+// As call_native, for a function the host registered
+static Value* call_host_native(HostNative* native, ASTNode** arg_nodes, int num_args, Scope* scope) {
+    Value* stack_args[8];
+    Value** args = num_args <= 8 ? stack_args : (Value**)malloc(num_args * sizeof(Value*));
+    for (int i = 0; i < num_args; i++) {
+        args[i] = interpret_ast(arg_nodes[i], scope);
+    }
+    Value* result = native->fn(args, num_args, native->user);
+    for (int i = 0; i < num_args; i++) {
+        free_value(args[i]);
+    }
+    if (args != stack_args) free(args);
+    return result ? result : create_nil_value_helper();
+}
 
 // Helper function to detect and convert input string to appropriate type
 Value* detect_and_convert_type(const char* input) {
-    Value* result = (Value*)malloc(sizeof(Value));
+    Value* result = alloc_value();
     
     // Trim leading/trailing whitespace
     while (*input == ' ' || *input == '\t') input++;
@@ -759,16 +6638,189 @@ Value* detect_and_convert_type(const char* input) {
         free(trimmed);
         return result;
     }
-    
-    // Default to string
-    result->type = VAL_STRING;
-    result->as.string = trimmed;
-    return result;
+    
+    // Default to string
+    result->type = VAL_STRING;
+    result->as.string = trimmed;
+    return result;
+}
+
+// Overflow-checked int64 arithmetic: false when the result does not fit
+static bool int_add(int64_t a, int64_t b, int64_t* out) {
+#if defined(__GNUC__)
+    return !__builtin_add_overflow(a, b, out);
+#else
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) return false;
+    *out = a + b;
+    return true;
+#endif
+}
+
+static bool int_sub(int64_t a, int64_t b, int64_t* out) {
+#if defined(__GNUC__)
+    return !__builtin_sub_overflow(a, b, out);
+#else
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b)) return false;
+    *out = a - b;
+    return true;
+#endif
+}
+
+static bool int_mul(int64_t a, int64_t b, int64_t* out) {
+#if defined(__GNUC__)
+    return !__builtin_mul_overflow(a, b, out);
+#else
+    if (fabs((double)a * (double)b) >= 9.2e18) return false;
+    *out = a * b;
+    return true;
+#endif
+}
+
+// Binary operators on two VAL_INT operands. Returns false when the double
+// path has to take over: division, overflow, or a non-numeric operator.
+static bool int_binary_op(const char* op, int64_t l, int64_t r, Value* out) {
+    int64_t n;
+    bool ok;
+    bool eq = op[0] != '\0' && op[1] == '=' && op[2] == '\0'; // >=, <=, ==, '=
+    if (op[0] == '\0' || (op[1] != '\0' && !eq)) return false;
+    switch (op[0]) {
+        case '+': ok = !eq && int_add(l, r, &n); break;
+        case '-': ok = !eq && int_sub(l, r, &n); break;
+        case '*': ok = !eq && int_mul(l, r, &n); break;
+        case '>': out->type = VAL_BOOL; out->as.boolean = eq ? l >= r : l > r; return true;
+        case '<': out->type = VAL_BOOL; out->as.boolean = eq ? l <= r : l < r; return true;
+        case '=': if (!eq) return false; out->type = VAL_BOOL; out->as.boolean = l == r; return true;
+        case '\'': if (!eq) return false; out->type = VAL_BOOL; out->as.boolean = l != r; return true;
+        default: return false;
+    }
+    if (!ok) return false;
+    out->type = VAL_INT;
+    out->as.integer = n;
+    return true;
+}
+
+// Applies a binary operator to two evaluated operands, which stay the
+// caller's. Shared by the interpreter and compiled code (aot.h).
+static Value* binary_op(const char* op, Value* left_val, Value* right_val) {
+    Value* result_val = alloc_value();
+    result_val->type = VAL_NUMBER;
+
+    if (left_val->type == VAL_INT && right_val->type == VAL_INT &&
+        int_binary_op(op, left_val->as.integer, right_val->as.integer, result_val)) {
+        // Integer result (or comparison) computed without doubles
+    } else if (strcmp(op, "+") == 0) {
+        if (is_text(left_val) || is_text(right_val)) {
+            free_value(result_val);
+            result_val = text_concat(left_val, right_val);
+        } else {
+            result_val->as.number = number_of(left_val) + number_of(right_val);
+        }
+    } else if (strcmp(op, "-") == 0) {
+        result_val->as.number = number_of(left_val) - number_of(right_val);
+    } else if (strcmp(op, "*") == 0) {
+        result_val->as.number = number_of(left_val) * number_of(right_val);
+    } else if (strcmp(op, "/") == 0) {
+        result_val->as.number = number_of(left_val) / number_of(right_val);
+    } else if (strcmp(op, ">") == 0) {
+        result_val->type = VAL_BOOL;
+        result_val->as.boolean = number_of(left_val) > number_of(right_val);
+    } else if (strcmp(op, "<") == 0) {
+        result_val->type = VAL_BOOL;
+        result_val->as.boolean = number_of(left_val) < number_of(right_val);
+    } else if (strcmp(op, ">=") == 0) {
+        result_val->type = VAL_BOOL;
+        result_val->as.boolean = number_of(left_val) >= number_of(right_val);
+    } else if (strcmp(op, "<=") == 0) {
+        result_val->type = VAL_BOOL;
+        result_val->as.boolean = number_of(left_val) <= number_of(right_val);
+    } else if (strcmp(op, "==") == 0) {
+        result_val->type = VAL_BOOL;
+        if (is_number(left_val) && is_number(right_val)) {
+            result_val->as.boolean = numbers_equal(left_val, right_val);
+        } else if (is_text(left_val) && is_text(right_val)) {
+            result_val->as.boolean = texts_equal(left_val, right_val);
+        } else if (left_val->type != right_val->type) {
+            result_val->as.boolean = false;
+        } else {
+            switch (left_val->type) {
+                case VAL_BOOL: result_val->as.boolean = left_val->as.boolean == right_val->as.boolean; break;
+                case VAL_NIL: result_val->as.boolean = true; break;
+                default: result_val->as.boolean = false; break;
+            }
+        }
+    } else if (strcmp(op, "'=") == 0) {
+        result_val->type = VAL_BOOL;
+        if (is_number(left_val) && is_number(right_val)) {
+            result_val->as.boolean = !numbers_equal(left_val, right_val);
+        } else if (is_text(left_val) && is_text(right_val)) {
+            result_val->as.boolean = !texts_equal(left_val, right_val);
+        } else if (left_val->type != right_val->type) {
+            result_val->as.boolean = true;
+        } else {
+            switch (left_val->type) {
+                case VAL_BOOL: result_val->as.boolean = left_val->as.boolean != right_val->as.boolean; break;
+                case VAL_NIL: result_val->as.boolean = false; break;
+                default: result_val->as.boolean = true; break;
+            }
+        }
+    }
+
+    else if (strcmp(op, "..") == 0) {
+         result_val->type = VAL_RANGE;
+         result_val->as.range.start = is_number(left_val) ? number_of(left_val) : 0;
+         result_val->as.range.end = is_number(right_val) ? number_of(right_val) : 0;
+    } else if (strcmp(op, "is") == 0) {
+        // Type check: 'val is a Num' -> operator 'is', right operand is TypeNode/String?
+        // Parser likely produces right operand as TypeNode or similar.
+        // Assuming right operand evaluates to type string.
+        // If the parser handles `is a`, it might produce `is` operator.
+        result_val->type = VAL_BOOL;
+        result_val->as.boolean = false;
+        
+        // We need to check left value's type against right value string
+        char* type_name = NULL;
+        if (right_val->type == VAL_STRING) {
+            type_name = right_val->as.string;
+        } else {
+             // Try to interpret right node directly if it's a TYPE node
+             // But here right_val is already evaluated.
+             // The parser might have converted TypeNode to a String or similar?
+             // Let's assume right_val contains the type name as string.
+        }
+
+        if (type_name) {
+             if (strcmp(type_name, "Num") == 0) result_val->as.boolean = is_number(left_val);
+             else if (strcmp(type_name, "Text") == 0) result_val->as.boolean = is_text(left_val);
+             else if (strcmp(type_name, "On") == 0) result_val->as.boolean = (left_val->type == VAL_BOOL && left_val->as.boolean); // Maybe? or type Bool
+             else if (strcmp(type_name, "Off") == 0) result_val->as.boolean = (left_val->type == VAL_BOOL && !left_val->as.boolean); 
+             else if (strcmp(type_name, "Nil") == 0) result_val->as.boolean = (left_val->type == VAL_NIL);
+             else if (strcmp(type_name, "Spec") == 0) result_val->as.boolean = (left_val->type == VAL_FUNCTION);
+             else if (strcmp(type_name, "Blueprint") == 0) result_val->as.boolean = (left_val->type == VAL_BLUEPRINT);
+             else if (strcmp(type_name, "Instance") == 0) result_val->as.boolean = (left_val->type == VAL_BLUEPRINT_INSTANCE);
+             else if (strcmp(type_name, "List") == 0) result_val->as.boolean = (left_val->type == VAL_LIST);
+             else if (strcmp(type_name, "Dict") == 0) result_val->as.boolean = (left_val->type == VAL_DICT);
+             else if (strcmp(type_name, "Set") == 0) result_val->as.boolean = (left_val->type == VAL_SET);
+             else if (strcmp(type_name, "Iterator") == 0) result_val->as.boolean = (left_val->type == VAL_ITER);
+        }
+    } else {
+        runtime_errorf("Unknown binary operator: %s\n", op);
+        result_val->type = VAL_NIL;
+    }
+    return result_val;
+}
+
+static void run_traverse_body(ASTNode* node, Scope* scope) {
+    for (int j = 0; j < node->data.traverse.num_body_statements; j++) {
+        ASTNode* stmt = node->data.traverse.body[j];
+        if (stmt->type == NODE_PROCEED) continue;
+        if (stmt->type == NODE_HALT) break;
+        free_value(interpret_ast(stmt, scope));
+    }
 }
 
 Value* interpret_ast(ASTNode* node, Scope* scope) {
     if (!node) {
-        Value* nil_val = (Value*)malloc(sizeof(Value));
+        Value* nil_val = alloc_value();
         nil_val->type = VAL_NIL;
         return nil_val;
     }
@@ -782,18 +6834,17 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             for (int i = 0; i < node->data.program.num_statements; i++) {
                 free_value(interpret_ast(node->data.program.statements[i], scope));
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_NUMBER: {
-            result_val = (Value*)malloc(sizeof(Value));
-            result_val->type = VAL_NUMBER;
-            result_val->as.number = node->data.number_val;
+            result_val = alloc_value();
+            set_numeric(result_val, node->data.number_val);
             break;
         }
         case NODE_STRING: {
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_STRING;
             result_val->as.string = strdup(node->data.string_val);
             break;
@@ -801,95 +6852,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
         case NODE_BINARY_OP: {
             Value* left_val = interpret_ast(node->data.binary_op.left, scope);
             Value* right_val = interpret_ast(node->data.binary_op.right, scope);
-            result_val = (Value*)malloc(sizeof(Value));
-            result_val->type = VAL_NUMBER;
-
-            if (strcmp(node->data.binary_op.op, "+") == 0) {
-                result_val->as.number = left_val->as.number + right_val->as.number;
-            } else if (strcmp(node->data.binary_op.op, "-") == 0) {
-                result_val->as.number = left_val->as.number - right_val->as.number;
-            } else if (strcmp(node->data.binary_op.op, "*") == 0) {
-                result_val->as.number = left_val->as.number * right_val->as.number;
-            } else if (strcmp(node->data.binary_op.op, "/") == 0) {
-                result_val->as.number = left_val->as.number / right_val->as.number;
-            } else if (strcmp(node->data.binary_op.op, ">") == 0) {
-                result_val->type = VAL_BOOL;
-                result_val->as.boolean = left_val->as.number > right_val->as.number;
-            } else if (strcmp(node->data.binary_op.op, "<") == 0) {
-                result_val->type = VAL_BOOL;
-                result_val->as.boolean = left_val->as.number < right_val->as.number;
-            } else if (strcmp(node->data.binary_op.op, ">=") == 0) {
-                result_val->type = VAL_BOOL;
-                result_val->as.boolean = left_val->as.number >= right_val->as.number;
-            } else if (strcmp(node->data.binary_op.op, "<=") == 0) {
-                result_val->type = VAL_BOOL;
-                result_val->as.boolean = left_val->as.number <= right_val->as.number;
-            } else if (strcmp(node->data.binary_op.op, "==") == 0) {
-                result_val->type = VAL_BOOL;
-                if (left_val->type != right_val->type) {
-                    result_val->as.boolean = false;
-                } else {
-                    switch (left_val->type) {
-                        case VAL_NUMBER: result_val->as.boolean = left_val->as.number == right_val->as.number; break;
-                        case VAL_BOOL: result_val->as.boolean = left_val->as.boolean == right_val->as.boolean; break;
-                        case VAL_STRING: result_val->as.boolean = strcmp(left_val->as.string, right_val->as.string) == 0; break;
-                        case VAL_NIL: result_val->as.boolean = true; break;
-                        default: result_val->as.boolean = false; break;
-                    }
-                }
-            } else if (strcmp(node->data.binary_op.op, "'=") == 0) {
-                result_val->type = VAL_BOOL;
-                if (left_val->type != right_val->type) {
-                    result_val->as.boolean = true;
-                } else {
-                    switch (left_val->type) {
-                        case VAL_NUMBER: result_val->as.boolean = left_val->as.number != right_val->as.number; break;
-                        case VAL_BOOL: result_val->as.boolean = left_val->as.boolean != right_val->as.boolean; break;
-                        case VAL_STRING: result_val->as.boolean = strcmp(left_val->as.string, right_val->as.string) != 0; break;
-                        case VAL_NIL: result_val->as.boolean = false; break;
-                        default: result_val->as.boolean = true; break;
-                    }
-                }
-            }
-
-            else if (strcmp(node->data.binary_op.op, "..") == 0) {
-                 result_val->type = VAL_RANGE;
-                 result_val->as.range.start = (left_val->type == VAL_NUMBER) ? left_val->as.number : 0;
-                 result_val->as.range.end = (right_val->type == VAL_NUMBER) ? right_val->as.number : 0;
-            } else if (strcmp(node->data.binary_op.op, "is") == 0) {
-                // Type check: 'val is a Num' -> operator 'is', right operand is TypeNode/String?
-                // Parser likely produces right operand as TypeNode or similar.
-                // Assuming right operand evaluates to type string.
-                // If the parser handles `is a`, it might produce `is` operator.
-                result_val->type = VAL_BOOL;
-                result_val->as.boolean = false;
-                
-                // We need to check left value's type against right value string
-                char* type_name = NULL;
-                if (right_val->type == VAL_STRING) {
-                    type_name = right_val->as.string;
-                } else {
-                     // Try to interpret right node directly if it's a TYPE node
-                     // But here right_val is already evaluated.
-                     // The parser might have converted TypeNode to a String or similar?
-                     // Let's assume right_val contains the type name as string.
-                }
-
-                if (type_name) {
-                     if (strcmp(type_name, "Num") == 0) result_val->as.boolean = (left_val->type == VAL_NUMBER);
-                     else if (strcmp(type_name, "Text") == 0) result_val->as.boolean = (left_val->type == VAL_STRING);
-                     else if (strcmp(type_name, "On") == 0) result_val->as.boolean = (left_val->type == VAL_BOOL && left_val->as.boolean); // Maybe? or type Bool
-                     else if (strcmp(type_name, "Off") == 0) result_val->as.boolean = (left_val->type == VAL_BOOL && !left_val->as.boolean); 
-                     else if (strcmp(type_name, "Nil") == 0) result_val->as.boolean = (left_val->type == VAL_NIL);
-                     else if (strcmp(type_name, "Spec") == 0) result_val->as.boolean = (left_val->type == VAL_FUNCTION);
-                     else if (strcmp(type_name, "Blueprint") == 0) result_val->as.boolean = (left_val->type == VAL_BLUEPRINT);
-                     else if (strcmp(type_name, "Instance") == 0) result_val->as.boolean = (left_val->type == VAL_BLUEPRINT_INSTANCE);
-                }
-            } else {
-                fprintf(stderr, "Unknown binary operator: %s\n", node->data.binary_op.op);
-                result_val->type = VAL_NIL;
-            }
-
+            result_val = binary_op(node->data.binary_op.op, left_val, right_val);
             free_value(left_val);
             free_value(right_val);
             break;
@@ -897,15 +6860,12 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
         case NODE_VAR_ACCESS: {
             Value* stored_val = get_variable(scope, node->data.var_access.var_name);
             if (stored_val) {
-                result_val = (Value*)malloc(sizeof(Value));
-                memcpy(result_val, stored_val, sizeof(Value));
-                if (stored_val->type == VAL_STRING) {
-                    result_val->as.string = strdup(stored_val->as.string);
-                }
+                // get_variable already hands back a private copy
+                result_val = stored_val;
                 // printf("VAR_ACCESS: '%s' found. Type: %d (Scope %p)\n", node->data.var_access.var_name, result_val->type, scope);
             } else {
-                fprintf(stderr, "Variable '%s' not found.\n", node->data.var_access.var_name);
-                result_val = (Value*)malloc(sizeof(Value));
+                runtime_errorf("Variable '%s' not found.\n", node->data.var_access.var_name);
+                result_val = alloc_value();
                 result_val->type = VAL_NIL;
             }
             break;
@@ -924,50 +6884,50 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                                 node->data.var_assign.target->data.attribute_access.attribute_name, 
                                 value_to_assign);
                 } else {
-                    fprintf(stderr, "Cannot assign attribute to non-blueprint instance.\n");
+                    runtime_errorf("Cannot assign attribute to non-blueprint instance.\n");
                 }
                 free_value(object_val);
             } else {
-                fprintf(stderr, "Unsupported assignment target type.\n");
+                runtime_errorf("Unsupported assignment target type.\n");
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_CONSTANT_DECL: {
             Value* value_to_assign = interpret_ast(node->data.constant_decl.value, scope);
             define_variable(scope, node->data.constant_decl.const_name, value_to_assign, true);
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_EXPRESSION_STATEMENT: {
             free_value(interpret_ast(node->data.expr_statement.expression, scope));
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_SHOW_STATEMENT: {
+            // One write per line
+            StrBuf line;
+            strbuf_init(&line, 128);
             for (int i = 0; i < node->data.show_statement.num_expressions; i++) {
                 Value* val = interpret_ast(node->data.show_statement.expressions[i], scope);
-                char* str = value_to_string(val);
-                printf("%s ", str);
-                free(str);
+                strbuf_append_value(&line, val);
+                strbuf_append_n(&line, " ", 1);
                 free_value(val);
             }
-            printf("\n");
-            result_val = (Value*)malloc(sizeof(Value));
+            strbuf_append_n(&line, "\n", 1);
+            runtime_write(line.data, line.len);
+            free(line.data);
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_FUNCTION_DECL: {
-            Value* func_val = (Value*)malloc(sizeof(Value));
+            Value* func_val = alloc_value();
             func_val->type = VAL_FUNCTION;
-            FunctionSymbol* func_sym = (FunctionSymbol*)malloc(sizeof(FunctionSymbol));
-            strncpy(func_sym->name, node->data.function_decl.name, 49);
-            func_sym->name[49] = '\0';
-            func_sym->node = node;
-            func_val->as.function = func_sym;
+            func_val->as.function = node->data.function_decl.symbol;
             set_variable(scope, node->data.function_decl.name, func_val);
             // If inside a toolkit and function is shared/exposed, add to exports
             if (node->data.function_decl.exposed || node->data.function_decl.shared) {
@@ -984,7 +6944,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                     set_variable(toolkit_val->as.toolkit.exports, node->data.function_decl.name, copy_value(func_val));
                 }
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -995,41 +6955,30 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                 ASTNode* func_node = func_sym->node;
 
                 if (node->data.function_call.num_arguments != func_node->data.function_decl.num_params) {
-                    fprintf(stderr, "Function '%s' called with incorrect number of arguments.\n", node->data.function_call.function_name);
-                    result_val = (Value*)malloc(sizeof(Value));
+                    runtime_errorf("Function '%s' called with incorrect number of arguments.\n", node->data.function_call.function_name);
+                    result_val = alloc_value();
                     result_val->type = VAL_NIL;
                 } else {
-                    Scope* func_scope = create_scope(scope);
-
-                    for (int i = 0; i < node->data.function_call.num_arguments; i++) {
-                        Value* arg_val = interpret_ast(node->data.function_call.arguments[i], scope);
-                        set_variable(func_scope, func_node->data.function_decl.params[i], arg_val);
-                    }
-
-                    result_val = NULL;
-                    for (int i = 0; i < func_node->data.function_decl.num_body_statements; i++) {
-                        ASTNode* statement_node = func_node->data.function_decl.body[i];
-                        Value* statement_result = interpret_ast(statement_node, func_scope);
-
-                        if (statement_node->type == NODE_RETURN_STATEMENT) {
-                            if (result_val) free_value(result_val);
-                            result_val = statement_result;
-                            break;
-                        }
-                        free_value(statement_result);
-                    }
-
-                    destroy_scope(func_scope);
-
-                    if (!result_val) {
-                        result_val = (Value*)malloc(sizeof(Value));
-                        result_val->type = VAL_NIL;
+                    int argc = node->data.function_call.num_arguments;
+                    Value* stack_args[8];
+                    Value** args = argc <= 8 ? stack_args : (Value**)malloc(argc * sizeof(Value*));
+                    for (int i = 0; i < argc; i++) {
+                        args[i] = interpret_ast(node->data.function_call.arguments[i], scope);
                     }
+                    result_val = call_spec(func_sym, args, argc, scope);
+                    if (args != stack_args) free(args);
                 }
                 free_value(func_val);
+            } else if (!func_val && find_native(native_builtins, node->data.function_call.function_name)) {
+                NativeFn fn = find_native(native_builtins, node->data.function_call.function_name);
+                result_val = call_native(fn, NULL, node->data.function_call.arguments, node->data.function_call.num_arguments, scope);
+            } else if (!func_val && find_host_native(node->data.function_call.function_name)) {
+                HostNative* native = find_host_native(node->data.function_call.function_name);
+                result_val = call_host_native(native, node->data.function_call.arguments, node->data.function_call.num_arguments, scope);
             } else {
-                fprintf(stderr, "Function '%s' not implemented.\n", node->data.function_call.function_name);
-                result_val = (Value*)malloc(sizeof(Value));
+                if (func_val) free_value(func_val);
+                runtime_errorf("Function '%s' not implemented.\n", node->data.function_call.function_name);
+                result_val = alloc_value();
                 result_val->type = VAL_NIL;
             }
             break;
@@ -1038,7 +6987,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             if (node->data.return_statement.expression) {
                 result_val = interpret_ast(node->data.return_statement.expression, scope);
             } else {
-                result_val = (Value*)malloc(sizeof(Value));
+                result_val = alloc_value();
                 result_val->type = VAL_NIL;
             }
             break;
@@ -1057,10 +7006,10 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                 Value* msg = get_variable(attempt_scope, "__last_error_message");
                 Scope* trap_scope = create_scope(scope);
                 if (node->data.attempt_trap_conclude.peek) {
-                    if (msg && msg->type == VAL_STRING) {
-                        Value* peek_val = (Value*)malloc(sizeof(Value));
+                    if (msg && is_text(msg)) {
+                        Value* peek_val = alloc_value();
                         peek_val->type = VAL_STRING;
-                        peek_val->as.string = strdup(msg->as.string);
+                        peek_val->as.string = strdup(text_of(msg));
                         set_variable(trap_scope, "peek", peek_val);
                     }
                 }
@@ -1075,7 +7024,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                 }
             }
             destroy_scope(attempt_scope);
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1083,17 +7032,26 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             Value* v = interpret_ast(node->data.kind.expression, scope);
             const char* t = NULL;
             switch (v->type) {
-                case VAL_NUMBER: t = "Num"; break;
-                case VAL_STRING: t = "Text"; break;
+                case VAL_NUMBER:
+                case VAL_INT: t = "Num"; break;
+                case VAL_STRING:
+                case VAL_ROPE: t = "Text"; break;
                 case VAL_BOOL: t = v->as.boolean ? "On" : "Off"; break;
                 case VAL_NIL: t = "Nil"; break;
                 case VAL_FUNCTION: t = "Spec"; break;
                 case VAL_BLUEPRINT: t = "Blueprint"; break;
                 case VAL_BLUEPRINT_INSTANCE: t = "Instance"; break;
                 case VAL_TOOLKIT: t = "Toolkit"; break;
+                case VAL_LIST: t = "List"; break;
+                case VAL_DICT: t = "Dict"; break;
+                case VAL_SET: t = "Set"; break;
+                case VAL_ITER: t = "Iterator"; break;
+                case VAL_FILE: t = "File"; break;
+                case VAL_PENDING: t = "Pending"; break;
+                case VAL_SOCKET: t = "Socket"; break;
                 default: t = "Unknown"; break;
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_STRING;
             result_val->as.string = strdup(t);
             free_value(v);
@@ -1101,36 +7059,46 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
         }
         case NODE_WAIT: {
             // no-op wait
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_TRAVERSE: {
             Value* start_val = interpret_ast(node->data.traverse.start_val, scope);
             Value* end_val = interpret_ast(node->data.traverse.end_val, scope);
-            double step = 1.0;
+            Value step = {VAL_INT};
+            step.as.integer = 1;
             if (node->data.traverse.step_val) {
                 Value* step_val = interpret_ast(node->data.traverse.step_val, scope);
-                if (step_val->type == VAL_NUMBER) step = step_val->as.number;
+                if (is_number(step_val)) step = *step_val;
                 free_value(step_val);
             }
-            double i = start_val->as.number;
-            double endn = end_val->as.number;
-            for (; (step >= 0 ? i <= endn : i >= endn); i += step) {
-                Value* num = (Value*)malloc(sizeof(Value));
-                num->type = VAL_NUMBER;
-                num->as.number = i;
-                set_variable(scope, node->data.traverse.var_name, num);
-                for (int j = 0; j < node->data.traverse.num_body_statements; j++) {
-                    ASTNode* stmt = node->data.traverse.body[j];
-                    if (stmt->type == NODE_PROCEED) continue;
-                    if (stmt->type == NODE_HALT) { j = node->data.traverse.num_body_statements; break; }
-                    free_value(interpret_ast(stmt, scope));
+            if (start_val->type == VAL_INT && end_val->type == VAL_INT && step.type == VAL_INT) {
+                // Exact int64 counter; stops rather than wrapping at the int64 limits
+                int64_t i = start_val->as.integer;
+                int64_t endn = end_val->as.integer;
+                int64_t stepn = step.as.integer;
+                while (stepn >= 0 ? i <= endn : i >= endn) {
+                    set_variable(scope, node->data.traverse.var_name, create_int_value_helper(i));
+                    run_traverse_body(node, scope);
+                    if (!int_add(i, stepn, &i)) break;
+                }
+            } else {
+                // The counter is start + k * step, so fractional steps don't
+                // accumulate rounding error from one iteration to the next
+                double start = number_of(start_val);
+                double endn = number_of(end_val);
+                double stepn = number_of(&step);
+                for (int64_t k = 0;; k++) {
+                    double i = start + (double)k * stepn;
+                    if (stepn >= 0 ? i > endn : i < endn) break;
+                    set_variable(scope, node->data.traverse.var_name, create_number_value_helper(i));
+                    run_traverse_body(node, scope);
                 }
             }
             free_value(start_val);
             free_value(end_val);
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1166,12 +7134,12 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                 }
             }
             free_value(condition_val);
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_BLUEPRINT: {
-            Value* blueprint_val = (Value*)malloc(sizeof(Value));
+            Value* blueprint_val = alloc_value();
             blueprint_val->type = VAL_BLUEPRINT;
 
             Scope* blueprint_scope = create_scope(scope);
@@ -1198,33 +7166,19 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             set_variable(scope, node->data.blueprint.name, blueprint_val);
 
             // The result of a blueprint declaration is nil
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_SPAWN: {
             Value* blueprint_val = interpret_ast(node->data.spawn.blueprint_expr, scope);
             if (blueprint_val->type != VAL_BLUEPRINT) {
-                fprintf(stderr, "Cannot spawn from a non-blueprint value.\n");
-                result_val = (Value*)malloc(sizeof(Value));
+                runtime_errorf("Cannot spawn from a non-blueprint value.\n");
+                result_val = alloc_value();
                 result_val->type = VAL_NIL;
             } else {
-                Scope* instance_scope = create_scope(blueprint_val->as.blueprint.scope);
-                // printf("Spawned Instance Scope: %p (Blueprint Scope: %p)\n", instance_scope, blueprint_val->as.blueprint.scope);
-                for (int i = 0; i < blueprint_val->as.blueprint.scope->symbol_count; i++) {
-                    set_variable(instance_scope, blueprint_val->as.blueprint.scope->symbols[i].name, copy_value(blueprint_val->as.blueprint.scope->symbols[i].value));
-                }
-
-                result_val = (Value*)malloc(sizeof(Value));
-                result_val->type = VAL_BLUEPRINT_INSTANCE;
-                result_val->as.blueprint_instance.blueprint_scope = blueprint_val->as.blueprint.scope;
-                result_val->as.blueprint_instance.instance_scope = instance_scope;
-                result_val->as.blueprint_instance.instance_scope = instance_scope;
-                // set_variable(instance_scope, "self", result_val); // Removed erroneous line
-                
-                // Important: Pass a COPY of result_val as 'self' so instance_scope owns its own Value struct.
-                // Otherwise if result_val is freed, self becomes dangling.
-                set_variable(instance_scope, "self", copy_value(result_val));
+                result_val = blueprint_instantiate(blueprint_val);
+                Scope* instance_scope = result_val->as.blueprint_instance.instance_scope;
 
                 // Call 'make' constructor if it exists in blueprint
                 if (blueprint_val->as.blueprint.constructor) {
@@ -1234,7 +7188,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                     // Basic argument count check
                     // Constructor has 'own' as first parameter, so user provides num_params - 1 arguments
                     if (node->data.spawn.num_arguments != ctor_node->data.constructor_decl.num_params - 1) {
-                         fprintf(stderr, "Constructor called with incorrect number of arguments (expected %d, got %d).\n", 
+                         runtime_errorf("Constructor called with incorrect number of arguments (expected %d, got %d).\n", 
                                  ctor_node->data.constructor_decl.num_params - 1, node->data.spawn.num_arguments);
                     } else {
                          Scope* ctor_scope = create_scope(instance_scope);
@@ -1272,10 +7226,10 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                     set_variable(child_scope, parent_scope->symbols[i].name, copy_value(parent_scope->symbols[i].value));
                 }
             } else {
-                fprintf(stderr, "Could not find parent or child blueprint for adopt.\n");
+                runtime_errorf("Could not find parent or child blueprint for adopt.\n");
             }
 
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1289,24 +7243,25 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                 if (found_val) {
                     result_val = copy_value(found_val);
                 } else {
-                    result_val = (Value*)malloc(sizeof(Value));
+                    result_val = alloc_value();
                     result_val->type = VAL_NIL;
                 }
             } else {
-                fprintf(stderr, "Attribute access on non-blueprint instance or toolkit.\n");
-                result_val = (Value*)malloc(sizeof(Value));
+                runtime_errorf("Attribute access on non-blueprint instance or toolkit.\n");
+                result_val = alloc_value();
                 result_val->type = VAL_NIL;
             }
             free_value(object_val);
             break;
         }
         case NODE_DEN: {
-            Value* func_val = (Value*)malloc(sizeof(Value));
+            Value* func_val = alloc_value();
             func_val->type = VAL_FUNCTION;
             FunctionSymbol* func_sym = (FunctionSymbol*)malloc(sizeof(FunctionSymbol));
             // Anonymous function, so no name
             func_sym->name[0] = '\0';
             func_sym->node = node;
+            func_sym->compiled = NULL;
             func_val->as.function = func_sym;
             result_val = func_val;
             break;
@@ -1314,19 +7269,19 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
         case NODE_CONVERT: {
             Value* source_val = interpret_ast(node->data.convert.source, scope);
             char* target_type_str = node->data.convert.target_type;
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
 
             if (strcmp(target_type_str, "Text") == 0) {
                 result_val->type = VAL_STRING;
                 result_val->as.string = value_to_string(source_val);
             } else if (strcmp(target_type_str, "Num") == 0) {
-                result_val->type = VAL_NUMBER;
-                if (source_val->type == VAL_STRING) {
-                    result_val->as.number = atof(source_val->as.string);
-                } else if (source_val->type == VAL_NUMBER) {
-                    result_val->as.number = source_val->as.number;
+                if (is_text(source_val)) {
+                    set_numeric(result_val, atof(text_of(source_val)));
+                } else if (is_number(source_val)) {
+                    *result_val = *source_val;
                 } else {
-                    result_val->as.number = 0; // Or some other default
+                    result_val->type = VAL_INT;
+                    result_val->as.integer = 0; // Or some other default
                 }
             } else {
                 // Unknown target type
@@ -1337,7 +7292,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             break;
         }
         case NODE_TOOLKIT: {
-            Value* toolkit_val = (Value*)malloc(sizeof(Value));
+            Value* toolkit_val = alloc_value();
             toolkit_val->type = VAL_TOOLKIT;
             toolkit_val->as.toolkit.toolkit_scope = create_scope(scope);
             toolkit_val->as.toolkit.exports = create_scope(NULL); // Exports have no parent
@@ -1349,7 +7304,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
 
             set_variable(scope, node->data.toolkit.name, toolkit_val);
 
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1361,15 +7316,15 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                     set_variable(scope, exports->symbols[i].name, exports->symbols[i].value);
                 }
             } else {
-                fprintf(stderr, "Could not find toolkit to plug: %s\n", node->data.plug.toolkit_name);
+                runtime_errorf("Could not find toolkit to plug: %s\n", node->data.plug.toolkit_name);
             }
 
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_BRIDGE: {
-            Value* bridge_val = (Value*)malloc(sizeof(Value));
+            Value* bridge_val = alloc_value();
             bridge_val->type = VAL_BRIDGE;
             bridge_val->as.bridge.bridge_scope = create_scope(scope);
 
@@ -1380,7 +7335,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
 
             set_variable(scope, node->data.bridge.name, bridge_val);
 
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1389,7 +7344,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             for (int i = 0; i < node->data.inlet.num_body_statements; i++) {
                 free_value(interpret_ast(node->data.inlet.body[i], scope));
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1400,7 +7355,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                 set_variable(scope, node->data.link.greeter->data.var_access.var_name, copy_value(impl_val));
             }
             free_value(impl_val);
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1423,26 +7378,27 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                 if (value_to_expose) {
                     set_variable(toolkit_val->as.toolkit.exports, node->data.expose.identifier, value_to_expose);
                 } else {
-                    fprintf(stderr, "Cannot expose unknown identifier: %s\n", node->data.expose.identifier);
+                    runtime_errorf("Cannot expose unknown identifier: %s\n", node->data.expose.identifier);
                 }
             } else {
-                fprintf(stderr, "Expose can only be used inside a toolkit.\n");
+                runtime_errorf("Expose can only be used inside a toolkit.\n");
             }
 
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_CONSTRUCTOR_DECL: {
-            Value* func_val = (Value*)malloc(sizeof(Value));
+            Value* func_val = alloc_value();
             func_val->type = VAL_FUNCTION;
             FunctionSymbol* func_sym = (FunctionSymbol*)malloc(sizeof(FunctionSymbol));
             strncpy(func_sym->name, "constructor", 49);
             func_sym->name[49] = '\0';
             func_sym->node = node;
+            func_sym->compiled = NULL;
             func_val->as.function = func_sym;
             set_variable(scope, "constructor", func_val);
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1451,8 +7407,10 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                 ASTNode* stmt = node->data.ask.body[i];
                 if (stmt->type == NODE_EXPRESSION_STATEMENT) {
                     Value* val = interpret_ast(stmt->data.expr_statement.expression, scope);
-                    if (val && val->type == VAL_STRING) {
-                        printf("%s", val->as.string);
+                    if (val && is_text(val)) {
+                        size_t prompt_len;
+                        const char* prompt = text_view(val, &prompt_len);
+                        runtime_write(prompt, prompt_len);
                     }
                     free_value(val);
                 } else {
@@ -1462,11 +7420,16 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
 
             char *line = NULL;
             size_t len = 0;
-            getline(&line, &len, stdin);
+            // At the end of input (a server job's input runs out) the answer is empty
+            if (getline(&line, &len, stdin) < 0) {
+                free(line);
+                line = strdup("");
+            }
 
             // Remove trailing newline character
-            if (line[strlen(line) - 1] == '\n') {
-                line[strlen(line) - 1] = '\0';
+            size_t line_len = strlen(line);
+            if (line_len > 0 && line[line_len - 1] == '\n') {
+                line[line_len - 1] = '\0';
             }
 
             // Use dynamic type detection
@@ -1478,23 +7441,39 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
         }
 
         case NODE_INTERPOLATED_STRING: {
-            char* full_str = malloc(1024); // Allocate a large buffer
-            full_str[0] = '\0';
-            for (int i = 0; i < node->data.interpolated_string.num_parts; i++) {
-                InterpolatedStringPart* part = node->data.interpolated_string.parts[i];
+            InterpolatedStringNode* tmpl = &node->data.interpolated_string;
+            TemplateSlot small[TEMPLATE_SMALL_SLOTS];
+            TemplateSlot* slots = tmpl->num_slots <= TEMPLATE_SMALL_SLOTS ? small : (TemplateSlot*)malloc(tmpl->num_slots * sizeof(TemplateSlot));
+            // Evaluate and measure the slots, left to right
+            size_t total = tmpl->literal_length;
+            int slot = 0;
+            for (int i = 0; i < tmpl->num_parts; i++) {
+                InterpolatedStringPart* part = tmpl->parts[i];
+                if (part->type == INTERPOLATED_STRING_PART_EXPRESSION) {
+                    total += template_slot_fill(&slots[slot++], interpret_ast(part->data.expression, scope));
+                }
+            }
+            // Then write everything once into a buffer of the exact size
+            char* text = (char*)malloc(total + 1);
+            size_t pos = 0;
+            slot = 0;
+            for (int i = 0; i < tmpl->num_parts; i++) {
+                InterpolatedStringPart* part = tmpl->parts[i];
                 if (part->type == INTERPOLATED_STRING_PART_STRING) {
-                    strcat(full_str, part->data.string_val);
+                    memcpy(text + pos, part->data.string_val, part->length);
+                    pos += part->length;
                 } else { // INTERPOLATED_STRING_PART_EXPRESSION
-                    Value* part_val = interpret_ast(part->data.expression, scope);
-                    char* part_str = value_to_string(part_val);
-                    strcat(full_str, part_str);
-                    free(part_str);
-                    free_value(part_val);
+                    TemplateSlot* ts = &slots[slot++];
+                    memcpy(text + pos, ts->text, ts->length);
+                    pos += ts->length;
+                    template_slot_done(ts);
                 }
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            text[pos] = '\0';
+            if (slots != small) free(slots);
+            result_val = alloc_value();
             result_val->type = VAL_STRING;
-            result_val->as.string = full_str;
+            result_val->as.string = text;
             break;
         }
         case NODE_UNARY_OP: {
@@ -1502,48 +7481,36 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             if (strcmp(node->data.unary_op.op, "'") == 0) { // NOT operator
                 bool val = value_to_bool(operand);
                 free_value(operand);
-                result_val = (Value*)malloc(sizeof(Value));
+                result_val = alloc_value();
                 result_val->type = VAL_BOOL;
                 result_val->as.boolean = !val;
             } else {
-                fprintf(stderr, "Unknown unary operator: %s\n", node->data.unary_op.op);
+                runtime_errorf("Unknown unary operator: %s\n", node->data.unary_op.op);
                 free_value(operand);
-                result_val = (Value*)malloc(sizeof(Value));
+                result_val = alloc_value();
                 result_val->type = VAL_NIL;
             }
             break;
         }
         case NODE_EACH: {
              Value* iterable_val = interpret_ast(node->data.each.iterable, scope);
-             if (iterable_val->type == VAL_RANGE) {
-                 double start = iterable_val->as.range.start;
-                 double end = iterable_val->as.range.end;
-                 double step = 1.0;
-                 if (start > end) step = -1.0;
-                 
-                 for (double i = start; (step > 0 ? i <= end : i >= end); i += step) {
-                     Value* loop_var = (Value*)malloc(sizeof(Value));
-                     loop_var->type = VAL_NUMBER;
-                     loop_var->as.number = i;
-                     
-                     // Create loop scope? Or use current scope?
-                     // Usually loops have their own scope to prevent var leakage?
-                     // But Beacon might be simple. Let's use a sub-scope.
+             IterObj* it = iter_from_value(iterable_val);
+             if (it) {
+                 Value* item;
+                 while (iter_next(it, scope, &item)) {
                      Scope* loop_scope = create_scope(scope);
-                     set_variable(loop_scope, node->data.each.var_name, loop_var);
-                     
+                     set_variable(loop_scope, node->data.each.var_name, item);
                      for (int j = 0; j < node->data.each.num_body_statements; j++) {
-                         ASTNode* stmt = node->data.each.body[j];
-                         // Handle Proceed/Halt if needed (omitted for brevity unless needed)
-                         free_value(interpret_ast(stmt, loop_scope));
+                         free_value(interpret_ast(node->data.each.body[j], loop_scope));
                      }
                      destroy_scope(loop_scope);
                  }
+                 iter_release(it);
              } else {
-                 fprintf(stderr, "Type mismatch: 'each' loop requires a range.\n");
+                 runtime_errorf("Type mismatch: 'traverse ... in' requires a range, list, dict, set, text, file or iterator.\n");
              }
              free_value(iterable_val);
-             result_val = (Value*)malloc(sizeof(Value));
+             result_val = alloc_value();
              result_val->type = VAL_NIL;
              break;
         }
@@ -1560,13 +7527,38 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                     free_value(interpret_ast(stmt, scope));
                 }
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_METHOD_CALL: {
-            Value* object_val = interpret_ast(node->data.method_call.object, scope);
-            if (object_val && object_val->type == VAL_BLUEPRINT_INSTANCE) {
+            // Built-in toolkits (collection~>list() ...) unless a variable shadows them
+            ASTNode* object_node = node->data.method_call.object;
+            if (object_node->type == NODE_VAR_ACCESS && find_native_toolkit(object_node->data.var_access.var_name)) {
+                Value* shadow = get_variable(scope, object_node->data.var_access.var_name);
+                if (!shadow) {
+                    const NativeToolkit* toolkit = find_native_toolkit(object_node->data.var_access.var_name);
+                    NativeFn fn = find_native(toolkit->members, node->data.method_call.method_name);
+                    if (fn) {
+                        result_val = call_native(fn, NULL, node->data.method_call.args, node->data.method_call.num_args, scope);
+                    } else {
+                        runtime_errorf("Toolkit '%s' has no member '%s'.\n", toolkit->name, node->data.method_call.method_name);
+                        result_val = create_nil_value_helper();
+                    }
+                    break;
+                }
+                free_value(shadow);
+            }
+            Value* object_val = interpret_ast(object_node, scope);
+            if (object_val && native_methods_for(object_val)) {
+                NativeFn fn = find_native(native_methods_for(object_val), node->data.method_call.method_name);
+                if (fn) {
+                    result_val = call_native(fn, object_val, node->data.method_call.args, node->data.method_call.num_args, scope);
+                } else {
+                    runtime_errorf("%s has no method '%s'.\n", native_type_name(object_val), node->data.method_call.method_name);
+                    result_val = create_nil_value_helper();
+                }
+            } else if (object_val && object_val->type == VAL_BLUEPRINT_INSTANCE) {
                  // Look for method in instance scope? Or blueprint scope?
                  // Methods are usually in Blueprint scope (shared), but `own` is the instance.
                  // Values: 
@@ -1587,9 +7579,9 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                      // Helper: map arguments
                      // Method 'own' is param[0]
                      if (node->data.method_call.num_args != func_node->data.function_decl.num_params - 1) {
-                          fprintf(stderr, "Method '%s' called with incorrect number of arguments (expected %d, got %d).\n", 
+                          runtime_errorf("Method '%s' called with incorrect number of arguments (expected %d, got %d).\n", 
                                   node->data.method_call.method_name, func_node->data.function_decl.num_params - 1, node->data.method_call.num_args);
-                          result_val = (Value*)malloc(sizeof(Value));
+                          result_val = alloc_value();
                           result_val->type = VAL_NIL;
                      } else {
                          for (int i = 0; i < node->data.method_call.num_args; i++) {
@@ -1610,30 +7602,30 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                             free_value(r);
                         }
                         if (!result_val) {
-                             result_val = (Value*)malloc(sizeof(Value));
+                             result_val = alloc_value();
                              result_val->type = VAL_NIL;
                         }
                      }
                      destroy_scope(method_scope);
                  } else {
-                      fprintf(stderr, "Method '%s' not found.\n", node->data.method_call.method_name);
+                      runtime_errorf("Method '%s' not found.\n", node->data.method_call.method_name);
                       // Debug: Print available symbols in blueprint scope
                       Scope* sc = object_val->as.blueprint_instance.blueprint_scope;
-                      fprintf(stderr, "Available symbols in blueprint scope (%p): ", sc);
+                      runtime_errorf("Available symbols in blueprint scope (%p): ", sc);
                       for(int k=0; k<sc->symbol_count; k++) {
-                          fprintf(stderr, "'%s'(type=%d), ", sc->symbols[k].name, sc->symbols[k].value->type);
+                          runtime_errorf("'%s'(type=%d), ", sc->symbols[k].name, sc->symbols[k].value->type);
                       }
-                      fprintf(stderr, "\n");
+                      runtime_errorf("\n");
                       Value* check_val = get_variable(sc, node->data.method_call.method_name);
-                      fprintf(stderr, "get_variable('%s') returned %p. Type if not null: %d\n", 
+                      runtime_errorf("get_variable('%s') returned %p. Type if not null: %d\n", 
                               node->data.method_call.method_name, check_val, check_val ? check_val->type : -1);
 
-                      result_val = (Value*)malloc(sizeof(Value));
+                      result_val = alloc_value();
                       result_val->type = VAL_NIL;
                  }
             } else {
-                fprintf(stderr, "Method call on non-instance. Type: %d\n", object_val ? object_val->type : -1);
-                result_val = (Value*)malloc(sizeof(Value));
+                runtime_errorf("Method call on non-instance. Type: %d\n", object_val ? object_val->type : -1);
+                result_val = alloc_value();
                 result_val->type = VAL_NIL;
             }
             free_value(object_val);
@@ -1645,7 +7637,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
              // Let's create a VAL_TOOLKIT-like structure for Module?
              // For now, simplicity: Execute body in current scope (flattened) or create a scope and assign to name.
              // Beaconic modules seem to be namespaces.
-             result_val = (Value*)malloc(sizeof(Value));
+             result_val = alloc_value();
              result_val->type = VAL_NIL;
              break;
         }
@@ -1655,7 +7647,9 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
              
              if (node->data.bring.source) {
                  // 1. Parse the referenced file (AST JSON)
-                 ASTNode* imported_ast = parse_ast_from_file(node->data.bring.source);
+                 // Modules are parsed once and kept: the specs they define
+                 // point into their AST (see ast_cache_get)
+                 ASTNode* imported_ast = ast_cache_get(node->data.bring.source);
                  if (imported_ast) {
                      // 2. Create a module scope or just interpret in current scope?
                      // Beacon 'bring' usually imports INTO current namespace or as a namespace.
@@ -1669,22 +7663,21 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                      } else {
                          free_value(interpret_ast(imported_ast, scope));
                      }
-                     free_ast(imported_ast);
                  } else {
-                     fprintf(stderr, "Runtime Error: Failed to import module '%s' from '%s'\n", 
+                     runtime_errorf("Runtime Error: Failed to import module '%s' from '%s'\n", 
                              node->data.bring.module, node->data.bring.source);
                  }
              } else {
-                 fprintf(stderr, "Runtime Error: No source file provided for module '%s'\n", node->data.bring.module);
+                 runtime_errorf("Runtime Error: No source file provided for module '%s'\n", node->data.bring.module);
              }
 
-             result_val = (Value*)malloc(sizeof(Value));
+             result_val = alloc_value();
              result_val->type = VAL_NIL;
              break;
         }
         case NODE_CONTRACT: {
              // Define contract (interface) - currently no-op or register name
-             result_val = (Value*)malloc(sizeof(Value));
+             result_val = alloc_value();
              result_val->type = VAL_NIL;
              break;
         }
@@ -1694,22 +7687,26 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
                 free_value(interpret_ast(node->data.embed.body[i], embed_scope));
             }
             destroy_scope(embed_scope);
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_PARAL: {
             enqueue_paral(node->data.paral.body, node->data.paral.num_body_statements);
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_HOLD: {
             drain_hold(scope);
+            // hold is also where io~>read and io~>write calls complete,
+            // and where listeners' handlers take their waiting connections
+            ioq_wait_all();
+            net_dispatch(scope);
             for (int i = 0; i < node->data.hold.num_body_statements; i++) {
                 free_value(interpret_ast(node->data.hold.body[i], scope));
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1722,7 +7719,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             // Actually, set_variable bubbles up if variable exists. NODE_ATTEMPT checks local attempt_scope.
             // If trigger is inside attempt_scope, set_variable works.
             set_variable(scope, "__last_error_name", create_string_value_helper(node->data.trigger_node.error_name));
-            if (msg_val->type == VAL_STRING) {
+            if (is_text(msg_val)) {
                 set_variable(scope, "__last_error_message", msg_val);
             } else {
                 set_variable(scope, "__last_error_message", create_string_value_helper("Error triggered"));
@@ -1732,13 +7729,12 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             // We need interpret_ast to return NULL or special value to signal interrupt?
             // Current main.c logic relies on caller checking specific variables or return values?
             // NODE_ATTEMPT checks __last_error_name.
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL; 
             break;
         }
         case NODE_SIGNAL: {
             const char *event = NULL;
-            int start_idx = 0;
             if (node->data.signal_node.num_body_statements > 0 && node->data.signal_node.body[0]->type == NODE_EXPRESSION_STATEMENT) {
                 ASTNode* expr = node->data.signal_node.body[0]->data.expr_statement.expression;
                 if (expr->type == NODE_STRING) {
@@ -1753,7 +7749,7 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             } else {
                 for (int i = 0; i < node->data.signal_node.num_body_statements; i++) { free_value(interpret_ast(node->data.signal_node.body[i], scope)); }
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1772,18 +7768,18 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             } else {
                 for (int i = 0; i < node->data.listen.num_body_statements; i++) { free_value(interpret_ast(node->data.listen.body[i], scope)); }
             }
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_BOOL: {
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_BOOL;
             result_val->as.boolean = node->data.boolean_val;
             break;
         }
         case NODE_NIL: {
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
@@ -1794,52 +7790,28 @@ Value* interpret_ast(ASTNode* node, Scope* scope) {
             // But NickNode definition suggests they are ASTNodes.
             // Assuming it's a declaration, we might need to do something.
             // For now, just return nil to silence error.
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
         }
         case NODE_TYPE: {
-            result_val = (Value*)malloc(sizeof(Value));
+            result_val = alloc_value();
             result_val->type = VAL_STRING;
             result_val->as.string = strdup(node->data.type_node.type_name);
             break;
         }
         case NODE_PACK: {
-            // Create a string representation of the pack (simple implementation)
-            // Format: "[item1, item2, item3]"
-            char buffer[4096] = "[";
-            int offset = 1;
-            
+            // A pack is a list; all-number packs start out dense
+            ListObj* list = list_new(node->data.pack.num_items, true);
             for (int i = 0; i < node->data.pack.num_items; i++) {
-                Value* item_val = interpret_ast(node->data.pack.items[i], scope);
-                char item_str[512];
-                
-                if (item_val->type == VAL_NUMBER) {
-                    snprintf(item_str, sizeof(item_str), "%.10g", item_val->as.number);
-                } else if (item_val->type == VAL_STRING) {
-                    snprintf(item_str, sizeof(item_str), "\"%s\"", item_val->as.string);
-                } else if (item_val->type == VAL_BOOL) {
-                    snprintf(item_str, sizeof(item_str), "%s", item_val->as.boolean ? "true" : "false");
-                } else {
-                    snprintf(item_str, sizeof(item_str), "nil");
-                }
-                
-                offset += snprintf(buffer + offset, sizeof(buffer) - offset, "%s%s", 
-                                  i > 0 ? ", " : "", item_str);
-                free_value(item_val);
+                list_append(list, interpret_ast(node->data.pack.items[i], scope));
             }
-            
-            buffer[offset++] = ']';
-            buffer[offset] = '\0';
-            
-            result_val = (Value*)malloc(sizeof(Value));
-            result_val->type = VAL_STRING;
-            result_val->as.string = strdup(buffer);
+            result_val = create_list_value_helper(list);
             break;
         }
         default:
-            fprintf(stderr, "Unhandled AST node type: %d\n", node->type);
-            result_val = (Value*)malloc(sizeof(Value));
+            runtime_errorf("Unhandled AST node type: %d\n", node->type);
+            result_val = alloc_value();
             result_val->type = VAL_NIL;
             break;
     }
@@ -1856,6 +7828,7 @@ void free_ast(ASTNode *node) {
                 free_ast(node->data.program.statements[i]);
             }
             free(node->data.program.statements);
+            free(node->data.program.nodes);
             break;
         case NODE_BINARY_OP:
             free_ast(node->data.binary_op.left);
@@ -1879,6 +7852,7 @@ void free_ast(ASTNode *node) {
             free(node->data.show_statement.expressions);
             break;
         case NODE_FUNCTION_DECL:
+            free(node->data.function_decl.symbol);
             free(node->data.function_decl.name);
             if (node->data.function_decl.docstring) {
                 free(node->data.function_decl.docstring);
@@ -2150,8 +8124,72 @@ void free_ast(ASTNode *node) {
 
 
 
+// Server mode loads ASTs without the progress messages, which would
+// otherwise end up in a job's output
+#ifdef BEACON_LIBRARY
+static bool ast_quiet = true;
+#else
+static bool ast_quiet = false;
+#endif
+
+// Nodes parsed so far for the AST being built on this thread
+typedef struct {
+    ASTNode** nodes;
+    int count;
+    int capacity;
+} AstNodeTable;
+
+static WORKERS_THREAD_LOCAL AstNodeTable* ast_node_table;
+
+static void ast_node_register(ASTNode* node) {
+    AstNodeTable* table = ast_node_table;
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 256;
+        table->nodes = (ASTNode**)realloc(table->nodes, table->capacity * sizeof(ASTNode*));
+    }
+    node->index = table->count;
+    table->nodes[table->count++] = node;
+}
+
+// Builds an AST from JSON text; name is for messages
+static ASTNode* parse_ast_from_text(const char* text, const char* name) {
+    if (!ast_quiet) printf("Parsing JSON...\n");
+    cJSON *json = cJSON_Parse(text);
+    if (json == NULL) {
+        const char *error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr != NULL) {
+            printf("Error parsing JSON in %s near: %s\n", name, error_ptr);
+        } else {
+            printf("Error parsing JSON: unknown error\n");
+        }
+        return NULL;
+    }
+
+    if (!ast_quiet) printf("Building AST...\n");
+    AstNodeTable table = {NULL, 0, 0};
+    AstNodeTable* outer = ast_node_table;
+    ast_node_table = &table;
+    ASTNode *ast = parse_ast_from_json(json);
+    ast_node_table = outer;
+    if (ast && ast->type == NODE_PROGRAM) {
+        ast->data.program.nodes = table.nodes;
+        ast->data.program.num_nodes = table.count;
+        ast->data.program.source_hash = snapshot_hash(text, strlen(text));
+    } else {
+        free(table.nodes);
+    }
+    if (!ast) {
+        printf("Failed to parse AST from %s (root is null or invalid).\n", name);
+    } else if (!ast_quiet) {
+        printf("AST parsed successfully.\n");
+    }
+
+    cJSON_Delete(json);
+    return ast;
+}
+
 ASTNode* parse_ast_from_file(const char* filename) {
-    printf("Opening file: %s\n", filename);
+    if (!ast_quiet) printf("Opening file: %s\n", filename);
     FILE *file = fopen(filename, "rb");
     if (!file) {
         printf("Failed to open file: %s\n", filename); // Changed to printf
@@ -2161,7 +8199,7 @@ ASTNode* parse_ast_from_file(const char* filename) {
     fseek(file, 0, SEEK_END);
     long length = ftell(file);
     fseek(file, 0, SEEK_SET);
-    printf("File size: %ld\n", length);
+    if (!ast_quiet) printf("File size: %ld\n", length);
 
     char *buffer = (char*)malloc(length + 1);
     if (!buffer) {
@@ -2174,66 +8212,452 @@ ASTNode* parse_ast_from_file(const char* filename) {
     fclose(file);
     buffer[length] = '\0';
 
-    printf("Parsing JSON...\n");
-    cJSON *json = cJSON_Parse(buffer);
-    if (json == NULL) {
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL) {
-            printf("Error parsing JSON in %s near: %s\n", filename, error_ptr);
-        } else {
-            printf("Error parsing JSON: unknown error\n");
+    ASTNode *ast = parse_ast_from_text(buffer, filename);
+    free(buffer);
+    return ast;
+}
+
+// ASTs loaded by path (modules, and server jobs) are kept for the life of
+// the process and reloaded only when the file changes. They are never
+// freed: specs, listeners and blueprints defined while running one keep
+// pointers into it. Runtimes on different threads share the cache, and
+// the ASTs in it, under ast_cache_lock.
+typedef struct {
+    char* path;
+    ASTNode* ast;
+    long long mtime_ns;
+    long long size;
+} AstCacheEntry;
+
+static AstCacheEntry* ast_cache = NULL;
+static int ast_cache_count = 0;
+static int ast_cache_capacity = 0;
+static WorkerLock ast_cache_lock = WORKER_LOCK_INIT;
+
+static bool ast_file_stamp(const char* path, long long* mtime_ns, long long* size) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+#if defined(__linux__)
+    *mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+    *mtime_ns = (long long)st.st_mtime * 1000000000LL;
+#endif
+    *size = (long long)st.st_size;
+    return true;
+}
+
+static ASTNode* ast_cache_load(const char* filename) {
+    long long mtime_ns = 0, size = 0;
+    bool stamped = ast_file_stamp(filename, &mtime_ns, &size);
+    for (int i = 0; i < ast_cache_count; i++) {
+        AstCacheEntry* entry = &ast_cache[i];
+        if (strcmp(entry->path, filename) != 0) continue;
+        if (!stamped || (entry->mtime_ns == mtime_ns && entry->size == size)) return entry->ast;
+        ASTNode* ast = parse_ast_from_file(filename);
+        if (!ast) return NULL;
+        entry->ast = ast;  // the old one stays alive, see above
+        entry->mtime_ns = mtime_ns;
+        entry->size = size;
+        return ast;
+    }
+    ASTNode* ast = parse_ast_from_file(filename);
+    if (!ast) return NULL;
+    if (ast_cache_count == ast_cache_capacity) {
+        ast_cache_capacity = ast_cache_capacity ? ast_cache_capacity * 2 : 8;
+        ast_cache = (AstCacheEntry*)realloc(ast_cache, ast_cache_capacity * sizeof(AstCacheEntry));
+    }
+    AstCacheEntry* entry = &ast_cache[ast_cache_count++];
+    entry->path = strdup(filename);
+    entry->ast = ast;
+    entry->mtime_ns = mtime_ns;
+    entry->size = size;
+    return ast;
+}
+
+ASTNode* ast_cache_get(const char* filename) {
+    worker_lock(&ast_cache_lock);
+    ASTNode* ast = ast_cache_load(filename);
+    worker_unlock(&ast_cache_lock);
+    return ast;
+}
+
+// The cached module that node belongs to, and a copy of its path; NULL if
+// node is in none of them (or in one that has since been reloaded)
+static ASTNode* ast_cache_owner(const ASTNode* node, char** path) {
+    ASTNode* owner = NULL;
+    worker_lock(&ast_cache_lock);
+    for (int i = 0; i < ast_cache_count && !owner; i++) {
+        if (ast_owns_node(ast_cache[i].ast, node)) {
+            owner = ast_cache[i].ast;
+            *path = strdup(ast_cache[i].path);
         }
-        free(buffer);
+    }
+    worker_unlock(&ast_cache_lock);
+    return owner;
+}
+
+// Forgets what the last run left in rt: its globals, listeners and queue
+static void runtime_reset(BeaconRuntime* rt) {
+    if (rt->globals) destroy_scope(rt->globals);
+    rt->globals = NULL;
+    for (int i = 0; i < rt->event_registry_count; i++) {
+        free(rt->event_registry[i].event_name);
+        free(rt->event_registry[i].handlers);
+    }
+    rt->event_registry_count = 0;
+    rt->paral_queue_count = 0;
+    ioq_wait_all();
+}
+
+// The file of a snapshot~>point("file") statement, or NULL if statement
+// is anything else
+static const char* snapshot_point_path(ASTNode* statement) {
+    if (statement->type != NODE_EXPRESSION_STATEMENT) return NULL;
+    ASTNode* call = statement->data.expr_statement.expression;
+    if (!call || call->type != NODE_METHOD_CALL || call->data.method_call.num_args != 1) return NULL;
+    ASTNode* object = call->data.method_call.object;
+    ASTNode* file = call->data.method_call.args[0];
+    if (object->type != NODE_VAR_ACCESS || strcmp(object->data.var_access.var_name, "snapshot") != 0 ||
+        strcmp(call->data.method_call.method_name, "point") != 0 || !file || file->type != NODE_STRING) {
         return NULL;
     }
+    return file->data.string_val;
+}
 
-    printf("Building AST...\n");
-    ASTNode *ast = parse_ast_from_json(json);
-    if (!ast) {
-        printf("Failed to parse AST from %s (root is null or invalid).\n", filename);
+// Runs a program in rt from fresh globals, which rt keeps; rt must be current.
+// If the program has a snapshot point (the first top-level
+// snapshot~>point statement) and a snapshot made there by this same
+// program, the run starts from the snapshot's globals at the statement
+// after the point; otherwise reaching the point writes the snapshot.
+static void run_program(BeaconRuntime* rt, ASTNode* ast) {
+    runtime_reset(rt);
+    rt->globals = create_scope(NULL);
+    rt->resumed = false;
+    if (ast->type == NODE_PROGRAM) {
+        int point = -1;
+        const char* point_path = NULL;
+        for (int i = 0; i < ast->data.program.num_statements && !point_path; i++) {
+            point_path = snapshot_point_path(ast->data.program.statements[i]);
+            point = i;
+        }
+        int start = 0;
+        SnapshotReader reader;
+        if (point_path && snapshot_open(&reader, ast, point + 1, point_path)) {
+            if (snapshot_restore(rt, &reader)) {
+                rt->resumed = true;
+                start = point + 1;
+            } else {
+                runtime_errorf("Runtime Error: Snapshot '%s' is damaged; running the program from the start.\n", point_path);
+                runtime_reset(rt);
+                rt->globals = create_scope(NULL);
+            }
+        }
+        for (int i = start; i < ast->data.program.num_statements; i++) {
+            if (point_path && i == point) {
+                snapshot_write(rt, ast, point + 1, point_path);
+                continue;
+            }
+            Value* result = interpret_ast(ast->data.program.statements[i], rt->globals);
+            if (result) {
+                free_value(result);
+            }
+        }
     } else {
-        printf("AST parsed successfully.\n");
+        Value* result = interpret_ast(ast, rt->globals);
+        if (result) {
+            free_value(result);
+        }
     }
+}
 
-    cJSON_Delete(json);
-    free(buffer);
-    return ast;
+// ---------------------------------------------------------------------------
+// Embedding API (beacon.h)
+// ---------------------------------------------------------------------------
+
+struct BeaconProgram {
+    ASTNode* ast;
+};
+
+static BeaconProgram* program_wrap(ASTNode* ast) {
+    if (!ast) return NULL;
+    BeaconProgram* program = (BeaconProgram*)malloc(sizeof(BeaconProgram));
+    program->ast = ast;
+    return program;
+}
+
+BeaconProgram* beacon_program_load(const char* ast_path) {
+    return program_wrap(parse_ast_from_file(ast_path));
+}
+
+BeaconProgram* beacon_program_parse(const char* ast_json, const char* name) {
+    return program_wrap(parse_ast_from_text(ast_json, name ? name : "<program>"));
+}
+
+void beacon_program_free(BeaconProgram* program) {
+    if (!program) return;
+    free_ast(program->ast);
+    free(program);
+}
+
+BeaconRuntime* beacon_runtime_new(void) {
+    return (BeaconRuntime*)calloc(1, sizeof(BeaconRuntime));
+}
+
+void beacon_runtime_free(BeaconRuntime* rt) {
+    if (!rt) return;
+    BeaconRuntime* saved = runtime_enter(rt);
+    runtime_reset(rt);
+    runtime_leave(saved);
+    free(rt->event_registry);
+    free(rt->paral_queue);
+    free(rt->net_listeners);
+    for (int i = 0; i < rt->native_count; i++) free(rt->natives[i].name);
+    free(rt->natives);
+    free(rt);
+}
+
+void beacon_set_output(BeaconRuntime* rt, BeaconWriteFn write, void* user) {
+    rt->write_out = write;
+    rt->out_user = user;
+}
+
+void beacon_set_errors(BeaconRuntime* rt, BeaconWriteFn write, void* user) {
+    rt->write_err = write;
+    rt->err_user = user;
+}
+
+void beacon_buffer_write(void* buffer, const char* data, size_t length) {
+    BeaconBuffer* out = (BeaconBuffer*)buffer;
+    // Keeps one byte for the terminator
+    size_t room = out->size > out->length + 1 ? out->size - out->length - 1 : 0;
+    size_t take = length < room ? length : room;
+    memcpy(out->data + out->length, data, take);
+    out->length += take;
+    if (out->size > 0) out->data[out->length] = '\0';
+    out->overflow += length - take;
+}
+
+int beacon_register(BeaconRuntime* rt, const char* name, BeaconNativeFn fn, void* user) {
+    if (find_native(native_builtins, name) || find_native_toolkit(name)) return -1;
+    for (int i = 0; i < rt->native_count; i++) {
+        if (strcmp(rt->natives[i].name, name) == 0) {
+            rt->natives[i].fn = fn;
+            rt->natives[i].user = user;
+            return 0;
+        }
+    }
+    if (rt->native_count == rt->native_capacity) {
+        rt->native_capacity = rt->native_capacity ? rt->native_capacity * 2 : 8;
+        rt->natives = (HostNative*)realloc(rt->natives, rt->native_capacity * sizeof(HostNative));
+    }
+    HostNative* native = &rt->natives[rt->native_count++];
+    native->name = strdup(name);
+    native->fn = fn;
+    native->user = user;
+    return 0;
+}
+
+int beacon_run(BeaconRuntime* rt, BeaconProgram* program) {
+    if (!rt || !program) return -1;
+    BeaconRuntime* saved = runtime_enter(rt);
+    run_program(rt, program->ast);
+    runtime_leave(saved);
+    return 0;
+}
+
+BeaconValue* beacon_call(BeaconRuntime* rt, const char* spec, BeaconValue** args, int argc) {
+    if (!rt || !rt->globals) return NULL;
+    BeaconRuntime* saved = runtime_enter(rt);
+    Value* func_val = get_variable(rt->globals, spec);
+    Value* result = NULL;
+    if (func_val && func_val->type == VAL_FUNCTION) {
+        // call_spec takes its arguments over; the caller keeps theirs
+        Value* stack_args[8];
+        Value** owned = argc <= 8 ? stack_args : (Value**)malloc(argc * sizeof(Value*));
+        for (int i = 0; i < argc; i++) owned[i] = copy_value(args[i]);
+        result = call_spec(func_val->as.function, owned, argc, rt->globals);
+        if (owned != stack_args) free(owned);
+    }
+    if (func_val) free_value(func_val);
+    runtime_leave(saved);
+    return result;
+}
+
+BeaconValue* beacon_nil(void) {
+    return create_nil_value_helper();
+}
+
+BeaconValue* beacon_bool(int value) {
+    return create_bool_value_helper(value != 0);
+}
+
+BeaconValue* beacon_number(double value) {
+    return create_numeric_value_helper(value);
+}
+
+BeaconValue* beacon_text(const char* text, size_t length) {
+    return create_rope_value_helper(rope_leaf(text, length));
+}
+
+BeaconValue* beacon_list(BeaconValue** items, int count) {
+    ListObj* list = list_new(count, true);
+    for (int i = 0; i < count; i++) list_append(list, copy_value(items[i]));
+    return create_list_value_helper(list);
+}
+
+void beacon_value_free(BeaconValue* value) {
+    free_value(value);
+}
+
+BeaconType beacon_type(const BeaconValue* value) {
+    if (!value) return BEACON_NIL;
+    if (is_number(value)) return BEACON_NUMBER;
+    if (is_text(value)) return BEACON_TEXT;
+    switch (value->type) {
+        case VAL_NIL: return BEACON_NIL;
+        case VAL_BOOL: return BEACON_BOOL;
+        case VAL_LIST: return BEACON_LIST;
+        case VAL_DICT: return BEACON_DICT;
+        default: return BEACON_OTHER;
+    }
+}
+
+int beacon_as_bool(const BeaconValue* value) {
+    return value_to_bool((Value*)value) ? 1 : 0;
+}
+
+double beacon_as_number(const BeaconValue* value) {
+    return value && is_number(value) ? number_of(value) : 0.0;
+}
+
+const char* beacon_as_text(BeaconValue* value, size_t* length) {
+    if (!value || !is_text(value)) return NULL;
+    if (length) *length = text_length(value);
+    return text_of(value);
+}
+
+int beacon_list_length(const BeaconValue* value) {
+    return value && value->type == VAL_LIST ? value->as.list->count : 0;
+}
+
+BeaconValue* beacon_list_get(const BeaconValue* value, int index) {
+    if (!value || value->type != VAL_LIST || index < 0 || index >= value->as.list->count) return NULL;
+    return list_get(value->as.list, index);
+}
+
+size_t beacon_render(BeaconValue* value, char* buffer, size_t size) {
+    StrBuf sb;
+    strbuf_init(&sb, 64);
+    if (value) strbuf_append_value(&sb, value);
+    if (size > 0) {
+        size_t take = sb.len < size - 1 ? sb.len : size - 1;
+        memcpy(buffer, sb.data, take);
+        buffer[take] = '\0';
+    }
+    size_t length = sb.len;
+    free(sb.data);
+    return length;
+}
+
+// ---------------------------------------------------------------------------
+// Server mode
+// ---------------------------------------------------------------------------
+
+#ifdef JOB_SERVER
+// Runs jobs from one channel until it ends or sends QUIT; false on QUIT
+static bool serve_jobs(JobChannel* ch) {
+    JobRequest req;
+    while (job_read_request(ch, &req)) {
+        JobCapture cap;
+        if (!job_capture_start(&cap, ch->out_fd, req.input, req.input_len)) {
+            runtime_errorf("Server Error: could not set up job '%s': %s\n", req.path, strerror(errno));
+            job_request_free(&req);
+            return false;
+        }
+        ASTNode* ast = req.ast ? parse_ast_from_text(req.ast, req.path) : ast_cache_get(req.path);
+        if (!ast && !req.ast) printf("Failed to load %s\n", req.path);
+        // Each job starts clean
+        if (ast) run_program(&default_runtime, ast);
+        runtime_reset(&default_runtime);
+        job_capture_finish(&cap, ast ? 0 : 1);
+        // Nothing from the job outlives its scope, so an inline AST can go
+        if (ast && req.ast) free_ast(ast);
+        job_request_free(&req);
+    }
+    return !ch->quit;
+}
+
+// --serve reads jobs from stdin; --serve <path> accepts clients on a Unix
+// socket, one at a time. See jobserver.h for the protocol.
+static int serve_main(const char* socket_path) {
+    ast_quiet = true;
+    workers_init();
+    if (!socket_path) {
+        JobChannel ch;
+        job_channel_stdio(&ch);
+        serve_jobs(&ch);
+        return 0;
+    }
+    int listen_fd = job_listen_unix(socket_path);
+    if (listen_fd < 0) {
+        runtime_errorf("Server Error: could not listen on %s: %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+    runtime_errorf("Serving jobs on %s\n", socket_path);
+    int null_fd = open("/dev/null", O_RDWR);
+    dup2(null_fd, 0);
+    dup2(null_fd, 1);
+    close(null_fd);
+    bool running = true;
+    while (running) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        JobChannel ch;
+        memset(&ch, 0, sizeof(ch));
+        ch.in_fd = fd;
+        ch.out_fd = fd;
+        running = serve_jobs(&ch);
+        close(fd);
+    }
+    close(listen_fd);
+    unlink(socket_path);
+    return 0;
 }
+#endif
 
+#ifndef BEACON_LIBRARY
 int main(int argc, char** argv) {
-    printf("BPL running: %s\n", argv[1]); // Debug
     setvbuf(stdout, NULL, _IONBF, 0);
     setvbuf(stderr, NULL, _IONBF, 0);
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <path to ast.json>\n", argv[0]);
+        runtime_errorf("Usage: %s <path to ast.json>\n       %s --serve [unix socket path]\n", argv[0], argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "--serve") == 0) {
+#ifdef JOB_SERVER
+        return serve_main(argc > 2 ? argv[2] : NULL);
+#else
+        runtime_errorf("Server mode is not available on this platform.\n");
         return 1;
+#endif
     }
+    printf("BPL running: %s\n", argv[1]); // Debug
 
     ASTNode *ast = parse_ast_from_file(argv[1]);
     if (!ast) {
         return 1;
     }
-    
-    Scope* global_scope = create_scope(NULL);
-    if (ast->type == NODE_PROGRAM) {
-        for (int i = 0; i < ast->data.program.num_statements; i++) {
-            Value* result = interpret_ast(ast->data.program.statements[i], global_scope);
-            if (result) {
-                free_value(result);
-            }
-        }
-    } else {
-        Value* result = interpret_ast(ast, global_scope);
-        if (result) {
-            free_value(result);
-        }
-    }
 
-    destroy_scope(global_scope);
+    run_program(&default_runtime, ast);
+    runtime_reset(&default_runtime);
     free_ast(ast);
 
     return 0;
 }
+#endif
 
 ASTNode* parse_ast_from_json(cJSON *json_node) {
     if (!json_node || cJSON_IsNull(json_node)) return NULL;
@@ -2243,7 +8667,7 @@ ASTNode* parse_ast_from_json(cJSON *json_node) {
 
     if (!type_str) {
         char *json_str = cJSON_Print(json_node);
-        fprintf(stderr, "Invalid or missing type in JSON AST: %s\n", json_str);
+        runtime_errorf("Invalid or missing type in JSON AST: %s\n", json_str);
         free(json_str);
         return NULL;
     }
@@ -2255,6 +8679,13 @@ ASTNode* parse_ast_from_json(cJSON *json_node) {
         exit(EXIT_FAILURE);
     }
     memset(node, 0, sizeof(ASTNode));
+    if (ast_node_table) ast_node_register(node);
+#ifdef BEACON_AOT
+    // Compiled programs find the nodes they hand back to the interpreter by
+    // the marks the compiler put on them (aot.h)
+    cJSON *aot_mark_json = cJSON_GetObjectItemCaseSensitive(json_node, "aot");
+    if (cJSON_IsNumber(aot_mark_json)) aot_mark(aot_mark_json->valueint, node);
+#endif
 
     if (strcmp(type_str, "ProgramNode") == 0) {
         node->type = NODE_PROGRAM;
@@ -2339,6 +8770,12 @@ ASTNode* parse_ast_from_json(cJSON *json_node) {
         for (int i = 0; i < body_count; i++) {
             node->data.function_decl.body[i] = parse_ast_from_json(cJSON_GetArrayItem(body_json, i));
         }
+        FunctionSymbol* func_sym = (FunctionSymbol*)malloc(sizeof(FunctionSymbol));
+        strncpy(func_sym->name, node->data.function_decl.name, 49);
+        func_sym->name[49] = '\0';
+        func_sym->node = node;
+        func_sym->compiled = NULL;
+        node->data.function_decl.symbol = func_sym;
     } else if (strcmp(type_str, "ReturnStatementNode") == 0) {
         node->type = NODE_RETURN_STATEMENT;
         node->data.return_statement.expression = parse_ast_from_json(cJSON_GetObjectItemCaseSensitive(json_node, "expression"));
@@ -2562,6 +8999,8 @@ ASTNode* parse_ast_from_json(cJSON *json_node) {
         int part_count = cJSON_GetArraySize(parts_json);
         node->data.interpolated_string.parts = (InterpolatedStringPart**)malloc(part_count * sizeof(InterpolatedStringPart*));
         node->data.interpolated_string.num_parts = part_count;
+        node->data.interpolated_string.num_slots = 0;
+        node->data.interpolated_string.literal_length = 0;
         for (int i = 0; i < part_count; i++) {
             cJSON* part_json = cJSON_GetArrayItem(parts_json, i);
             InterpolatedStringPart* part = (InterpolatedStringPart*)malloc(sizeof(InterpolatedStringPart));
@@ -2573,9 +9012,13 @@ ASTNode* parse_ast_from_json(cJSON *json_node) {
             if (strcmp(part_type_str, "StringNode") == 0) {
                 part->type = INTERPOLATED_STRING_PART_STRING;
                 part->data.string_val = strdup(cJSON_GetObjectItemCaseSensitive(part_json, "value")->valuestring);
+                part->length = strlen(part->data.string_val);
+                node->data.interpolated_string.literal_length += part->length;
             } else {
                 part->type = INTERPOLATED_STRING_PART_EXPRESSION;
                 part->data.expression = parse_ast_from_json(part_json);
+                part->length = 0;
+                node->data.interpolated_string.num_slots++;
             }
         }
     } else if (strcmp(type_str, "StringNode") == 0) {
@@ -2776,7 +9219,7 @@ ASTNode* parse_ast_from_json(cJSON *json_node) {
             node->data.pack.items[i] = parse_ast_from_json(cJSON_GetArrayItem(items_json, i));
         }
     } else {
-        fprintf(stderr, "Unknown AST node type: %s\n", type_str);
+        runtime_errorf("Unknown AST node type: %s\n", type_str);
         free(node);
         return NULL;
     }
@@ -2786,11 +9229,11 @@ ASTNode* parse_ast_from_json(cJSON *json_node) {
 
 
 Scope* create_scope(Scope* parent) {
-    Scope* scope = (Scope*)malloc(sizeof(Scope));
+    Scope* scope = (Scope*)slab_alloc(&scope_slab, sizeof(Scope));
     scope->parent = parent;
     scope->symbol_count = 0;
-    scope->symbol_capacity = 10;
-    scope->symbols = (Symbol*)malloc(scope->symbol_capacity * sizeof(Symbol));
+    scope->symbol_capacity = SCOPE_INITIAL_SYMBOLS;
+    scope->symbols = (Symbol*)slab_alloc(&symbol_slab, SCOPE_INITIAL_SYMBOLS * sizeof(Symbol));
     return scope;
 }
 
@@ -2799,20 +9242,19 @@ void destroy_scope(Scope* scope) {
         free(scope->symbols[i].name);
         free_value(scope->symbols[i].value);
     }
-    free(scope->symbols);
-    free(scope);
+    if (scope->symbol_capacity == SCOPE_INITIAL_SYMBOLS) {
+        slab_free(&symbol_slab, scope->symbols);
+    } else {
+        free(scope->symbols);
+    }
+    slab_free(&scope_slab, scope);
 }
 
 Value* get_variable(Scope* scope, const char* name) {
     for (int i = 0; i < scope->symbol_count; i++) {
         if (strcmp(scope->symbols[i].name, name) == 0) {
             // Return a copy to prevent modification of the original value
-            Value* copy = (Value*)malloc(sizeof(Value));
-            memcpy(copy, scope->symbols[i].value, sizeof(Value));
-            if (copy->type == VAL_STRING) {
-                copy->as.string = strdup(scope->symbols[i].value->as.string);
-            }
-            return copy;
+            return copy_value(scope->symbols[i].value);
         }
     }
     if (scope->parent) {
@@ -2835,7 +9277,7 @@ void define_variable(Scope* scope, const char* name, Value* value, bool is_const
         if (strcmp(scope->symbols[i].name, name) == 0) {
             // Already exists. If it was constant, error.
             if (scope->symbols[i].is_constant) {
-                fprintf(stderr, "Runtime Error: Cannot reassign constant '%s'.\n", name);
+                runtime_errorf("Runtime Error: Cannot reassign constant '%s'.\n", name);
                 // For now, just return (ignoring assignment) or we could exit.
                 // Let's print error and keep old value to safe-guard.
                 free_value(value);
@@ -2855,8 +9297,17 @@ void define_variable(Scope* scope, const char* name, Value* value, bool is_const
     }
 
     if (scope->symbol_count >= scope->symbol_capacity) {
-        scope->symbol_capacity *= 2;
-        scope->symbols = (Symbol*)realloc(scope->symbols, scope->symbol_capacity * sizeof(Symbol));
+        if (scope->symbol_capacity == SCOPE_INITIAL_SYMBOLS) {
+            // Leave the slab-owned initial array for a heap one
+            Symbol* grown = (Symbol*)malloc(scope->symbol_capacity * 2 * sizeof(Symbol));
+            memcpy(grown, scope->symbols, scope->symbol_count * sizeof(Symbol));
+            slab_free(&symbol_slab, scope->symbols);
+            scope->symbols = grown;
+            scope->symbol_capacity *= 2;
+        } else {
+            scope->symbol_capacity *= 2;
+            scope->symbols = (Symbol*)realloc(scope->symbols, scope->symbol_capacity * sizeof(Symbol));
+        }
     }
 
     scope->symbols[scope->symbol_count].name = strdup(name);
@@ -2872,7 +9323,7 @@ void set_variable(Scope* scope, const char* name, Value* value) {
         for (int i = 0; i < current->symbol_count; i++) {
             if (strcmp(current->symbols[i].name, name) == 0) {
                 if (current->symbols[i].is_constant) {
-                    fprintf(stderr, "Runtime Error: Cannot assign to constant '%s'.\n", name);
+                    runtime_errorf("Runtime Error: Cannot assign to constant '%s'.\n", name);
                     free_value(value);
                     return;
                 }
@@ -2894,37 +9345,13 @@ char* value_to_string(Value* val) {
     if (!val) {
         return strdup("null");
     }
-    char* str = malloc(100); // Allocate a buffer
-    switch (val->type) {
-        case VAL_NUMBER:
-            if ((long long)val->as.number == val->as.number) {
-                sprintf(str, "%lld", (long long)val->as.number);
-            } else {
-                sprintf(str, "%g", val->as.number);
-            }
-            break;
-        case VAL_STRING:
-            if (val->as.string) {
-                free(str); // Free the small buffer
-                str = strdup(val->as.string); // Return a copy of the string
-            } else {
-                sprintf(str, "(null string)");
-            }
-            break;
-        case VAL_BOOL:
-            sprintf(str, "%s", val->as.boolean ? "true" : "false");
-            break;
-        case VAL_RANGE:
-            sprintf(str, "%g..%g", val->as.range.start, val->as.range.end);
-            break;
-        case VAL_NIL:
-            sprintf(str, "nil");
-            break;
-        default:
-            sprintf(str, "Unknown value type");
-            break;
+    if (val->type == VAL_STRING) {
+        return strdup(val->as.string ? val->as.string : "(null string)");
     }
-    return str;
+    StrBuf sb;
+    strbuf_init(&sb, 32);
+    strbuf_append_value(&sb, val);
+    return sb.data;
 }
 
 
@@ -0,0 +1,463 @@
+#ifndef BEACON_NETLOOP_H
+#define BEACON_NETLOOP_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// TCP connections on a nonblocking event loop behind the net toolkit.
+//
+// Every socket is nonblocking and registered with one epoll instance, level
+// triggered. net_poll() waits for events and does the I/O they allow:
+// listeners accept into a backlog of connections waiting for their handler,
+// readable connections read into their input buffer, and writable ones
+// flush whatever output is queued. The interpreter never blocks in a read
+// or write; it waits in net_poll() until the connection it needs is ready
+// (net_wait), and every other connection makes progress meanwhile.
+//
+// Each connection keeps one input buffer and one output buffer for its
+// whole life. Reads land in the free space at the end of the input buffer,
+// which is compacted rather than reallocated, so steady traffic allocates
+// nothing per read. A send is a single sendmsg over the caller's pieces
+// (gathered I/O, like writev); only bytes the socket cannot take at once are
+// copied into the output buffer. A connection whose unread input passes
+// NET_INPUT_MAX stops being read until the script catches up.
+//
+// The loop belongs to the thread: each thread that uses the net toolkit
+// gets its own epoll instance and timeout, so interpreters running on
+// different threads never see each other's connections.
+//
+// Linux only; elsewhere every call fails with ENOSYS.
+
+#ifdef __linux__
+#define NET_EPOLL 1
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
+#define NET_READ_CHUNK 65536          // free space made before each read
+#define NET_INPUT_MAX (16u << 20)     // unread input past this pauses reading
+#define NET_BUFFER_KEEP (256u << 10)  // emptied buffers larger than this are freed
+#define NET_EVENTS 64
+#define NET_IOV_MAX 64
+
+// --- buffers --------------------------------------------------------------------
+
+// Bytes live in data[start..end); the space after end is free
+typedef struct {
+    char* data;
+    size_t start;
+    size_t end;
+    size_t cap;
+} NetBuf;
+
+static inline size_t netbuf_size(const NetBuf* b) {
+    return b->end - b->start;
+}
+
+// Makes room for n more bytes after end, moving the contents to the front
+// before growing
+static void netbuf_reserve(NetBuf* b, size_t n) {
+    if (b->cap - b->end >= n) return;
+    size_t size = netbuf_size(b);
+    if (b->start > 0) {
+        memmove(b->data, b->data + b->start, size);
+        b->start = 0;
+        b->end = size;
+        if (b->cap - b->end >= n) return;
+    }
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap - size < n) cap *= 2;
+    b->data = (char*)realloc(b->data, cap);
+    b->cap = cap;
+}
+
+static void netbuf_append(NetBuf* b, const char* p, size_t n) {
+    netbuf_reserve(b, n);
+    memcpy(b->data + b->end, p, n);
+    b->end += n;
+}
+
+static void netbuf_consume(NetBuf* b, size_t n) {
+    b->start += n;
+    if (b->start < b->end) return;
+    b->start = b->end = 0;
+    if (b->cap > NET_BUFFER_KEEP) {
+        free(b->data);
+        b->data = NULL;
+        b->cap = 0;
+    }
+}
+
+static void netbuf_free(NetBuf* b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+// --- connections ----------------------------------------------------------------
+
+typedef struct NetConn {
+    int fd;
+    bool listener;
+    bool connecting;     // a connect still in progress
+    bool eof;            // the peer has closed its side
+    int error;           // errno of a failure, 0 while healthy
+    uint32_t events;     // what epoll is watching for
+    NetBuf in;
+    NetBuf out;          // queued bytes the socket did not take yet
+    struct NetConn** backlog;  // a listener's accepted connections
+    int backlog_count;
+    int backlog_cap;
+    void* owner;         // the interpreter's object for this connection
+} NetConn;
+
+#if defined(_MSC_VER)
+#define NET_THREAD_LOCAL __declspec(thread)
+#else
+#define NET_THREAD_LOCAL _Thread_local
+#endif
+
+static NET_THREAD_LOCAL int net_epoll_fd = -1;
+static NET_THREAD_LOCAL int net_timeout_ms = 30000;  // how long a wait may go without progress
+
+static double net_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+#ifdef NET_EPOLL
+
+static bool net_loop_start(void) {
+    if (net_epoll_fd < 0) net_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return net_epoll_fd >= 0;
+}
+
+// Watches for input unless it is paused or finished, and for writability
+// while a connect is in progress or output is queued
+static void net_update(NetConn* c) {
+    if (c->fd < 0) return;
+    uint32_t events = 0;
+    if (c->listener || (!c->eof && !c->error && netbuf_size(&c->in) < NET_INPUT_MAX)) events |= EPOLLIN;
+    if (c->connecting || netbuf_size(&c->out) > 0) events |= EPOLLOUT;
+    if (events == c->events) return;
+    struct epoll_event ev = {0};
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(net_epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+}
+
+static NetConn* net_conn_new(int fd, bool listener, bool connecting) {
+    NetConn* c = (NetConn*)calloc(1, sizeof(NetConn));
+    c->fd = fd;
+    c->listener = listener;
+    c->connecting = connecting;
+    c->events = listener || !connecting ? EPOLLIN : EPOLLIN | EPOLLOUT;
+    struct epoll_event ev = {0};
+    ev.events = c->events;
+    ev.data.ptr = c;
+    epoll_ctl(net_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    if (!listener) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return c;
+}
+
+static void net_close(NetConn* c) {
+    if (!c) return;
+    if (c->fd >= 0) {
+        epoll_ctl(net_epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+    }
+    for (int i = 0; i < c->backlog_count; i++) net_close(c->backlog[i]);
+    free(c->backlog);
+    netbuf_free(&c->in);
+    netbuf_free(&c->out);
+    free(c);
+}
+
+static void net_fail(NetConn* c, int error) {
+    if (!c->error) c->error = error;
+    netbuf_consume(&c->out, netbuf_size(&c->out));
+}
+
+// Resolves host and port; host NULL means every local address
+static struct addrinfo* net_resolve(const char* host, int port, bool passive, int* error) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo* list = NULL;
+    int rc = getaddrinfo(host, service, &hints, &list);
+    if (rc != 0) {
+        *error = rc == EAI_SYSTEM ? errno : EHOSTUNREACH;
+        return NULL;
+    }
+    return list;
+}
+
+// A listening socket on host:port (port 0 picks a free one), or NULL with
+// *error set
+static NetConn* net_listen(const char* host, int port, int* error) {
+    if (!net_loop_start()) {
+        *error = errno;
+        return NULL;
+    }
+    struct addrinfo* list = net_resolve(host, port, true, error);
+    if (!list) return NULL;
+    int fd = -1;
+    for (struct addrinfo* ai = list; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) break;
+        *error = errno;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(list);
+    return fd < 0 ? NULL : net_conn_new(fd, true, false);
+}
+
+// Starts connecting to host:port; the connection is usable once
+// net_wait(c, NET_WAIT_CONNECT) returns true
+static NetConn* net_connect(const char* host, int port, int* error) {
+    if (!net_loop_start()) {
+        *error = errno;
+        return NULL;
+    }
+    struct addrinfo* list = net_resolve(host, port, false, error);
+    if (!list) return NULL;
+    NetConn* c = NULL;
+    for (struct addrinfo* ai = list; ai && !c; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            *error = errno;
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            c = net_conn_new(fd, false, false);
+        } else if (errno == EINPROGRESS) {
+            c = net_conn_new(fd, false, true);
+        } else {
+            *error = errno;
+            close(fd);
+        }
+    }
+    freeaddrinfo(list);
+    return c;
+}
+
+static int net_port(const NetConn* c) {
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(c->fd, (struct sockaddr*)&addr, &len) != 0) return -1;
+    if (addr.ss_family == AF_INET6) return ntohs(((struct sockaddr_in6*)&addr)->sin6_port);
+    return ntohs(((struct sockaddr_in*)&addr)->sin_port);
+}
+
+// "host:port" of the other end of a connection
+static void net_peer_name(const NetConn* c, char* out, size_t size) {
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    char host[NI_MAXHOST], port[NI_MAXSERV];
+    if (getpeername(c->fd, (struct sockaddr*)&addr, &len) != 0 ||
+        getnameinfo((struct sockaddr*)&addr, len, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        snprintf(out, size, "unknown");
+        return;
+    }
+    snprintf(out, size, addr.ss_family == AF_INET6 ? "[%s]:%s" : "%s:%s", host, port);
+}
+
+// Writes queued output until the socket is full
+static void net_flush(NetConn* c) {
+    while (netbuf_size(&c->out) > 0) {
+        ssize_t n = send(c->fd, c->out.data + c->out.start, netbuf_size(&c->out), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) net_fail(c, errno);
+            break;
+        }
+        netbuf_consume(&c->out, (size_t)n);
+    }
+    net_update(c);
+}
+
+// Sends the pieces in order with as few system calls as possible; what the
+// socket cannot take now is queued and flushed by the loop. False once the
+// connection has failed.
+static bool net_send(NetConn* c, struct iovec* iov, int count) {
+    if (c->error || c->listener) return false;
+    int i = 0;
+    if (!c->connecting && netbuf_size(&c->out) == 0) {
+        while (i < count) {
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov + i;
+            msg.msg_iovlen = (size_t)(count - i < NET_IOV_MAX ? count - i : NET_IOV_MAX);
+            ssize_t n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    net_fail(c, errno);
+                    return false;
+                }
+                break;
+            }
+            size_t sent = (size_t)n;
+            while (i < count && sent >= iov[i].iov_len) sent -= iov[i++].iov_len;
+            if (i < count) {
+                iov[i].iov_base = (char*)iov[i].iov_base + sent;
+                iov[i].iov_len -= sent;
+            }
+        }
+    }
+    for (; i < count; i++) netbuf_append(&c->out, (const char*)iov[i].iov_base, iov[i].iov_len);
+    net_update(c);
+    return true;
+}
+
+// Reads what the socket has, up to the input limit
+static void net_fill(NetConn* c) {
+    while (netbuf_size(&c->in) < NET_INPUT_MAX) {
+        netbuf_reserve(&c->in, NET_READ_CHUNK);
+        size_t space = c->in.cap - c->in.end;
+        ssize_t n = recv(c->fd, c->in.data + c->in.end, space, 0);
+        if (n > 0) {
+            c->in.end += (size_t)n;
+            if ((size_t)n < space) break;  // the socket is drained
+            continue;
+        }
+        if (n == 0) {
+            c->eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            c->error = errno;
+        }
+        break;
+    }
+    net_update(c);
+}
+
+static void net_accept(NetConn* l) {
+    for (;;) {
+        int fd = accept(l->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        // accept4 would save these two calls, but needs _GNU_SOURCE
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (l->backlog_count == l->backlog_cap) {
+            l->backlog_cap = l->backlog_cap ? l->backlog_cap * 2 : 8;
+            l->backlog = (NetConn**)realloc(l->backlog, l->backlog_cap * sizeof(NetConn*));
+        }
+        l->backlog[l->backlog_count++] = net_conn_new(fd, false, false);
+    }
+}
+
+// The oldest accepted connection waiting for its handler, or NULL
+static NetConn* net_take_accepted(NetConn* l) {
+    if (l->backlog_count == 0) return NULL;
+    NetConn* c = l->backlog[0];
+    memmove(l->backlog, l->backlog + 1, (size_t)(--l->backlog_count) * sizeof(NetConn*));
+    return c;
+}
+
+// Waits up to timeout_ms (-1 for ever) for events and handles them.
+// Returns the number handled.
+static int net_poll(int timeout_ms) {
+    if (net_epoll_fd < 0) return 0;
+    struct epoll_event events[NET_EVENTS];
+    int n = epoll_wait(net_epoll_fd, events, NET_EVENTS, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        NetConn* c = (NetConn*)events[i].data.ptr;
+        uint32_t ev = events[i].events;
+        if (c->listener) {
+            net_accept(c);
+            continue;
+        }
+        if (c->connecting && (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            c->connecting = false;
+            if (err) net_fail(c, err);
+        }
+        if (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) net_fill(c);
+        if (ev & EPOLLOUT) net_flush(c);
+        net_update(c);
+    }
+    return n < 0 ? 0 : n;
+}
+
+typedef enum {
+    NET_WAIT_CONNECT,   // the connect has finished
+    NET_WAIT_INPUT,     // `want` bytes are buffered, or no more will come
+    NET_WAIT_SENT,      // all queued output is written
+    NET_WAIT_ACCEPT     // a listener has an accepted connection
+} NetWait;
+
+static bool net_waited(NetConn* c, NetWait what, size_t want) {
+    switch (what) {
+        case NET_WAIT_CONNECT: return !c->connecting || c->error;
+        case NET_WAIT_INPUT: return netbuf_size(&c->in) >= want || c->eof || c->error;
+        case NET_WAIT_SENT: return netbuf_size(&c->out) == 0 || c->error;
+        case NET_WAIT_ACCEPT: return c->backlog_count > 0;
+    }
+    return true;
+}
+
+// Runs the loop until the condition holds; false if net_timeout_ms passes
+// without it (timeout_ms < 0 waits for ever)
+static bool net_wait(NetConn* c, NetWait what, size_t want, int timeout_ms) {
+    double deadline = net_now_ms() + timeout_ms;
+    while (!net_waited(c, what, want)) {
+        int left = timeout_ms < 0 ? -1 : (int)(deadline - net_now_ms());
+        if (timeout_ms >= 0 && left <= 0) return false;
+        net_poll(left);
+    }
+    return true;
+}
+
+#else  // !NET_EPOLL
+
+static NetConn* net_listen(const char* host, int port, int* error) { *error = ENOSYS; return NULL; }
+static NetConn* net_connect(const char* host, int port, int* error) { *error = ENOSYS; return NULL; }
+static void net_close(NetConn* c) { free(c); }
+static int net_port(const NetConn* c) { return -1; }
+static void net_peer_name(const NetConn* c, char* out, size_t size) { snprintf(out, size, "unknown"); }
+static bool net_send(NetConn* c, struct iovec* iov, int count) { return false; }
+static NetConn* net_take_accepted(NetConn* l) { return NULL; }
+static int net_poll(int timeout_ms) { return 0; }
+typedef enum { NET_WAIT_CONNECT, NET_WAIT_INPUT, NET_WAIT_SENT, NET_WAIT_ACCEPT } NetWait;
+static bool net_wait(NetConn* c, NetWait what, size_t want, int timeout_ms) { return true; }
+
+#endif
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef BEACON_NUMFMT_H
+#define BEACON_NUMFMT_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Number formatting for show, interpolation and `as Text`.
+//
+// numfmt_int writes an int64 two digits at a time from a lookup table.
+// numfmt_double writes the shortest decimal string that reads back as the
+// same double, using Grisu2 (Loitsch, "Printing Floating-Point Numbers
+// Quickly and Accurately with Integers", PLDI 2010): the value and the
+// edges of its rounding interval are scaled by a cached power of ten into
+// 64-bit fixed point, and digits are generated until the result is
+// inside the interval. For a tiny fraction of inputs Grisu2 settles on
+// a string one digit longer than the shortest; it still round-trips.
+//
+// Both write into a caller buffer of at least NUMFMT_MAX bytes, append no
+// terminator and return the length. Doubles use plain notation for
+// magnitudes in [1e-6, 1e21) and 1.5e+300 style outside that, the same
+// cut-offs JavaScript uses.
+
+#define NUMFMT_MAX 32
+
+static const char numfmt_digit_pairs[200] = {
+    '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+    '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+    '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+    '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+    '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+    '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+    '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+    '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+    '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+    '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+};
+
+static inline int numfmt_uint(char* out, uint64_t n) {
+    char tmp[20];
+    int pos = 20;
+    while (n >= 100) {
+        unsigned pair = (unsigned)(n % 100) * 2;
+        n /= 100;
+        tmp[--pos] = numfmt_digit_pairs[pair + 1];
+        tmp[--pos] = numfmt_digit_pairs[pair];
+    }
+    if (n >= 10) {
+        tmp[--pos] = numfmt_digit_pairs[n * 2 + 1];
+        tmp[--pos] = numfmt_digit_pairs[n * 2];
+    } else {
+        tmp[--pos] = (char)('0' + n);
+    }
+    memcpy(out, tmp + pos, 20 - pos);
+    return 20 - pos;
+}
+
+static inline int numfmt_int(char* out, int64_t n) {
+    if (n < 0) {
+        out[0] = '-';
+        return 1 + numfmt_uint(out + 1, (uint64_t)0 - (uint64_t)n);
+    }
+    return numfmt_uint(out, (uint64_t)n);
+}
+
+// --- Grisu2 ----------------------------------------------------------------
+
+// A 64-bit significand and binary exponent: f * 2^e
+typedef struct {
+    uint64_t f;
+    int e;
+} NumfmtFp;
+
+// Normalized 10^k for k = -348, -340, ..., 340 (generated with exact
+// rational arithmetic)
+static const uint64_t numfmt_pow10_f[87] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t numfmt_pow10_e[87] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066
+};
+
+static const uint64_t numfmt_pow10_u64[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static inline int numfmt_clz64(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & 0x8000000000000000ULL)) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// Upper 64 bits of the 128-bit product, rounded
+static inline NumfmtFp numfmt_mul(NumfmtFp x, NumfmtFp y) {
+    const uint64_t m32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    tmp += 1ULL << 31;
+    NumfmtFp r = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+    return r;
+}
+
+static inline NumfmtFp numfmt_normalize(NumfmtFp x) {
+    int s = numfmt_clz64(x.f);
+    NumfmtFp r = {x.f << s, x.e - s};
+    return r;
+}
+
+// Nudges the last digit down while that moves the result closer to the
+// exact value and stays inside the rounding interval
+static inline void numfmt_round(char* buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static inline int numfmt_count_digits(uint32_t n) {
+    int d = 1;
+    while (d < 10 && n >= (uint32_t)numfmt_pow10_u64[d]) d++;
+    return d;
+}
+
+static inline void numfmt_digit_gen(NumfmtFp w, NumfmtFp mp, uint64_t delta, char* buf, int* len, int* k) {
+    NumfmtFp one = {1ULL << -mp.e, mp.e};
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = numfmt_count_digits(p1);
+    *len = 0;
+    while (kappa > 0) {
+        uint32_t div = (uint32_t)numfmt_pow10_u64[kappa - 1];
+        uint32_t d = p1 / div;
+        p1 %= div;
+        if (d || *len) buf[(*len)++] = (char)('0' + d);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            numfmt_round(buf, *len, delta, rest, numfmt_pow10_u64[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || *len) buf[(*len)++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            int index = -kappa;
+            numfmt_round(buf, *len, delta, p2, one.f, wp_w * (index < 20 ? numfmt_pow10_u64[index] : 0));
+            return;
+        }
+    }
+}
+
+// Digits of a positive, finite, non-zero double: value = digits * 10^k
+static inline int numfmt_grisu2(double value, char* buf, int* k) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased_e = (int)((bits >> 52) & 0x7FF);
+    uint64_t significand = bits & 0x000FFFFFFFFFFFFFULL;
+    NumfmtFp v;
+    if (biased_e != 0) {
+        v.f = significand | 0x0010000000000000ULL;
+        v.e = biased_e - 1075;
+    } else {
+        v.f = significand;
+        v.e = -1074;
+    }
+    // Boundaries halfway to the neighbouring doubles
+    NumfmtFp plus = {(v.f << 1) + 1, v.e - 1};
+    plus = numfmt_normalize(plus);
+    NumfmtFp minus;
+    if (v.f == 0x0010000000000000ULL) {
+        minus.f = (v.f << 2) - 1;
+        minus.e = v.e - 2;
+    } else {
+        minus.f = (v.f << 1) - 1;
+        minus.e = v.e - 1;
+    }
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    // A cached power c = 10^-k that brings plus.e into [-60, -32]
+    double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    int ki = (int)dk;
+    if (dk - ki > 0.0) ki++;
+    int index = (ki >> 3) + 1;
+    *k = -(-348 + index * 8);
+    NumfmtFp c = {numfmt_pow10_f[index], numfmt_pow10_e[index]};
+
+    NumfmtFp w = numfmt_mul(numfmt_normalize(v), c);
+    NumfmtFp wp = numfmt_mul(plus, c);
+    NumfmtFp wm = numfmt_mul(minus, c);
+    wm.f++;
+    wp.f--;
+    int len;
+    numfmt_digit_gen(w, wp, wp.f - wm.f, buf, &len, k);
+    return len;
+}
+
+static inline int numfmt_exponent(char* out, int e) {
+    int n = 0;
+    out[n++] = 'e';
+    out[n++] = e < 0 ? '-' : '+';
+    return n + numfmt_uint(out + n, (uint64_t)(e < 0 ? -e : e));
+}
+
+static inline int numfmt_double(char* out, double value) {
+    if (value != value) {
+        memcpy(out, "nan", 3);
+        return 3;
+    }
+    int n = 0;
+    if (value < 0) {
+        out[n++] = '-';
+        value = -value;
+    }
+    if (value == 0) {
+        // -0 prints as 0
+        out[0] = '0';
+        return 1;
+    }
+    if (value > 1.7976931348623157e308) {
+        memcpy(out + n, "inf", 3);
+        return n + 3;
+    }
+    char digits[20];
+    int k;
+    int len = numfmt_grisu2(value, digits, &k);
+    int point = len + k; // position of the decimal point relative to digits
+    char* p = out + n;
+    if (k >= 0 && point <= 21) {
+        // Integer: 1234e2 -> 123400
+        memcpy(p, digits, len);
+        memset(p + len, '0', k);
+        return n + point;
+    }
+    if (point > 0 && point <= 21) {
+        // 1234e-2 -> 12.34
+        memcpy(p, digits, point);
+        p[point] = '.';
+        memcpy(p + point + 1, digits + point, len - point);
+        return n + len + 1;
+    }
+    if (point > -6 && point <= 0) {
+        // 1234e-6 -> 0.001234
+        p[0] = '0';
+        p[1] = '.';
+        memset(p + 2, '0', -point);
+        memcpy(p + 2 - point, digits, len);
+        return n + 2 - point + len;
+    }
+    // Scientific: 1234e30 -> 1.234e+33
+    int m = 0;
+    p[m++] = digits[0];
+    if (len > 1) {
+        p[m++] = '.';
+        memcpy(p + m, digits + 1, len - 1);
+        m += len - 1;
+    }
+    m += numfmt_exponent(p + m, point - 1);
+    return n + m;
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef BEACON_SERIAL_H
+#define BEACON_SERIAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Byte-level pieces of the binary format behind serial~>pack and
+// serial~>unpack.
+//
+// A packed value is the four bytes SERIAL_MAGIC followed by one encoded
+// value. Every value starts with a tag byte; counts and lengths are LEB128
+// varints, whole numbers are zigzag varints, and other numbers are 8-byte
+// little-endian IEEE doubles. Texts are a length and the raw bytes, so the
+// decoder can hand out slices of the input instead of copying. Lists of
+// numbers are a count and a packed run of doubles, which on little-endian
+// machines is a single memcpy in either direction.
+//
+//   nil / off / on   tag
+//   number           tag, double
+//   int              tag, zigzag varint
+//   text             tag, length, bytes
+//   list             tag, count, values
+//   numbers          tag, count, doubles
+//   dict             tag, count, key, value, key, value...
+//   set              tag, count, members
+//   instance         tag, blueprint name length, name bytes, field count,
+//                    then per field a name length, name bytes and value
+//
+// The reader never reads past the end of its input: a truncated or corrupt
+// buffer sets `failed` and the getters return zeros from then on.
+
+#define SERIAL_MAGIC "BPK\001"
+#define SERIAL_MAGIC_SIZE 4
+#define SERIAL_MAX_DEPTH 512   // nesting limit, which also stops a list packed inside itself
+#define SERIAL_VARINT_MAX 10
+
+typedef enum {
+    SERIAL_NIL,
+    SERIAL_OFF,
+    SERIAL_ON,
+    SERIAL_NUMBER,
+    SERIAL_INT,
+    SERIAL_TEXT,
+    SERIAL_LIST,
+    SERIAL_NUMBERS,
+    SERIAL_DICT,
+    SERIAL_SET,
+    SERIAL_INSTANCE
+} SerialTag;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SERIAL_LITTLE_ENDIAN 1
+#endif
+
+// --- writing (into space the caller has reserved) ------------------------------
+
+static inline size_t serial_put_varint(char* out, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (char)v;
+    return n;
+}
+
+static inline uint64_t serial_zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline void serial_put_f64(char* out, double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    for (int i = 0; i < 8; i++) out[i] = (char)(bits >> (8 * i));
+}
+
+static inline void serial_put_f64s(char* out, const double* values, size_t count) {
+#ifdef SERIAL_LITTLE_ENDIAN
+    memcpy(out, values, count * sizeof(double));
+#else
+    for (size_t i = 0; i < count; i++) serial_put_f64(out + 8 * i, values[i]);
+#endif
+}
+
+// --- reading --------------------------------------------------------------------
+
+typedef struct {
+    const char* data;
+    size_t length;
+    size_t pos;
+    bool failed;
+} SerialReader;
+
+static inline bool serial_fail(SerialReader* r) {
+    r->failed = true;
+    r->pos = r->length;
+    return false;
+}
+
+// The next n bytes, or NULL past the end
+static inline const char* serial_get_bytes(SerialReader* r, size_t n) {
+    if (n > r->length - r->pos) {
+        serial_fail(r);
+        return NULL;
+    }
+    const char* p = r->data + r->pos;
+    r->pos += n;
+    return p;
+}
+
+static inline int serial_get_byte(SerialReader* r) {
+    const char* p = serial_get_bytes(r, 1);
+    return p ? (unsigned char)*p : 0;
+}
+
+static inline uint64_t serial_get_varint(SerialReader* r) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 7 * SERIAL_VARINT_MAX; shift += 7) {
+        const char* p = serial_get_bytes(r, 1);
+        if (!p) return 0;
+        v |= (uint64_t)(*p & 0x7f) << shift;
+        if (!(*p & 0x80)) return v;
+    }
+    serial_fail(r);
+    return 0;
+}
+
+static inline int64_t serial_get_zigzag(SerialReader* r) {
+    uint64_t v = serial_get_varint(r);
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline double serial_f64_at(const char* p) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; i++) bits |= (uint64_t)(unsigned char)p[i] << (8 * i);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+static inline double serial_get_f64(SerialReader* r) {
+    const char* p = serial_get_bytes(r, 8);
+    return p ? serial_f64_at(p) : 0;
+}
+
+// A count of items that each take at least min_size bytes; fails rather
+// than letting a corrupt count ask for a huge allocation
+static inline size_t serial_get_count(SerialReader* r, size_t min_size) {
+    uint64_t count = serial_get_varint(r);
+    if (count > (r->length - r->pos) / min_size || count > INT32_MAX) {
+        serial_fail(r);
+        return 0;
+    }
+    return (size_t)count;
+}
+
+static inline void serial_get_f64s(SerialReader* r, double* out, size_t count) {
+    const char* p = serial_get_bytes(r, count * 8);
+    if (!p) return;
+#ifdef SERIAL_LITTLE_ENDIAN
+    memcpy(out, p, count * sizeof(double));
+#else
+    for (size_t i = 0; i < count; i++) out[i] = serial_f64_at(p + 8 * i);
+#endif
+}
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef BEACON_SLAB_H
+#define BEACON_SLAB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Fixed-size object pools with per-thread free lists.
+//
+// The interpreter creates and drops Value and Scope structs for almost every
+// node it evaluates. A SlabCache carves objects of one size out of large
+// blocks and recycles them through a free list owned by the calling thread,
+// so an alloc/free pair is a couple of pointer moves instead of a malloc call.
+//
+// Blocks are never handed back to the system; a pool stays at its high-water
+// mark until the process exits. Build with -DBEACON_NO_SLAB to route every
+// request straight to malloc/free (useful under valgrind or ASan).
+//
+// Each thread-local cache belongs to a process-wide SlabPool. When a thread
+// exits, whatever is left on its free lists, including objects other threads
+// allocated and it freed, moves to the pool under the pool's lock; a thread
+// whose own list runs dry takes those before carving a new block. Declare a
+// cache with SLAB_CACHE_INIT(pool) so it knows where to hand them.
+
+#if defined(_MSC_VER)
+#define SLAB_THREAD_LOCAL __declspec(thread)
+#else
+#define SLAB_THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+typedef SRWLOCK SlabLock;
+#define SLAB_LOCK_INIT SRWLOCK_INIT
+#define slab_lock(l) AcquireSRWLockExclusive(l)
+#define slab_unlock(l) ReleaseSRWLockExclusive(l)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t SlabLock;
+#define SLAB_LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#define slab_lock(l) pthread_mutex_lock(l)
+#define slab_unlock(l) pthread_mutex_unlock(l)
+#endif
+
+#define SLAB_BLOCK_OBJECTS 256
+#define SLAB_ALIGN 16
+
+typedef struct SlabFree {
+    struct SlabFree* next;
+} SlabFree;
+
+// Objects left behind by threads that have exited
+typedef struct {
+    SlabLock lock;
+    SlabFree* orphans;
+} SlabPool;
+
+#define SLAB_POOL_INIT {SLAB_LOCK_INIT, NULL}
+
+typedef struct SlabCache {
+    SlabFree* free_list;
+    SlabPool* pool;
+    struct SlabCache* next_cache;   // the thread's other caches
+    int attached;                   // on the thread's exit list
+} SlabCache;
+
+#define SLAB_CACHE_INIT(pool) {NULL, &(pool), NULL, 0}
+
+#ifndef BEACON_NO_SLAB
+
+// Moves every cache on the exiting thread's list to its pool
+#ifdef _WIN32
+static void WINAPI slab_thread_exit(void* head) {
+#else
+static void slab_thread_exit(void* head) {
+#endif
+    for (SlabCache* cache = (SlabCache*)head; cache; cache = cache->next_cache) {
+        SlabFree* first = cache->free_list;
+        if (!first) continue;
+        SlabFree* last = first;
+        while (last->next) last = last->next;
+        slab_lock(&cache->pool->lock);
+        last->next = cache->pool->orphans;
+        cache->pool->orphans = first;
+        slab_unlock(&cache->pool->lock);
+        cache->free_list = NULL;
+    }
+}
+
+#ifdef _WIN32
+static DWORD slab_exit_key = FLS_OUT_OF_INDEXES;
+static INIT_ONCE slab_key_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK slab_make_key(PINIT_ONCE once, PVOID param, PVOID* context) {
+    slab_exit_key = FlsAlloc(slab_thread_exit);
+    return TRUE;
+}
+#else
+static pthread_key_t slab_exit_key;
+static pthread_once_t slab_key_once = PTHREAD_ONCE_INIT;
+
+static void slab_make_key(void) {
+    pthread_key_create(&slab_exit_key, slab_thread_exit);
+}
+#endif
+
+// Puts the cache on its thread's exit list, the first time the thread
+// touches it
+static void slab_attach(SlabCache* cache) {
+#ifdef _WIN32
+    InitOnceExecuteOnce(&slab_key_once, slab_make_key, NULL, NULL);
+    cache->next_cache = (SlabCache*)FlsGetValue(slab_exit_key);
+    FlsSetValue(slab_exit_key, cache);
+#else
+    pthread_once(&slab_key_once, slab_make_key);
+    cache->next_cache = (SlabCache*)pthread_getspecific(slab_exit_key);
+    pthread_setspecific(slab_exit_key, cache);
+#endif
+    cache->attached = 1;
+}
+
+static void slab_refill(SlabCache* cache, size_t obj_size) {
+    if (cache->pool) {
+        slab_lock(&cache->pool->lock);
+        cache->free_list = cache->pool->orphans;
+        cache->pool->orphans = NULL;
+        slab_unlock(&cache->pool->lock);
+        if (cache->free_list) return;
+    }
+    size_t stride = obj_size < sizeof(SlabFree) ? sizeof(SlabFree) : obj_size;
+    stride = (stride + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    char* block = (char*)malloc(stride * SLAB_BLOCK_OBJECTS);
+    if (!block) {
+        perror("Failed to allocate slab block");
+        exit(EXIT_FAILURE);
+    }
+    // Thread the block onto the free list back to front so objects are
+    // handed out in address order.
+    for (int i = SLAB_BLOCK_OBJECTS - 1; i >= 0; i--) {
+        SlabFree* obj = (SlabFree*)(block + (size_t)i * stride);
+        obj->next = cache->free_list;
+        cache->free_list = obj;
+    }
+}
+
+#endif
+
+static inline void* slab_alloc(SlabCache* cache, size_t obj_size) {
+#ifdef BEACON_NO_SLAB
+    (void)cache;
+    return malloc(obj_size);
+#else
+    if (!cache->attached) slab_attach(cache);
+    if (!cache->free_list) slab_refill(cache, obj_size);
+    SlabFree* obj = cache->free_list;
+    cache->free_list = obj->next;
+    return obj;
+#endif
+}
+
+static inline void slab_free(SlabCache* cache, void* ptr) {
+    if (!ptr) return;
+#ifdef BEACON_NO_SLAB
+    (void)cache;
+    free(ptr);
+#else
+    // Objects freed on another thread join that thread's list, and go back
+    // to the pool when it exits.
+    if (!cache->attached) slab_attach(cache);
+    SlabFree* obj = (SlabFree*)ptr;
+    obj->next = cache->free_list;
+    cache->free_list = obj;
+#endif
+}
+
+#endif // BEACON_SLAB_H
@@ -0,0 +1,162 @@
+#ifndef BEACON_SNAPSHOT_H
+#define BEACON_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "serial.h"
+
+// Byte-level pieces of heap snapshots, the files behind snapshot~>point.
+//
+// A program marks the end of its setup with a top-level
+// snapshot~>point("file"). The first run executes everything before it and
+// then writes the globals it built to the file; later runs of the same
+// program find the file, map it, rebuild the globals from it and go on
+// with the statement after the point, skipping the setup entirely.
+//
+// A snapshot is SNAPSHOT_MAGIC, then a header that ties it to the exact
+// program it came from, then the heap:
+//
+//   program hash      8 bytes, snapshot_hash of the program's AST JSON
+//   resume at         varint, the top-level statement after the point
+//   modules           count, then per module (a file brought in before the
+//                     point) its path length, path bytes and 8-byte hash
+//   globals           count, then per symbol its name length, name bytes,
+//                     a constant flag byte and value
+//   listeners         count, then per signal its name and handler nodes
+//   paral queue       count, then the queued nodes
+//
+// Values are encoded much as serial~>pack encodes them (serial.h): a tag
+// byte, varints for counts and whole numbers, little-endian doubles, texts
+// as a length and raw bytes, and lists of numbers as one run of doubles.
+// Unlike a packed value, a snapshot keeps the shape of the heap. Lists,
+// dicts, sets, scopes and blueprint names are objects with ids, numbered in
+// the order they are first reached: a reference is the id, and the first
+// reference to an object is followed by its contents. A list held by two
+// variables is still one list after a restore, a list inside itself works,
+// and a blueprint instance keeps its scope and the scope it inherits from.
+// Id 0 is no object and id 1 is the global scope.
+//
+// Specs, blueprint constructors and signal handlers point into the program
+// that defined them, so they are stored as nodes: a module number (0 is
+// no node, 1 the program itself, 2 on the modules in the header) and the
+// node's position in that module's parse order. That is why a snapshot
+// only fits the program and modules it was written with, byte for byte;
+// anything else is rejected by the hashes and the program runs from the
+// start (and writes a new snapshot).
+//
+// Open files, iterators, pending io~> operations and connections belong to
+// the process that made them and cannot be stored.
+
+#define SNAPSHOT_MAGIC "BSN\001"
+#define SNAPSHOT_MAGIC_SIZE 4
+#define SNAPSHOT_GLOBALS 1     // the object id of the global scope
+
+typedef enum {
+    SNAPSHOT_NIL,
+    SNAPSHOT_OFF,
+    SNAPSHOT_ON,
+    SNAPSHOT_NUMBER,      // double
+    SNAPSHOT_INT,         // zigzag varint
+    SNAPSHOT_TEXT,        // length, bytes
+    SNAPSHOT_RANGE,       // two doubles
+    SNAPSHOT_SPEC,        // name length, name bytes, node
+    SNAPSHOT_LIST,        // id; when new, a dense flag byte, count, then doubles or values
+    SNAPSHOT_DICT,        // id; when new, count, then key, value...
+    SNAPSHOT_SET,         // id; when new, count, members
+    SNAPSHOT_BLUEPRINT,   // name id, scope id, constructor node
+    SNAPSHOT_INSTANCE,    // name id, blueprint scope id, instance scope id
+    SNAPSHOT_TOOLKIT,     // scope id, exports scope id
+    SNAPSHOT_BRIDGE       // scope id
+} SnapshotTag;
+
+// Kinds of objects, which the reader checks every reference against
+typedef enum {
+    SNAPSHOT_OBJ_SCOPE,
+    SNAPSHOT_OBJ_LIST,
+    SNAPSHOT_OBJ_DICT,
+    SNAPSHOT_OBJ_SET,
+    SNAPSHOT_OBJ_NAME
+} SnapshotObjKind;
+
+// FNV-1a, 64-bit
+static inline uint64_t snapshot_hash(const char* data, size_t length) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static inline void snapshot_put_u64(char* out, uint64_t v) {
+    for (int i = 0; i < 8; i++) out[i] = (char)(v >> (8 * i));
+}
+
+static inline uint64_t snapshot_get_u64(SerialReader* r) {
+    const char* p = serial_get_bytes(r, 8);
+    uint64_t v = 0;
+    if (!p) return 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)(unsigned char)p[i] << (8 * i);
+    return v;
+}
+
+// --- object ids while writing ---------------------------------------------------
+
+// Open-addressing map from an object's address to its id. Ids start at 1,
+// so 0 marks an empty slot.
+typedef struct {
+    const void** keys;
+    uint32_t* ids;
+    size_t capacity;   // power of two
+    size_t count;
+} SnapshotIds;
+
+static inline size_t snapshot_ids_slot(const SnapshotIds* map, const void* key) {
+    uint64_t h = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL;
+    size_t mask = map->capacity - 1;
+    size_t slot = (size_t)(h >> 32) & mask;
+    while (map->ids[slot] && map->keys[slot] != key) slot = (slot + 1) & mask;
+    return slot;
+}
+
+static inline void snapshot_ids_init(SnapshotIds* map) {
+    map->capacity = 256;
+    map->count = 0;
+    map->keys = (const void**)calloc(map->capacity, sizeof(void*));
+    map->ids = (uint32_t*)calloc(map->capacity, sizeof(uint32_t));
+}
+
+static inline void snapshot_ids_free(SnapshotIds* map) {
+    free(map->keys);
+    free(map->ids);
+}
+
+// The id of key, or 0 if it has none yet
+static inline uint32_t snapshot_ids_find(const SnapshotIds* map, const void* key) {
+    return map->ids[snapshot_ids_slot(map, key)];
+}
+
+// Gives key the next id and returns it
+static inline uint32_t snapshot_ids_add(SnapshotIds* map, const void* key) {
+    if ((map->count + 1) * 4 > map->capacity * 3) {
+        SnapshotIds grown = {NULL, NULL, map->capacity * 2, map->count};
+        grown.keys = (const void**)calloc(grown.capacity, sizeof(void*));
+        grown.ids = (uint32_t*)calloc(grown.capacity, sizeof(uint32_t));
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (!map->ids[i]) continue;
+            size_t slot = snapshot_ids_slot(&grown, map->keys[i]);
+            grown.keys[slot] = map->keys[i];
+            grown.ids[slot] = map->ids[i];
+        }
+        snapshot_ids_free(map);
+        *map = grown;
+    }
+    size_t slot = snapshot_ids_slot(map, key);
+    map->keys[slot] = key;
+    map->ids[slot] = (uint32_t)++map->count;
+    return map->ids[slot];
+}
+
+#endif
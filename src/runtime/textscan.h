@@ -0,0 +1,114 @@
+#ifndef BEACON_TEXTSCAN_H
+#define BEACON_TEXTSCAN_H
+
+#include <stdint.h>
+#include <string.h>
+#include "kernels.h"
+
+// Substring search behind the text toolkit (find, count, split, replace).
+//
+// Single characters go to memchr, which the C library already vectorizes.
+// Longer needles use the "first and last byte" filter: compare 16 (SSE2) or
+// 32 (AVX2) candidate positions at once against the needle's first and last
+// characters, and only run memcmp on the middle where both match. On text
+// the filter rejects nearly every position, so the scan runs at close to
+// memory speed. The scalar version does the same one position at a time,
+// using memchr to skip to candidates. AVX2 is chosen at run time as in
+// kernels.h.
+
+#define SCAN_NONE SIZE_MAX
+
+// --- scalar -----------------------------------------------------------------
+
+static inline size_t scan_find_scalar(const char* h, size_t n, const char* s, size_t m) {
+    if (m > n) return SCAN_NONE;
+    const char* end = h + n - m + 1;  // one past the last possible start
+    const char* p = h;
+    while (p < end) {
+        p = (const char*)memchr(p, s[0], end - p);
+        if (!p) return SCAN_NONE;
+        if (p[m - 1] == s[m - 1] && memcmp(p + 1, s + 1, m - 2) == 0) return p - h;
+        p++;
+    }
+    return SCAN_NONE;
+}
+
+// --- SSE2 -------------------------------------------------------------------
+
+#ifdef KERNELS_SSE2
+static inline size_t scan_find_sse2(const char* h, size_t n, const char* s, size_t m) {
+    const __m128i first = _mm_set1_epi8(s[0]);
+    const __m128i last = _mm_set1_epi8(s[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(h + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(h + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(h + i + bit + 1, s + 1, m - 2) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = scan_find_scalar(h + i, n - i, s, m);
+    return rest == SCAN_NONE ? SCAN_NONE : i + rest;
+}
+#endif
+
+// --- AVX2 -------------------------------------------------------------------
+
+#ifdef KERNELS_AVX2
+KERNELS_TARGET_AVX2
+static size_t scan_find_avx2(const char* h, size_t n, const char* s, size_t m) {
+    const __m256i first = _mm256_set1_epi8(s[0]);
+    const __m256i last = _mm256_set1_epi8(s[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(h + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(h + i + m - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(h + i + bit + 1, s + 1, m - 2) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = scan_find_scalar(h + i, n - i, s, m);
+    return rest == SCAN_NONE ? SCAN_NONE : i + rest;
+}
+#endif
+
+// --- dispatch ---------------------------------------------------------------
+
+// Offset of the first occurrence of s (m bytes) in h (n bytes), or SCAN_NONE
+static inline size_t scan_find(const char* h, size_t n, const char* s, size_t m) {
+    if (m == 0) return 0;
+    if (m > n) return SCAN_NONE;
+    if (m == 1) {
+        const char* p = (const char*)memchr(h, s[0], n);
+        return p ? (size_t)(p - h) : SCAN_NONE;
+    }
+#ifdef KERNELS_AVX2
+    if (kernels_use_avx2()) return scan_find_avx2(h, n, s, m);
+#endif
+#ifdef KERNELS_SSE2
+    return scan_find_sse2(h, n, s, m);
+#else
+    return scan_find_scalar(h, n, s, m);
+#endif
+}
+
+// Number of non-overlapping occurrences of s (m > 0 bytes) in h
+static inline size_t scan_count(const char* h, size_t n, const char* s, size_t m) {
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos < n) {
+        size_t at = scan_find(h + pos, n - pos, s, m);
+        if (at == SCAN_NONE) break;
+        count++;
+        pos += at + m;
+    }
+    return count;
+}
+
+#endif
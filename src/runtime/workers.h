@@ -0,0 +1,243 @@
+#ifndef BEACON_WORKERS_H
+#define BEACON_WORKERS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+// A fixed pool of worker threads for the data-parallel builtins.
+//
+// workers_run() splits a job into numbered tasks and hands them out to the
+// pool; the calling thread works through tasks too and returns once all of
+// them have finished. The pool starts on first use with one thread per CPU
+// (override with the BEACON_WORKERS environment variable) and lives until
+// the process exits. A job started from inside a task, or while another
+// thread's job is running, runs inline on the calling thread instead.
+// Tasks see the worker_context of the thread that started the job, so state
+// a caller keeps there (the interpreter keeps its current runtime) follows
+// the job onto the pool.
+//
+// Also home to the atomic reference count helpers, since values shared
+// between tasks are retained and released from several threads at once.
+
+#if defined(_MSC_VER)
+#define WORKERS_THREAD_LOCAL __declspec(thread)
+#else
+#define WORKERS_THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+typedef SRWLOCK WorkerLock;
+typedef CONDITION_VARIABLE WorkerCond;
+#define WORKER_LOCK_INIT SRWLOCK_INIT
+#define worker_lock(l) AcquireSRWLockExclusive(l)
+#define worker_unlock(l) ReleaseSRWLockExclusive(l)
+#define worker_wait(c, l) SleepConditionVariableSRW(c, l, INFINITE, 0)
+#define worker_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_mutex_t WorkerLock;
+typedef pthread_cond_t WorkerCond;
+#define WORKER_LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#define worker_lock(l) pthread_mutex_lock(l)
+#define worker_unlock(l) pthread_mutex_unlock(l)
+#define worker_wait(c, l) pthread_cond_wait(c, l)
+#define worker_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+#define WORKERS_MAX 64
+
+static inline void ref_retain(int* count) {
+#if defined(__GNUC__)
+    __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+#elif defined(_WIN32)
+    InterlockedIncrement((volatile LONG*)count);
+#else
+    (*count)++;
+#endif
+}
+
+// Returns the count left after releasing
+static inline int ref_release(int* count) {
+#if defined(__GNUC__)
+    return __atomic_sub_fetch(count, 1, __ATOMIC_ACQ_REL);
+#elif defined(_WIN32)
+    return (int)InterlockedDecrement((volatile LONG*)count);
+#else
+    return --(*count);
+#endif
+}
+
+// Reads a pointer another worker may have published
+static inline void* ptr_load(void** slot) {
+#if defined(__GNUC__)
+    return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+#elif defined(_WIN32)
+    return InterlockedCompareExchangePointer(slot, NULL, NULL);
+#else
+    return *slot;
+#endif
+}
+
+// Stores value into an empty slot; false if another worker got there first
+static inline bool ptr_publish(void** slot, void* value) {
+#if defined(__GNUC__)
+    void* expected = NULL;
+    return __atomic_compare_exchange_n(slot, &expected, value, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#elif defined(_WIN32)
+    return InterlockedCompareExchangePointer(slot, value, NULL) == NULL;
+#else
+    if (*slot) return false;
+    *slot = value;
+    return true;
+#endif
+}
+
+typedef void (*WorkerTaskFn)(void* ctx, int task);
+
+typedef struct {
+    int threads;            // pool threads, not counting callers
+    WorkerLock lock;
+    WorkerCond wake;        // a job was posted
+    WorkerCond done;        // the last task of a job finished
+    bool busy;
+    WorkerTaskFn fn;
+    void* ctx;
+    void* context;          // the caller's worker_context
+    int num_tasks;
+    int next_task;
+    int unfinished;
+    unsigned generation;
+} WorkerPool;
+
+static WorkerPool worker_pool;
+static WORKERS_THREAD_LOCAL bool worker_in_task;
+static WORKERS_THREAD_LOCAL void* worker_context;
+
+#ifdef _WIN32
+static INIT_ONCE worker_once = INIT_ONCE_STATIC_INIT;
+#else
+static pthread_once_t worker_once = PTHREAD_ONCE_INIT;
+#endif
+
+// Runs tasks of the current job until none are left. Called with the lock held.
+static void workers_drain(WorkerPool* pool) {
+    while (pool->next_task < pool->num_tasks) {
+        int task = pool->next_task++;
+        void* own_context = worker_context;
+        worker_context = pool->context;
+        worker_unlock(&pool->lock);
+        worker_in_task = true;
+        pool->fn(pool->ctx, task);
+        worker_in_task = false;
+        worker_context = own_context;
+        worker_lock(&pool->lock);
+        if (--pool->unfinished == 0) worker_broadcast(&pool->done);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID arg) {
+#else
+static void* worker_main(void* arg) {
+#endif
+    WorkerPool* pool = (WorkerPool*)arg;
+    unsigned seen = 0;
+    worker_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen) worker_wait(&pool->wake, &pool->lock);
+        seen = pool->generation;
+        workers_drain(pool);
+    }
+    return 0;
+}
+
+static int workers_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK workers_start(PINIT_ONCE once, PVOID param, PVOID* context) {
+#else
+static void workers_start(void) {
+#endif
+    WorkerPool* pool = &worker_pool;
+    const char* env = getenv("BEACON_WORKERS");
+    int total = env ? atoi(env) : workers_cpu_count();
+    if (total < 1) total = 1;
+    if (total > WORKERS_MAX) total = WORKERS_MAX;
+#ifdef _WIN32
+    InitializeSRWLock(&pool->lock);
+    InitializeConditionVariable(&pool->wake);
+    InitializeConditionVariable(&pool->done);
+#else
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+#endif
+    // The calling thread counts as one worker
+    for (int i = 0; i < total - 1; i++) {
+#ifdef _WIN32
+        HANDLE thread = CreateThread(NULL, 0, worker_main, pool, 0, NULL);
+        if (!thread) break;
+        CloseHandle(thread);
+#else
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, pool) != 0) break;
+        pthread_detach(thread);
+#endif
+        pool->threads++;
+    }
+#ifdef _WIN32
+    return TRUE;
+#endif
+}
+
+static void workers_init(void) {
+#ifdef _WIN32
+    InitOnceExecuteOnce(&worker_once, workers_start, NULL, NULL);
+#else
+    pthread_once(&worker_once, workers_start);
+#endif
+}
+
+// Threads that take part in a job, including the caller
+static int workers_count(void) {
+    workers_init();
+    return worker_pool.threads + 1;
+}
+
+static void workers_run(WorkerTaskFn fn, void* ctx, int num_tasks) {
+    WorkerPool* pool = &worker_pool;
+    workers_init();
+    worker_lock(&pool->lock);
+    if (worker_in_task || pool->busy || pool->threads == 0) {
+        worker_unlock(&pool->lock);
+        for (int i = 0; i < num_tasks; i++) fn(ctx, i);
+        return;
+    }
+    pool->busy = true;
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->context = worker_context;
+    pool->num_tasks = num_tasks;
+    pool->next_task = 0;
+    pool->unfinished = num_tasks;
+    pool->generation++;
+    worker_broadcast(&pool->wake);
+    workers_drain(pool);
+    while (pool->unfinished > 0) worker_wait(&pool->done, &pool->lock);
+    pool->busy = false;
+    worker_unlock(&pool->lock);
+}
+
+#endif // BEACON_WORKERS_H
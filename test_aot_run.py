@@ -0,0 +1,63 @@
+import sys
+import os
+import json
+import subprocess
+sys.path.append(os.getcwd())
+
+from src.frontend.lexer import Lexer
+from src.frontend.parser import Parser
+from src.frontend.aot import compile_program, build
+
+def compile_to_json(filename, output_filename=None):
+    print(f"Compiling {filename}...")
+    try:
+        with open(filename, 'r') as f:
+            code = f.read()
+            
+        lexer = Lexer(code)
+        tokens = lexer.tokenize()
+        
+        parser = Parser(tokens)
+        ast = parser.parse()
+        
+        if not output_filename:
+            output_filename = filename + ".json"
+            
+        with open(output_filename, 'w') as f:
+            json.dump(ast.to_dict(), f, indent=2)
+        print(f"Generated {output_filename}")
+        return output_filename
+            
+    except Exception as e:
+        print(f"Error compiling {filename}: {e}")
+        import traceback
+        traceback.print_exc()
+        return None
+def run(title, command):
+    print(f"\n--- {title} ---")
+    result = subprocess.run(command, capture_output=True, text=True)
+    print(result.stdout)
+    if result.stderr:
+        print("Errors:")
+        print(result.stderr)
+
+if __name__ == "__main__":
+    test_json = compile_to_json("test_aot.bpl")
+    if not test_json:
+        sys.exit(1)
+
+    with open(test_json) as f:
+        source, report = compile_program(json.load(f), "test_aot.bpl")
+    with open("test_aot.c", 'w') as f:
+        f.write(source)
+    for spec, reason in report:
+        print(f"spec '{spec}' stays interpreted: {reason}")
+    exe = "test_aot.exe" if os.name == 'nt' else "./test_aot"
+    if build("test_aot.c", exe) != 0:
+        sys.exit(1)
+
+    # Both runs must print the same lines
+    run("Executing Runtime", ['src/runtime/BPL.exe', test_json])
+    run("Executing compiled program", [exe])
+    os.remove("test_aot.c")
+    os.remove(exe)
@@ -0,0 +1,55 @@
+import sys
+import os
+import json
+import subprocess
+sys.path.append(os.getcwd())
+
+from src.frontend.lexer import Lexer
+from src.frontend.parser import Parser
+from src.frontend.runtime_server import RuntimeServer
+
+def compile_to_json(filename, output_filename=None):
+    print(f"Compiling {filename}...")
+    try:
+        with open(filename, 'r') as f:
+            code = f.read()
+            
+        lexer = Lexer(code)
+        tokens = lexer.tokenize()
+        
+        parser = Parser(tokens)
+        ast = parser.parse()
+        
+        if not output_filename:
+            output_filename = filename + ".json"
+            
+        with open(output_filename, 'w') as f:
+            json.dump(ast.to_dict(), f, indent=2)
+        print(f"Generated {output_filename}")
+        return output_filename
+            
+    except Exception as e:
+        print(f"Error compiling {filename}: {e}")
+        import traceback
+        traceback.print_exc()
+        return None
+
+def show(title, result):
+    print(f"\n--- {title} (status {result.status}) ---")
+    print(result.stdout)
+    if result.stderr:
+        print("Errors:")
+        print(result.stderr)
+
+if __name__ == "__main__":
+    test_json = compile_to_json("test_server.bpl")
+    if not test_json:
+        sys.exit(1)
+
+    # One runtime process runs every job below
+    with RuntimeServer(runtime='src/runtime/BPL.exe') as server:
+        show("By path, with input", server.run_file(test_json, "Ada\n21\n"))
+        show("By path again, parsed AST reused", server.run_file(test_json, "Grace\n7\n"))
+        with open(test_json) as f:
+            show("Inline AST, no input", server.run_json(f.read(), label="test_server.bpl"))
+        show("Another fixture", server.run_file("test_list.bpl.json"))